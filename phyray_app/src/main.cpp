@@ -16,7 +16,37 @@ int main(int argc, const char* argv[]) {
     LOG_INFO("Initiating Phyray...");
 
     Spectrum::init();
-    parallelInit();
+
+    // Get render settings
+    bool useConfig = true;
+    RenderConfig config; ConfigArgsList args;
+    try {
+        useConfig = config.parseConfig("phyray_app/config/render.conf");
+    } catch (UnsupportedConfigException& ex1) {
+        LOG_ERR_FMT("%s", ex1.what());
+        return 1;
+    } catch (MalformedConfigException& ex2) {
+        LOG_ERR_FMT("%s", ex2.what());
+        return 2;
+    }
+
+    if (!useConfig) LOG_WARNING("Using default render settings");
+
+    // Start the render threads, pinned to CPUs if configured
+    int nThreads = 0;
+    ThreadAffinity affinity = ThreadAffinity::None;
+    if (useConfig && config.getConfigArgs("threads", &args))
+        nThreads = args.getParam<int>(0).value;
+    if (useConfig && config.getConfigArgs("affinity", &args)) {
+        std::string policy = args.getParam<std::string>(0).value;
+        if (policy == "compact")
+            affinity = ThreadAffinity::Compact;
+        else if (policy == "scatter")
+            affinity = ThreadAffinity::Scatter;
+        else if (policy != "none")
+            LOG_WARNING_FMT("Unknown thread affinity \"%s\", threads are not pinned", policy.c_str());
+    }
+    parallelInit(nThreads, affinity);
 
     LOG_INFO("Constructing scene...\n");
 
@@ -91,27 +121,21 @@ int main(int argc, const char* argv[]) {
     sceneObjects.push_back(objDisk1); sceneObjects.push_back(objSphere2);
     sceneObjects.push_back(objDome); sceneObjects.push_back(objDiskLight);
 
-    // Create the Accel structure
-    std::shared_ptr<AccelBVH> accel = createBVHAccel(sceneObjects, 2);
+    // Create the Accel structure, mapped from the BVH cache file if configured.
+    // Spatial splits keep the floor and sky dome out of most nodes. Lazy
+    // builds trade them for getting the first pixels sooner.
+    std::shared_ptr<AccelBVH> accel;
+    if (useConfig && config.getConfigArgs("bvhcache", &args))
+        accel = createCachedBVHAccel(sceneObjects, args.getParam<std::string>(0).value, 2,
+                                     TreeSplitMethod::SBVH);
+    else if (useConfig && config.getConfigArgs("lazybvh", &args) && args.getParam<int>(0).value)
+        accel = createLazyBVHAccel(sceneObjects, 2);
+    else
+        accel = createBVHAccel(sceneObjects, 2, TreeSplitMethod::SBVH);
 
     // Create the scene
     Scene scene(accel, sceneLights);
 
-    // Get render settings
-    bool useConfig = true;
-    RenderConfig config; ConfigArgsList args;
-    try {
-        useConfig = config.parseConfig("phyray_app/config/render.conf");
-    } catch (UnsupportedConfigException& ex1) {
-        LOG_ERR_FMT("%s", ex1.what()); parallelCleanup();
-        return 1;
-    } catch (MalformedConfigException& ex2) {
-        LOG_ERR_FMT("%s", ex2.what()); parallelCleanup();
-        return 2;
-    }
-
-    if (!useConfig) LOG_WARNING("Using default render settings");
-
     int resx = 640, resy = 400;
     if (useConfig && config.getConfigArgs("resolution", &args)) {
         resx = args.getParam<int>(0).value;
@@ -0,0 +1,110 @@
+#include <cstdlib>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/concurrency.h>
+#include <core/phyr_reporter.h>
+#include <core/accel/bvh.h>
+
+#include <modules/shapes/sphere.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+/**
+ * Measures BVH construction time with SAH and HLBVH over a random sphere
+ * scene for every thread count from 1 up to the number of system cores,
+ * along with the time taken to refit the built BVH. Then compares the time
+ * until a narrow view of the scene is traced with a full and a lazy build.
+ *
+ * Usage: bench_bvh_build [nSpheres] [maxThreads]
+ */
+int main(int argc, const char* argv[]) {
+    int nSpheres = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int maxThreads = argc > 2 ? std::atoi(argv[2]) : numSystemCores();
+
+    RNG rng;
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * nSpheres);
+
+    std::vector<std::shared_ptr<Object>> objects;
+    for (int i = 0; i < nSpheres; i++) {
+        Vector3f center(200 * rng.uniformReal() - 100, 200 * rng.uniformReal() - 100,
+                        200 * rng.uniformReal() - 100);
+        transforms.push_back(Transform::translate(center));
+        transforms.push_back(Transform::inverse(transforms.back()));
+
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, 0.1 + 0.4 * rng.uniformReal());
+        objects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    const TreeSplitMethod methods[2] = { TreeSplitMethod::SAH, TreeSplitMethod::HLBVH };
+    const char* methodNames[2] = { "SAH", "HLBVH" };
+    std::vector<std::string> results;
+
+    for (int m = 0; m < 2; m++) {
+        uint64_t serialTime = 0;
+
+        for (int nThreads = 1; nThreads <= maxThreads; nThreads++) {
+            parallelInit(nThreads);
+
+            Timer timer;
+            timer.startTimer();
+            std::shared_ptr<AccelBVH> bvh = createBVHAccel(objects, 4, methods[m]);
+            uint64_t elapsed = std::max(uint64_t(1), timer.getElapsedTime());
+
+            // Refit without allowing a rebuild
+            timer.startTimer();
+            bvh->refit(Infinity);
+            uint64_t refitElapsed = timer.getElapsedTime();
+
+            parallelCleanup();
+
+            if (nThreads == 1) serialTime = elapsed;
+            results.push_back(formatString("%6s %8d %12llu %10.2f %12llu %10d", methodNames[m],
+                                           nThreads, (unsigned long long)elapsed,
+                                           double(serialTime) / elapsed,
+                                           (unsigned long long)refitElapsed, bvh->getNodeCount()));
+        }
+    }
+
+    std::cout << formatString("\nBVH build over %d spheres\n", nSpheres);
+    std::cout << "method  threads    time (ms)    speedup   refit (ms)      nodes\n";
+    for (const std::string& line : results) std::cout << line << "\n";
+
+    // Rays of a narrow view into the scene, as a preview would trace first
+    std::vector<Ray> viewRays(10000);
+    for (Ray& ray : viewRays) {
+        Vector3f d(0.2 * rng.uniformReal() - 0.1, 0.2 * rng.uniformReal() - 0.1, 1);
+        ray = Ray(Point3f(0, 0, -150), normalize(d));
+    }
+
+    std::cout << formatString("\nTime to trace %d view rays\n", int(viewRays.size()));
+    std::cout << " build    build (ms)   rays (ms)  total (ms)     subtrees\n";
+    parallelInit(maxThreads);
+    for (int lazy = 0; lazy < 2; lazy++) {
+        Timer timer;
+        timer.startTimer();
+        std::shared_ptr<AccelBVH> bvh = lazy ? createLazyBVHAccel(objects, 4)
+                                             : createBVHAccel(objects, 4);
+        uint64_t buildTime = timer.getElapsedTime();
+
+        timer.startTimer();
+        for (const Ray& ray : viewRays) bvh->intersectRay(ray);
+        uint64_t raysTime = timer.getElapsedTime();
+
+        std::cout << formatString("%6s %13llu %11llu %11llu %6d / %d\n", lazy ? "lazy" : "full",
+                                  (unsigned long long)buildTime, (unsigned long long)raysTime,
+                                  (unsigned long long)(buildTime + raysTime),
+                                  bvh->getBuiltSubtreeCount(), bvh->getLazySubtreeCount());
+    }
+    parallelCleanup();
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
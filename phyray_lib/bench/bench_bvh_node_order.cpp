@@ -0,0 +1,144 @@
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/phyr_reporter.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+/**
+ * Hardware event counter of the calling thread. Reports -1 where
+ * performance counters are unavailable, e.g. in containers.
+ */
+class PerfCounter {
+  public:
+    PerfCounter(uint32_t type, uint64_t config) {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type; attr.config = config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1; attr.exclude_hv = 1;
+        fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+    }
+    ~PerfCounter() { if (fd >= 0) close(fd); }
+
+    void start() {
+        if (fd < 0) return;
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+    int64_t stop() {
+        if (fd < 0) return -1;
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        int64_t count;
+        return read(fd, &count, sizeof(count)) == sizeof(count) ? count : -1;
+    }
+
+  private:
+    int fd;
+};
+
+static std::string perRay(int64_t count, int nRays) {
+    return count < 0 ? std::string("n/a") : formatString("%.2f", double(count) / nRays);
+}
+
+/**
+ * Measures closest hit traversal of the binary BVH layout with its nodes in
+ * depth first order and in treelets of several block sizes. Reports the node
+ * cache lines and pages a ray is expected to fetch, as estimated by the BVH,
+ * along with the measured cache and TLB misses per ray where hardware
+ * counters are available.
+ *
+ * Usage: bench_bvh_node_order [nSpheres] [nRays]
+ */
+int main(int argc, const char* argv[]) {
+    int nSpheres = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int nRays = argc > 2 ? std::atoi(argv[2]) : 200000;
+
+    RNG rng;
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * nSpheres);
+
+    std::vector<std::shared_ptr<Object>> objects;
+    for (int i = 0; i < nSpheres; i++) {
+        Vector3f center(100 * rng.uniformReal() - 50, 100 * rng.uniformReal() - 50,
+                        100 * rng.uniformReal() - 50);
+        transforms.push_back(Transform::translate(center));
+        transforms.push_back(Transform::inverse(transforms.back()));
+
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, 0.05 + 0.2 * rng.uniformReal());
+        objects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    std::vector<Ray> rays(nRays);
+    for (Ray& ray : rays) {
+        Point3f o(100 * rng.uniformReal() - 50, 100 * rng.uniformReal() - 50,
+                  100 * rng.uniformReal() - 50);
+        Vector3f d(2 * rng.uniformReal() - 1, 2 * rng.uniformReal() - 1, 2 * rng.uniformReal() - 1);
+        ray = Ray(o, normalize(d));
+    }
+
+    std::shared_ptr<AccelBVH> bvh = createBVHAccel(objects, 4);
+
+    PerfCounter cacheMisses(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    PerfCounter l1Misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                             (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                             (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    PerfCounter tlbMisses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB |
+                                              (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                              (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+
+    const size_t blockSizes[4] = { 0, 256, 4096, 65536 };
+    std::vector<std::string> results;
+
+    for (size_t blockSize : blockSizes) {
+        bvh->reorderNodes(blockSize);
+
+        Timer timer;
+        timer.startTimer();
+        cacheMisses.start(); l1Misses.start(); tlbMisses.start();
+        int nHits = 0;
+        for (const Ray& r : rays) {
+            Ray ray = r;
+            SurfaceInteraction si;
+            if (bvh->intersectRay(ray, &si)) nHits++;
+        }
+        int64_t tlb = tlbMisses.stop(), l1 = l1Misses.stop(), llc = cacheMisses.stop();
+        uint64_t time = std::max(uint64_t(1), timer.getElapsedTime());
+
+        std::string order = blockSize == 0 ? std::string("depth-first")
+                                           : formatString("%d B", int(blockSize));
+        results.push_back(formatString("%11s %12.3f %10.2f %10.2f %10s %10s %10s %8d",
+                                       order.c_str(), nRays / (1000.0 * time),
+                                       bvh->getExpectedBlockFetches(64),
+                                       bvh->getExpectedBlockFetches(4096),
+                                       perRay(l1, nRays).c_str(), perRay(llc, nRays).c_str(),
+                                       perRay(tlb, nRays).c_str(), nHits));
+    }
+
+    std::cout << formatString("\nBVH node order, %d rays over %d spheres (%d nodes)\n",
+                              nRays, nSpheres, bvh->getNodeCount());
+    std::cout << "      order closest (Mr/s)  lines/ray  pages/ray    L1D/ray    LLC/ray"
+                 "   dTLB/ray     hits\n";
+    for (const std::string& line : results) std::cout << line << "\n";
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,123 @@
+#include <cstdlib>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/phyr_reporter.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+#include <modules/shapes/triangle.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+/**
+ * Measures the closest and any hit throughput of {rays} over {objects}
+ * with each BVH layout, adding a line per layout to {results}
+ */
+static void measureLayouts(const char* scene, const std::vector<std::shared_ptr<Object>>& objects,
+                           const std::vector<Ray>& rays, std::vector<std::string>& results) {
+    const BVHLayout layouts[4] = { BVHLayout::Binary, BVHLayout::Wide4,
+                                   BVHLayout::Wide8, BVHLayout::Compressed };
+    const char* layoutNames[4] = { "binary", "BVH4", "BVH8", "BVH8c" };
+    int nRays = rays.size();
+
+    for (int l = 0; l < 4; l++) {
+        std::shared_ptr<AccelBVH> bvh = createBVHAccel(objects, 4, TreeSplitMethod::SAH, layouts[l]);
+
+        // Closest hit
+        Timer timer;
+        timer.startTimer();
+        int nHits = 0;
+        for (const Ray& r : rays) {
+            Ray ray = r;
+            SurfaceInteraction si;
+            if (bvh->intersectRay(ray, &si)) nHits++;
+        }
+        uint64_t closestTime = std::max(uint64_t(1), timer.getElapsedTime());
+
+        // Any hit
+        timer.startTimer();
+        int nOccluded = 0;
+        for (const Ray& r : rays)
+            if (bvh->intersectRay(r)) nOccluded++;
+        uint64_t anyTime = std::max(uint64_t(1), timer.getElapsedTime());
+
+        results.push_back(formatString("%9s %6s %12.2f %12.2f %8d %8d %12llu", scene, layoutNames[l],
+                                       nRays / (1000.0 * closestTime), nRays / (1000.0 * anyTime),
+                                       nHits, nOccluded, (unsigned long long)bvh->getNodeMemory()));
+    }
+}
+
+/**
+ * Measures traversal throughput of the binary and wide BVH layouts with
+ * incoherent rays (random origins and directions) over a random sphere
+ * scene, and over a soup of random triangles.
+ *
+ * Usage: bench_bvh_traversal [nSpheres] [nRays] [nTriangles]
+ */
+int main(int argc, const char* argv[]) {
+    int nSpheres = argc > 1 ? std::atoi(argv[1]) : 200000;
+    int nRays = argc > 2 ? std::atoi(argv[2]) : 1000000;
+    int nTriangles = argc > 3 ? std::atoi(argv[3]) : 1000000;
+
+    RNG rng;
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * nSpheres);
+
+    std::vector<std::shared_ptr<Object>> spheres;
+    for (int i = 0; i < nSpheres; i++) {
+        Vector3f center(100 * rng.uniformReal() - 50, 100 * rng.uniformReal() - 50,
+                        100 * rng.uniformReal() - 50);
+        transforms.push_back(Transform::translate(center));
+        transforms.push_back(Transform::inverse(transforms.back()));
+
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, 0.1 + 0.4 * rng.uniformReal());
+        spheres.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    // Triangles of about the same size as the spheres
+    std::vector<Point3f> vertices;
+    std::vector<uint32_t> indices;
+    for (int i = 0; i < nTriangles; i++) {
+        Vector3f center(100 * rng.uniformReal() - 50, 100 * rng.uniformReal() - 50,
+                        100 * rng.uniformReal() - 50);
+        for (int v = 0; v < 3; v++) {
+            vertices.push_back(Point3f(center + Vector3f(rng.uniformReal() - 0.5, rng.uniformReal() - 0.5,
+                                                         rng.uniformReal() - 0.5)));
+            indices.push_back(3 * i + v);
+        }
+    }
+    Transform identity;
+    std::vector<std::shared_ptr<Object>> triangles;
+    for (const auto& shape : createTriangleMeshShapes(&identity, &identity, false, nTriangles,
+                                                      indices.data(), vertices.size(),
+                                                      vertices.data()))
+        triangles.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+
+    std::vector<Ray> rays(nRays);
+    for (Ray& ray : rays) {
+        Point3f o(100 * rng.uniformReal() - 50, 100 * rng.uniformReal() - 50,
+                  100 * rng.uniformReal() - 50);
+        Vector3f d(2 * rng.uniformReal() - 1, 2 * rng.uniformReal() - 1, 2 * rng.uniformReal() - 1);
+        ray = Ray(o, normalize(d));
+    }
+
+    std::vector<std::string> results;
+    measureLayouts("spheres", spheres, rays, results);
+    measureLayouts("triangles", triangles, rays, results);
+
+    std::cout << formatString("\nBVH traversal of %d rays over %d spheres and %d triangles\n",
+                              nRays, nSpheres, nTriangles);
+    std::cout << "    scene layout closest (Mr/s)  any (Mr/s)     hits occluded  nodes (B)\n";
+    for (const std::string& line : results) std::cout << line << "\n";
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
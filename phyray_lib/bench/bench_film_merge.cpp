@@ -0,0 +1,107 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/film.h>
+#include <core/concurrency.h>
+#include <core/phyr_reporter.h>
+
+#include <modules/filters/mitchell.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+struct MergeResult {
+    double totalTime, mergeTime;
+    uint64_t nLocks, nContended;
+};
+
+/**
+ * Fills the tiles of a {resolution} film with {nSamples} samples per pixel
+ * in parallel, merging each tile as it is done as the integrator does
+ */
+static MergeResult measureMerging(const Point2i& resolution, int tileSize, int nSamples) {
+    std::unique_ptr<Filter> filter(new MitchellFilter(Vector2f(2, 2), Real(1) / 3, Real(1) / 3));
+    Film film(resolution, Bounds2f(Point2f(0, 0), Point2f(1, 1)), std::move(filter), 35.,
+              "bench_film_merge", 1);
+    Bounds2i sampleBounds = film.getSampleBounds();
+    Vector2i sampleExtent = sampleBounds.diagonal();
+    Point2i nTiles((sampleExtent.x + tileSize - 1) / tileSize,
+                   (sampleExtent.y + tileSize - 1) / tileSize);
+
+    Real rgb[3] = { 0.8, 0.4, 0.2 };
+    Spectrum L = Spectrum::getFromRGB(rgb, SpectrumType::Reflectance);
+    std::vector<AtomicReal> threadMergeTime(maxThreadIndex());
+
+    Timer timer;
+    timer.startTimer();
+    ParallelFor2D([&](Point2i tile) {
+        int x0 = sampleBounds.pMin.x + tile.x * tileSize;
+        int x1 = std::min(x0 + tileSize, sampleBounds.pMax.x);
+        int y0 = sampleBounds.pMin.y + tile.y * tileSize;
+        int y1 = std::min(y0 + tileSize, sampleBounds.pMax.y);
+        Bounds2i tileBounds(Point2i(x0, y0), Point2i(x1, y1));
+
+        RNG rng(tile.y * nTiles.x + tile.x);
+        std::unique_ptr<FilmTile> filmTile = film.getFilmTile(tileBounds);
+        for (Point2i pixel : tileBounds) {
+            for (int s = 0; s < nSamples; s++) {
+                Point2f pFilm(pixel.x + rng.uniformReal(), pixel.y + rng.uniformReal());
+                filmTile->addSample(pFilm, L * rng.uniformReal(), 1);
+            }
+        }
+
+        // Merges take well under a millisecond, too short for {Timer}
+        auto mergeStart = std::chrono::steady_clock::now();
+        film.mergeFilmTile(std::move(filmTile));
+        std::chrono::duration<double, std::milli> mergeTime =
+            std::chrono::steady_clock::now() - mergeStart;
+        threadMergeTime[ThreadIndex].add(mergeTime.count());
+    }, nTiles);
+
+    MergeResult result;
+    result.totalTime = timer.getElapsedTime();
+    result.mergeTime = 0;
+    for (const AtomicReal& t : threadMergeTime) result.mergeTime += t;
+    result.nLocks = film.getMergeLockCount();
+    result.nContended = film.getContendedMergeLockCount();
+    return result;
+}
+
+/**
+ * Measures how often merging film tiles waits on the row locks of the
+ * film as the thread count doubles up to the number of system cores, for
+ * small and regular tiles. Merge time is summed over all threads.
+ *
+ * Usage: bench_film_merge [width] [height] [nSamples]
+ */
+int main(int argc, const char* argv[]) {
+    Point2i resolution(argc > 1 ? std::atoi(argv[1]) : 1280, argc > 2 ? std::atoi(argv[2]) : 720);
+    int nSamples = argc > 3 ? std::atoi(argv[3]) : 2;
+    Spectrum::init();
+
+    std::cout << formatString("\nFilm tile merging, %d x %d pixels, %d samples per pixel\n",
+                              resolution.x, resolution.y, nSamples);
+    std::cout << " tile  threads  total (ms)  merge (ms)     locks  contended\n";
+    for (int tileSize : { 8, 16 }) {
+        for (int nThreads = 1;; nThreads = std::min(2 * nThreads, numSystemCores())) {
+            parallelInit(nThreads);
+            MergeResult result = measureMerging(resolution, tileSize, nSamples);
+            parallelCleanup();
+
+            std::cout << formatString("%5d %8d %11.1f %11.1f %9llu %9.2f%%\n", tileSize, nThreads,
+                                      result.totalTime, result.mergeTime,
+                                      (unsigned long long)result.nLocks,
+                                      100.0 * result.nContended / std::max(uint64_t(1), result.nLocks));
+            if (nThreads == numSystemCores()) break;
+        }
+    }
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
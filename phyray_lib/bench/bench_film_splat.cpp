@@ -0,0 +1,85 @@
+#include <cstdlib>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/film.h>
+#include <core/concurrency.h>
+#include <core/phyr_reporter.h>
+
+#include <modules/filters/box.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+/**
+ * Returns the splats per second, in millions, of {nSplats} splats added in
+ * parallel to a {resolution} film in {mode}, and the bytes of splat buffers
+ * used. Splats land anywhere on the film, or in a 32 x 32 pixel region
+ * if {focused}, as e.g. caustics do.
+ */
+static double measureSplats(const Point2i& resolution, SplatMode mode, bool focused,
+                            int64_t nSplats, size_t* bufferMemory) {
+    std::unique_ptr<Filter> filter(new BoxFilter(Vector2f(0.5, 0.5)));
+    Film film(resolution, Bounds2f(Point2f(0, 0), Point2f(1, 1)), std::move(filter), 35.,
+              "bench_film_splat", 1, mode);
+    Vector2f extent = focused ? Vector2f(32, 32) : Vector2f(resolution.x, resolution.y);
+
+    Real rgb[3] = { 0.8, 0.4, 0.2 };
+    Spectrum L = Spectrum::getFromRGB(rgb, SpectrumType::Illuminant);
+
+    constexpr int64_t chunkSize = 4096;
+    Timer timer;
+    timer.startTimer();
+    ParallelFor([&](int64_t chunk) {
+        RNG rng(chunk);
+        int64_t end = std::min(nSplats, (chunk + 1) * chunkSize);
+        for (int64_t i = chunk * chunkSize; i < end; i++)
+            film.addSplat(Point2f(extent.x * rng.uniformReal(), extent.y * rng.uniformReal()), L);
+    }, (nSplats + chunkSize - 1) / chunkSize);
+    uint64_t elapsed = std::max(uint64_t(1), timer.getElapsedTime());
+
+    *bufferMemory = film.getSplatBufferMemory();
+    return nSplats / (1000.0 * elapsed);
+}
+
+/**
+ * Compares splatting into per-thread buffers against atomic adds to the
+ * film pixels, as the thread count doubles up to the number of system
+ * cores. The time to sum the buffers when writing the image is not
+ * included.
+ *
+ * Usage: bench_film_splat [nSplats] [width] [height]
+ */
+int main(int argc, const char* argv[]) {
+    int64_t nSplats = argc > 1 ? std::atoll(argv[1]) : 20000000;
+    Point2i resolution(argc > 2 ? std::atoi(argv[2]) : 1280, argc > 3 ? std::atoi(argv[3]) : 720);
+    Spectrum::init();
+
+    std::cout << formatString("\nFilm splats, %lld splats on %d x %d pixels\n",
+                              (long long)nSplats, resolution.x, resolution.y);
+    std::cout << "  splats  threads  atomic (M/s)  buffers (M/s)   speedup  buffers (MB)\n";
+    for (bool focused : { false, true }) {
+        for (int nThreads = 1;; nThreads = std::min(2 * nThreads, numSystemCores())) {
+            parallelInit(nThreads);
+            size_t atomicMemory, bufferMemory;
+            double atomicRate = measureSplats(resolution, SplatMode::Atomic, focused, nSplats,
+                                              &atomicMemory);
+            double bufferRate = measureSplats(resolution, SplatMode::ThreadBuffers, focused,
+                                              nSplats, &bufferMemory);
+            parallelCleanup();
+
+            std::cout << formatString("%8s %8d %13.1f %14.1f %9.2f %13.1f\n",
+                                      focused ? "focused" : "spread", nThreads, atomicRate,
+                                      bufferRate, bufferRate / atomicRate,
+                                      bufferMemory / (1024.0 * 1024.0));
+            if (nThreads == numSystemCores()) break;
+        }
+    }
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/meshio.h>
+#include <core/concurrency.h>
+#include <core/phyr_reporter.h>
+
+#include <modules/shapes/triangle.h>
+
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+template <typename T>
+static void writeBinary(std::ofstream& file, T value, bool bigEndian) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    if (bigEndian) std::reverse(bytes, bytes + sizeof(T));
+    file.write(bytes, sizeof(T));
+}
+
+/**
+ * Writes a {res} x {res} grid of triangles with normals and
+ * (u, v) coordinates, in the given PLY format
+ */
+static void writeGridPLY(const std::string& path, int res, const std::string& format) {
+    std::ofstream file(path, std::ios::binary);
+    int nVertices = (res + 1) * (res + 1), nTriangles = 2 * res * res;
+    file << "ply\nformat " << format << " 1.0\n"
+         << "element vertex " << nVertices << "\n"
+         << "property float x\nproperty float y\nproperty float z\n"
+         << "property float nx\nproperty float ny\nproperty float nz\n"
+         << "property float u\nproperty float v\n"
+         << "element face " << nTriangles << "\n"
+         << "property list uchar int vertex_indices\nend_header\n";
+
+    bool ascii = format == "ascii", bigEndian = format == "binary_big_endian";
+    for (int y = 0; y <= res; y++) {
+        for (int x = 0; x <= res; x++) {
+            float vertex[8] = { float(x) / res, float(y) / res, 0.1f * std::sin(0.1f * (x + y)),
+                                0, 0, 1, float(x) / res, float(y) / res };
+            if (ascii) {
+                file << vertex[0];
+                for (int c = 1; c < 8; c++) file << " " << vertex[c];
+                file << "\n";
+            } else {
+                for (float c : vertex) writeBinary(file, c, bigEndian);
+            }
+        }
+    }
+
+    for (int y = 0; y < res; y++) {
+        for (int x = 0; x < res; x++) {
+            int v0 = y * (res + 1) + x, v1 = v0 + 1, v2 = v0 + res + 1, v3 = v2 + 1;
+            int triangles[2][3] = { { v0, v1, v3 }, { v0, v3, v2 } };
+            for (const auto& triangle : triangles) {
+                if (ascii) {
+                    file << "3 " << triangle[0] << " " << triangle[1] << " " << triangle[2] << "\n";
+                } else {
+                    writeBinary(file, uint8_t(3), bigEndian);
+                    for (int v : triangle) writeBinary(file, int32_t(v), bigEndian);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Writes the same grid as {writeGridPLY} to an OBJ file, with
+ * the (u, v) coordinates and normal indexed apart from positions
+ */
+static void writeGridOBJ(const std::string& path, int res) {
+    std::ofstream file(path);
+    for (int y = 0; y <= res; y++) {
+        for (int x = 0; x <= res; x++) {
+            file << "v " << float(x) / res << " " << float(y) / res << " "
+                 << 0.1f * std::sin(0.1f * (x + y)) << "\n";
+            file << "vt " << float(x) / res << " " << float(y) / res << "\n";
+        }
+    }
+    file << "vn 0 0 1\nusemtl grid\n";
+
+    for (int y = 0; y < res; y++) {
+        for (int x = 0; x < res; x++) {
+            int v0 = y * (res + 1) + x + 1, v1 = v0 + 1, v2 = v0 + res + 1, v3 = v2 + 1;
+            file << "f " << v0 << "/" << v0 << "/1 " << v1 << "/" << v1 << "/1 " << v3 << "/" << v3 << "/1\n";
+            file << "f " << v0 << "/" << v0 << "/1 " << v3 << "/" << v3 << "/1 " << v2 << "/" << v2 << "/1\n";
+        }
+    }
+}
+
+struct LoadResult {
+    uint64_t loadTime = 0, buildTime = 0;
+    bool zeroCopy = false, valid = false;
+    // Peak resident set size in KB
+    long peakRSS = 0;
+};
+
+/**
+ * Loads the PLY or OBJ mesh at {path} with {nThreads} threads in a child
+ * process, so that its peak resident set size is measured apart from other
+ * runs. Triangle shapes are created from the loaded meshes if {build} is set.
+ */
+static LoadResult measureLoad(const std::string& path, bool build, int nThreads) {
+    LoadResult result;
+    int fds[2];
+    if (pipe(fds) != 0) return result;
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        parallelInit(nThreads);
+
+        Timer timer;
+        timer.startTimer();
+        std::vector<std::unique_ptr<IndexedMesh>> meshes;
+        if (path.compare(path.size() - 4, 4, ".obj") == 0) meshes = loadOBJMeshes(path);
+        else meshes.push_back(loadPLYMesh(path));
+        result.loadTime = timer.getElapsedTime();
+        result.valid = !meshes.empty() && meshes[0] != nullptr;
+
+        if (result.valid) {
+            result.zeroCopy = meshes[0]->isZeroCopy();
+            if (build) {
+                Transform identity;
+                timer.startTimer();
+                for (const auto& mesh : meshes) {
+                    std::vector<std::shared_ptr<Shape>> shapes =
+                            createTriangleMeshShapes(&identity, &identity, false, *mesh);
+                    result.valid &= shapes.size() == size_t(mesh->nTriangles);
+                }
+                result.buildTime = timer.getElapsedTime();
+            }
+        }
+
+        bool written = write(fds[1], &result, sizeof(result)) == sizeof(result);
+        _exit(written ? 0 : 1);
+    }
+
+    close(fds[1]);
+    bool received = pid > 0 && read(fds[0], &result, sizeof(result)) == sizeof(result);
+    close(fds[0]);
+
+    int status = 0;
+    rusage usage;
+    if (pid > 0 && wait4(pid, &status, 0, &usage) == pid) result.peakRSS = usage.ru_maxrss;
+    if (!received || status != 0) result.valid = false;
+    return result;
+}
+
+/**
+ * Measures loading a PLY grid mesh stored as binary little endian, which
+ * is viewed in place, and as big endian and ASCII, which are decoded in
+ * parallel. The OBJ importer is measured on the same grid with a single
+ * thread and with all cores. Reports load time and throughput, and the peak
+ * resident set size of loading alone and of creating triangle shapes,
+ * against the file size.
+ *
+ * Usage: bench_mesh_load [gridResolution]
+ */
+int main(int argc, const char* argv[]) {
+    int res = argc > 1 ? std::atoi(argv[1]) : 1000;
+
+    const char* formats[5] = { "binary_little_endian", "binary_big_endian", "ascii", "obj", "obj" };
+    const int threads[5] = { 0, 0, 0, 1, 0 };
+    std::vector<std::string> results;
+
+    for (int i = 0; i < 5; i++) {
+        std::string format = formats[i];
+        std::string path = format == "obj" ? std::string("bench_mesh_load.obj")
+                                           : formatString("bench_mesh_load_%s.ply", formats[i]);
+        if (format == "obj") writeGridOBJ(path, res);
+        else writeGridPLY(path, res, format);
+
+        struct stat fileStat;
+        double fileMB = stat(path.c_str(), &fileStat) == 0 ? fileStat.st_size / (1024.0 * 1024.0) : 0;
+
+        LoadResult load = measureLoad(path, false, threads[i]);
+        LoadResult build = measureLoad(path, true, threads[i]);
+        std::remove(path.c_str());
+
+        int nThreads = threads[i] == 0 ? numSystemCores() : threads[i];
+        double loadTime = std::max(uint64_t(1), load.loadTime);
+        results.push_back(formatString("%20s %7d %9.1f %9d %10.1f %9d %11.1f %11.1f %6.2f %6.2f %9s %6d",
+                                       formats[i], nThreads, fileMB, int(load.loadTime),
+                                       fileMB / (loadTime / 1000), int(build.buildTime),
+                                       load.peakRSS / 1024.0, build.peakRSS / 1024.0,
+                                       load.peakRSS / 1024.0 / fileMB, build.peakRSS / 1024.0 / fileMB,
+                                       load.zeroCopy ? "yes" : "no", int(load.valid && build.valid)));
+    }
+
+    std::cout << formatString("\nMesh load, %d triangles\n", 2 * res * res);
+    std::cout << "              format threads file (MB) load (ms) load (MB/s) mesh (ms)"
+                 " load RSS (MB) mesh RSS (MB)  RSS/f mRSS/f zero-copy  valid\n";
+    for (const std::string& line : results) std::cout << line << "\n";
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,114 @@
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/concurrency.h>
+#include <core/phyr_reporter.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+// Stand-in for the work of one iteration, e.g. one pixel or ray
+static double iterationWork(int64_t index, int nSteps) {
+    double x = double(index % 1000) * 1e-3;
+    for (int i = 0; i < nSteps; i++) x = std::sin(x) + 0.5;
+    return x;
+}
+
+/**
+ * Measures the time in milliseconds of a loop of {count} iterations of
+ * {nSteps} steps each, and of the same work split into 64 x 64 tiles
+ * with {ParallelFor2D} and nested loops over the rows of each tile
+ */
+static void measureLoops(int64_t count, int nSteps, double* flatTime, double* tiledTime) {
+    std::vector<double> results(count);
+    Timer timer;
+    timer.startTimer();
+    ParallelFor([&](int64_t i) { results[i] = iterationWork(i, nSteps); }, count);
+    *flatTime = std::max(uint64_t(1), timer.getElapsedTime());
+
+    int nTiles = int(std::sqrt(double(count) / (64 * 64)));
+    timer.startTimer();
+    ParallelFor2D([&](Point2i tile) {
+        ParallelFor([&](int64_t y) {
+            int64_t rowStart = ((int64_t(tile.y) * 64 + y) * nTiles + tile.x) * 64;
+            for (int x = 0; x < 64; x++)
+                results[rowStart + x] = iterationWork(rowStart + x, nSteps);
+        }, 64);
+    }, Point2i(nTiles, nTiles));
+    *tiledTime = std::max(uint64_t(1), timer.getElapsedTime());
+}
+
+/**
+ * Measures the time in milliseconds of scaling {count} values, first with
+ * {ParallelFor} calling through {std::function} for each index, and then
+ * with {ParallelForRange} inlining it, both in blocks of {grain}
+ */
+static void measureFineLoops(int64_t count, int64_t grain, double* functionTime,
+                             double* rangeTime) {
+    std::vector<Real> values(count, 1);
+    Timer timer;
+    timer.startTimer();
+    for (int r = 0; r < 10; r++)
+        ParallelFor([&](int64_t i) { values[i] = values[i] * Real(0.5) + 1; }, count, grain);
+    *functionTime = std::max(uint64_t(1), timer.getElapsedTime());
+
+    timer.startTimer();
+    for (int r = 0; r < 10; r++)
+        ParallelForRange(0, count, grain, [&](int64_t i) { values[i] = values[i] * Real(0.5) + 1; });
+    *rangeTime = std::max(uint64_t(1), timer.getElapsedTime());
+}
+
+/**
+ * Measures how the parallel loops scale with the thread count, doubling
+ * it up to the number of system cores. Loops use the default chunk size
+ * of one, so each thread mostly runs iterations it stole. Then compares
+ * loops with little work per index run through {ParallelFor} and
+ * {ParallelForRange}.
+ *
+ * Usage: bench_parallel_for [nIterations] [nSteps]
+ */
+int main(int argc, const char* argv[]) {
+    int64_t count = argc > 1 ? std::atoll(argv[1]) : 1 << 20;
+    int nSteps = argc > 2 ? std::atoi(argv[2]) : 200;
+
+    std::cout << formatString("\nParallel loops, %lld iterations of %d steps\n",
+                              (long long)count, nSteps);
+    std::cout << " threads   flat (ms)   speedup  tiled (ms)   speedup\n";
+    double flatBase = 0, tiledBase = 0;
+    for (int nThreads = 1;; nThreads = std::min(2 * nThreads, numSystemCores())) {
+        parallelInit(nThreads);
+        double flatTime, tiledTime;
+        measureLoops(count, nSteps, &flatTime, &tiledTime);
+        parallelCleanup();
+
+        if (nThreads == 1) {
+            flatBase = flatTime;
+            tiledBase = tiledTime;
+        }
+        std::cout << formatString("%8d %11.1f %9.2f %11.1f %9.2f\n", nThreads, flatTime,
+                                  flatBase / flatTime, tiledTime, tiledBase / tiledTime);
+        if (nThreads == numSystemCores()) break;
+    }
+
+    std::cout << formatString("\nScaling %lld values 10 times, blocks of 4096\n",
+                              (long long)(16 * count));
+    std::cout << " threads  function (ms)  range (ms)   speedup\n";
+    for (int nThreads = 1;; nThreads = std::min(2 * nThreads, numSystemCores())) {
+        parallelInit(nThreads);
+        double functionTime, rangeTime;
+        measureFineLoops(16 * count, 4096, &functionTime, &rangeTime);
+        parallelCleanup();
+
+        std::cout << formatString("%8d %14.1f %11.1f %9.2f\n", nThreads, functionTime,
+                                  rangeTime, functionTime / rangeTime);
+        if (nThreads == numSystemCores()) break;
+    }
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,125 @@
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/scene.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+typedef std::chrono::steady_clock Clock;
+
+static uint64_t elapsedMicroseconds(const Clock::time_point& start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+}
+
+/**
+ * Compares batched and single ray scene intersection for coherent camera
+ * rays and the shadow rays cast from their hit points towards a point light,
+ * over a random sphere scene with each BVH layout.
+ *
+ * Usage: bench_ray_batch [nSpheres] [resolution]
+ */
+int main(int argc, const char* argv[]) {
+    int nSpheres = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int resolution = argc > 2 ? std::atoi(argv[2]) : 512;
+    const int tileSize = 8, batchSize = 4096;
+
+    RNG rng;
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * nSpheres);
+
+    std::vector<std::shared_ptr<Object>> objects;
+    for (int i = 0; i < nSpheres; i++) {
+        Vector3f center(100 * rng.uniformReal() - 50, 100 * rng.uniformReal() - 50,
+                        100 * rng.uniformReal() - 50);
+        transforms.push_back(Transform::translate(center));
+        transforms.push_back(Transform::inverse(transforms.back()));
+
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, 0.1 + 0.4 * rng.uniformReal());
+        objects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    // Pinhole camera rays, ordered tile by tile so that packets are coherent
+    std::vector<Ray> cameraRays;
+    cameraRays.reserve(resolution * resolution);
+    const Point3f eye(0, 0, -80), light(0, 80, -80);
+    for (int ty = 0; ty < resolution; ty += tileSize)
+        for (int tx = 0; tx < resolution; tx += tileSize)
+            for (int y = ty; y < std::min(ty + tileSize, resolution); y++)
+                for (int x = tx; x < std::min(tx + tileSize, resolution); x++) {
+                    Vector3f d((x + 0.5) / resolution - 0.5, (y + 0.5) / resolution - 0.5, 1);
+                    cameraRays.push_back(Ray(eye, normalize(d)));
+                }
+    int nRays = cameraRays.size();
+
+    const BVHLayout layouts[4] = { BVHLayout::Binary, BVHLayout::Wide4,
+                                   BVHLayout::Wide8, BVHLayout::Compressed };
+    const char* layoutNames[4] = { "binary", "BVH4", "BVH8", "BVH8c" };
+    std::vector<std::string> results;
+
+    std::vector<Ray> rays(batchSize), shadowRays;
+    std::vector<SurfaceInteraction> isects(batchSize);
+    std::unique_ptr<bool[]> hits(new bool[batchSize]), occluded(new bool[batchSize]);
+
+    for (int l = 0; l < 4; l++) {
+        Scene scene(createBVHAccel(objects, 4, TreeSplitMethod::SAH, layouts[l]), {});
+        uint64_t time[2][2] = {};
+        int nHits[2] = {}, nOccluded[2] = {};
+
+        for (int batched = 0; batched < 2; batched++) {
+            for (int offset = 0; offset < nRays; offset += batchSize) {
+                int n = std::min(batchSize, nRays - offset);
+                std::copy(cameraRays.begin() + offset, cameraRays.begin() + offset + n, rays.begin());
+
+                Clock::time_point start = Clock::now();
+                if (batched) {
+                    nHits[batched] += scene.intersect(rays.data(), isects.data(), hits.get(), n);
+                } else {
+                    for (int i = 0; i < n; i++) {
+                        hits[i] = scene.intersect(rays[i], &isects[i]);
+                        nHits[batched] += hits[i];
+                    }
+                }
+                time[batched][0] += elapsedMicroseconds(start);
+
+                shadowRays.clear();
+                for (int i = 0; i < n; i++)
+                    if (hits[i]) shadowRays.push_back(isects[i].emitRay(light));
+
+                start = Clock::now();
+                int nShadow = shadowRays.size();
+                if (batched) {
+                    nOccluded[batched] += scene.intersectP(shadowRays.data(), occluded.get(), nShadow);
+                } else {
+                    for (int i = 0; i < nShadow; i++)
+                        nOccluded[batched] += scene.intersectP(shadowRays[i]);
+                }
+                time[batched][1] += elapsedMicroseconds(start);
+            }
+        }
+
+        for (int batched = 0; batched < 2; batched++)
+            results.push_back(formatString("%6s %7s %12.1f %12.1f %8d %8d", layoutNames[l],
+                                           batched ? "batch" : "single",
+                                           time[batched][0] / 1000.0, time[batched][1] / 1000.0,
+                                           nHits[batched], nOccluded[batched]));
+    }
+
+    std::cout << formatString("\nIntersection of %d camera rays over %d spheres\n", nRays, nSpheres);
+    std::cout << "layout    mode  camera (ms)  shadow (ms)     hits occluded\n";
+    for (const std::string& line : results) std::cout << line << "\n";
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,82 @@
+#include <cstdlib>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/phyr_reporter.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+#include <modules/shapes/disk.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+/**
+ * Returns the average time in nanoseconds of intersecting {shape}
+ * with each of {rays} {nRepeats} times, and the number of hits
+ */
+static double measureIntersection(const Shape& shape, const std::vector<Ray>& rays,
+                                  int nRepeats, int* nHits) {
+    Timer timer;
+    timer.startTimer();
+    *nHits = 0;
+    for (int i = 0; i < nRepeats; i++) {
+        for (const Ray& ray : rays) {
+            SurfaceHit hit;
+            if (shape.intersectHit(ray, &hit)) (*nHits)++;
+        }
+    }
+    return 1e6 * timer.getElapsedTime() / (double(rays.size()) * nRepeats);
+}
+
+/**
+ * Measures the time per intersection of spheres and disks that are only
+ * scaled and translated, whose rays skip the full matrix products, against
+ * the same shapes additionally rotated around z, which look the same but
+ * take the full world to local transform.
+ *
+ * Usage: bench_shape_isec [nRays] [nRepeats]
+ */
+int main(int argc, const char* argv[]) {
+    int nRays = argc > 1 ? std::atoi(argv[1]) : 100000;
+    int nRepeats = argc > 2 ? std::atoi(argv[2]) : 100;
+
+    Transform st = Transform::translate(Vector3f(3, -1, 8)) * Transform::scale(1.5, 1.5, 1.5);
+    Transform rotated = st * Transform::rotateZ(30);
+    Transform stInv = Transform::inverse(st), rotatedInv = Transform::inverse(rotated);
+
+    // Rays from around the shapes aimed near them, so that about half hit
+    RNG rng;
+    std::vector<Ray> rays(nRays);
+    for (Ray& ray : rays) {
+        Point3f o(20 * rng.uniformReal() - 10, 20 * rng.uniformReal() - 10, 20 * rng.uniformReal() - 10);
+        Point3f target = st(Point3f(3 * rng.uniformReal() - 1.5, 3 * rng.uniformReal() - 1.5,
+                                    rng.uniformReal() - 0.5));
+        ray = Ray(o, target - o);
+    }
+
+    Sphere spheres[2] = { Sphere(&st, &stInv, 1), Sphere(&rotated, &rotatedInv, 1) };
+    Disk disks[2] = { Disk(&st, &stInv, 0, 1, 0, 360, false),
+                      Disk(&rotated, &rotatedInv, 0, 1, 0, 360, false) };
+    const Shape* shapes[4] = { &spheres[0], &spheres[1], &disks[0], &disks[1] };
+    const char* names[4] = { "sphere", "sphere", "disk", "disk" };
+
+    std::cout << formatString("\nShape intersection, %d rays x %d\n", nRays, nRepeats);
+    std::cout << " shape    transform  isec (ns)   speedup     hits\n";
+    for (int s = 0; s < 4; s += 2) {
+        int nHitsFull, nHitsFast;
+        double fullTime = measureIntersection(*shapes[s + 1], rays, nRepeats, &nHitsFull);
+        double fastTime = measureIntersection(*shapes[s], rays, nRepeats, &nHitsFast);
+        std::cout << formatString("%6s %12s %10.2f %9.2f %8d\n", names[s], "full",
+                                  fullTime, 1.0, nHitsFull);
+        std::cout << formatString("%6s %12s %10.2f %9.2f %8d\n", names[s], "scale+offset",
+                                  fastTime, fullTime / fastTime, nHitsFast);
+    }
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
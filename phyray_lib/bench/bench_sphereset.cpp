@@ -0,0 +1,126 @@
+#include <cstdlib>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/phyr_reporter.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+#include <modules/shapes/sphereset.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+struct TraversalResult {
+    double closest, any, buildTime;
+    int nHits, nOccluded;
+};
+
+static TraversalResult measureTraversal(const Object& scene, const std::vector<Ray>& rays,
+                                        uint64_t buildTime) {
+    TraversalResult result;
+    result.buildTime = buildTime;
+
+    Timer timer;
+    timer.startTimer();
+    result.nHits = 0;
+    for (const Ray& r : rays) {
+        Ray ray = r;
+        SurfaceInteraction si;
+        if (scene.intersectRay(ray, &si)) result.nHits++;
+    }
+    result.closest = rays.size() / (1000.0 * std::max(uint64_t(1), timer.getElapsedTime()));
+
+    timer.startTimer();
+    result.nOccluded = 0;
+    for (const Ray& r : rays)
+        if (scene.intersectRay(r)) result.nOccluded++;
+    result.any = rays.size() / (1000.0 * std::max(uint64_t(1), timer.getElapsedTime()));
+    return result;
+}
+
+/**
+ * Compares a SphereSet against the same spheres created as individual
+ * shapes in a BVH, in build time, memory per sphere and ray throughput.
+ *
+ * Usage: bench_sphereset [nSpheres] [nRays]
+ */
+int main(int argc, const char* argv[]) {
+    int nSpheres = argc > 1 ? std::atoi(argv[1]) : 1000000;
+    int nRays = argc > 2 ? std::atoi(argv[2]) : 1000000;
+
+    RNG rng;
+    std::vector<Point3f> centers(nSpheres);
+    std::vector<Real> radii(nSpheres);
+    for (int i = 0; i < nSpheres; i++) {
+        centers[i] = Point3f(100 * rng.uniformReal() - 50, 100 * rng.uniformReal() - 50,
+                             100 * rng.uniformReal() - 50);
+        radii[i] = 0.02 + 0.08 * rng.uniformReal();
+    }
+
+    std::vector<Ray> rays(nRays);
+    for (Ray& ray : rays) {
+        Point3f o(100 * rng.uniformReal() - 50, 100 * rng.uniformReal() - 50,
+                  100 * rng.uniformReal() - 50);
+        Vector3f d(2 * rng.uniformReal() - 1, 2 * rng.uniformReal() - 1, 2 * rng.uniformReal() - 1);
+        ray = Ray(o, normalize(d));
+    }
+
+    std::vector<std::string> results;
+
+    // Individual spheres
+    {
+        Timer timer;
+        timer.startTimer();
+        std::vector<Transform> transforms;
+        transforms.reserve(2 * nSpheres);
+        std::vector<std::shared_ptr<Object>> objects;
+        for (int i = 0; i < nSpheres; i++) {
+            transforms.push_back(Transform::translate(Vector3f(centers[i])));
+            transforms.push_back(Transform::inverse(transforms.back()));
+            std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                             false, radii[i]);
+            objects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+        }
+        std::shared_ptr<AccelBVH> bvh = createBVHAccel(objects, 4);
+        TraversalResult result = measureTraversal(*bvh, rays, timer.getElapsedTime());
+
+        // Shapes, objects and their transforms, along with the BVH
+        double bytes = bvh->getNodeMemory() +
+                       nSpheres * (sizeof(Sphere) + sizeof(GeometricObject) + 2 * sizeof(Transform));
+        results.push_back(formatString("%10s %10.0f %10.1f %12.2f %12.2f %8d %8d", "spheres",
+                                       result.buildTime, bytes / nSpheres, result.closest,
+                                       result.any, result.nHits, result.nOccluded));
+    }
+
+    // Sphere set
+    {
+        Transform identity;
+        Timer timer;
+        timer.startTimer();
+        std::shared_ptr<SphereSet> set = createSphereSetShape(&identity, &identity, false, nSpheres,
+                                                              centers.data(), radii.data());
+        std::vector<std::shared_ptr<Object>> objects(
+                1, std::make_shared<GeometricObject>(set, nullptr, nullptr));
+        std::shared_ptr<AccelBVH> bvh = createBVHAccel(objects, 4);
+        TraversalResult result = measureTraversal(*bvh, rays, timer.getElapsedTime());
+
+        double bytes = set->getMemory();
+        results.push_back(formatString("%10s %10.0f %10.1f %12.2f %12.2f %8d %8d", "sphere set",
+                                       result.buildTime, bytes / nSpheres, result.closest,
+                                       result.any, result.nHits, result.nOccluded));
+    }
+
+    std::cout << formatString("\nSphere set traversal of %d rays over %d spheres, %d wide packets\n",
+                              nRays, nSpheres, SpherePacketWidth);
+    std::cout << "     shape build (ms)  bytes/sph closest (Mr/s)  any (Mr/s)     hits occluded\n";
+    for (const std::string& line : results) std::cout << line << "\n";
+
+    return 0;
+}
+
+#pragma GCC diagnostic pop
@@ -5,6 +5,11 @@
 #include <core/object/object.h>
 #include <core/geometry/geometry.h>
 #include <core/geometry/interaction.h>
+#include <core/accel/bvhray.h>
+#include <core/accel/widebvh.h>
+
+#include <atomic>
+#include <memory>
 
 namespace phyr {
 
@@ -18,6 +23,12 @@ struct BVHObjectInfo {
     Point3f centroid;
 };
 
+struct MortonObject {
+    int objectIdx;
+    // 30-bit Morton code of the object centroid
+    uint32_t mortonCode;
+};
+
 struct BVHTreeNode {
     BVHTreeNode() {
         bounds = Bounds3f();
@@ -27,12 +38,24 @@ struct BVHTreeNode {
     void createLeafNode(int sIdx, int n, const Bounds3f& b) {
         startIdx = sIdx; nObjects = n; bounds = b;
         child[0] = child[1] = nullptr;
+        subtreeIdx = -1;
     }
 
     void createInteriorNode(int spAxis, BVHTreeNode* lc, BVHTreeNode* rc) {
         child[0] = lc; child[1] = rc;
         splitAxis = spAxis; nObjects = 0;
         bounds = unionBounds(lc->bounds, rc->bounds);
+        subtreeIdx = -1;
+    }
+
+    /**
+     * Marks this node as a stand-in for the subtree over the object
+     * range [{sIdx}, {end}) that gets built separately by the parallel builder
+     */
+    void createSubtreeNode(int idx, int sIdx, int end) {
+        startIdx = sIdx; nObjects = end - sIdx;
+        child[0] = child[1] = nullptr;
+        subtreeIdx = idx;
     }
 
     Bounds3f bounds;
@@ -44,12 +67,54 @@ struct BVHTreeNode {
     // ordered object indexes. The indexes refer to the elements in
     // {AccelBVH}'s {objectList} member
     int splitAxis, startIdx, nObjects;
+    // Index of the separately built subtree this node stands for, -1 otherwise
+    int subtreeIdx;
 };
 
+// Split axis marking a node of a lazily built BVH that stands for a subtree
+// which is not built yet. Its {secondChildIdx} holds the index of the subtree.
+static constexpr uint8_t LazySubtreeAxis = 3;
+
+/**
+ * Traversal node of the flattened BVH, packed into 32 bytes so that
+ * two nodes share a cache line. Bounds are kept in single precision
+ * and rounded outwards regardless of {Real}, as only the objects
+ * in the leaves need to be intersected exactly.
+ */
 struct LinearBVHNode {
-    LinearBVHNode() { bounds = Bounds3f(); }
+    LinearBVHNode() {}
 
-    Bounds3f bounds;
+    void setBounds(const Bounds3f& b) {
+        for (int axis = 0; axis < 3; axis++) {
+            bounds[0][axis] = roundFloatDown(b.pMin[axis]);
+            bounds[1][axis] = roundFloatUp(b.pMax[axis]);
+        }
+    }
+    Bounds3f getBounds() const {
+        return Bounds3f(Point3f(bounds[0][0], bounds[0][1], bounds[0][2]),
+                        Point3f(bounds[1][0], bounds[1][1], bounds[1][2]));
+    }
+
+    /**
+     * Conservative slab test of the node bounds against {ray}
+     */
+    bool intersectRay(const BVHRay& ray) const {
+        float tn = 0, tf = ray.tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (bounds[ray.nearIdx[axis]][axis] - ray.oNear[axis]) * ray.invDir[axis];
+            float t1 = (bounds[1 - ray.nearIdx[axis]][axis] - ray.oFar[axis]) *
+                       ray.invDir[axis] * BVHFarScale;
+            // Comparisons are arranged so that NaNs are ignored
+            tn = t0 > tn ? t0 : tn;
+            tf = t1 < tf ? t1 : tf;
+        }
+        return tn <= tf;
+    }
+
+    bool isLazySubtree() const { return nObjects == 0 && splitAxis == LazySubtreeAxis; }
+
+    // Bounds indexed as [pMin/pMax][axis]
+    float bounds[2][3];
     union {
         int objectStartIdx;  // To be used for leaf nodes
         int secondChildIdx;  // To be used for internal nodes
@@ -58,29 +123,81 @@ struct LinearBVHNode {
     // Number of objects in the node (0 for internal nodes)
     uint16_t nObjects;
     uint8_t splitAxis;
-    // Alignment padding
-    uint8_t _padding[1];
+    // Whether the child stored right after this node is the one
+    // above the split plane rather than the one below it
+    uint8_t childrenSwapped;
+};
+static_assert(sizeof(LinearBVHNode) == 32, "LinearBVHNode must be 32 bytes");
+
+// Shapes whose objects are tested by BVH leaves directly, rather than through
+// the virtual calls of Object and Shape. Other objects, e.g. instances,
+// nested BVHs or other shapes, are tested through Object.
+enum class LeafObjectType : uint8_t { Triangle, Sphere, Disk, Object };
+
+/**
+ * Object reference of a BVH leaf, with the shape of geometric
+ * objects resolved when the BVH is built
+ */
+struct LeafObject {
+    // The Triangle, Sphere or Disk tested, or the Object for other types
+    const void* target;
+    // Object recorded in hits
+    const Object* object;
+    LeafObjectType type;
 };
 
-// Support Surface Area Heuristic for tree splitting
-enum class TreeSplitMethod { SAH };
+// Support Surface Area Heuristic for tree splitting, a Hierarchical
+// Linear BVH for fast builds over large object counts, and a Spatial
+// split BVH that may reference large objects from several leaves
+enum class TreeSplitMethod { SAH, HLBVH, SBVH };
+
+inline const char* getTreeSplitMethodName(const TreeSplitMethod tsp) {
+    return tsp == TreeSplitMethod::HLBVH ? "HLBVH" : tsp == TreeSplitMethod::SBVH ? "SBVH" : "SAH";
+}
+
+// Node layout used for traversal. The wide layouts collapse the built
+// binary tree into nodes with 4 or 8 children tested with SIMD instructions.
+// The compressed layout is 8-wide with child bounds quantized to 8 bits
+enum class BVHLayout { Binary, Wide4, Wide8, Compressed };
 
 class AccelBVH : public ObjectGroup {
   public:
     static const int DEF_MAX_OBJ_PER_NODE;
+    // Maximum number of object references created by spatial splits,
+    // relative to the number of objects
+    static const Real SBVH_REFERENCE_BUDGET;
 
+    /**
+     * Builds the BVH over {objList}. With {lazyBuild}, only the top levels
+     * are built up front. Their leaves stand for subtrees that are built when
+     * a ray first reaches them, so subtrees no ray reaches are never built.
+     * Lazy builds use SAH splits and the binary layout.
+     */
     AccelBVH(const std::vector<std::shared_ptr<Object>>& objList,
              const int maxObjectsPerNode = 1,
-             const TreeSplitMethod tspMethod = TreeSplitMethod::SAH) :
+             const TreeSplitMethod tspMethod = TreeSplitMethod::SAH,
+             const BVHLayout layout = BVHLayout::Binary, const bool lazyBuild = false) :
         // Ensure {maxObjectsPerNode} does not exceed {DEF_MAX_OBJ_PER_NODE}
         maxObjectsPerNode(std::min(DEF_MAX_OBJ_PER_NODE, maxObjectsPerNode)),
-        tspMethod(tspMethod), objectList(objList) {
-        LOG_INFO("Constructing BVH...");
+        tspMethod(lazyBuild ? TreeSplitMethod::SAH : tspMethod),
+        layout(lazyBuild ? BVHLayout::Binary : layout), lazyBuild(lazyBuild),
+        sourceObjects(objList), objectList(objList) {
+        LOG_INFO_FMT("Constructing BVH (%s)...", getTreeSplitMethodName(tspMethod));
         LOG_INFO_FMT("Number of objects received: %d", objList.size());
         constructBVH();
         LOG_INFO("Done constructing BVH.");
     }
 
+    /**
+     * Maps the BVH from the cache file at {cachePath} if the file was
+     * written for the same object bounds and build parameters. Otherwise
+     * the BVH is built as usual and written to {cachePath} for later runs.
+     */
+    AccelBVH(const std::vector<std::shared_ptr<Object>>& objList,
+             const std::string& cachePath, const int maxObjectsPerNode = 1,
+             const TreeSplitMethod tspMethod = TreeSplitMethod::SAH,
+             const BVHLayout layout = BVHLayout::Binary);
+
     ~AccelBVH();
 
     Bounds3f worldBounds() const override;
@@ -90,9 +207,143 @@ class AccelBVH : public ObjectGroup {
      */
     bool intersectRay(const Ray& ray, SurfaceInteraction* si) const override;
     bool intersectRay(const Ray& ray) const override;
+    bool intersectHit(const Ray& ray, SurfaceHit* hit) const override;
+
+    /**
+     * Test batches of rays with packet traversal. Rays are processed in
+     * packets of up to {MAX_PACKET_SIZE}, which visit the nodes hit by
+     * any of their rays together.
+     */
+    void intersectRays(const Ray* rays, SurfaceInteraction* si, bool* hits, int n) const override;
+    void intersectRays(const Ray* rays, bool* hits, int n) const override;
+    static const int MAX_PACKET_SIZE = 64;
+
+    /**
+     * Recomputes the node bounds bottom-up from the current object bounds,
+     * keeping the tree topology, e.g. after objects have been animated.
+     * Objects update their cached bounds first, so a top level BVH picks up
+     * refitted bottom level BVHs of its instances. References duplicated by spatial splits get the full object bounds.
+     * The BVH is rebuilt from scratch instead if the SAH cost of the
+     * refitted tree exceeds {rebuildThreshold} times its cost after the last build.
+     * Lazily built BVHs are always rebuilt, as only their top levels are built.
+     * @returns true if the BVH was rebuilt
+     */
+    bool refit(Real rebuildThreshold = 1.5);
+
+    /**
+     * Reorders the nodes of the binary layout for cache locality. Of the
+     * children of a node, the one more likely to be hit, by surface area,
+     * is stored right after it. Subtrees larger than {blockSize} bytes are
+     * split into treelets filling such blocks, grown from their root by the
+     * subtrees most likely to be hit. Subtrees that fit a block, or all of
+     * them if {blockSize} is 0, are stored in depth first order.
+     * Binary nodes are reordered depth first after every build.
+     */
+    void reorderNodes(size_t blockSize = 0);
+
+    /**
+     * Estimates the number of {blockSize} byte blocks of binary nodes, e.g.
+     * cache lines or pages, a ray fetches while traversing. Each node is
+     * weighted by the probability of a ray visiting it, given by its surface
+     * area, and counted if it lies in another block than its parent.
+     */
+    Real getExpectedBlockFetches(size_t blockSize) const;
+
+    /**
+     * Returns the SAH cost of the tree, in units of object intersections
+     */
+    Real getSAHCost() const { return sahCost; }
+
+    /**
+     * Returns the number of object references in the leaves, which
+     * exceeds the number of objects if spatial splits were used
+     */
+    int getReferenceCount() const { return objectList.size(); }
+    /**
+     * Returns the number of nodes in the flattened BVH
+     */
+    int getNodeCount() const { return totalNodes; }
+    /**
+     * Returns the number of nodes in the wide layout, 0 if not used
+     */
+    int getWideNodeCount() const { return totalWideNodes; }
+    /**
+     * Returns the size in bytes of the nodes used for traversal
+     */
+    size_t getNodeMemory() const;
+    /**
+     * Returns true if the nodes were mapped from a cache file instead of built
+     */
+    bool isLoadedFromCache() const { return cacheMapping != nullptr; }
+    /**
+     * Returns the number of subtrees of a lazily built BVH, and the
+     * number of them built so far
+     */
+    int getLazySubtreeCount() const { return nLazySubtrees; }
+    int getBuiltSubtreeCount() const;
 
   private:
     void constructBVH();
+    void releaseNodes();
+
+    /**
+     * Subtree of a lazily built BVH over the object range [{startIdx},
+     * {startIdx + nObjects}) of {lazyObjectInfo}. The first ray reaching it
+     * claims its build by setting {claimed}, while other rays reaching it
+     * meanwhile wait for {nodes} to be published.
+     */
+    struct LazySubtree {
+        int startIdx, nObjects;
+        std::atomic<bool> claimed;
+        std::atomic<LinearBVHNode*> nodes;
+        int nNodes;
+        // Objects referenced by the leaves of the subtree
+        std::unique_ptr<LeafObject[]> leafObjects;
+    };
+
+    /**
+     * Returns the lazy subtree {idx}, building its nodes if no
+     * ray reached it before
+     */
+    const LazySubtree& expandLazySubtree(int idx) const;
+
+    /**
+     * Hashes the bounds of the objects in {sourceObjects} along with the
+     * build parameters, storing the union of the bounds in {bounds}
+     */
+    uint64_t computeSceneHash(Bounds3f* bounds) const;
+    /**
+     * Maps the cache file at {path} if it matches {sceneHash}, and
+     * sets {objectList} to the object references stored in the file.
+     * @returns false if the file is missing or does not match
+     */
+    bool loadCache(const std::string& path, uint64_t sceneHash);
+    /**
+     * Writes the nodes of the active layout to {path}. The object order is
+     * stored as indexes into {objList}, the list the BVH was created with.
+     */
+    bool saveCache(const std::string& path, uint64_t sceneHash,
+                   const std::vector<std::shared_ptr<Object>>& objList) const;
+
+    /**
+     * Resolves the objects in {objectList} into {leafObjects}, and orders the
+     * objects of each binary leaf by type if {groupLeaves} is set, so that
+     * leaves test runs of the same type
+     */
+    void createLeafObjects(bool groupLeaves);
+
+    /**
+     * Refits the nodes of the active layout to {objectBounds},
+     * which holds the bounds of the objects in {objectList}. Subtrees
+     * below the top levels are refitted in parallel.
+     */
+    void refitBinaryBVH(const std::vector<Bounds3f>& objectBounds);
+    template <typename NodeType>
+    void refitWideBVH(NodeType* nodes, const std::vector<Bounds3f>& objectBounds);
+
+    Real computeSAHCost() const;
+    template <typename NodeType>
+    Real computeWideSAHCost(const NodeType* nodes) const;
     /**
      * Recursively builds the BVH tree with object range [{startIdx}, {end}).
      * @returns The root of the built tree as a pointer to {BVHTreeNode}
@@ -102,20 +353,210 @@ class AccelBVH : public ObjectGroup {
                                        std::vector<std::shared_ptr<Object>>& orderedObjectList) const;
 
     /**
-     * Transforms the BVH binary tree structure into a linear array
+     * Builds the top levels of the BVH tree over [{startIdx}, {end}) on the
+     * calling thread, with the SAH binning spread over the worker threads.
+     * Ranges smaller than {subtreeSize} are not split any further here,
+     * but recorded in {subtrees} to be built concurrently afterwards.
+     */
+    BVHTreeNode* constructBVHTopLevel(MemoryPool& pool, std::vector<BVHObjectInfo>& objectInfoList,
+                                      int startIdx, int end, int subtreeSize, int* nodeCount,
+                                      std::vector<BVHTreeNode*>& subtrees) const;
+
+    /**
+     * Builds the BVH tree by sorting objects along a Morton curve and
+     * emitting treelets over clusters of nearby objects. SAH is only
+     * used for combining the treelets into the final tree.
+     * @returns The root of the built tree as a pointer to {BVHTreeNode}
+     */
+    BVHTreeNode* constructHLBVH(MemoryPool& pool, const std::vector<BVHObjectInfo>& objectInfoList,
+                                int* nodeCount,
+                                std::vector<std::shared_ptr<Object>>& orderedObjectList) const;
+
+    /**
+     * Recursively builds a treelet over the {nObjects} Morton sorted objects
+     * in {mortonObjects}, splitting on the Morton code bit {bitIndex} and below.
+     * Nodes are taken in order from {buildNodes}. {offset} is the position
+     * of the first object in the Morton sorted list.
+     */
+    BVHTreeNode* emitLBVH(BVHTreeNode*& buildNodes, const std::vector<BVHObjectInfo>& objectInfoList,
+                          const MortonObject* mortonObjects, int offset, int nObjects,
+                          int* nodeCount, std::vector<std::shared_ptr<Object>>& orderedObjectList,
+                          int bitIndex) const;
+
+    /**
+     * Combines the treelets in [{startIdx}, {end}) into a single tree using
+     * SAH. {treeletInfoList} describes the bounds of the roots in {treeletRoots}.
+     */
+    BVHTreeNode* constructUpperSAH(MemoryPool& pool, std::vector<BVHObjectInfo>& treeletInfoList,
+                                   const std::vector<BVHTreeNode*>& treeletRoots,
+                                   int startIdx, int end, int* nodeCount) const;
+
+    /**
+     * Recursively builds a spatial split BVH over the object references in
+     * {refs}, whose bounds may be clipped parts of the object bounds. A node
+     * is either split by partitioning its references, or by a plane that
+     * clips the references straddling it into both children. {refBudget}
+     * is the number of further references spatial splits may create.
+     * @returns The root of the built tree as a pointer to {BVHTreeNode}
+     */
+    BVHTreeNode* constructSBVHRecursive(MemoryPool& pool, std::vector<BVHObjectInfo>& refs,
+                                        Real rootSurfaceArea, int* refBudget, int* nodeCount,
+                                        std::vector<std::shared_ptr<Object>>& orderedObjectList) const;
+
+    /**
+     * Finds the SAH optimal plane along {dim} for splitting {nodeBound}
+     * spatially, with the references in {refs} clipped to the bins.
+     * @returns false if no plane leaves references on both sides
      */
-    int flattenBVH(BVHTreeNode* treeNode, int* linearIdx);
+    bool findSpatialSplit(const std::vector<BVHObjectInfo>& refs, const Bounds3f& nodeBound,
+                          int dim, Real* cost, Real* splitPos) const;
+
+    /**
+     * Distributes {refs} to the sides of the plane at {splitPos} along {dim}
+     */
+    void splitReferences(const std::vector<BVHObjectInfo>& refs, int dim, Real splitPos,
+                         std::vector<BVHObjectInfo>& left,
+                         std::vector<BVHObjectInfo>& right) const;
+
+    /**
+     * Partitions the object range [{startIdx}, {end}) along {maxDim}
+     * using SAH. Computations over the range are done with {ParallelFor}
+     * if {parallel} is true.
+     * @returns The index at which the range was split, or -1 if the objects
+     *          should rather be stored in a single leaf
+     */
+    int partitionObjects(std::vector<BVHObjectInfo>& objectInfoList,
+                         int startIdx, int end, const Bounds3f& nodeBound,
+                         const Bounds3f& centroidBounds, int maxDim, bool parallel) const;
+
+    /**
+     * Transforms the BVH binary tree structure into the linear array {nodes}.
+     * Placeholder nodes for separately built subtrees are replaced by the
+     * corresponding flattened node array from {subtreeNodes}, or become
+     * lazy subtree nodes if it is null.
+     */
+    int flattenBVH(BVHTreeNode* treeNode, LinearBVHNode* nodes, int* linearIdx,
+                   const std::vector<std::vector<LinearBVHNode>>* subtreeNodes = nullptr) const;
+
+    /**
+     * Collapses the binary subtree at {bvhNodes[nodeIdx]} into {wideNodes}.
+     * Children are gathered by repeatedly opening the interior child
+     * with the largest surface area until all {N} slots are used.
+     * @returns The index of the created wide node
+     */
+    template <int N>
+    int collapseBVH(int nodeIdx, std::vector<WideBVHNode<N>>& wideNodes) const;
+    /**
+     * Builds the wide layout from {bvhNodes} into cache line aligned memory
+     */
+    template <int N>
+    WideBVHNode<N>* createWideBVH();
+    CompressedBVHNode* createCompressedBVH();
+
+    /**
+     * Traverses the binary layout in {nodes}, whose leaves reference
+     * {leaves}. Lazy subtrees are expanded and traversed as they are
+     * reached. Stops at the first hit if {hit} is null.
+     */
+    bool intersectBinaryBVH(const LinearBVHNode* nodes, const LeafObject* leaves,
+                            const Ray& ray, BVHRay& bvhRay, SurfaceHit* hit) const;
+    /**
+     * Traverses the wide layout in {nodes} front to back. Stops at the
+     * first hit if {hit} is null.
+     */
+    template <typename NodeType>
+    bool intersectWideBVH(const NodeType* nodes, const Ray& ray, SurfaceHit* hit) const;
+
+    /**
+     * Traverses the BVH with the packet of {n} rays in {rays}. Rays
+     * that hit are flagged in {hits}. Only occlusion is tested if {si} is null.
+     */
+    void intersectPacket(const Ray* rays, SurfaceInteraction* si, bool* hits, int n) const;
+    template <typename NodeType>
+    void intersectWidePacket(const NodeType* nodes, const Ray* rays, BVHRay* bvhRays,
+                             SurfaceHit* hit, bool* hits, uint64_t activeMask) const;
+    void intersectBinaryPacket(const Ray* rays, BVHRay* bvhRays, SurfaceHit* hit,
+                               bool* hits, uint64_t activeMask) const;
+    /**
+     * Intersects the rays in {rayMask} with the objects of a leaf, recording
+     * the closest hit of each ray in {hit}. Rays found occluded are added
+     * to {doneMask} if {hit} is null.
+     */
+    void intersectLeafPacket(int startIdx, int nObjects, uint64_t rayMask,
+                             const Ray* rays, BVHRay* bvhRays, SurfaceHit* hit,
+                             bool* hits, uint64_t* doneMask) const;
 
     const int maxObjectsPerNode;
     const TreeSplitMethod tspMethod;
+    const BVHLayout layout;
+    const bool lazyBuild = false;
+    // Objects the BVH was created with, which rebuilds start from
+    const std::vector<std::shared_ptr<Object>> sourceObjects;
+    // Objects referenced by the leaves, in leaf order. Objects split by the
+    // SBVH builder are referenced more than once.
     std::vector<std::shared_ptr<Object>> objectList;
+    // Objects of {objectList} as tested by the leaves
+    std::vector<LeafObject> leafObjects;
 
     LinearBVHNode* bvhNodes = nullptr;
+    int totalNodes = 0;
+    // Exact bounds of the scene, as the nodes only keep rounded ones
+    Bounds3f sceneBounds;
+
+    // Subtrees of a lazily built BVH, and the objects they are built over.
+    // {objectList} keeps its original order in lazy builds.
+    std::unique_ptr<LazySubtree[]> lazySubtrees;
+    int nLazySubtrees = 0;
+    std::vector<BVHObjectInfo> lazyObjectInfo;
+
+    // SAH cost of the tree now and right after it was built
+    Real sahCost = 0, builtSAHCost = 0;
+
+    // Collapsed nodes for the wide layouts
+    WideBVHNode<4>* wide4Nodes = nullptr;
+    WideBVHNode<8>* wide8Nodes = nullptr;
+    CompressedBVHNode* compressedNodes = nullptr;
+    int totalWideNodes = 0;
+
+    // Private mapping of the cache file the nodes point into, if loaded from
+    // cache. Pages are copied on write, so the nodes can still be refitted.
+    void* cacheMapping = nullptr;
+    size_t cacheMappingSize = 0;
 };
 
 std::shared_ptr<AccelBVH> createBVHAccel(const std::vector<std::shared_ptr<Object>>& objList,
                                          int maxObjectsPerNode = 4,
-                                         const TreeSplitMethod tsp = TreeSplitMethod::SAH);
+                                         const TreeSplitMethod tsp = TreeSplitMethod::SAH,
+                                         const BVHLayout layout = BVHLayout::Binary);
+
+/**
+ * Creates a BVH whose subtrees are built on demand, the first time a ray
+ * reaches them. Gives the first rays in a fraction of the full build time,
+ * e.g. for interactive previews.
+ */
+std::shared_ptr<AccelBVH> createLazyBVHAccel(const std::vector<std::shared_ptr<Object>>& objList,
+                                             int maxObjectsPerNode = 4);
+
+/**
+ * Creates a BVH that is mapped from the cache file at {cachePath} when
+ * the scene did not change since the file was written, and built and
+ * written to {cachePath} otherwise.
+ */
+std::shared_ptr<AccelBVH> createCachedBVHAccel(const std::vector<std::shared_ptr<Object>>& objList,
+                                               const std::string& cachePath,
+                                               int maxObjectsPerNode = 4,
+                                               const TreeSplitMethod tsp = TreeSplitMethod::SAH,
+                                               const BVHLayout layout = BVHLayout::Binary);
+
+/**
+ * Creates the top level of a two level BVH over {instances}. Instances
+ * may share their bottom level BVH, which is traversed in the local space
+ * of each instance. Leaves hold a single instance by default, as testing
+ * an instance is far more expensive than testing a node.
+ */
+std::shared_ptr<AccelBVH> createInstanceBVHAccel(
+        const std::vector<std::shared_ptr<InstancedObject>>& instances,
+        int maxObjectsPerNode = 1, const BVHLayout layout = BVHLayout::Binary);
 
 }  // namespace phyr
 
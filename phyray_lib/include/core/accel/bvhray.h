@@ -0,0 +1,42 @@
+#ifndef PHYRAY_ACCEL_BVHRAY_H
+#define PHYRAY_ACCEL_BVHRAY_H
+
+#include <core/phyr.h>
+#include <core/geometry/geometry.h>
+
+namespace phyr {
+
+// Widens the far intersection distances to account
+// for the rounding errors of the slab tests
+static constexpr float BVHFarScale = 1 + 4 * (3 * 0.5f * std::numeric_limits<float>::epsilon());
+
+/**
+ * Ray data precomputed for testing against the single precision
+ * bounds of BVH nodes. As the origin can't be represented exactly in
+ * single precision, it is kept as a float interval and each slab test
+ * picks the bound of the interval that makes the test conservative.
+ */
+struct BVHRay {
+    BVHRay() {}
+    BVHRay(const Ray& ray) {
+        for (int axis = 0; axis < 3; axis++) {
+            invDir[axis] = float(1 / ray.d[axis]);
+            nearIdx[axis] = invDir[axis] < 0;
+
+            float oLow = roundFloatDown(ray.o[axis]), oHigh = roundFloatUp(ray.o[axis]);
+            oNear[axis] = nearIdx[axis] ? oLow : oHigh;
+            oFar[axis] = nearIdx[axis] ? oHigh : oLow;
+        }
+        setTMax(ray.tMax);
+    }
+
+    void setTMax(Real t) { tMax = roundFloatUp(t) * BVHFarScale; }
+
+    float oNear[3], oFar[3], invDir[3];
+    int nearIdx[3];
+    float tMax;
+};
+
+}  // namespace phyr
+
+#endif
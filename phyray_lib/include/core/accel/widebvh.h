@@ -0,0 +1,310 @@
+#ifndef PHYRAY_ACCEL_WIDEBVH_H
+#define PHYRAY_ACCEL_WIDEBVH_H
+
+#include <core/phyr.h>
+#include <core/geometry/geometry.h>
+#include <core/accel/bvhray.h>
+
+#include <cmath>
+
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__AVX__)
+#include <immintrin.h>
+#endif
+
+namespace phyr {
+
+/**
+ * BVH node with {N} children, which are stored in a structure of arrays
+ * layout so that all child bounds can be tested against a ray at once.
+ * Child bounds are kept in single precision, rounded outwards.
+ * Nodes are padded to 32 * {N} bytes so that they fill whole cache lines.
+ */
+template <int N>
+struct alignas(16) WideBVHNode {
+    static constexpr int width = N;
+
+    WideBVHNode() {
+        // Unused lanes get inverted bounds, which never intersect a ray
+        for (int i = 0; i < N; i++) {
+            for (int axis = 0; axis < 3; axis++) {
+                bounds[0][axis][i] = std::numeric_limits<float>::infinity();
+                bounds[1][axis][i] = -std::numeric_limits<float>::infinity();
+            }
+            childIdx[i] = -1; nObjects[i] = 0;
+        }
+    }
+
+    void setChild(int lane, const Bounds3f& b, int idx, int n) {
+        for (int axis = 0; axis < 3; axis++) {
+            bounds[0][axis][lane] = roundFloatDown(b.pMin[axis]);
+            bounds[1][axis][lane] = roundFloatUp(b.pMax[axis]);
+        }
+        childIdx[lane] = idx; nObjects[lane] = n;
+    }
+
+    Bounds3f getChildBounds(int lane) const {
+        return Bounds3f(Point3f(bounds[0][0][lane], bounds[0][1][lane], bounds[0][2][lane]),
+                        Point3f(bounds[1][0][lane], bounds[1][1][lane], bounds[1][2][lane]));
+    }
+    /**
+     * Replaces the bounds of all used lanes with {childBounds}
+     */
+    void setChildBounds(const Bounds3f* childBounds) {
+        for (int i = 0; i < N; i++)
+            if (childIdx[i] >= 0) setChild(i, childBounds[i], childIdx[i], nObjects[i]);
+    }
+
+    // Child bounds indexed as [pMin/pMax][axis][lane]
+    float bounds[2][3][N];
+    // Index of a child wide node, or the first object index for leaves
+    int32_t childIdx[N];
+    // Number of objects in a child leaf (0 for interior children)
+    uint16_t nObjects[N];
+    // Alignment padding
+    uint8_t _padding[2 * N];
+};
+
+/**
+ * 8-wide BVH node with child bounds quantized to 8 bits per plane.
+ * Each axis of the node spans a grid of 255 steps starting at {origin},
+ * with a power of two step size so that decoding a plane only involves
+ * an exact multiplication and a single rounding. Planes are quantized
+ * outwards, making the decoded child bounds conservative.
+ */
+struct alignas(16) CompressedBVHNode {
+    static constexpr int width = 8;
+
+    explicit CompressedBVHNode(const WideBVHNode<8>& node) {
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = std::numeric_limits<float>::infinity();
+            float hi = -std::numeric_limits<float>::infinity();
+            for (int i = 0; i < width; i++) {
+                if (node.childIdx[i] < 0) continue;
+                lo = std::min(lo, node.bounds[0][axis][i]);
+                hi = std::max(hi, node.bounds[1][axis][i]);
+            }
+            origin[axis] = lo;
+
+            // Pick the smallest step size for which the grid covers the node
+            int e;
+            std::frexp((hi - lo) / 255, &e);
+            exponent[axis] = std::max(-126, std::min(e, 127));
+            while (exponent[axis] < 127 && decode(axis, 255) < hi) exponent[axis]++;
+
+            for (int i = 0; i < width; i++) {
+                if (node.childIdx[i] < 0) {
+                    // Inverted bounds, which never intersect a ray
+                    qBounds[0][axis][i] = 255; qBounds[1][axis][i] = 0;
+                    continue;
+                }
+
+                float scale = getScale(axis);
+                int qLow = std::max(0, std::min(int(std::floor((node.bounds[0][axis][i] - lo) / scale)), 255));
+                while (qLow > 0 && decode(axis, qLow) > node.bounds[0][axis][i]) qLow--;
+                int qHigh = std::max(0, std::min(int(std::ceil((node.bounds[1][axis][i] - lo) / scale)), 255));
+                while (qHigh < 255 && decode(axis, qHigh) < node.bounds[1][axis][i]) qHigh++;
+
+                qBounds[0][axis][i] = qLow; qBounds[1][axis][i] = qHigh;
+            }
+        }
+
+        for (int i = 0; i < width; i++) {
+            childIdx[i] = node.childIdx[i];
+            nObjects[i] = node.nObjects[i];
+        }
+    }
+
+    float getScale(int axis) const { return bitsToFloat(uint32_t(exponent[axis] + 127) << 23); }
+    float decode(int axis, int q) const { return origin[axis] + float(q) * getScale(axis); }
+
+    Bounds3f getChildBounds(int lane) const {
+        return Bounds3f(Point3f(decode(0, qBounds[0][0][lane]), decode(1, qBounds[0][1][lane]),
+                                decode(2, qBounds[0][2][lane])),
+                        Point3f(decode(0, qBounds[1][0][lane]), decode(1, qBounds[1][1][lane]),
+                                decode(2, qBounds[1][2][lane])));
+    }
+    /**
+     * Requantizes the node for the new bounds {childBounds} of the used lanes
+     */
+    void setChildBounds(const Bounds3f* childBounds) {
+        WideBVHNode<8> node;
+        for (int i = 0; i < width; i++)
+            if (childIdx[i] >= 0) node.setChild(i, childBounds[i], childIdx[i], nObjects[i]);
+        *this = CompressedBVHNode(node);
+    }
+
+    // Origin of the quantization grid
+    float origin[3];
+    // Base 2 exponent of the grid step size along each axis
+    int8_t exponent[3];
+    uint8_t _padding0[1];
+    // Quantized child bounds indexed as [pMin/pMax][axis][lane]
+    uint8_t qBounds[2][3][8];
+    // Index of a child node, or the first object index for leaves
+    int32_t childIdx[8];
+    // Number of objects in a child leaf (0 for interior children), as wide
+    // as in the other layouts, since leaves of unsplittable ranges may hold
+    // more than 255 objects
+    uint16_t nObjects[8];
+};
+static_assert(sizeof(CompressedBVHNode) == 112, "CompressedBVHNode must be 112 bytes");
+
+/**
+ * Tests {ray} against the bounds of all children of {node}.
+ * The entry distance of every child is written to {tNear}.
+ * @returns A bit mask of the children intersected by the ray
+ */
+template <int N>
+inline int intersectWideNode(const WideBVHNode<N>& node, const BVHRay& ray, float* tNear) {
+    int mask = 0;
+    for (int i = 0; i < N; i++) {
+        float tn = 0, tf = ray.tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (node.bounds[ray.nearIdx[axis]][axis][i] - ray.oNear[axis]) * ray.invDir[axis];
+            float t1 = (node.bounds[1 - ray.nearIdx[axis]][axis][i] - ray.oFar[axis]) *
+                       ray.invDir[axis] * BVHFarScale;
+            // Comparisons are arranged so that NaNs are ignored
+            tn = t0 > tn ? t0 : tn;
+            tf = t1 < tf ? t1 : tf;
+        }
+        tNear[i] = tn;
+        if (tn <= tf) mask |= 1 << i;
+    }
+    return mask;
+}
+
+#if defined(__SSE__)
+template <>
+inline int intersectWideNode<4>(const WideBVHNode<4>& node, const BVHRay& ray, float* tNear) {
+    __m128 tn = _mm_setzero_ps(), tf = _mm_set1_ps(ray.tMax);
+    const __m128 farScale = _mm_set1_ps(BVHFarScale);
+
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 invDir = _mm_set1_ps(ray.invDir[axis]);
+        __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[ray.nearIdx[axis]][axis]),
+                                          _mm_set1_ps(ray.oNear[axis])), invDir);
+        __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.bounds[1 - ray.nearIdx[axis]][axis]),
+                                          _mm_set1_ps(ray.oFar[axis])), invDir);
+        // Min/max return their second operand if either one is NaN
+        tn = _mm_max_ps(t0, tn);
+        tf = _mm_min_ps(_mm_mul_ps(t1, farScale), tf);
+    }
+
+    _mm_storeu_ps(tNear, tn);
+    return _mm_movemask_ps(_mm_cmple_ps(tn, tf));
+}
+#endif
+
+#if defined(__AVX__)
+template <>
+inline int intersectWideNode<8>(const WideBVHNode<8>& node, const BVHRay& ray, float* tNear) {
+    __m256 tn = _mm256_setzero_ps(), tf = _mm256_set1_ps(ray.tMax);
+    const __m256 farScale = _mm256_set1_ps(BVHFarScale);
+
+    for (int axis = 0; axis < 3; axis++) {
+        __m256 invDir = _mm256_set1_ps(ray.invDir[axis]);
+        __m256 t0 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.bounds[ray.nearIdx[axis]][axis]),
+                                                _mm256_set1_ps(ray.oNear[axis])), invDir);
+        __m256 t1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_loadu_ps(node.bounds[1 - ray.nearIdx[axis]][axis]),
+                                                _mm256_set1_ps(ray.oFar[axis])), invDir);
+        // Min/max return their second operand if either one is NaN
+        tn = _mm256_max_ps(t0, tn);
+        tf = _mm256_min_ps(_mm256_mul_ps(t1, farScale), tf);
+    }
+
+    _mm256_storeu_ps(tNear, tn);
+    return _mm256_movemask_ps(_mm256_cmp_ps(tn, tf, _CMP_LE_OQ));
+}
+#elif defined(__SSE__)
+template <>
+inline int intersectWideNode<8>(const WideBVHNode<8>& node, const BVHRay& ray, float* tNear) {
+    // Test both halves of the node with 4-wide instructions
+    __m128 tn[2] = { _mm_setzero_ps(), _mm_setzero_ps() };
+    __m128 tf[2] = { _mm_set1_ps(ray.tMax), _mm_set1_ps(ray.tMax) };
+    const __m128 farScale = _mm_set1_ps(BVHFarScale);
+
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 invDir = _mm_set1_ps(ray.invDir[axis]);
+        __m128 oNear = _mm_set1_ps(ray.oNear[axis]), oFar = _mm_set1_ps(ray.oFar[axis]);
+        const float* nearBounds = node.bounds[ray.nearIdx[axis]][axis];
+        const float* farBounds = node.bounds[1 - ray.nearIdx[axis]][axis];
+
+        for (int h = 0; h < 2; h++) {
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(nearBounds + 4 * h), oNear), invDir);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(farBounds + 4 * h), oFar), invDir);
+            tn[h] = _mm_max_ps(t0, tn[h]);
+            tf[h] = _mm_min_ps(_mm_mul_ps(t1, farScale), tf[h]);
+        }
+    }
+
+    _mm_storeu_ps(tNear, tn[0]); _mm_storeu_ps(tNear + 4, tn[1]);
+    return _mm_movemask_ps(_mm_cmple_ps(tn[0], tf[0])) |
+           (_mm_movemask_ps(_mm_cmple_ps(tn[1], tf[1])) << 4);
+}
+#endif
+
+#if defined(__SSE2__)
+/**
+ * Decodes the 8 quantized planes in {q} into {lanes}
+ */
+inline void decodeQuantizedLanes(const uint8_t* q, __m128 origin, __m128 scale, __m128* lanes) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i q16 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(q)), zero);
+    lanes[0] = _mm_add_ps(origin, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(q16, zero)), scale));
+    lanes[1] = _mm_add_ps(origin, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(q16, zero)), scale));
+}
+
+inline int intersectWideNode(const CompressedBVHNode& node, const BVHRay& ray, float* tNear) {
+    __m128 tn[2] = { _mm_setzero_ps(), _mm_setzero_ps() };
+    __m128 tf[2] = { _mm_set1_ps(ray.tMax), _mm_set1_ps(ray.tMax) };
+    const __m128 farScale = _mm_set1_ps(BVHFarScale);
+
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 origin = _mm_set1_ps(node.origin[axis]), scale = _mm_set1_ps(node.getScale(axis));
+        __m128 nearBounds[2], farBounds[2];
+        decodeQuantizedLanes(node.qBounds[ray.nearIdx[axis]][axis], origin, scale, nearBounds);
+        decodeQuantizedLanes(node.qBounds[1 - ray.nearIdx[axis]][axis], origin, scale, farBounds);
+
+        __m128 invDir = _mm_set1_ps(ray.invDir[axis]);
+        __m128 oNear = _mm_set1_ps(ray.oNear[axis]), oFar = _mm_set1_ps(ray.oFar[axis]);
+        for (int h = 0; h < 2; h++) {
+            __m128 t0 = _mm_mul_ps(_mm_sub_ps(nearBounds[h], oNear), invDir);
+            __m128 t1 = _mm_mul_ps(_mm_sub_ps(farBounds[h], oFar), invDir);
+            tn[h] = _mm_max_ps(t0, tn[h]);
+            tf[h] = _mm_min_ps(_mm_mul_ps(t1, farScale), tf[h]);
+        }
+    }
+
+    _mm_storeu_ps(tNear, tn[0]); _mm_storeu_ps(tNear + 4, tn[1]);
+    return _mm_movemask_ps(_mm_cmple_ps(tn[0], tf[0])) |
+           (_mm_movemask_ps(_mm_cmple_ps(tn[1], tf[1])) << 4);
+}
+#else
+inline int intersectWideNode(const CompressedBVHNode& node, const BVHRay& ray, float* tNear) {
+    int mask = 0;
+    for (int i = 0; i < CompressedBVHNode::width; i++) {
+        float tn = 0, tf = ray.tMax;
+        for (int axis = 0; axis < 3; axis++) {
+            float t0 = (node.decode(axis, node.qBounds[ray.nearIdx[axis]][axis][i]) -
+                        ray.oNear[axis]) * ray.invDir[axis];
+            float t1 = (node.decode(axis, node.qBounds[1 - ray.nearIdx[axis]][axis][i]) -
+                        ray.oFar[axis]) * ray.invDir[axis] * BVHFarScale;
+            tn = t0 > tn ? t0 : tn;
+            tf = t1 < tf ? t1 : tf;
+        }
+        tNear[i] = tn;
+        if (tn <= tf) mask |= 1 << i;
+    }
+    return mask;
+}
+#endif
+
+}  // namespace phyr
+
+#endif
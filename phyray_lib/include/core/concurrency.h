@@ -60,16 +60,78 @@ class Barrier {
     int count;
 };
 
+/**
+ * Runs {func} for each index in [0, count) on the worker threads, and
+ * returns once all have completed. The range is split in halves down to
+ * {chunkSize} iterations, which idle threads steal from each other. Calls
+ * may be nested; the calling thread runs other queued work while waiting.
+ */
 void ParallelFor(std::function<void(int64_t)> func, int64_t count,
                  int chunkSize = 1);
 extern thread_local int ThreadIndex;
 
+/**
+ * Runs {func} for each point in [0, count.x) x [0, count.y), one point
+ * per chunk, as with {ParallelFor}
+ */
 void ParallelFor2D(std::function<void(Point2i)> func, const Point2i &count);
 
+/**
+ * Splits [begin, end) into blocks of {grain} indices as with
+ * {ParallelFor}, and calls {func} once per block with its first and
+ * one past its last index. Without worker threads, or if the range is
+ * at most {grain} long, it is run as a single block.
+ */
+void ParallelForBlocks(std::function<void(int64_t, int64_t)> func, int64_t begin,
+                       int64_t end, int64_t grain);
+
+/**
+ * Runs {func} for each index in [begin, end) in blocks of {grain}
+ * indices. Only the block is dispatched through {std::function}, so {func}
+ * is inlined into the loop over each block, which makes loops with little
+ * work per index worth running in parallel.
+ */
+template <typename Func>
+void ParallelForRange(int64_t begin, int64_t end, int64_t grain, Func&& func) {
+    ParallelForBlocks([&func](int64_t blockBegin, int64_t blockEnd) {
+        for (int64_t i = blockBegin; i < blockEnd; ++i) func(i);
+    }, begin, end, grain);
+}
+
+/**
+ * Placement of the threads of the pool on the CPUs the process may use
+ */
+enum class ThreadAffinity {
+    // Threads are not pinned and may migrate between CPUs
+    None,
+    // Threads are pinned to consecutive CPUs, filling one NUMA node first
+    Compact,
+    // Threads are pinned round robin over the NUMA nodes
+    Scatter
+};
+
 int maxThreadIndex();
+/**
+ * Returns the number of CPUs the process may run on, which can be fewer
+ * than the system has when it is restricted e.g. by taskset or cgroups
+ */
 int numSystemCores();
-
-void parallelInit();
+/**
+ * Returns the number of NUMA nodes the pool's threads are pinned to, and
+ * the node of the calling thread. Unpinned threads count as one node, 0.
+ */
+int numNumaNodes();
+int threadNumaNode();
+
+/**
+ * Starts the worker thread pool. {nThreads} is the total number of
+ * threads doing work, including the calling thread. A value of 0 uses
+ * one thread per system core. Threads are pinned to CPUs by {affinity},
+ * and then steal work from threads on their own NUMA node first. Memory
+ * a pinned thread allocates and first writes, such as the {MemoryPool}
+ * and {FilmTile} of the tiles it renders, stays local to its node.
+ */
+void parallelInit(int nThreads = 0, ThreadAffinity affinity = ThreadAffinity::None);
 void parallelCleanup();
 void mergeWorkerThreadStats();
 
@@ -113,6 +113,18 @@ class RenderConfig {
 
         // Max-bounces
         config["bounces"].push_back(ParamType::INT);
+
+        // BVH cache file
+        config["bvhcache"].push_back(ParamType::STRING);
+
+        // Build BVH subtrees on demand if non-zero
+        config["lazybvh"].push_back(ParamType::INT);
+
+        // Number of render threads, 0 for one per core
+        config["threads"].push_back(ParamType::INT);
+
+        // Pinning of the render threads: none, compact or scatter
+        config["affinity"].push_back(ParamType::STRING);
         return config;
     }
 
@@ -2,12 +2,14 @@
 #define PHYRAY_CORE_FILM_H
 
 #include <core/phyr.h>
+#include <core/phyr_mem.h>
 #include <core/concurrency.h>
 #include <core/color/spectrum.h>
 #include <core/integrator/filter.h>
 #include <core/geometry/geometry.h>
 
 #include <mutex>
+#include <atomic>
 #include <memory>
 
 namespace phyr {
@@ -49,13 +51,25 @@ class FilmTile {
     std::vector<FilmTilePixel> pixels;
 };
 
+/**
+ * How {Film::addSplat} accumulates splats
+ */
+enum class SplatMode {
+    // Each thread adds into a buffer of its own, allocated on its first
+    // splat, and the buffers are summed when writing the image
+    ThreadBuffers,
+    // All threads add into the film pixels atomically, using no extra memory
+    Atomic
+};
+
 // Film declarations
 class Film {
   public:
     // Film size must be specified in millimetres
     Film(const Point2i& resolution, const Bounds2f& cropWindow,
          std::unique_ptr<Filter> filter, Real filmSize,
-         const std::string& filename, Real scale);
+         const std::string& filename, Real scale,
+         SplatMode splatMode = SplatMode::ThreadBuffers);
 
     // Interface
     Bounds2i getSampleBounds() const;
@@ -72,16 +86,39 @@ class Film {
      */
     void mergeFilmTile(std::unique_ptr<FilmTile> tile);
 
+    /**
+     * Returns the number of row locks taken by {mergeFilmTile}, and how
+     * many of them were held by another thread at the time
+     */
+    uint64_t getMergeLockCount() const { return nMergeLocks; }
+    uint64_t getContendedMergeLockCount() const { return nContendedMergeLocks; }
+
+    /**
+     * Returns the XYZ and filter weight sums merged into pixel {p}
+     */
+    void getPixelSums(const Point2i& p, Real xyz[3], Real* filterWeightSum) const;
+
     /**
      * Fill pixel data from given Spectrum array all at once
      */
     void setImage(const Spectrum* img);
     /**
      * Add contributions to random pixels. More the splats around
-     * a given pixel, the brighter the pixel is.
+     * a given pixel, the brighter the pixel is. With thread buffers,
+     * threads outside the pool must not splat at the same time as
+     * the thread that called {parallelInit}, as they share its index.
      */
     void addSplat(const Point2f& pt, const Spectrum& spec);
 
+    /**
+     * Returns the XYZ sum of the splats added to pixel {p} by all threads
+     */
+    void getSplatXYZ(const Point2i& p, Real xyz[3]) const;
+    /**
+     * Returns the bytes held by the per-thread splat buffers
+     */
+    size_t getSplatBufferMemory() const;
+
     /**
      * Generate and write to file the actual RGB image data from the render samples
      */
@@ -121,12 +158,32 @@ class Film {
                   (pt.x - croppedImageBounds.pMin.x);
         return pixels[idx];
     }
+    const Pixel& getPixel(const Point2i& pt) const {
+        return const_cast<Film*>(this)->getPixel(pt);
+    }
+    // Sums the splats of pixel {idx} added atomically and to the thread buffers
+    void sumSplats(int64_t idx, Real xyz[3]) const;
 
     const Real scale;
     std::unique_ptr<Pixel[]> pixels;
-    // Mutex lock to be used for acquiring access to
-    // Film for merging FilmTiles
-    std::mutex mutex;
+    // Row y of the film is merged under the lock of stripe y % nMergeStripes,
+    // so that only tiles merging the same rows at once wait for each other
+    static constexpr int nMergeStripes = 64;
+    // Padded rather than aligned to a cache line, as the film is allocated
+    // with new, which does not honour over-alignment
+    struct MergeStripe {
+        std::mutex mutex;
+        char padding[DEF_PHYR_L1_CACHE_LINESZ - sizeof(std::mutex) % DEF_PHYR_L1_CACHE_LINESZ];
+    };
+    MergeStripe mergeStripes[nMergeStripes];
+    std::atomic<uint64_t> nMergeLocks{0}, nContendedMergeLocks{0};
+
+    const SplatMode splatMode;
+    // XYZ splat sums of each thread, indexed by ThreadIndex; null until the
+    // thread first splats. Threads beyond the pool size at construction
+    // splat atomically.
+    std::unique_ptr<std::unique_ptr<Real[]>[]> splatBuffers;
+    int nSplatBuffers = 0;
 
     // Filter table data
     static constexpr int filterTableSize = 16;
@@ -85,6 +85,30 @@ class SurfaceInteraction : public Interaction {
     } shadingGeom;
 };
 
+// Deepest nesting of instances a SurfaceHit can record
+static constexpr int MaxInstanceDepth = 4;
+
+/**
+ * Minimal record of a ray hit, kept while searching for the closest hit.
+ * The full SurfaceInteraction is built from it only once the closest hit
+ * is known, with {Shape::computeInteraction}.
+ */
+struct SurfaceHit {
+    // Parametric distance of the hit along the ray
+    Real t = 0;
+    // Shape specific data for completing the interaction,
+    // e.g. the refined hit point in local space for quadrics
+    Real hint[3];
+    // Shape specific index, e.g. of the sphere hit in a SphereSet
+    int hintIndex = 0;
+
+    // The object hit and the instances it was reached through, from the
+    // innermost outwards
+    const Object* object = nullptr;
+    const InstancedObject* instances[MaxInstanceDepth];
+    int nInstances = 0;
+};
+
 } // namespace phyr
 
 #endif
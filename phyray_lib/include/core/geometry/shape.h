@@ -6,6 +6,9 @@
 
 namespace phyr {
 
+// Relative slack allowed for rounding errors when clipping shapes to boxes
+static constexpr Real ClipTolerance = 1e-4;
+
 class Shape {
   public:
     Shape(const Transform* localToWorld,
@@ -23,6 +26,19 @@ class Shape {
      * Returns the object bounds in world space
      */
     virtual Bounds3f worldBounds() const { return (*localToWorld)(objectBounds()); }
+    /**
+     * Computes the world space bounds of the part of the surface
+     * inside {clip} in {bounds}. Shapes may return bounds larger than
+     * the exact ones, but never smaller.
+     * @returns false if the surface does not overlap {clip}
+     */
+    virtual bool clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const;
+    /**
+     * Appends the values {clipWorldBounds} depends on, other than the world
+     * bounds, to {params}. Shapes overriding {clipWorldBounds} override this
+     * too, so that cached clipped bounds are not reused for other geometry.
+     */
+    virtual void getClipParameters(std::vector<Real>* params) const {}
     virtual Real surfaceArea() const = 0;
 
     /**
@@ -33,12 +49,24 @@ class Shape {
      * Rays are assumed to be in the world space.
      */
     virtual bool intersectRay(const Ray& ray, Real* t0, SurfaceInteraction* si,
-                              bool testAlpha = true) const = 0;
+                              bool testAlpha = true) const;
     /**
      * Just checks for a ray intersection without having to fill in any details
      */
     virtual bool intersectRay(const Ray& ray, bool testAlpha = true) const;
 
+    /**
+     * Finds the ray intersection like {intersectRay}, but only records the
+     * distance and what {computeInteraction} needs in {hit}. Lets traversal
+     * skip the surface parameterization for hits that end up occluded.
+     */
+    virtual bool intersectHit(const Ray& ray, SurfaceHit* hit, bool testAlpha = true) const = 0;
+    /**
+     * Builds the SurfaceInteraction of a {hit} found for {ray} by {intersectHit}
+     */
+    virtual void computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                                    SurfaceInteraction* si) const = 0;
+
     // Sample a point on the surface of the shape and return the PDF with
     // respect to area on the surface.
     virtual Interaction sample(const Point2f& u, Real* pdf) const = 0;
@@ -53,6 +81,17 @@ class Shape {
     const Transform *localToWorld, *worldToLocal;
     const bool reverseNormals;
     const bool transformChangesCoordSys;
+
+  protected:
+    /**
+     * Tests a hit at the surface point {si} found by {ray} against
+     * {alphaMask}. Hits where the mask is zero are cut out and ones where
+     * it is one are kept. Fractional values keep the hit with that
+     * probability, decided by a hash of the ray and the hit point so that
+     * tests are repeatable.
+     */
+    static bool alphaTest(const Texture<Real>& alphaMask, const SurfaceInteraction& si,
+                          const Ray& ray);
 };
 
 } // namespace phyr
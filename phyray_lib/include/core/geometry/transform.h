@@ -18,9 +18,12 @@ class Transform {
                      tMat[2][0], tMat[2][1], tMat[2][2], tMat[2][3],
                      tMat[3][0], tMat[3][1], tMat[3][2], tMat[3][3]);
         invMat = Mat4x4::inverse(mat);
+        scaleTranslation = onlyScalesAndTranslates(mat);
     }
-    Transform(const Mat4x4& mat) : mat(mat), invMat(Mat4x4::inverse(mat)) {}
-    Transform(const Mat4x4& mat, const Mat4x4& invMat) : mat(mat), invMat(invMat) {}
+    Transform(const Mat4x4& mat) :
+        mat(mat), invMat(Mat4x4::inverse(mat)), scaleTranslation(onlyScalesAndTranslates(mat)) {}
+    Transform(const Mat4x4& mat, const Mat4x4& invMat) :
+        mat(mat), invMat(invMat), scaleTranslation(onlyScalesAndTranslates(mat)) {}
 
     // Getters
     const Mat4x4& getMatrix() const { return mat; }
@@ -34,6 +37,12 @@ class Transform {
         return mat != t.mat && invMat != t.invMat;
     }
     bool isIdentity() const { return mat == Mat4x4(); }
+    /**
+     * Returns true if this transform only scales uniformly and translates,
+     * as most shapes are placed. Rays are then transformed without the
+     * zero terms of the matrix products.
+     */
+    bool isScaleTranslation() const { return scaleTranslation; }
 
     /**
      * Returns true if this transform changes the
@@ -174,7 +183,17 @@ class Transform {
     static Transform perspective(Real fov, Real near, Real far);
 
   private:
+    static bool onlyScalesAndTranslates(const Mat4x4& m) {
+        return m.d[0][1] == 0 && m.d[0][2] == 0 && m.d[1][0] == 0 && m.d[1][2] == 0 &&
+               m.d[2][0] == 0 && m.d[2][1] == 0 && m.d[0][0] == m.d[1][1] &&
+               m.d[0][0] == m.d[2][2] && m.d[3][0] == 0 && m.d[3][1] == 0 &&
+               m.d[3][2] == 0 && m.d[3][3] == 1;
+    }
+
     Mat4x4 mat, invMat;
+    // Set if {mat} only scales uniformly and translates, computed on
+    // construction so that transforms updated in place stay consistent
+    bool scaleTranslation = true;
 };
 
 #define PT_COMP_ABS_ERROR(ex, ey, ez, m, p) \
@@ -328,8 +347,22 @@ inline Ray Transform::operator()(const Ray& r) const {
 
 inline Ray Transform::operator()(const Ray& r, Vector3f* roAbsError, Vector3f* rdAbsError) const {
     // Transform ray origin and direction
-    Point3f o = (*this)(r.o, roAbsError);
-    Vector3f d = (*this)(r.d, rdAbsError);
+    Point3f o;
+    Vector3f d;
+    if (scaleTranslation) {
+        // Same results and error bounds as the full products, whose other terms are zero
+        Real scale = mat.d[0][0];
+        Vector3f offset(mat.d[0][3], mat.d[1][3], mat.d[2][3]);
+        o = Point3f(scale * r.o.x + offset.x, scale * r.o.y + offset.y, scale * r.o.z + offset.z);
+        d = Vector3f(scale * r.d.x, scale * r.d.y, scale * r.d.z);
+        *roAbsError = Vector3f(std::abs(scale * r.o.x) + std::abs(offset.x),
+                               std::abs(scale * r.o.y) + std::abs(offset.y),
+                               std::abs(scale * r.o.z) + std::abs(offset.z)) * gamma(3);
+        *rdAbsError = abs(d) * gamma(3);
+    } else {
+        o = (*this)(r.o, roAbsError);
+        d = (*this)(r.d, rdAbsError);
+    }
 
     Real tMax = r.tMax, lengthSq = d.lengthSquared();
     if (lengthSq > 0) {
@@ -41,6 +41,9 @@ Vector3f uniformSampleCone(const Point2f &u, Real thetamax, const Vector3f &x,
                            const Vector3f &y, const Vector3f &z);
 Real uniformConePdf(Real cosThetaMax);
 
+// Triangle sampling, returning barycentric coordinates
+Point2f uniformSampleTriangle(const Point2f& u);
+
 /* Code adapted for PhyRay from pbrt */
 struct Distribution1D {
     // Distribution1D Public Methods
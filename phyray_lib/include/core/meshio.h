@@ -0,0 +1,100 @@
+#ifndef PHYRAY_CORE_MESHIO_H
+#define PHYRAY_CORE_MESHIO_H
+
+#include <core/phyr.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace phyr {
+
+// Scalar types that mesh attributes can be stored in
+enum class MeshScalarType { Int8, UInt8, Int16, UInt16, Int32, UInt32, Float32, Float64 };
+
+/**
+ * Read only, strided view of one scalar component of a mesh attribute,
+ * e.g. the x coordinate of the vertex positions. Elements are read in
+ * place, so the view may point straight into a mapped file.
+ */
+struct MeshAttribute {
+    MeshAttribute() {}
+    MeshAttribute(const char* data, size_t stride, MeshScalarType type) :
+        data(data), stride(stride), type(type) {}
+
+    bool isValid() const { return data != nullptr; }
+
+    // Returns element {i}, which may be unaligned in the underlying storage
+    Real getReal(size_t i) const;
+    uint32_t getIndex(size_t i) const;
+
+    const char* data = nullptr;
+    size_t stride = 0;
+    MeshScalarType type = MeshScalarType::Float32;
+};
+
+/**
+ * Indexed triangle mesh as read from a file. Attributes either view the
+ * file mapping directly or the storage decoded by the loader, both of
+ * which live as long as the mesh.
+ */
+class IndexedMesh {
+  public:
+    IndexedMesh() {}
+    ~IndexedMesh();
+
+    IndexedMesh(const IndexedMesh&) = delete;
+    IndexedMesh& operator=(const IndexedMesh&) = delete;
+
+    bool hasNormals() const { return n[0].isValid(); }
+    bool hasUVs() const { return uv[0].isValid(); }
+
+    // Whether the positions and indices are read from the file mapping in place
+    bool isZeroCopy() const { return zeroCopyVertices && zeroCopyIndices; }
+
+    int64_t nVertices = 0, nTriangles = 0;
+    // Vertex positions, normals and (u, v) coordinates
+    MeshAttribute p[3], n[3], uv[2];
+    // The three vertex indices of each triangle
+    MeshAttribute indices[3];
+    // Material the faces of the mesh are assigned to, if any
+    std::string material;
+
+  private:
+    friend class PLYReader;
+    friend class OBJReader;
+
+    // Sets the attributes to view the decoded {vertexData} and {indexData}. Vertices
+    // are packed as positions, followed by normals and (u, v) coordinates if present.
+    void setDecodedAttributes(bool hasNormals, bool hasUVs);
+
+    void* mapping = nullptr;
+    size_t mappingSize = 0;
+    bool zeroCopyVertices = false, zeroCopyIndices = false;
+
+    // Storage for attributes that could not be viewed in place
+    std::vector<Real> vertexData;
+    std::vector<uint32_t> indexData;
+};
+
+/**
+ * Loads the triangle mesh of the PLY file at {path}. Binary little endian
+ * files are mapped and viewed in place, ASCII and big endian files are
+ * decoded in parallel. Polygons are triangulated as fans.
+ * @returns nullptr if the file could not be read
+ */
+std::unique_ptr<IndexedMesh> loadPLYMesh(const std::string& path);
+
+/**
+ * Loads the Wavefront OBJ file at {path} as one mesh per material named by
+ * its "usemtl" statements, in order of first use. Chunks of the file are
+ * parsed in parallel, and the position, (u, v) and normal index tuples of
+ * face vertices are merged into shared vertices. Polygons are triangulated
+ * as fans.
+ * @returns no meshes if the file could not be read
+ */
+std::vector<std::unique_ptr<IndexedMesh>> loadOBJMeshes(const std::string& path);
+
+}  // namespace phyr
+
+#endif
@@ -18,9 +18,41 @@ class Object {
      * Returns the bounds of the object in world space
      */
     virtual Bounds3f worldBounds() const = 0;
+    /**
+     * Computes the world space bounds of the part of the object inside
+     * {clip} in {bounds}, for splitting the object between BVH nodes.
+     * @returns false if the object does not overlap {clip}
+     */
+    virtual bool clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const;
+    /**
+     * Appends the values {clipWorldBounds} depends on, other than the
+     * world bounds, to {params}
+     */
+    virtual void getClipParameters(std::vector<Real>* params) const {}
+    /**
+     * Refreshes bounds the object caches from other objects, after those
+     * were refitted. Aggregates call this on their objects when refitting.
+     */
+    virtual void updateBounds() {}
     virtual bool intersectRay(const Ray& ray) const = 0;
     virtual bool intersectRay(const Ray& ray, SurfaceInteraction* si) const = 0;
 
+    /**
+     * Finds the closest hit along {ray} like {intersectRay}, but only
+     * records it in {hit}. The SurfaceInteraction of the closest hit is
+     * built afterwards with {computeInteraction} of the same object.
+     */
+    virtual bool intersectHit(const Ray& ray, SurfaceHit* hit) const = 0;
+    virtual void computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                                    SurfaceInteraction* si) const = 0;
+
+    /**
+     * Intersects a batch of {n} rays, flagging the rays that hit in {hits}.
+     * Aggregates may override these to share work between the rays.
+     */
+    virtual void intersectRays(const Ray* rays, SurfaceInteraction* si, bool* hits, int n) const;
+    virtual void intersectRays(const Ray* rays, bool* hits, int n) const;
+
     /**
      * Returns a pointer to the AreaLight describing the object's emission
      * distribution. If the object is non-emissive, the function returns nullptr
@@ -48,11 +80,16 @@ class GeometricObject : public Object {
         shape(shape), material(material), areaLight(areaLight) {}
 
     Bounds3f worldBounds() const;
+    bool clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const;
+    void getClipParameters(std::vector<Real>* params) const;
     bool intersectRay(const Ray& ray) const;
     bool intersectRay(const Ray& ray, SurfaceInteraction* si) const;
+    bool intersectHit(const Ray& ray, SurfaceHit* hit) const;
+    void computeInteraction(const Ray& ray, const SurfaceHit& hit, SurfaceInteraction* si) const;
 
     const AreaLight* getAreaLight() const;
     const Material* getMaterial() const;
+    const Shape* getShape() const { return shape.get(); }
 
     void computeScatteringFunctions(SurfaceInteraction* si,
                                     MemoryPool& mem, TransportMode mode,
@@ -67,18 +104,42 @@ class InstancedObject : public Object {
   public:
     InstancedObject(const std::shared_ptr<Object>& object,
                     const Transform& objectToInstanceWorld) :
-        object(object), objectToInstanceWorld(objectToInstanceWorld) {}
+        object(object), objectToInstanceWorld(objectToInstanceWorld),
+        instanceWorldToObject(Transform::inverse(objectToInstanceWorld)),
+        instanceBounds(objectToInstanceWorld(object->worldBounds())) {}
 
     Bounds3f worldBounds() const;
     bool intersectRay(const Ray& ray) const;
     bool intersectRay(const Ray& ray, SurfaceInteraction* si) const;
+    /**
+     * Appends the instance to the chain of instances in {hit}, so that the
+     * closest hit is only transformed back to world space, one level at a
+     * time, by {computeInteraction}. Up to {MaxInstanceDepth} instances
+     * may be nested.
+     */
+    bool intersectHit(const Ray& ray, SurfaceHit* hit) const;
+    void computeInteraction(const Ray& ray, const SurfaceHit& hit, SurfaceInteraction* si) const;
+
+    /**
+     * Moves the instance with a new {objectToInstanceWorld} transform
+     */
+    void setTransform(const Transform& objectToInstanceWorld);
+    /**
+     * Recomputes the cached world bounds from the instanced object, which
+     * changes when it is refitted. Refitting an aggregate over the instance
+     * calls this, so only instances tested directly need it.
+     */
+    void updateBounds();
 
     const AreaLight* getAreaLight() const { return nullptr; }
     const Material* getMaterial() const { return nullptr; }
 
   private:
     std::shared_ptr<Object> object;
-    const Transform objectToInstanceWorld;
+    Transform objectToInstanceWorld;
+    // Cached so that rays need not build the inverse on every test
+    Transform instanceWorldToObject;
+    Bounds3f instanceBounds;
 
     // Function has no purpose in this context
     void computeScatteringFunctions(SurfaceInteraction* si,
@@ -87,6 +148,12 @@ class InstancedObject : public Object {
 };
 
 class ObjectGroup : public Object {
+  public:
+    /**
+     * Hands the {hit} found by traversal to the object or instance hit
+     */
+    void computeInteraction(const Ray& ray, const SurfaceHit& hit, SurfaceInteraction* si) const;
+
   private:
     // Functions have no purpose in this context
     const AreaLight* getAreaLight() const { return nullptr; }
@@ -48,10 +48,12 @@ class Transform;
 // Interactions
 class Interaction;
 class SurfaceInteraction;
+struct SurfaceHit;
 
 // Objects
 class Shape;
 class Object;
+class InstancedObject;
 class Sphere;
 class Scene;
 
@@ -60,6 +62,7 @@ class Light;
 class AreaLight;
 
 class Material;
+template <typename T> class Texture;
 class MemoryPool;
 class BSDF;
 
@@ -239,6 +242,21 @@ inline double nextFloatDown(double f, int delta = 1) {
     return bitsToFloat(i);
 }
 
+/**
+ * Rounds {v} to the nearest float that is not greater than it
+ */
+inline float roundFloatDown(double v) {
+    float f = float(v);
+    return double(f) > v ? nextFloatDown(f) : f;
+}
+/**
+ * Rounds {v} to the nearest float that is not lesser than it
+ */
+inline float roundFloatUp(double v) {
+    float f = float(v);
+    return double(f) < v ? nextFloatUp(f) : f;
+}
+
 inline Real erf(Real x) {
     // Define constants
     Real a1 = 0.254829592f;
@@ -31,6 +31,14 @@ class Scene {
     const Bounds3f& getWorldBounds() const { return worldBounds; }
     bool intersect(const Ray& ray, SurfaceInteraction* isect) const;
     bool intersectP(const Ray& ray) const;
+    /**
+     * Batched variants of {intersect} and {intersectP} over {n} rays.
+     * Coherent batches such as camera or shadow rays traverse faster
+     * than the same rays one at a time.
+     * @returns The number of rays that hit the scene
+     */
+    int intersect(const Ray* rays, SurfaceInteraction* isects, bool* hits, int n) const;
+    int intersectP(const Ray* rays, bool* occluded, int n) const;
     bool intersectTr(Ray ray, Sampler& sampler, SurfaceInteraction* isect,
                      Spectrum* transmittance) const;
 
@@ -4,36 +4,43 @@
 #include <core/phyr.h>
 #include <core/geometry/shape.h>
 
+#include <memory>
+
 namespace phyr {
 
 class Disk : public Shape {
   public:
     Disk(const Transform* localToWorld, const Transform* worldToLocal,
          Real height, Real radius, Real innerRadius, Real phiMax,
-         bool reverseNormals) :
+         bool reverseNormals, const std::shared_ptr<Texture<Real>>& alphaMask = nullptr) :
         Shape(localToWorld, worldToLocal, reverseNormals),
         height(height), radius(radius), innerRadius(innerRadius),
-        phiMax(radians(clamp(phiMax, 0, 360))) {}
+        phiMax(radians(clamp(phiMax, 0, 360))), alphaMask(alphaMask) {}
 
     // Interface
     Bounds3f objectBounds() const override;
+    bool clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const override;
+    void getClipParameters(std::vector<Real>* params) const override;
     Real surfaceArea() const override;
 
-    bool intersectRay(const Ray& ray, Real* t0, SurfaceInteraction* si,
-                      bool testAlpha = true) const override;
-    bool intersectRay(const Ray& ray, bool testAlpha = true) const override;
+    bool intersectHit(const Ray& ray, SurfaceHit* hit, bool testAlpha = true) const override;
+    void computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                            SurfaceInteraction* si) const override;
 
     // Sampling
     Interaction sample(const Point2f& u, Real* pdf) const override;
 
   private:
     const Real height, radius, innerRadius, phiMax;
+    // Cuts out parts of the surface, if set
+    std::shared_ptr<Texture<Real>> alphaMask;
 };
 
 std::shared_ptr<Disk> createDiskShape(const Transform* o2w, const Transform* w2o,
                                       Real height = 0, Real radius = 1,
                                       Real innerRadius = 0, Real phiMax = 360,
-                                      bool reverseOrientation = true);
+                                      bool reverseOrientation = true,
+                                      const std::shared_ptr<Texture<Real>>& alphaMask = nullptr);
 
 }  // namespace phyr
 
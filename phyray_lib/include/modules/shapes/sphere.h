@@ -12,8 +12,9 @@ class Sphere : public Shape {
   public:
     Sphere(const Transform* localToWorld, const Transform* worldToLocal,
            Real radius, const bool reverseNormals = false,
-           Real zMin = -Infinity, Real zMax = Infinity) :
-           Shape(localToWorld, worldToLocal, reverseNormals) {
+           Real zMin = -Infinity, Real zMax = Infinity,
+           const std::shared_ptr<Texture<Real>>& alphaMask = nullptr) :
+           Shape(localToWorld, worldToLocal, reverseNormals), alphaMask(alphaMask) {
         this->radius = radius;
         // Clip z visibility
         this->zMin = clamp(std::min(zMin, zMax), -radius, radius);
@@ -29,11 +30,13 @@ class Sphere : public Shape {
         return Bounds3f(Point3f(-radius, -radius, zMin),
                         Point3f( radius,  radius, zMax));
     }
+    bool clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const override;
+    void getClipParameters(std::vector<Real>* params) const override;
     Real surfaceArea() const override { return 2 * Pi * radius * (zMax - zMin); }
 
-    bool intersectRay(const Ray& ray, Real* t0, SurfaceInteraction* si,
-                      bool testAlpha = true) const override;
-    bool intersectRay(const Ray& ray, bool testAlpha = true) const override;
+    bool intersectHit(const Ray& ray, SurfaceHit* hit, bool testAlpha = true) const override;
+    void computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                            SurfaceInteraction* si) const override;
 
     // Sampling
     Interaction sample(const Point2f& u, Real* pdf) const override;
@@ -43,15 +46,25 @@ class Sphere : public Shape {
     Real solidAngle(const Point3f& p, int nSamples) const;
 
   private:
+    /**
+     * Refines the point at {t} along the local space ray {lr} onto the
+     * surface, then tests it against the z range and, if {testAlpha}
+     * is set, the alpha mask
+     */
+    bool refineHit(const Ray& ray, const Ray& lr, Real t, bool testAlpha, Point3f* hpt) const;
+
     Real radius;
     Real zMin, zMax;
     Real thetaMin, thetaMax;
+    // Cuts out parts of the surface, if set
+    std::shared_ptr<Texture<Real>> alphaMask;
 };
 
 std::shared_ptr<Shape> createSphereShape(const Transform* o2w,
                                          const Transform* w2o,
                                          bool reverseOrientation,
-                                         Real radius = 1);
+                                         Real radius = 1,
+                                         const std::shared_ptr<Texture<Real>>& alphaMask = nullptr);
 
 } // namespace phyr
 
@@ -0,0 +1,122 @@
+#ifndef PHYRAY_SHAPES_SPHERESET_H
+#define PHYRAY_SHAPES_SPHERESET_H
+
+#include <core/phyr.h>
+#include <core/geometry/shape.h>
+#include <core/accel/bvh.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace phyr {
+
+struct Distribution1D;
+
+// Number of spheres tested at once, matching the SIMD width
+#if defined(__AVX__)
+static constexpr int SpherePacketWidth = 8;
+#else
+static constexpr int SpherePacketWidth = 4;
+#endif
+
+/**
+ * Spheres of a BVH leaf in a structure of arrays layout, so that a ray can
+ * be tested against all of them at once. Unused lanes have NaN centers,
+ * which never pass the test.
+ */
+struct alignas(16) SpherePacket {
+    // Centers indexed as [axis][lane]
+    float center[3][SpherePacketWidth];
+    float radius[SpherePacketWidth];
+};
+
+/**
+ * Aggregate of many spheres, e.g. particles or point clouds, stored as a
+ * single shape. Centers and radii are kept in single precision, in packets
+ * at the leaves of an internal BVH. Rays are culled against a whole packet
+ * with a conservative SIMD test, and only the spheres passing it are
+ * intersected exactly. Costs about 36 bytes per sphere, including the BVH.
+ */
+class SphereSet : public Shape {
+  public:
+    SphereSet(const Transform* localToWorld, const Transform* worldToLocal,
+              bool reverseNormals, int nSpheres, const Point3f* centers, const Real* radii,
+              const std::shared_ptr<Texture<Real>>& alphaMask = nullptr);
+    ~SphereSet();
+
+    // Interface
+    Bounds3f objectBounds() const override { return bounds; }
+    Real surfaceArea() const override { return area; }
+
+    bool intersectRay(const Ray& ray, bool testAlpha = true) const override;
+    /**
+     * Records the index of the sphere hit as the hint for {computeInteraction}
+     */
+    bool intersectHit(const Ray& ray, SurfaceHit* hit, bool testAlpha = true) const override;
+    void computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                            SurfaceInteraction* si) const override;
+
+    /**
+     * Samples a sphere by its surface area, and then a point on it
+     */
+    Interaction sample(const Point2f& u, Real* pdf) const override;
+
+    int getSphereCount() const { return nSpheres; }
+    /**
+     * Returns the bytes held by the spheres and the BVH
+     */
+    size_t getMemory() const;
+
+  private:
+    /**
+     * Builds the BVH over the spheres and stores them in packets at its
+     * leaves. Subtrees are built in parallel.
+     */
+    void constructBVH(const Point3f* centers, const Real* radii);
+
+    /**
+     * Finds the closest hit of {ray} along its local space version {lr}, or
+     * any hit if {hit} is null. {roErr} and {rdErr} bound the error of the
+     * transformed ray.
+     */
+    bool intersectSpheres(const Ray& ray, const Ray& lr, const Vector3f& roErr,
+                          const Vector3f& rdErr, bool testAlpha, SurfaceHit* hit) const;
+    /**
+     * Exact test of {lr} against the sphere in lane {lane} of {packet}. The
+     * far hit is returned in {tFar} when the near one is {tHit}, and is
+     * infinite otherwise.
+     */
+    bool intersectSphere(const SpherePacket& packet, int lane, const Ray& lr,
+                         const Vector3f& roErr, const Vector3f& rdErr,
+                         Real* tHit, Real* tFar) const;
+    /**
+     * Returns true if the hit of {ray} at {t} on sphere {index} is not
+     * cut out by the alpha mask, as {Sphere} tests it
+     */
+    bool testAlphaMask(const Ray& ray, int index, Real t) const;
+
+    const int nSpheres;
+    std::vector<LinearBVHNode> nodes;
+    std::vector<SpherePacket> packets;
+    Bounds3f bounds;
+    Real area = 0;
+    std::shared_ptr<Texture<Real>> alphaMask;
+
+    // Sphere areas for sampling, built on first use
+    mutable std::unique_ptr<Distribution1D> areaDistribution;
+    mutable std::once_flag areaDistributionFlag;
+};
+
+/**
+ * Creates a set of {nSpheres} spheres with the given {centers} and {radii},
+ * all cut out by {alphaMask} if given
+ */
+std::shared_ptr<SphereSet> createSphereSetShape(const Transform* o2w, const Transform* w2o,
+                                                bool reverseOrientation, int nSpheres,
+                                                const Point3f* centers, const Real* radii,
+                                                const std::shared_ptr<Texture<Real>>& alphaMask = nullptr);
+
+}  // namespace phyr
+
+#endif
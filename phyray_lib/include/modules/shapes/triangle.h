@@ -0,0 +1,108 @@
+#ifndef PHYRAY_SHAPES_TRIANGLE_H
+#define PHYRAY_SHAPES_TRIANGLE_H
+
+#include <core/phyr.h>
+#include <core/geometry/shape.h>
+
+#include <memory>
+#include <vector>
+
+namespace phyr {
+
+class TriangleMesh;
+class IndexedMesh;
+
+class Triangle : public Shape {
+  public:
+    Triangle(const Transform* localToWorld, const Transform* worldToLocal,
+             bool reverseNormals, const TriangleMesh* mesh, uint32_t triIdx) :
+        Shape(localToWorld, worldToLocal, reverseNormals), triIdx(triIdx), mesh(mesh) {}
+
+    // Interface
+    Bounds3f objectBounds() const override;
+    Bounds3f worldBounds() const override;
+    bool clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const override;
+    void getClipParameters(std::vector<Real>* params) const override;
+    Real surfaceArea() const override;
+
+    /**
+     * Watertight ray-triangle test. Records the barycentric
+     * coordinates of the hit as the hint for {computeInteraction}.
+     * The alpha mask of the mesh only sees the hit point and its
+     * (u, v) coordinates, so cutouts skip the full interaction.
+     */
+    bool intersectHit(const Ray& ray, SurfaceHit* hit, bool testAlpha = true) const override;
+    void computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                            SurfaceInteraction* si) const override;
+
+    // Sampling
+    Interaction sample(const Point2f& u, Real* pdf) const override;
+
+  private:
+    // Fills the per vertex (u, v) coordinates, or the default ones if the mesh has none
+    void getUVs(Point2f uv[3]) const;
+
+    // Index of the triangle in the mesh. Declared first,
+    // so that it fills the padding after the Shape members
+    const uint32_t triIdx;
+    const TriangleMesh* mesh;
+};
+
+/**
+ * Vertex data shared by all triangles of a mesh, along with the triangles
+ * themselves. Vertices are transformed to world space once on creation,
+ * so rays are tested against the triangles without being transformed.
+ */
+class TriangleMesh {
+  public:
+    TriangleMesh(const Transform* localToWorld, const Transform* worldToLocal,
+                 bool reverseOrientation, int nTriangles, const uint32_t* vertexIndices,
+                 int nVertices, const Point3f* p, const Normal3f* n, const Point2f* uv);
+    // Reads the vertices and indices of a loaded mesh, which may be released afterwards
+    TriangleMesh(const Transform* localToWorld, const Transform* worldToLocal,
+                 bool reverseOrientation, const IndexedMesh& mesh);
+
+    /**
+     * Returns the bytes held by the mesh, including its triangles
+     */
+    size_t getMemory() const;
+
+    const int nTriangles, nVertices;
+    // Three vertex indices per triangle
+    std::unique_ptr<uint32_t[]> vertexIndices;
+    // World space positions, and optionally normals and (u, v) coordinates
+    std::unique_ptr<Point3f[]> p;
+    std::unique_ptr<Normal3f[]> n;
+    std::unique_ptr<Point2f[]> uv;
+    // Cuts out parts of the triangles, if set
+    std::shared_ptr<Texture<Real>> alphaMask;
+
+    std::vector<Triangle> triangles;
+
+  private:
+    void createTriangles(const Transform* localToWorld, const Transform* worldToLocal,
+                         bool reverseOrientation);
+};
+
+/**
+ * Creates the triangles of a mesh with {nTriangles} triangles indexing
+ * {nVertices} vertices. Normals {n}, (u, v) coordinates {uv} and the
+ * {alphaMask} are optional. The returned shapes share ownership of a
+ * single mesh.
+ */
+std::vector<std::shared_ptr<Shape>> createTriangleMeshShapes(
+        const Transform* o2w, const Transform* w2o, bool reverseOrientation,
+        int nTriangles, const uint32_t* vertexIndices, int nVertices,
+        const Point3f* p, const Normal3f* n = nullptr, const Point2f* uv = nullptr,
+        const std::shared_ptr<Texture<Real>>& alphaMask = nullptr);
+
+/**
+ * Creates the triangles of a mesh loaded from a file, see {loadPLYMesh}
+ */
+std::vector<std::shared_ptr<Shape>> createTriangleMeshShapes(
+        const Transform* o2w, const Transform* w2o, bool reverseOrientation,
+        const IndexedMesh& mesh, const std::shared_ptr<Texture<Real>>& alphaMask = nullptr);
+
+}  // namespace phyr
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef PHYRAY_MODULES_CHECKERBOARDTEX_H
+#define PHYRAY_MODULES_CHECKERBOARDTEX_H
+
+#include <cmath>
+#include <memory>
+
+#include <core/material/texture.h>
+#include <core/geometry/interaction.h>
+
+namespace phyr {
+
+template <typename T>
+class CheckerboardTexture : public Texture<T> {
+  public:
+    // Constructor
+    CheckerboardTexture(const std::shared_ptr<Texture<T>>& tex1,
+                        const std::shared_ptr<Texture<T>>& tex2,
+                        Real uScale = 1, Real vScale = 1) :
+        tex1(tex1), tex2(tex2), uScale(uScale), vScale(vScale) {}
+
+    // Interface
+
+    /**
+     * Alternates between {tex1} and {tex2} over the (u, v) coordinates
+     * scaled by {uScale} and {vScale}. Only reads {si.uv}, so it makes a
+     * cheap alpha mask when given constant textures of zero and one.
+     */
+    T evaluate(const SurfaceInteraction& si) const override {
+        int cell = int(std::floor(si.uv.x * uScale)) + int(std::floor(si.uv.y * vScale));
+        return (cell & 1) ? tex2->evaluate(si) : tex1->evaluate(si);
+    }
+
+  private:
+    std::shared_ptr<Texture<T>> tex1, tex2;
+    Real uScale, vScale;
+};
+
+}  // namespace phyr
+
+#endif
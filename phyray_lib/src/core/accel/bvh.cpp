@@ -1,36 +1,173 @@
 #include <core/phyr.h>
 #include <core/phyr_mem.h>
+#include <core/concurrency.h>
 #include <core/accel/bvh.h>
 
+#include <modules/shapes/disk.h>
+#include <modules/shapes/sphere.h>
+#include <modules/shapes/triangle.h>
+
+#include <algorithm>
+#include <queue>
+#include <thread>
+#include <typeinfo>
+
+#include <sys/mman.h>
+
 namespace phyr {
 
-AccelBVH::~AccelBVH() { if (bvhNodes) freeAligned(bvhNodes); }
+AccelBVH::~AccelBVH() { releaseNodes(); }
+
+void AccelBVH::releaseNodes() {
+    if (cacheMapping) {
+        // Nodes point into the mapped cache file
+        munmap(cacheMapping, cacheMappingSize);
+        cacheMapping = nullptr;
+        cacheMappingSize = 0;
+    } else {
+        if (bvhNodes) freeAligned(bvhNodes);
+        if (wide4Nodes) freeAligned(wide4Nodes);
+        if (wide8Nodes) freeAligned(wide8Nodes);
+        if (compressedNodes) freeAligned(compressedNodes);
+    }
+
+    bvhNodes = nullptr;
+    wide4Nodes = nullptr; wide8Nodes = nullptr;
+    compressedNodes = nullptr;
+    totalNodes = totalWideNodes = 0;
+
+    for (int i = 0; i < nLazySubtrees; i++) {
+        LinearBVHNode* nodes = lazySubtrees[i].nodes.load(std::memory_order_acquire);
+        if (nodes) freeAligned(nodes);
+    }
+    lazySubtrees.reset();
+    nLazySubtrees = 0;
+    std::vector<BVHObjectInfo>().swap(lazyObjectInfo);
+}
 
 const int AccelBVH::DEF_MAX_OBJ_PER_NODE = 255;
+const Real AccelBVH::SBVH_REFERENCE_BUDGET = 2;
+
+// Ranges of objects smaller than this are never split by the top level
+// of the parallel builder, and scenes smaller than this are built serially
+constexpr int minParallelSubtreeSize = 1024;
+// Number of objects processed per work item when binning in parallel
+constexpr int parallelChunkSize = 16384;
+// Trees with fewer nodes than this are refitted serially
+constexpr int refitSubtreeSize = 1024;
+// Ranges of objects smaller than this are left to be built on demand
+// by lazy builds, which takes about a millisecond for each
+constexpr int lazySubtreeSize = 4096;
 
 void AccelBVH::constructBVH() {
-    if (objectList.size() == 0) return;
+    if (sourceObjects.size() == 0) return;
 
     // Initiate object info list
-    size_t sz = objectList.size();
+    size_t sz = sourceObjects.size();
     std::vector<BVHObjectInfo> objectInfoList(sz);
 
     for (size_t i = 0; i < sz; i++)
-        objectInfoList[i] = { i, objectList[i]->worldBounds() };
+        objectInfoList[i] = { i, sourceObjects[i]->worldBounds() };
 
     // Create a BVH Tree from the object info list
     int nodeCount = 0;
     // Memory pool with a block size of 1MB
     MemoryPool pool(1024 * 1024);
-    // Stores the ordered permutation of objectList as defined
+    // Stores the ordered permutation of sourceObjects as defined
     // by the recursive BVH algorithm
-    std::vector<std::shared_ptr<Object>> orderedObjectList;
+    std::vector<std::shared_ptr<Object>> orderedObjectList(sz);
 
-    // Recursively build the BVH Tree
-    LOG_INFO("Computing BVH tree...");
-    BVHTreeNode* root = constructBVHRecursive(pool, objectInfoList, 0, sz,
-                                              &nodeCount, orderedObjectList);
-    objectList.swap(orderedObjectList);
+    BVHTreeNode* root = nullptr;
+    // Flattened subtrees built concurrently by the parallel builder
+    std::vector<std::vector<LinearBVHNode>> subtreeNodes;
+
+    int nThreads = maxThreadIndex();
+    if (lazyBuild) {
+        LOG_INFO("Computing top levels of lazy BVH tree...");
+        std::vector<BVHTreeNode*> subtrees;
+        root = constructBVHTopLevel(pool, objectInfoList, 0, sz, lazySubtreeSize,
+                                    &nodeCount, subtrees);
+
+        // Placeholders are flattened into nodes of their own, bounding their objects
+        nLazySubtrees = subtrees.size();
+        lazySubtrees.reset(new LazySubtree[nLazySubtrees]);
+        for (int i = 0; i < nLazySubtrees; i++) {
+            BVHTreeNode* placeholder = subtrees[i];
+            int end = placeholder->startIdx + placeholder->nObjects;
+            placeholder->bounds = objectInfoList[placeholder->startIdx].bounds;
+            for (int j = placeholder->startIdx + 1; j < end; j++)
+                placeholder->bounds = unionBounds(placeholder->bounds, objectInfoList[j].bounds);
+
+            LazySubtree& subtree = lazySubtrees[i];
+            subtree.startIdx = placeholder->startIdx;
+            subtree.nObjects = placeholder->nObjects;
+            subtree.claimed = false;
+            subtree.nodes = nullptr;
+            subtree.nNodes = 0;
+        }
+        nodeCount += nLazySubtrees;
+        LOG_INFO_FMT("Lazy BVH subtrees: %d", nLazySubtrees);
+    } else if (tspMethod == TreeSplitMethod::HLBVH) {
+        LOG_INFO("Computing HLBVH tree...");
+        root = constructHLBVH(pool, objectInfoList, &nodeCount, orderedObjectList);
+    } else if (tspMethod == TreeSplitMethod::SBVH) {
+        LOG_INFO("Computing SBVH tree...");
+        // Leaves append their references, as objects may be referenced more than once
+        orderedObjectList.clear();
+        int refBudget = int(sz * (SBVH_REFERENCE_BUDGET - 1));
+        Bounds3f rootBound = objectInfoList[0].bounds;
+        for (size_t i = 1; i < sz; i++) rootBound = unionBounds(rootBound, objectInfoList[i].bounds);
+
+        root = constructSBVHRecursive(pool, objectInfoList, rootBound.surfaceArea(),
+                                      &refBudget, &nodeCount, orderedObjectList);
+        LOG_INFO_FMT("SBVH object references: %d", int(orderedObjectList.size()));
+    } else if (nThreads > 1 && sz >= 4 * minParallelSubtreeSize) {
+        LOG_INFO_FMT("Computing BVH tree with %d threads...", nThreads);
+        // Aim for several subtrees per thread to even out the load
+        int subtreeSize = std::max(minParallelSubtreeSize, int(sz / (8 * nThreads)));
+
+        std::vector<BVHTreeNode*> subtrees;
+        root = constructBVHTopLevel(pool, objectInfoList, 0, sz, subtreeSize,
+                                    &nodeCount, subtrees);
+
+        // Hand out the largest subtrees first
+        std::vector<int> order(subtrees.size());
+        for (size_t i = 0; i < order.size(); i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](int a, int b) {
+            return subtrees[a]->nObjects > subtrees[b]->nObjects;
+        });
+
+        subtreeNodes.resize(subtrees.size());
+        std::vector<int> subtreeNodeCount(subtrees.size(), 0);
+        ParallelFor([&](int64_t i) {
+            int idx = order[i];
+            const BVHTreeNode* placeholder = subtrees[idx];
+            MemoryPool subtreePool(256 * 1024);
+
+            int startIdx = placeholder->startIdx;
+            BVHTreeNode* subtreeRoot =
+                    constructBVHRecursive(subtreePool, objectInfoList, startIdx,
+                                          startIdx + placeholder->nObjects,
+                                          &subtreeNodeCount[idx], orderedObjectList);
+
+            // Flatten locally; the nodes are spliced into {bvhNodes} later
+            int linearIdx = 0;
+            subtreeNodes[idx].resize(subtreeNodeCount[idx]);
+            flattenBVH(subtreeRoot, subtreeNodes[idx].data(), &linearIdx);
+        }, subtrees.size());
+
+        for (int count : subtreeNodeCount) nodeCount += count;
+    } else {
+        // Recursively build the BVH Tree
+        LOG_INFO("Computing BVH tree...");
+        root = constructBVHRecursive(pool, objectInfoList, 0, sz,
+                                     &nodeCount, orderedObjectList);
+    }
+
+    // Lazy subtrees reference the objects in their original order
+    if (lazyBuild) lazyObjectInfo.swap(objectInfoList);
+    else objectList.swap(orderedObjectList);
+    sceneBounds = root->bounds;
     LOG_INFO_FMT("Computed BVH nodes: %d", nodeCount);
 
     // Compute linear BVH by DFS on {root}
@@ -42,15 +179,307 @@ void AccelBVH::constructBVH() {
 
     // Transform BVH tree to a BVH linear array
     LOG_INFO("Flattening BVH nodes...");
-    flattenBVH(root, &linearIdx);
+    flattenBVH(root, bvhNodes, &linearIdx, lazyBuild ? nullptr : &subtreeNodes);
     ASSERT(linearIdx == nodeCount);
+    totalNodes = nodeCount;
+    LOG_INFO_FMT("BVH node memory: %d bytes", int(nodeCount * sizeof(LinearBVHNode)));
+
+    if (lazyBuild) {
+        // Leaves only exist in the subtrees, which group their own objects
+        sahCost = builtSAHCost = computeSAHCost();
+        return;
+    }
+
+    // Group leaves by object type while the binary nodes are still around
+    createLeafObjects(true);
+
+    if (layout == BVHLayout::Wide4) wide4Nodes = createWideBVH<4>();
+    else if (layout == BVHLayout::Wide8) wide8Nodes = createWideBVH<8>();
+    else if (layout == BVHLayout::Compressed) compressedNodes = createCompressedBVH();
+
+    // Binary nodes are not traversed once collapsed
+    if (layout != BVHLayout::Binary) {
+        freeAligned(bvhNodes);
+        bvhNodes = nullptr;
+    } else {
+        reorderNodes();
+    }
+
+    sahCost = builtSAHCost = computeSAHCost();
+    LOG_INFO_FMT("BVH SAH cost: %f", sahCost);
+}
+
+/**
+ * Resolves the shape of {object} if leaves can test it directly
+ */
+static LeafObject resolveLeafObject(const Object* object) {
+    LeafObject leaf = { object, object, LeafObjectType::Object };
+    const GeometricObject* geometric = dynamic_cast<const GeometricObject*>(object);
+    if (!geometric) return leaf;
+
+    // Exact types only, as subclasses may override the intersection tests
+    const Shape* shape = geometric->getShape();
+    const std::type_info& type = typeid(*shape);
+    if (type == typeid(Triangle)) leaf = { shape, object, LeafObjectType::Triangle };
+    else if (type == typeid(Sphere)) leaf = { shape, object, LeafObjectType::Sphere };
+    else if (type == typeid(Disk)) leaf = { shape, object, LeafObjectType::Disk };
+    return leaf;
+}
+
+void AccelBVH::createLeafObjects(bool groupLeaves) {
+    int nObjects = objectList.size();
+    int nChunks = (nObjects + parallelChunkSize - 1) / parallelChunkSize;
+    leafObjects.resize(nObjects);
+    ParallelFor([&](int64_t c) {
+        int s = c * parallelChunkSize, e = std::min(s + parallelChunkSize, nObjects);
+        for (int i = s; i < e; i++) leafObjects[i] = resolveLeafObject(objectList[i].get());
+    }, nChunks);
+    if (!groupLeaves) return;
+
+    // Insertion sort the objects of each leaf by type, leaves being small
+    int nNodeChunks = (totalNodes + parallelChunkSize - 1) / parallelChunkSize;
+    ParallelFor([&](int64_t c) {
+        int s = c * parallelChunkSize, e = std::min(s + parallelChunkSize, totalNodes);
+        for (int n = s; n < e; n++) {
+            int start = bvhNodes[n].objectStartIdx, end = start + bvhNodes[n].nObjects;
+            if (bvhNodes[n].nObjects < 2) continue;
+            for (int i = start + 1; i < end; i++) {
+                LeafObject leaf = leafObjects[i];
+                std::shared_ptr<Object> object = std::move(objectList[i]);
+                int j = i;
+                for (; j > start && leafObjects[j - 1].type > leaf.type; j--) {
+                    leafObjects[j] = leafObjects[j - 1];
+                    objectList[j] = std::move(objectList[j - 1]);
+                }
+                leafObjects[j] = leaf;
+                objectList[j] = std::move(object);
+            }
+        }
+    }, nNodeChunks);
+}
+
+bool AccelBVH::refit(Real rebuildThreshold) {
+    if (objectList.empty()) return false;
+
+    // Refresh bounds that objects cache, e.g. those of instances over
+    // refitted BVHs. The source objects are not duplicated by spatial
+    // splits, so each is updated by one thread only.
+    int nSources = sourceObjects.size();
+    ParallelFor([&](int64_t c) {
+        int s = c * parallelChunkSize, e = std::min(s + parallelChunkSize, nSources);
+        for (int i = s; i < e; i++) sourceObjects[i]->updateBounds();
+    }, (nSources + parallelChunkSize - 1) / parallelChunkSize);
+
+    if (lazyBuild) {
+        // Rebuilding the top levels is about as cheap as refitting them
+        releaseNodes();
+        constructBVH();
+        return true;
+    }
+
+    // Gather the object bounds in parallel, as these may be costly to compute
+    int nObjects = objectList.size();
+    int nChunks = (nObjects + parallelChunkSize - 1) / parallelChunkSize;
+    std::vector<Bounds3f> objectBounds(nObjects), chunkBounds(nChunks);
+    ParallelFor([&](int64_t c) {
+        int s = c * parallelChunkSize, e = std::min(s + parallelChunkSize, nObjects);
+        for (int i = s; i < e; i++) {
+            objectBounds[i] = objectList[i]->worldBounds();
+            chunkBounds[c] = i == s ? objectBounds[i] : unionBounds(chunkBounds[c], objectBounds[i]);
+        }
+    }, nChunks);
+
+    sceneBounds = chunkBounds[0];
+    for (int c = 1; c < nChunks; c++) sceneBounds = unionBounds(sceneBounds, chunkBounds[c]);
+
+    if (wide4Nodes) refitWideBVH(wide4Nodes, objectBounds);
+    else if (wide8Nodes) refitWideBVH(wide8Nodes, objectBounds);
+    else if (compressedNodes) refitWideBVH(compressedNodes, objectBounds);
+    else refitBinaryBVH(objectBounds);
+
+    sahCost = computeSAHCost();
+    if (sahCost <= rebuildThreshold * builtSAHCost) return false;
+
+    LOG_INFO_FMT("BVH SAH cost grew from %f to %f, rebuilding...", builtSAHCost, sahCost);
+    releaseNodes();
+    constructBVH();
+    return true;
+}
+
+/**
+ * Refits the nodes of a tree stored with children after their parent, with
+ * {refitNode} refitting a node whose children are done and {forChildren}
+ * calling a function on the interior child nodes of a node. Subtrees below a
+ * cut through the top levels are refitted in parallel, each in post-order,
+ * and then the nodes above the cut, deepest first.
+ */
+template <typename RefitNode, typename ForChildren>
+static void refitTree(int nNodes, const RefitNode& refitNode, const ForChildren& forChildren) {
+    // Aim for several subtrees per thread to even out their sizes
+    size_t nSubtrees = nNodes < refitSubtreeSize ? 1 : 8 * maxThreadIndex();
+    std::vector<int> topNodes, subtreeRoots(1, 0), nextRoots;
+    while (subtreeRoots.size() < nSubtrees) {
+        nextRoots.clear();
+        bool expanded = false;
+        for (int i : subtreeRoots) {
+            size_t nRoots = nextRoots.size();
+            forChildren(i, [&](int child) { nextRoots.push_back(child); });
+            if (nextRoots.size() == nRoots) {
+                // Leaves have nothing below them to split
+                nextRoots.push_back(i);
+            } else {
+                topNodes.push_back(i);
+                expanded = true;
+            }
+        }
+        if (!expanded) break;
+        subtreeRoots.swap(nextRoots);
+    }
+
+    std::function<void(int)> refitSubtree = [&](int i) {
+        forChildren(i, refitSubtree);
+        refitNode(i);
+    };
+    ParallelFor([&](int64_t r) { refitSubtree(subtreeRoots[r]); }, subtreeRoots.size());
+    for (auto it = topNodes.rbegin(); it != topNodes.rend(); ++it) refitNode(*it);
+}
+
+void AccelBVH::refitBinaryBVH(const std::vector<Bounds3f>& objectBounds) {
+    refitTree(totalNodes, [&](int i) {
+        LinearBVHNode* node = &bvhNodes[i];
+        if (node->nObjects > 0) {
+            Bounds3f b = objectBounds[node->objectStartIdx];
+            for (int j = 1; j < node->nObjects; j++)
+                b = unionBounds(b, objectBounds[node->objectStartIdx + j]);
+            node->setBounds(b);
+        } else {
+            node->setBounds(unionBounds(bvhNodes[i + 1].getBounds(),
+                                        bvhNodes[node->secondChildIdx].getBounds()));
+        }
+    }, [&](int i, const std::function<void(int)>& visit) {
+        if (bvhNodes[i].nObjects > 0) return;
+        visit(i + 1);
+        visit(bvhNodes[i].secondChildIdx);
+    });
+}
+
+template <typename NodeType>
+void AccelBVH::refitWideBVH(NodeType* nodes, const std::vector<Bounds3f>& objectBounds) {
+    constexpr int N = NodeType::width;
+
+    // Wide nodes only store the bounds of their children
+    std::vector<Bounds3f> nodeBounds(totalWideNodes);
+    refitTree(totalWideNodes, [&](int i) {
+        NodeType& node = nodes[i];
+        Bounds3f childBounds[N];
+        bool first = true;
+
+        for (int lane = 0; lane < N; lane++) {
+            int idx = node.childIdx[lane];
+            if (idx < 0) continue;
+
+            if (node.nObjects[lane] > 0) {
+                childBounds[lane] = objectBounds[idx];
+                for (int j = 1; j < node.nObjects[lane]; j++)
+                    childBounds[lane] = unionBounds(childBounds[lane], objectBounds[idx + j]);
+            } else {
+                childBounds[lane] = nodeBounds[idx];
+            }
+
+            nodeBounds[i] = first ? childBounds[lane] : unionBounds(nodeBounds[i], childBounds[lane]);
+            first = false;
+        }
+
+        node.setChildBounds(childBounds);
+    }, [&](int i, const std::function<void(int)>& visit) {
+        for (int lane = 0; lane < N; lane++)
+            if (nodes[i].childIdx[lane] >= 0 && nodes[i].nObjects[lane] == 0)
+                visit(nodes[i].childIdx[lane]);
+    });
+}
+
+// Assumed cost of intersecting an object relative to visiting a node,
+// matching the SAH used for partitioning
+constexpr Real sahTraversalCost = 1;
+
+Real AccelBVH::computeSAHCost() const {
+    if (wide4Nodes) return computeWideSAHCost(wide4Nodes);
+    if (wide8Nodes) return computeWideSAHCost(wide8Nodes);
+    if (compressedNodes) return computeWideSAHCost(compressedNodes);
+    if (!bvhNodes) return 0;
+
+    Real rootArea = bvhNodes[0].getBounds().surfaceArea(), cost = 0;
+    if (rootArea <= 0) return 0;
+    for (int i = 0; i < totalNodes; i++) {
+        const LinearBVHNode* node = &bvhNodes[i];
+        Real area = node->getBounds().surfaceArea();
+        cost += area * (node->nObjects > 0 ? node->nObjects : sahTraversalCost);
+    }
+    return cost / rootArea;
+}
+
+template <typename NodeType>
+Real AccelBVH::computeWideSAHCost(const NodeType* nodes) const {
+    constexpr int N = NodeType::width;
+
+    Real rootArea = 0, cost = 0;
+    for (int i = 0; i < totalWideNodes; i++) {
+        Bounds3f nodeBounds;
+        bool first = true;
+        for (int lane = 0; lane < N; lane++) {
+            if (nodes[i].childIdx[lane] < 0) continue;
+            Bounds3f b = nodes[i].getChildBounds(lane);
+            nodeBounds = first ? b : unionBounds(nodeBounds, b);
+            first = false;
+            // Leaves are stored in the lanes of their parent
+            if (nodes[i].nObjects[lane] > 0) cost += b.surfaceArea() * nodes[i].nObjects[lane];
+        }
+
+        cost += nodeBounds.surfaceArea() * sahTraversalCost;
+        if (i == 0) rootArea = nodeBounds.surfaceArea();
+    }
+    return rootArea > 0 ? cost / rootArea : 0;
 }
 
 constexpr int nBins = 12;
-struct BinInfo { int freq; Bounds3f bounds; };
+struct BinInfo { int freq = 0; Bounds3f bounds; };
 
 Bounds3f AccelBVH::worldBounds() const {
-    return bvhNodes ? bvhNodes[0].bounds : Bounds3f();
+    return totalNodes > 0 ? sceneBounds : Bounds3f();
+}
+
+/**
+ * Computes the bounds of the objects in [{startIdx}, {end}) as well as
+ * the bounds of their centroids, splitting the work over the worker
+ * threads if {parallel} is true
+ */
+static void computeRangeBounds(const std::vector<BVHObjectInfo>& objectInfoList,
+                               int startIdx, int end, Bounds3f* nodeBound,
+                               Bounds3f* centroidBounds, bool parallel) {
+    int nChunks = parallel ? (end - startIdx + parallelChunkSize - 1) / parallelChunkSize : 1;
+    std::vector<Bounds3f> chunkBounds(nChunks), chunkCentroidBounds(nChunks);
+
+    auto boundChunk = [&](int64_t c) {
+        int s = parallel ? startIdx + c * parallelChunkSize : startIdx;
+        int e = parallel ? std::min(s + parallelChunkSize, end) : end;
+
+        Bounds3f b = objectInfoList[s].bounds;
+        Bounds3f cb(objectInfoList[s].centroid);
+        for (int i = s + 1; i < e; i++) {
+            b = unionBounds(b, objectInfoList[i].bounds);
+            cb = unionBounds(cb, objectInfoList[i].centroid);
+        }
+        chunkBounds[c] = b; chunkCentroidBounds[c] = cb;
+    };
+
+    if (nChunks > 1) ParallelFor(boundChunk, nChunks);
+    else boundChunk(0);
+
+    *nodeBound = chunkBounds[0]; *centroidBounds = chunkCentroidBounds[0];
+    for (int c = 1; c < nChunks; c++) {
+        *nodeBound = unionBounds(*nodeBound, chunkBounds[c]);
+        *centroidBounds = unionBounds(*centroidBounds, chunkCentroidBounds[c]);
+    }
 }
 
 BVHTreeNode*
@@ -68,113 +497,643 @@ AccelBVH::constructBVHRecursive(MemoryPool& pool, std::vector<BVHObjectInfo>& ob
     for (int i = startIdx + 1; i < end; i++)
         nodeBound = unionBounds(nodeBound, objectInfoList[i].bounds);
 
-#define CREATE_LEAF_NODE() \
-    int offset = orderedObjectList.size(); \
-    for (int i = startIdx; i < end; i++) { \
-        int idx = objectInfoList[i].objectIdx; \
-        orderedObjectList.push_back(objectList[idx]); \
-    } \
-    node->createLeafNode(offset, range, nodeBound); \
-    return node;
-
-    int range = end - startIdx;
-    if (range == 1) {
-        CREATE_LEAF_NODE();
-    } else {
+    int range = end - startIdx, maxDim = 0, mid = -1;
+    if (range > 1) {
         Bounds3f centroidBounds(objectInfoList[startIdx].centroid);
         for (int i = startIdx + 1; i < end; i++)
             centroidBounds = unionBounds(centroidBounds, objectInfoList[i].centroid);
-        int maxDim = centroidBounds.maximumExtent();
+        maxDim = centroidBounds.maximumExtent();
 
-        // Check if all centroids lie at the same point
-        if (centroidBounds.pMin[maxDim] == centroidBounds.pMax[maxDim]) {
-            CREATE_LEAF_NODE();
-        } else {
-            int mid = (startIdx + end) / 2;
-
-            // @todo: Support other tree split methods
-            // Partition primitives using SAH
-            if (range <= 2) {
-                // Partition into equally sized subsets
-                std::nth_element(&objectInfoList[startIdx], &objectInfoList[mid],
-                                 &objectInfoList[end-1] + 1,
-                                 [maxDim](const BVHObjectInfo& a, const BVHObjectInfo& b) {
-                                     return a.centroid[maxDim] < b.centroid[maxDim];
-                                 });
+        mid = partitionObjects(objectInfoList, startIdx, end, nodeBound,
+                               centroidBounds, maxDim, false);
+    }
+
+    if (mid < 0) {
+        // Since subtrees are built over contiguous object ranges in
+        // depth first order, the objects of a leaf retain their range
+        // in the ordered object list
+        for (int i = startIdx; i < end; i++)
+            orderedObjectList[i] = sourceObjects[objectInfoList[i].objectIdx];
+        node->createLeafNode(startIdx, range, nodeBound);
+    } else {
+        BVHTreeNode* lc = constructBVHRecursive(pool, objectInfoList, startIdx, mid,
+                                                nodeCount, orderedObjectList);
+        BVHTreeNode* rc = constructBVHRecursive(pool, objectInfoList, mid, end,
+                                                nodeCount, orderedObjectList);
+        node->createInteriorNode(maxDim, lc, rc);
+    }
+
+    return node;
+}
+
+BVHTreeNode*
+AccelBVH::constructBVHTopLevel(MemoryPool& pool, std::vector<BVHObjectInfo>& objectInfoList,
+                               int startIdx, int end, int subtreeSize, int* nodeCount,
+                               std::vector<BVHTreeNode*>& subtrees) const {
+    BVHTreeNode* node = pool.alloc<BVHTreeNode>();
+
+    int mid = -1, maxDim = 0;
+    Bounds3f nodeBound, centroidBounds;
+    if (end - startIdx >= subtreeSize) {
+        computeRangeBounds(objectInfoList, startIdx, end, &nodeBound, &centroidBounds, true);
+        maxDim = centroidBounds.maximumExtent();
+        mid = partitionObjects(objectInfoList, startIdx, end, nodeBound,
+                               centroidBounds, maxDim, true);
+    }
+
+    // Leave small ranges, as well as the ones that end up
+    // in a single leaf, to the serial builder
+    if (mid < 0) {
+        node->createSubtreeNode(subtrees.size(), startIdx, end);
+        subtrees.push_back(node);
+        return node;
+    }
+
+    (*nodeCount)++;
+    BVHTreeNode* lc = constructBVHTopLevel(pool, objectInfoList, startIdx, mid,
+                                           subtreeSize, nodeCount, subtrees);
+    BVHTreeNode* rc = constructBVHTopLevel(pool, objectInfoList, mid, end,
+                                           subtreeSize, nodeCount, subtrees);
+    node->createInteriorNode(maxDim, lc, rc);
+    // Subtree placeholders have no bounds yet, use the ones computed above
+    node->bounds = nodeBound;
+
+    return node;
+}
+
+// Spatial splits are only tried where the children of the best object split
+// overlap by at least this fraction of the root surface area
+constexpr Real sbvhMinOverlap = 1e-5;
+
+/**
+ * Finds the SAH optimal partition of {refs} by their centroids along {dim}.
+ * References in the bins up to {splitBin} form the left child.
+ * @returns false if the centroids can not be separated
+ */
+static bool findObjectSplit(const std::vector<BVHObjectInfo>& refs, const Bounds3f& nodeBound,
+                            const Bounds3f& centroidBounds, int dim, Real* cost,
+                            int* splitBin, Bounds3f* leftBound, Bounds3f* rightBound) {
+    if (centroidBounds.pMin[dim] == centroidBounds.pMax[dim]) return false;
+
+    BinInfo bins[nBins];
+    for (const BVHObjectInfo& ref : refs) {
+        int bidx = centroidBounds.offset(ref.centroid)[dim] * nBins;
+        if (bidx == nBins) bidx--;
+        bins[bidx].bounds = bins[bidx].freq++ == 0 ? ref.bounds
+                                                   : unionBounds(bins[bidx].bounds, ref.bounds);
+    }
+
+    // Sweep from the right to get the bounds of all right hand sides
+    Bounds3f rightBounds[nBins];
+    int rightFreq[nBins] = {};
+    for (int i = nBins - 1; i > 0; i--) {
+        rightFreq[i] = bins[i].freq + (i < nBins - 1 ? rightFreq[i + 1] : 0);
+        rightBounds[i] = i == nBins - 1 || rightFreq[i + 1] == 0 ? bins[i].bounds
+                         : bins[i].freq == 0 ? rightBounds[i + 1]
+                         : unionBounds(bins[i].bounds, rightBounds[i + 1]);
+    }
+
+    *cost = MaxReal;
+    Bounds3f bl;
+    int leftFreq = 0;
+    Real nodeBoundSurfaceArea = nodeBound.surfaceArea();
+    for (int i = 0; i < nBins - 1; i++) {
+        if (bins[i].freq > 0) bl = leftFreq == 0 ? bins[i].bounds : unionBounds(bl, bins[i].bounds);
+        leftFreq += bins[i].freq;
+        if (leftFreq == 0 || rightFreq[i + 1] == 0) continue;
+
+        Real c = 1 + (leftFreq * bl.surfaceArea() +
+                      rightFreq[i + 1] * rightBounds[i + 1].surfaceArea()) / nodeBoundSurfaceArea;
+        if (c < *cost) {
+            *cost = c; *splitBin = i;
+            *leftBound = bl; *rightBound = rightBounds[i + 1];
+        }
+    }
+
+    return *cost < MaxReal;
+}
+
+bool AccelBVH::findSpatialSplit(const std::vector<BVHObjectInfo>& refs, const Bounds3f& nodeBound,
+                                int dim, Real* cost, Real* splitPos) const {
+    Real pMin = nodeBound.pMin[dim], binWidth = (nodeBound.pMax[dim] - pMin) / nBins;
+    if (binWidth <= 0) return false;
+
+    // References are counted in the bins they start and end in,
+    // and their clipped bounds are added to every bin they span
+    BinInfo bins[nBins];
+    int entries[nBins] = {}, exits[nBins] = {};
+    auto binIndex = [&](Real p) {
+        return std::min(std::max(int((p - pMin) / binWidth), 0), nBins - 1);
+    };
+
+    for (const BVHObjectInfo& ref : refs) {
+        int b0 = binIndex(ref.bounds.pMin[dim]), b1 = binIndex(ref.bounds.pMax[dim]);
+        entries[b0]++; exits[b1]++;
+
+        for (int b = b0; b <= b1; b++) {
+            Bounds3f clipped = ref.bounds;
+            if (b0 != b1) {
+                Bounds3f slab = ref.bounds;
+                slab.pMin[dim] = std::max(slab.pMin[dim], pMin + b * binWidth);
+                slab.pMax[dim] = std::min(slab.pMax[dim], pMin + (b + 1) * binWidth);
+                if (!sourceObjects[ref.objectIdx]->clipWorldBounds(slab, &clipped)) continue;
+            }
+            bins[b].bounds = bins[b].freq++ == 0 ? clipped : unionBounds(bins[b].bounds, clipped);
+        }
+    }
+
+    Bounds3f rightBounds[nBins];
+    bool rightEmpty[nBins];
+    int rightCount[nBins] = {};
+    for (int i = nBins - 1; i > 0; i--) {
+        bool nextEmpty = i == nBins - 1 || rightEmpty[i + 1];
+        rightCount[i] = exits[i] + (i < nBins - 1 ? rightCount[i + 1] : 0);
+        rightEmpty[i] = bins[i].freq == 0 && nextEmpty;
+        rightBounds[i] = nextEmpty ? bins[i].bounds
+                         : bins[i].freq == 0 ? rightBounds[i + 1]
+                         : unionBounds(bins[i].bounds, rightBounds[i + 1]);
+    }
+
+    *cost = MaxReal;
+    Bounds3f bl;
+    bool leftEmpty = true;
+    int leftCount = 0;
+    Real nodeBoundSurfaceArea = nodeBound.surfaceArea();
+    for (int i = 0; i < nBins - 1; i++) {
+        if (bins[i].freq > 0) {
+            bl = leftEmpty ? bins[i].bounds : unionBounds(bl, bins[i].bounds);
+            leftEmpty = false;
+        }
+        leftCount += entries[i];
+        if (leftEmpty || rightEmpty[i + 1]) continue;
+
+        Real c = 1 + (leftCount * bl.surfaceArea() +
+                      rightCount[i + 1] * rightBounds[i + 1].surfaceArea()) / nodeBoundSurfaceArea;
+        if (c < *cost) { *cost = c; *splitPos = pMin + (i + 1) * binWidth; }
+    }
+
+    return *cost < MaxReal;
+}
+
+void AccelBVH::splitReferences(const std::vector<BVHObjectInfo>& refs, int dim, Real splitPos,
+                               std::vector<BVHObjectInfo>& left,
+                               std::vector<BVHObjectInfo>& right) const {
+    for (const BVHObjectInfo& ref : refs) {
+        if (ref.bounds.pMax[dim] <= splitPos) { left.push_back(ref); continue; }
+        if (ref.bounds.pMin[dim] >= splitPos) { right.push_back(ref); continue; }
+
+        // Clip straddling references to either side of the plane
+        Bounds3f leftClip = ref.bounds, rightClip = ref.bounds, clipped;
+        leftClip.pMax[dim] = rightClip.pMin[dim] = splitPos;
+        const Object* object = sourceObjects[ref.objectIdx].get();
+
+        bool inLeft = object->clipWorldBounds(leftClip, &clipped);
+        if (inLeft) left.push_back(BVHObjectInfo(ref.objectIdx, clipped));
+        bool inRight = object->clipWorldBounds(rightClip, &clipped);
+        if (inRight) right.push_back(BVHObjectInfo(ref.objectIdx, clipped));
+
+        // Never drop a reference due to rounding in the clipping
+        if (!inLeft && !inRight) left.push_back(ref);
+    }
+}
+
+BVHTreeNode*
+AccelBVH::constructSBVHRecursive(MemoryPool& pool, std::vector<BVHObjectInfo>& refs,
+                                 Real rootSurfaceArea, int* refBudget, int* nodeCount,
+                                 std::vector<std::shared_ptr<Object>>& orderedObjectList) const {
+    (*nodeCount)++;
+    BVHTreeNode* node = pool.alloc<BVHTreeNode>();
+
+    int range = refs.size(), maxDim = 0;
+    Bounds3f nodeBound, centroidBounds;
+    computeRangeBounds(refs, 0, range, &nodeBound, &centroidBounds, false);
+
+    Real objectCost = MaxReal, spatialCost = MaxReal, splitPos = 0;
+    int splitBin = 0, spatialDim = nodeBound.maximumExtent();
+    if (range > 1) {
+        maxDim = centroidBounds.maximumExtent();
+        Bounds3f bl, br;
+        bool objectSplit = findObjectSplit(refs, nodeBound, centroidBounds, maxDim,
+                                           &objectCost, &splitBin, &bl, &br);
+
+        // Try a spatial split if the best object split leaves the children overlapping
+        Real overlapArea = objectSplit && overlaps(bl, br) ? intersect(bl, br).surfaceArea() : 0;
+        if (*refBudget > 0 && (!objectSplit || overlapArea > sbvhMinOverlap * rootSurfaceArea))
+            findSpatialSplit(refs, nodeBound, spatialDim, &spatialCost, &splitPos);
+    }
+
+    // Since cost of intersection is 1, cost of a leaf is {range}
+    Real minCost = std::min(objectCost, spatialCost);
+    std::vector<BVHObjectInfo> left, right;
+    if (minCost < MaxReal && (range > maxObjectsPerNode || minCost < range)) {
+        if (spatialCost < objectCost) {
+            splitReferences(refs, spatialDim, splitPos, left, right);
+            int duplicates = left.size() + right.size() - range;
+
+            // Fall back to the object split if over budget or if nothing got separated
+            if (duplicates > *refBudget || left.empty() || right.empty() ||
+                (int(left.size()) == range && int(right.size()) == range)) {
+                left.clear(); right.clear();
             } else {
-                BinInfo bins[nBins];
-                // Initialize bins
-                for (int i = startIdx; i < end; i++) {
-                    int bidx = centroidBounds.offset(objectInfoList[i].centroid)[maxDim] * nBins;
-                    if (bidx == nBins) bidx--; bins[bidx].freq++;
-
-                    if (bins[bidx].freq == 1)
-                        bins[bidx].bounds = objectInfoList[i].bounds;
-                    else
-                        bins[bidx].bounds = unionBounds(bins[bidx].bounds, objectInfoList[i].bounds);
-                }
+                *refBudget -= duplicates;
+                maxDim = spatialDim;
+            }
+        }
 
-                // Compute optimum split
-                Real cost, minCost = MaxReal, splitIdx = 0;
-                Real nodeBoundSurfaceArea = nodeBound.surfaceArea();
+        if (left.empty() && objectCost < MaxReal) {
+            for (const BVHObjectInfo& ref : refs) {
+                int bidx = centroidBounds.offset(ref.centroid)[maxDim] * nBins;
+                if (bidx == nBins) bidx--;
+                (bidx <= splitBin ? left : right).push_back(ref);
+            }
+        }
+    }
 
-                /* @todo Optimize the O(n^2) runtime */
-                for (int i = 0; i < nBins - 1; i++) {
-                    int f0 = 0, f1 = 0, j;
+    if (left.empty()) {
+        // Leaves are created in depth first order, and append their references
+        node->createLeafNode(orderedObjectList.size(), range, nodeBound);
+        for (const BVHObjectInfo& ref : refs)
+            orderedObjectList.push_back(sourceObjects[ref.objectIdx]);
+        return node;
+    }
 
-                    Bounds3f bl = bins[0].bounds;
-                    for (j = 1; j <= i; j++) {
-                        bl = unionBounds(bl, bins[j].bounds);
-                        f0 += bins[j].freq;
-                    }
+    // Release the references of this node before descending
+    std::vector<BVHObjectInfo>().swap(refs);
+    BVHTreeNode* lc = constructSBVHRecursive(pool, left, rootSurfaceArea, refBudget,
+                                             nodeCount, orderedObjectList);
+    BVHTreeNode* rc = constructSBVHRecursive(pool, right, rootSurfaceArea, refBudget,
+                                             nodeCount, orderedObjectList);
+    node->createInteriorNode(maxDim, lc, rc);
 
-                    Bounds3f br = bins[i + 1].bounds;
-                    for (j = i + 2; j < nBins; j++) {
-                        br = unionBounds(br, bins[j].bounds);
-                        f1 += bins[j].freq;
-                    }
+    return node;
+}
 
-                    // Assumed cost of intersection = 1; cost of traversal = 1/8
-                    cost = 1 + (f0 * bl.surfaceArea() + f1 * br.surfaceArea()) / nodeBoundSurfaceArea;
-                    if (cost < minCost) { minCost = cost; splitIdx = i; }
-                }
+int AccelBVH::partitionObjects(std::vector<BVHObjectInfo>& objectInfoList,
+                               int startIdx, int end, const Bounds3f& nodeBound,
+                               const Bounds3f& centroidBounds, int maxDim, bool parallel) const {
+    // Check if all centroids lie at the same point
+    if (centroidBounds.pMin[maxDim] == centroidBounds.pMax[maxDim]) return -1;
 
-                // Since cost of intersection is 1, cost of a leaf is {range}
-                Real leafCost = range;
-                if (range > maxObjectsPerNode || minCost < leafCost) {
-                    // Split objects around optimum split
-                    BVHObjectInfo* nmid = std::partition(
-                                &objectInfoList[startIdx], &objectInfoList[end-1] + 1,
-                                [=](const BVHObjectInfo& info) {
-                                    int bidx = centroidBounds.offset(info.centroid)[maxDim] * nBins;
-                                    if (bidx == nBins) bidx--;
-                                    return bidx <= splitIdx;
-                                });
-                    mid = nmid - &objectInfoList[0];
-                } else {
-                    CREATE_LEAF_NODE();
-                }
+    int range = end - startIdx;
+    int mid = (startIdx + end) / 2;
+
+    // @todo: Support other tree split methods
+    // Partition primitives using SAH
+    if (range <= 2) {
+        // Partition into equally sized subsets
+        std::nth_element(&objectInfoList[startIdx], &objectInfoList[mid],
+                         &objectInfoList[end-1] + 1,
+                         [maxDim](const BVHObjectInfo& a, const BVHObjectInfo& b) {
+                             return a.centroid[maxDim] < b.centroid[maxDim];
+                         });
+        return mid;
+    }
+
+    // Initialize bins, one set of bins per chunk of objects
+    int nChunks = parallel ? (range + parallelChunkSize - 1) / parallelChunkSize : 1;
+    std::vector<BinInfo> chunkBins(nChunks * nBins);
+
+    auto binChunk = [&](int64_t c) {
+        int s = parallel ? startIdx + c * parallelChunkSize : startIdx;
+        int e = parallel ? std::min(s + parallelChunkSize, end) : end;
+        BinInfo* bins = &chunkBins[c * nBins];
+
+        for (int i = s; i < e; i++) {
+            int bidx = centroidBounds.offset(objectInfoList[i].centroid)[maxDim] * nBins;
+            if (bidx == nBins) bidx--; bins[bidx].freq++;
+
+            if (bins[bidx].freq == 1)
+                bins[bidx].bounds = objectInfoList[i].bounds;
+            else
+                bins[bidx].bounds = unionBounds(bins[bidx].bounds, objectInfoList[i].bounds);
+        }
+    };
+
+    if (nChunks > 1) ParallelFor(binChunk, nChunks);
+    else binChunk(0);
+
+    // Merge chunk bins into the first set
+    BinInfo* bins = &chunkBins[0];
+    for (int c = 1; c < nChunks; c++) {
+        for (int b = 0; b < nBins; b++) {
+            const BinInfo& cbin = chunkBins[c * nBins + b];
+            if (cbin.freq == 0) continue;
+
+            bins[b].bounds = bins[b].freq == 0 ? cbin.bounds
+                                               : unionBounds(bins[b].bounds, cbin.bounds);
+            bins[b].freq += cbin.freq;
+        }
+    }
+
+    // Compute optimum split
+    Real cost, minCost = MaxReal, splitIdx = 0;
+    Real nodeBoundSurfaceArea = nodeBound.surfaceArea();
+
+    /* @todo Optimize the O(n^2) runtime */
+    for (int i = 0; i < nBins - 1; i++) {
+        int f0 = 0, f1 = 0, j;
+
+        Bounds3f bl = bins[0].bounds;
+        for (j = 1; j <= i; j++) {
+            bl = unionBounds(bl, bins[j].bounds);
+            f0 += bins[j].freq;
+        }
+
+        Bounds3f br = bins[i + 1].bounds;
+        for (j = i + 2; j < nBins; j++) {
+            br = unionBounds(br, bins[j].bounds);
+            f1 += bins[j].freq;
+        }
+
+        // Assumed cost of intersection = 1; cost of traversal = 1/8
+        cost = 1 + (f0 * bl.surfaceArea() + f1 * br.surfaceArea()) / nodeBoundSurfaceArea;
+        if (cost < minCost) { minCost = cost; splitIdx = i; }
+    }
+
+    // Since cost of intersection is 1, cost of a leaf is {range}
+    Real leafCost = range;
+    if (range > maxObjectsPerNode || minCost < leafCost) {
+        // Split objects around optimum split
+        BVHObjectInfo* nmid = std::partition(
+                    &objectInfoList[startIdx], &objectInfoList[end-1] + 1,
+                    [=](const BVHObjectInfo& info) {
+                        int bidx = centroidBounds.offset(info.centroid)[maxDim] * nBins;
+                        if (bidx == nBins) bidx--;
+                        return bidx <= splitIdx;
+                    });
+        return nmid - &objectInfoList[0];
+    }
+
+    return -1;
+}
+
+// Number of bits used for quantizing each axis of an object centroid
+constexpr int mortonBits = 10;
+// Objects sharing the topmost bits of their Morton codes form one treelet
+constexpr int treeletBits = 12;
+
+/**
+ * Spreads the lower {mortonBits} bits of {x}, inserting
+ * two zero bits between every consecutive pair of bits
+ */
+inline uint32_t leftShift3(uint32_t x) {
+    if (x == (1 << mortonBits)) --x;
+    x = (x | (x << 16)) & 0x030000FF;
+    x = (x | (x <<  8)) & 0x0300F00F;
+    x = (x | (x <<  4)) & 0x030C30C3;
+    x = (x | (x <<  2)) & 0x09249249;
+    return x;
+}
+
+/**
+ * Interleaves the bits of the quantized components of {v}, which are
+ * expected to be in the range [0, 2^{mortonBits}], into a Morton code
+ */
+inline uint32_t encodeMorton3(const Vector3f& v) {
+    return (leftShift3(v.z) << 2) | (leftShift3(v.y) << 1) | leftShift3(v.x);
+}
+
+/**
+ * Sorts {v} by Morton code with a least significant digit radix sort.
+ * Every pass histograms and then scatters chunks of the input in parallel;
+ * chunk offsets are laid out in input order, which keeps the sort stable.
+ */
+static void radixSort(std::vector<MortonObject>* v) {
+    constexpr int bitsPerPass = 8;
+    constexpr int nBuckets = 1 << bitsPerPass;
+    constexpr int bitMask = nBuckets - 1;
+    constexpr int nPasses = (3 * mortonBits + bitsPerPass - 1) / bitsPerPass;
+
+    int n = v->size();
+    int nChunks = (n + parallelChunkSize - 1) / parallelChunkSize;
+    std::vector<MortonObject> tempVector(n);
+    std::vector<int> offsets(nChunks * nBuckets);
+
+    for (int pass = 0; pass < nPasses; pass++) {
+        int lowBit = pass * bitsPerPass;
+        // Alternate between {v} and {tempVector} as the input
+        std::vector<MortonObject>& in = (pass & 1) ? tempVector : *v;
+        std::vector<MortonObject>& out = (pass & 1) ? *v : tempVector;
+
+        // Count occurences of each bucket within every chunk
+        std::fill(offsets.begin(), offsets.end(), 0);
+        ParallelFor([&](int64_t c) {
+            int* count = &offsets[c * nBuckets];
+            int e = std::min(int(c + 1) * parallelChunkSize, n);
+            for (int i = c * parallelChunkSize; i < e; i++)
+                count[(in[i].mortonCode >> lowBit) & bitMask]++;
+        }, nChunks);
+
+        // Convert counts to the starting output index of every chunk's bucket
+        int sum = 0;
+        for (int b = 0; b < nBuckets; b++) {
+            for (int c = 0; c < nChunks; c++) {
+                int count = offsets[c * nBuckets + b];
+                offsets[c * nBuckets + b] = sum;
+                sum += count;
             }
+        }
+
+        // Scatter objects to their sorted positions for this pass
+        ParallelFor([&](int64_t c) {
+            int* offset = &offsets[c * nBuckets];
+            int e = std::min(int(c + 1) * parallelChunkSize, n);
+            for (int i = c * parallelChunkSize; i < e; i++)
+                out[offset[(in[i].mortonCode >> lowBit) & bitMask]++] = in[i];
+        }, nChunks);
+    }
+
+    // Make sure the result ends up in {v}
+    if (nPasses & 1) v->swap(tempVector);
+}
+
+BVHTreeNode*
+AccelBVH::constructHLBVH(MemoryPool& pool, const std::vector<BVHObjectInfo>& objectInfoList,
+                         int* nodeCount,
+                         std::vector<std::shared_ptr<Object>>& orderedObjectList) const {
+    int nObjects = objectInfoList.size();
+    int nChunks = (nObjects + parallelChunkSize - 1) / parallelChunkSize;
+
+    // Compute bounding box of all object centroids
+    Bounds3f nodeBound, centroidBounds;
+    computeRangeBounds(objectInfoList, 0, nObjects, &nodeBound, &centroidBounds, nChunks > 1);
 
-            BVHTreeNode* lc = constructBVHRecursive(pool, objectInfoList, startIdx, mid,
-                                                    nodeCount, orderedObjectList);
-            BVHTreeNode* rc = constructBVHRecursive(pool, objectInfoList, mid, end,
-                                                    nodeCount, orderedObjectList);
-            node->createInteriorNode(maxDim, lc, rc);
+    // Compute Morton codes of the object centroids
+    std::vector<MortonObject> mortonObjects(nObjects);
+    ParallelFor([&](int64_t c) {
+        constexpr int mortonScale = 1 << mortonBits;
+        int e = std::min(int(c + 1) * parallelChunkSize, nObjects);
+        for (int i = c * parallelChunkSize; i < e; i++) {
+            Vector3f centroidOffset = centroidBounds.offset(objectInfoList[i].centroid);
+            mortonObjects[i].objectIdx = i;
+            mortonObjects[i].mortonCode = encodeMorton3(centroidOffset * mortonScale);
+        }
+    }, nChunks);
+
+    radixSort(&mortonObjects);
+
+    // Find intervals of objects for every treelet
+    constexpr uint32_t treeletMask = ((1 << treeletBits) - 1) << (3 * mortonBits - treeletBits);
+    std::vector<std::pair<int, int>> treelets;
+    for (int startIdx = 0, end = 1; end <= nObjects; end++) {
+        if (end == nObjects ||
+            (mortonObjects[startIdx].mortonCode & treeletMask) !=
+            (mortonObjects[end].mortonCode & treeletMask)) {
+            treelets.push_back(std::make_pair(startIdx, end - startIdx));
+            startIdx = end;
         }
     }
 
-#undef CREATE_LEAF_NODE
+    // A treelet over n objects needs at most 2n - 1 nodes, so every
+    // treelet takes its nodes from its own slice of a shared allocation
+    BVHTreeNode* buildNodes = pool.alloc<BVHTreeNode>(2 * nObjects);
+
+    // Create treelets in parallel
+    std::vector<BVHTreeNode*> treeletRoots(treelets.size());
+    std::vector<int> treeletNodeCount(treelets.size(), 0);
+    ParallelFor([&](int64_t i) {
+        int startIdx = treelets[i].first;
+        BVHTreeNode* nodes = buildNodes + 2 * startIdx;
+        int firstBitIndex = 3 * mortonBits - 1 - treeletBits;
+
+        treeletRoots[i] = emitLBVH(nodes, objectInfoList, &mortonObjects[startIdx], startIdx,
+                                   treelets[i].second, &treeletNodeCount[i],
+                                   orderedObjectList, firstBitIndex);
+    }, treelets.size());
+
+    for (int count : treeletNodeCount) *nodeCount += count;
+    LOG_INFO_FMT("Combining %d treelets...", treelets.size());
+
+    // Create the rest of the tree over the treelet roots with SAH
+    std::vector<BVHObjectInfo> treeletInfoList(treeletRoots.size());
+    for (size_t i = 0; i < treeletRoots.size(); i++)
+        treeletInfoList[i] = { i, treeletRoots[i]->bounds };
+
+    return constructUpperSAH(pool, treeletInfoList, treeletRoots,
+                             0, treeletRoots.size(), nodeCount);
+}
+
+BVHTreeNode*
+AccelBVH::emitLBVH(BVHTreeNode*& buildNodes, const std::vector<BVHObjectInfo>& objectInfoList,
+                   const MortonObject* mortonObjects, int offset, int nObjects,
+                   int* nodeCount, std::vector<std::shared_ptr<Object>>& orderedObjectList,
+                   int bitIndex) const {
+    if (bitIndex == -1 || nObjects <= maxObjectsPerNode) {
+        // Create and return leaf node of treelet
+        (*nodeCount)++;
+        BVHTreeNode* node = buildNodes++;
+
+        Bounds3f bounds = objectInfoList[mortonObjects[0].objectIdx].bounds;
+        for (int i = 0; i < nObjects; i++) {
+            const BVHObjectInfo& info = objectInfoList[mortonObjects[i].objectIdx];
+            bounds = unionBounds(bounds, info.bounds);
+            orderedObjectList[offset + i] = sourceObjects[info.objectIdx];
+        }
+
+        node->createLeafNode(offset, nObjects, bounds);
+        return node;
+    }
+
+    // Advance to next bit if all objects lie on the same side of this one
+    int mask = 1 << bitIndex;
+    if ((mortonObjects[0].mortonCode & mask) ==
+        (mortonObjects[nObjects - 1].mortonCode & mask))
+        return emitLBVH(buildNodes, objectInfoList, mortonObjects, offset, nObjects,
+                        nodeCount, orderedObjectList, bitIndex - 1);
+
+    // Find the first object with {bitIndex} set, using binary search
+    int searchStart = 0, searchEnd = nObjects - 1;
+    while (searchStart + 1 != searchEnd) {
+        int mid = (searchStart + searchEnd) / 2;
+        if ((mortonObjects[searchStart].mortonCode & mask) ==
+            (mortonObjects[mid].mortonCode & mask))
+            searchStart = mid;
+        else
+            searchEnd = mid;
+    }
+    int splitOffset = searchEnd;
+
+    // Create and return interior node of treelet
+    (*nodeCount)++;
+    BVHTreeNode* node = buildNodes++;
+
+    BVHTreeNode* lc = emitLBVH(buildNodes, objectInfoList, mortonObjects, offset,
+                               splitOffset, nodeCount, orderedObjectList, bitIndex - 1);
+    BVHTreeNode* rc = emitLBVH(buildNodes, objectInfoList, &mortonObjects[splitOffset],
+                               offset + splitOffset, nObjects - splitOffset, nodeCount,
+                               orderedObjectList, bitIndex - 1);
+    // Bits of the Morton code cycle through the x, y and z axes
+    node->createInteriorNode(bitIndex % 3, lc, rc);
 
     return node;
 }
 
-int AccelBVH::flattenBVH(BVHTreeNode* treeNode, int* linearIdx) {
-    // Copy data from tree node
-    LinearBVHNode* linearNode = &bvhNodes[*linearIdx];
+BVHTreeNode*
+AccelBVH::constructUpperSAH(MemoryPool& pool, std::vector<BVHObjectInfo>& treeletInfoList,
+                            const std::vector<BVHTreeNode*>& treeletRoots,
+                            int startIdx, int end, int* nodeCount) const {
+    ASSERT(startIdx < end);
+    if (end - startIdx == 1)
+        return treeletRoots[treeletInfoList[startIdx].objectIdx];
+
+    (*nodeCount)++;
+    BVHTreeNode* node = pool.alloc<BVHTreeNode>();
+
+    Bounds3f nodeBound, centroidBounds;
+    computeRangeBounds(treeletInfoList, startIdx, end, &nodeBound, &centroidBounds, false);
+    int maxDim = centroidBounds.maximumExtent();
+
+    int mid = partitionObjects(treeletInfoList, startIdx, end, nodeBound,
+                               centroidBounds, maxDim, false);
+    if (mid < 0) {
+        // Treelets can't be merged into a leaf, split them into equal halves
+        mid = (startIdx + end) / 2;
+        std::nth_element(&treeletInfoList[startIdx], &treeletInfoList[mid],
+                         &treeletInfoList[end-1] + 1,
+                         [maxDim](const BVHObjectInfo& a, const BVHObjectInfo& b) {
+                             return a.centroid[maxDim] < b.centroid[maxDim];
+                         });
+    }
+
+    BVHTreeNode* lc = constructUpperSAH(pool, treeletInfoList, treeletRoots,
+                                        startIdx, mid, nodeCount);
+    BVHTreeNode* rc = constructUpperSAH(pool, treeletInfoList, treeletRoots,
+                                        mid, end, nodeCount);
+    node->createInteriorNode(maxDim, lc, rc);
+
+    return node;
+}
+
+int AccelBVH::flattenBVH(BVHTreeNode* treeNode, LinearBVHNode* nodes, int* linearIdx,
+                         const std::vector<std::vector<LinearBVHNode>>* subtreeNodes) const {
+    int currentIdx = *linearIdx;
 
-    linearNode->bounds = treeNode->bounds;
-    int currentIdx = (*linearIdx)++;
+    if (treeNode->subtreeIdx >= 0 && !subtreeNodes) {
+        // Subtree of a lazy build, built once a ray reaches it
+        LinearBVHNode* linearNode = &nodes[(*linearIdx)++];
+        linearNode->setBounds(treeNode->bounds);
+        linearNode->nObjects = 0;
+        linearNode->splitAxis = LazySubtreeAxis;
+        linearNode->childrenSwapped = 0;
+        linearNode->secondChildIdx = treeNode->subtreeIdx;
+        return currentIdx;
+    }
+
+    if (treeNode->subtreeIdx >= 0) {
+        // Splice in the separately flattened subtree,
+        // shifting its child links to the new offset
+        ASSERT(subtreeNodes);
+        for (const LinearBVHNode& subtreeNode : (*subtreeNodes)[treeNode->subtreeIdx]) {
+            LinearBVHNode* linearNode = &nodes[(*linearIdx)++];
+            *linearNode = subtreeNode;
+            if (linearNode->nObjects == 0) linearNode->secondChildIdx += currentIdx;
+        }
+        return currentIdx;
+    }
+
+    // Copy data from tree node
+    LinearBVHNode* linearNode = &nodes[(*linearIdx)++];
+    linearNode->setBounds(treeNode->bounds);
 
     // If tree node is a leaf
     if (treeNode->nObjects > 0) {
@@ -183,39 +1142,436 @@ int AccelBVH::flattenBVH(BVHTreeNode* treeNode, int* linearIdx) {
     } else {
         linearNode->nObjects = 0;
         linearNode->splitAxis = treeNode->splitAxis;
+        linearNode->childrenSwapped = 0;
         // Recursive traverse left child
-        flattenBVH(treeNode->child[0], linearIdx);
+        flattenBVH(treeNode->child[0], nodes, linearIdx, subtreeNodes);
         // Store index of right child with a recursive call
-        linearNode->secondChildIdx = flattenBVH(treeNode->child[1], linearIdx);
+        linearNode->secondChildIdx = flattenBVH(treeNode->child[1], nodes,
+                                                linearIdx, subtreeNodes);
     }
 
     return currentIdx;
 }
 
+void AccelBVH::reorderNodes(size_t blockSize) {
+    // Lazy builds only have their top levels in {bvhNodes}
+    if (!bvhNodes || lazyBuild) return;
+    LOG_INFO_FMT("Reordering BVH nodes (%d byte blocks)...", int(blockSize));
+    constexpr size_t lineSize = 64, pageSize = 4096;
+    Real lineFetches = getExpectedBlockFetches(lineSize);
+    Real pageFetches = getExpectedBlockFetches(pageSize);
+
+    // The child more likely to be hit is stored right after its parent,
+    // which shares a cache line with it for every other node
+    auto area = [&](int idx) { return bvhNodes[idx].getBounds().surfaceArea(); };
+    std::vector<int> hotChild(totalNodes, -1), coldChild(totalNodes, -1);
+    for (int i = 0; i < totalNodes; i++) {
+        if (bvhNodes[i].nObjects > 0) continue;
+        bool swap = area(bvhNodes[i].secondChildIdx) > area(i + 1);
+        hotChild[i] = swap ? bvhNodes[i].secondChildIdx : i + 1;
+        coldChild[i] = swap ? i + 1 : bvhNodes[i].secondChildIdx;
+    }
+
+    // Node indexes in their new order. Placing a node places the chain of
+    // its hot children with it, as these must directly follow their parent.
+    std::vector<int> order;
+    order.reserve(totalNodes);
+    auto placeChain = [&](int nodeIdx, std::vector<int>* coldChildren) {
+        for (int idx = nodeIdx; idx >= 0; idx = hotChild[idx]) {
+            order.push_back(idx);
+            if (coldChild[idx] >= 0) coldChildren->push_back(coldChild[idx]);
+        }
+    };
+
+    // Subtrees small enough to fit a block are placed in depth first order,
+    // as this keeps them contiguous. Children come after their parent,
+    // so a reverse sweep gives the subtree sizes.
+    size_t blockNodes = blockSize > 0 ? std::max(size_t(1), blockSize / sizeof(LinearBVHNode))
+                                      : size_t(totalNodes);
+    std::vector<int> subtreeSize(totalNodes, 1);
+    for (int i = totalNodes - 1; i >= 0; i--) {
+        if (bvhNodes[i].nObjects == 0)
+            subtreeSize[i] += subtreeSize[i + 1] + subtreeSize[bvhNodes[i].secondChildIdx];
+    }
+
+    std::vector<int> treeletRoots(1, 0), coldChildren;
+    while (!treeletRoots.empty()) {
+        int rootIdx = treeletRoots.back(); treeletRoots.pop_back();
+        std::vector<int> leftOver;
+
+        if (size_t(subtreeSize[rootIdx]) <= blockNodes) {
+            // Depth first: cold children are placed once the subtree before them is done
+            std::vector<int> stack(1, rootIdx);
+            while (!stack.empty()) {
+                int nodeIdx = stack.back(); stack.pop_back();
+                coldChildren.clear();
+                placeChain(nodeIdx, &coldChildren);
+                stack.insert(stack.end(), coldChildren.rbegin(), coldChildren.rend());
+            }
+        } else {
+            // Grow the treelet by the subtrees whose roots are most likely to be hit
+            size_t blockEnd = order.size() + blockNodes;
+            std::priority_queue<std::pair<Real, int>> candidates;
+            candidates.push({ area(rootIdx), rootIdx });
+
+            while (!candidates.empty() && order.size() < blockEnd) {
+                int nodeIdx = candidates.top().second; candidates.pop();
+                coldChildren.clear();
+                placeChain(nodeIdx, &coldChildren);
+                for (int idx : coldChildren) candidates.push({ area(idx), idx });
+            }
+            for (; !candidates.empty(); candidates.pop()) leftOver.push_back(candidates.top().second);
+        }
+
+        // Subtrees left over start treelets of their own right after
+        // this one, the one most likely to be hit first
+        treeletRoots.insert(treeletRoots.end(), leftOver.rbegin(), leftOver.rend());
+    }
+    ASSERT(int(order.size()) == totalNodes);
+
+    std::vector<int> newIdx(totalNodes);
+    for (int i = 0; i < totalNodes; i++) newIdx[order[i]] = i;
+
+    LinearBVHNode* nodes = allocAligned<LinearBVHNode>(totalNodes);
+    for (int i = 0; i < totalNodes; i++) {
+        int oldIdx = order[i];
+        nodes[i] = bvhNodes[oldIdx];
+        if (nodes[i].nObjects > 0) continue;
+
+        ASSERT(newIdx[hotChild[oldIdx]] == i + 1);
+        nodes[i].secondChildIdx = newIdx[coldChild[oldIdx]];
+        if (hotChild[oldIdx] != oldIdx + 1) nodes[i].childrenSwapped ^= 1;
+    }
+
+    if (cacheMapping) {
+        // Mapped nodes can not be freed on their own, copy over them instead
+        std::copy(nodes, nodes + totalNodes, bvhNodes);
+        freeAligned(nodes);
+    } else {
+        freeAligned(bvhNodes);
+        bvhNodes = nodes;
+    }
+
+    LOG_INFO_FMT("Expected node cache lines fetched per ray: %f -> %f",
+                 lineFetches, getExpectedBlockFetches(lineSize));
+    LOG_INFO_FMT("Expected node pages fetched per ray: %f -> %f",
+                 pageFetches, getExpectedBlockFetches(pageSize));
+}
+
+Real AccelBVH::getExpectedBlockFetches(size_t blockSize) const {
+    if (!bvhNodes) return 0;
+
+    auto block = [&](int idx) { return uintptr_t(&bvhNodes[idx]) / blockSize; };
+    Real rootArea = bvhNodes[0].getBounds().surfaceArea(), fetches = 0;
+    if (rootArea <= 0) return 1;
+
+    for (int i = 0; i < totalNodes; i++) {
+        if (bvhNodes[i].nObjects > 0 || bvhNodes[i].isLazySubtree()) continue;
+        for (int child : { i + 1, bvhNodes[i].secondChildIdx }) {
+            if (block(child) != block(i))
+                fetches += bvhNodes[child].getBounds().surfaceArea();
+        }
+    }
+    return 1 + fetches / rootArea;
+}
+
+template <int N>
+int AccelBVH::collapseBVH(int nodeIdx, std::vector<WideBVHNode<N>>& wideNodes) const {
+    int children[N];
+    int nChildren = 0;
+
+    const LinearBVHNode* node = &bvhNodes[nodeIdx];
+    if (node->nObjects > 0) {
+        // Only happens for a leaf root
+        children[nChildren++] = nodeIdx;
+    } else {
+        children[nChildren++] = nodeIdx + 1;
+        children[nChildren++] = node->secondChildIdx;
+    }
+
+    // Pull up grandchildren until the wide node is full
+    while (nChildren < N) {
+        int best = -1;
+        Real bestArea = -1;
+        for (int i = 0; i < nChildren; i++) {
+            const LinearBVHNode* child = &bvhNodes[children[i]];
+            if (child->nObjects == 0 && child->getBounds().surfaceArea() > bestArea) {
+                best = i;
+                bestArea = child->getBounds().surfaceArea();
+            }
+        }
+        if (best < 0) break;
+
+        int openIdx = children[best];
+        children[best] = openIdx + 1;
+        children[nChildren++] = bvhNodes[openIdx].secondChildIdx;
+    }
+
+    int wideIdx = wideNodes.size();
+    wideNodes.emplace_back();
+    for (int i = 0; i < nChildren; i++) {
+        const LinearBVHNode* child = &bvhNodes[children[i]];
+        int childIdx = child->nObjects > 0 ? child->objectStartIdx
+                                           : collapseBVH<N>(children[i], wideNodes);
+        // Recursion may reallocate {wideNodes}, so index it afresh
+        wideNodes[wideIdx].setChild(i, child->getBounds(), childIdx, child->nObjects);
+    }
+
+    return wideIdx;
+}
+
+template <int N>
+WideBVHNode<N>* AccelBVH::createWideBVH() {
+    if (!bvhNodes) return nullptr;
+
+    LOG_INFO_FMT("Collapsing BVH into %d-wide nodes...", N);
+    std::vector<WideBVHNode<N>> wideNodes;
+    wideNodes.reserve(totalNodes / 2 + 1);
+    collapseBVH<N>(0, wideNodes);
+
+    totalWideNodes = wideNodes.size();
+    WideBVHNode<N>* nodes = allocAligned<WideBVHNode<N>>(totalWideNodes);
+    std::copy(wideNodes.begin(), wideNodes.end(), nodes);
+    LOG_INFO_FMT("Computed wide BVH nodes: %d", totalWideNodes);
+
+    return nodes;
+}
+
+CompressedBVHNode* AccelBVH::createCompressedBVH() {
+    if (!bvhNodes) return nullptr;
+
+    LOG_INFO("Compressing BVH into quantized 8-wide nodes...");
+    std::vector<WideBVHNode<8>> wideNodes;
+    wideNodes.reserve(totalNodes / 2 + 1);
+    collapseBVH<8>(0, wideNodes);
+
+    totalWideNodes = wideNodes.size();
+    CompressedBVHNode* nodes = allocAligned<CompressedBVHNode>(totalWideNodes);
+    for (int i = 0; i < totalWideNodes; i++)
+        new (&nodes[i]) CompressedBVHNode(wideNodes[i]);
+
+    long long compressedSize = totalWideNodes * sizeof(CompressedBVHNode);
+    LOG_INFO_FMT("Computed compressed BVH nodes: %d (%lld bytes)", totalWideNodes, compressedSize);
+    LOG_INFO_FMT("Bytes saved: %lld against 8-wide nodes, %lld against binary nodes",
+                 totalWideNodes * (long long)sizeof(WideBVHNode<8>) - compressedSize,
+                 totalNodes * (long long)sizeof(LinearBVHNode) - compressedSize);
+
+    return nodes;
+}
+
+size_t AccelBVH::getNodeMemory() const {
+    if (wide4Nodes) return totalWideNodes * sizeof(WideBVHNode<4>);
+    if (wide8Nodes) return totalWideNodes * sizeof(WideBVHNode<8>);
+    if (compressedNodes) return totalWideNodes * sizeof(CompressedBVHNode);
+
+    size_t nNodes = totalNodes;
+    for (int i = 0; i < nLazySubtrees; i++)
+        if (lazySubtrees[i].nodes.load(std::memory_order_acquire)) nNodes += lazySubtrees[i].nNodes;
+    return nNodes * sizeof(LinearBVHNode);
+}
+
+int AccelBVH::getBuiltSubtreeCount() const {
+    int nBuilt = 0;
+    for (int i = 0; i < nLazySubtrees; i++)
+        if (lazySubtrees[i].nodes.load(std::memory_order_acquire)) nBuilt++;
+    return nBuilt;
+}
+
+const AccelBVH::LazySubtree& AccelBVH::expandLazySubtree(int idx) const {
+    LazySubtree& subtree = lazySubtrees[idx];
+    if (subtree.nodes.load(std::memory_order_acquire)) return subtree;
+
+    bool unclaimed = false;
+    if (!subtree.claimed.compare_exchange_strong(unclaimed, true)) {
+        // Another ray is building the subtree. This should be rare, and
+        // only lasts for a single subtree build, so just spin until it is done.
+        while (!subtree.nodes.load(std::memory_order_acquire)) std::this_thread::yield();
+        return subtree;
+    }
+
+    // Build over a copy of the object range, leaving {lazyObjectInfo}
+    // untouched for the subtrees built concurrently
+    int startIdx = subtree.startIdx, nObjects = subtree.nObjects;
+    std::vector<BVHObjectInfo> objectInfoList(lazyObjectInfo.begin() + startIdx,
+                                              lazyObjectInfo.begin() + startIdx + nObjects);
+    std::vector<std::shared_ptr<Object>> orderedObjectList(nObjects);
+    MemoryPool pool(256 * 1024);
+    int nodeCount = 0;
+    BVHTreeNode* root = constructBVHRecursive(pool, objectInfoList, 0, nObjects,
+                                              &nodeCount, orderedObjectList);
+
+    LinearBVHNode* nodes = allocAligned<LinearBVHNode>(nodeCount);
+    int linearIdx = 0;
+    flattenBVH(root, nodes, &linearIdx);
+
+    // Group the objects of each leaf by type, as {createLeafObjects} does
+    LeafObject* leaves = new LeafObject[nObjects];
+    for (int i = 0; i < nObjects; i++) leaves[i] = resolveLeafObject(orderedObjectList[i].get());
+    for (int n = 0; n < nodeCount; n++) {
+        if (nodes[n].nObjects < 2) continue;
+        std::stable_sort(leaves + nodes[n].objectStartIdx,
+                         leaves + nodes[n].objectStartIdx + nodes[n].nObjects,
+                         [](const LeafObject& a, const LeafObject& b) { return a.type < b.type; });
+    }
+
+    subtree.leafObjects.reset(leaves);
+    subtree.nNodes = nodeCount;
+    subtree.nodes.store(nodes, std::memory_order_release);
+    return subtree;
+}
+
+/**
+ * Tests {ray} against the leaf object {leaf}, dispatching on its type.
+ * The closest hit is recorded in {hit} and {ray} is shortened to it,
+ * as {GeometricObject::intersectHit} does. Only occlusion is tested if
+ * {hit} is null. Shapes test their alpha masks themselves, so cut out
+ * hits never reach the traversal.
+ */
+static inline bool intersectLeafObject(const LeafObject& leaf, const Ray& ray, SurfaceHit* hit) {
+    SurfaceHit shapeHit;
+    SurfaceHit* h = hit ? hit : &shapeHit;
+    bool intersected;
+
+    // Qualified calls skip the virtual dispatch
+    switch (leaf.type) {
+        case LeafObjectType::Triangle:
+            intersected = static_cast<const Triangle*>(leaf.target)->Triangle::intersectHit(ray, h);
+            break;
+        case LeafObjectType::Sphere:
+            intersected = static_cast<const Sphere*>(leaf.target)->Sphere::intersectHit(ray, h);
+            break;
+        case LeafObjectType::Disk:
+            intersected = static_cast<const Disk*>(leaf.target)->Disk::intersectHit(ray, h);
+            break;
+        default: {
+            const Object* object = static_cast<const Object*>(leaf.target);
+            return hit ? object->intersectHit(ray, hit) : object->intersectRay(ray);
+        }
+    }
+
+    if (intersected && hit) {
+        ray.tMax = hit->t;
+        hit->object = leaf.object; hit->nInstances = 0;
+    }
+    return intersected;
+}
+
+template <typename NodeType>
+bool AccelBVH::intersectWideBVH(const NodeType* nodes, const Ray& ray,
+                                SurfaceHit* hit) const {
+    constexpr int N = NodeType::width;
+
+    bool intersected = false;
+    BVHRay bvhRay(ray);
+
+    // Children still to be visited along with their entry distance,
+    // so that they can be skipped if a closer hit has been found since
+    struct StackEntry { int idx, nObjects; float tNear; };
+    StackEntry nodeStack[64 * N];
+    int stackSize = 0;
+    nodeStack[stackSize++] = { 0, 0, 0 };
+
+    while (stackSize > 0) {
+        const StackEntry entry = nodeStack[--stackSize];
+        if (entry.tNear > bvhRay.tMax) continue;
+
+        if (entry.nObjects > 0) {
+            // Leaf. Test against all objects in leaf
+            for (int i = 0; i < entry.nObjects; i++) {
+                if (intersectLeafObject(leafObjects[entry.idx + i], ray, hit)) {
+                    if (!hit) return true;
+                    intersected = true;
+                }
+            }
+            if (intersected) bvhRay.setTMax(ray.tMax);
+            continue;
+        }
+
+        const NodeType& node = nodes[entry.idx];
+        float tNear[N];
+        int hitMask = intersectWideNode(node, bvhRay, tNear);
+
+        // Push hit children farthest first, so that the nearest one is popped next
+        StackEntry hits[N];
+        int nHits = 0;
+        for (int i = 0; i < N; i++) {
+            if (!(hitMask & (1 << i))) continue;
+            StackEntry hit = { node.childIdx[i], node.nObjects[i], tNear[i] };
+            int j = nHits++;
+            for (; j > 0 && hits[j - 1].tNear < hit.tNear; j--) hits[j] = hits[j - 1];
+            hits[j] = hit;
+        }
+        for (int i = 0; i < nHits; i++) nodeStack[stackSize++] = hits[i];
+    }
+
+    return intersected;
+}
+
 bool AccelBVH::intersectRay(const Ray& ray, SurfaceInteraction* si) const {
+    // Only the closest hit gets its full interaction computed
+    SurfaceHit hit;
+    if (!intersectHit(ray, &hit)) return false;
+    computeInteraction(ray, hit, si);
+    return true;
+}
+
+bool AccelBVH::intersectHit(const Ray& ray, SurfaceHit* hit) const {
+    if (wide4Nodes) return intersectWideBVH(wide4Nodes, ray, hit);
+    if (wide8Nodes) return intersectWideBVH(wide8Nodes, ray, hit);
+    if (compressedNodes) return intersectWideBVH(compressedNodes, ray, hit);
+    if (!bvhNodes) return false;
+
+    BVHRay bvhRay(ray);
+    return intersectBinaryBVH(bvhNodes, leafObjects.data(), ray, bvhRay, hit);
+}
+
+bool AccelBVH::intersectRay(const Ray& ray) const {
+    if (wide4Nodes) return intersectWideBVH(wide4Nodes, ray, nullptr);
+    if (wide8Nodes) return intersectWideBVH(wide8Nodes, ray, nullptr);
+    if (compressedNodes) return intersectWideBVH(compressedNodes, ray, nullptr);
+    if (!bvhNodes) return false;
+
+    BVHRay bvhRay(ray);
+    return intersectBinaryBVH(bvhNodes, leafObjects.data(), ray, bvhRay, nullptr);
+}
+
+bool AccelBVH::intersectBinaryBVH(const LinearBVHNode* nodes, const LeafObject* leaves,
+                                  const Ray& ray, BVHRay& bvhRay, SurfaceHit* hit) const {
     bool intersected = false;
-    // Initialize ray intersection parameters
-    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
-    int isDirNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+    const int* isDirNeg = bvhRay.nearIdx;
 
     // Test against each BVH node
     int nodeStack[64];
     int stackSize = 0, itrIdx = 0, i;
 
     while (true) {
-        const LinearBVHNode* node = &bvhNodes[itrIdx];
+        const LinearBVHNode* node = &nodes[itrIdx];
         // Inspect current node
-        if (node->bounds.intersectRay(ray, invDir, isDirNeg)) {
+        if (node->intersectRay(bvhRay)) {
             if (node->nObjects > 0) {
                 // Node is leaf. Test against all objects in leaf
-                for (i = 0; i < node->nObjects; i++)
-                    if (objectList[node->objectStartIdx + i]->intersectRay(ray, si))
+                for (i = 0; i < node->nObjects; i++) {
+                    if (intersectLeafObject(leaves[node->objectStartIdx + i], ray, hit)) {
+                        if (!hit) return true;
                         intersected = true;
+                    }
+                }
+                if (intersected) bvhRay.setTMax(ray.tMax);
+                if (stackSize == 0) break;
+                itrIdx = nodeStack[--stackSize];
+            } else if (node->isLazySubtree()) {
+                // Traverse the subtree in place of the node, building it on first use
+                const LazySubtree& subtree = expandLazySubtree(node->secondChildIdx);
+                if (intersectBinaryBVH(subtree.nodes.load(std::memory_order_acquire),
+                                       subtree.leafObjects.get(), ray, bvhRay, hit)) {
+                    if (!hit) return true;
+                    intersected = true;
+                }
                 if (stackSize == 0) break;
                 itrIdx = nodeStack[--stackSize];
             } else {
                 // Internal node. Test near nodes first. Put far nodes in the stack
-                if (isDirNeg[node->splitAxis]) {
+                if (isDirNeg[node->splitAxis] != node->childrenSwapped) {
                     // Stash first child and inspect second child first
                     nodeStack[stackSize++] = itrIdx + 1;
                     itrIdx = node->secondChildIdx;
@@ -234,50 +1590,210 @@ bool AccelBVH::intersectRay(const Ray& ray, SurfaceInteraction* si) const {
     return intersected;
 }
 
-bool AccelBVH::intersectRay(const Ray& ray) const {
-    // Initialize ray intersection parameters
-    Vector3f invDir(1 / ray.d.x, 1 / ray.d.y, 1 / ray.d.z);
-    int isDirNeg[3] = { invDir.x < 0, invDir.y < 0, invDir.z < 0 };
+const int AccelBVH::MAX_PACKET_SIZE;
 
-    // Test against each BVH node
-    int nodeStack[64];
-    int stackSize = 0, itrIdx = 0, i;
+void AccelBVH::intersectRays(const Ray* rays, SurfaceInteraction* si, bool* hits, int n) const {
+    for (int i = 0; i < n; i += MAX_PACKET_SIZE)
+        intersectPacket(rays + i, si + i, hits + i, std::min(MAX_PACKET_SIZE, n - i));
+}
+
+void AccelBVH::intersectRays(const Ray* rays, bool* hits, int n) const {
+    for (int i = 0; i < n; i += MAX_PACKET_SIZE)
+        intersectPacket(rays + i, nullptr, hits + i, std::min(MAX_PACKET_SIZE, n - i));
+}
+
+void AccelBVH::intersectPacket(const Ray* rays, SurfaceInteraction* si, bool* hits, int n) const {
+    BVHRay bvhRays[MAX_PACKET_SIZE];
+    SurfaceHit hitRecords[MAX_PACKET_SIZE];
+    SurfaceHit* hit = si ? hitRecords : nullptr;
+    for (int i = 0; i < n; i++) {
+        bvhRays[i] = BVHRay(rays[i]);
+        hits[i] = false;
+    }
+
+    uint64_t activeMask = n == 64 ? ~uint64_t(0) : (uint64_t(1) << n) - 1;
+    if (wide4Nodes)
+        intersectWidePacket(wide4Nodes, rays, bvhRays, hit, hits, activeMask);
+    else if (wide8Nodes)
+        intersectWidePacket(wide8Nodes, rays, bvhRays, hit, hits, activeMask);
+    else if (compressedNodes)
+        intersectWidePacket(compressedNodes, rays, bvhRays, hit, hits, activeMask);
+    else if (bvhNodes)
+        intersectBinaryPacket(rays, bvhRays, hit, hits, activeMask);
+
+    if (!si) return;
+    for (int i = 0; i < n; i++)
+        if (hits[i]) computeInteraction(rays[i], hitRecords[i], &si[i]);
+}
+
+void AccelBVH::intersectLeafPacket(int startIdx, int nObjects, uint64_t rayMask,
+                                   const Ray* rays, BVHRay* bvhRays, SurfaceHit* hit,
+                                   bool* hits, uint64_t* doneMask) const {
+    // Test each object against all rays in turn, so that it is fetched only once
+    for (int i = 0; i < nObjects; i++) {
+        const LeafObject& leaf = leafObjects[startIdx + i];
+        for (uint64_t m = rayMask; m; m &= m - 1) {
+            int r = __builtin_ctzll(m);
+            if (hit) {
+                if (intersectLeafObject(leaf, rays[r], &hit[r]))
+                    hits[r] = true;
+            } else if (intersectLeafObject(leaf, rays[r], nullptr)) {
+                hits[r] = true;
+                rayMask &= ~(uint64_t(1) << r);
+                *doneMask |= uint64_t(1) << r;
+            }
+        }
+    }
+
+    if (hit) {
+        for (uint64_t m = rayMask; m; m &= m - 1) {
+            int r = __builtin_ctzll(m);
+            if (hits[r]) bvhRays[r].setTMax(rays[r].tMax);
+        }
+    }
+}
+
+void AccelBVH::intersectBinaryPacket(const Ray* rays, BVHRay* bvhRays, SurfaceHit* hit,
+                                     bool* hits, uint64_t activeMask) const {
+    // Far children are stacked along with the rays that entered their parent
+    struct StackEntry { int idx; uint64_t rayMask; };
+    StackEntry nodeStack[64];
+    int stackSize = 0, itrIdx = 0;
+    uint64_t rayMask = activeMask, doneMask = 0;
 
     while (true) {
         const LinearBVHNode* node = &bvhNodes[itrIdx];
-        // Inspect current node
-        if (node->bounds.intersectRay(ray, invDir, isDirNeg)) {
-            if (node->nObjects > 0) {
-                // Node is leaf. Test against all objects in leaf
-                for (i = 0; i < node->nObjects; i++)
-                    if (objectList[node->objectStartIdx + i]->intersectRay(ray))
-                        return true;
-                if (stackSize == 0) break;
-                itrIdx = nodeStack[--stackSize];
+        // Find the rays that enter the current node
+        uint64_t nodeMask = 0;
+        for (uint64_t m = rayMask & ~doneMask; m; m &= m - 1) {
+            int r = __builtin_ctzll(m);
+            if (node->intersectRay(bvhRays[r])) nodeMask |= uint64_t(1) << r;
+        }
+
+        if (nodeMask != 0 && node->nObjects > 0) {
+            intersectLeafPacket(node->objectStartIdx, node->nObjects, nodeMask,
+                                rays, bvhRays, hit, hits, &doneMask);
+            if (doneMask == activeMask) break;
+        } else if (nodeMask != 0 && node->isLazySubtree()) {
+            // Rays entering a lazy subtree traverse it one at a time
+            const LazySubtree& subtree = expandLazySubtree(node->secondChildIdx);
+            const LinearBVHNode* subtreeNodes = subtree.nodes.load(std::memory_order_acquire);
+            for (uint64_t m = nodeMask; m; m &= m - 1) {
+                int r = __builtin_ctzll(m);
+                if (!intersectBinaryBVH(subtreeNodes, subtree.leafObjects.get(), rays[r],
+                                        bvhRays[r], hit ? &hit[r] : nullptr))
+                    continue;
+                hits[r] = true;
+                if (!hit) doneMask |= uint64_t(1) << r;
+            }
+            if (doneMask == activeMask) break;
+        } else if (nodeMask != 0) {
+            // Internal node. Order children by the direction of the first ray
+            int r = __builtin_ctzll(nodeMask);
+            if (bvhRays[r].nearIdx[node->splitAxis] != node->childrenSwapped) {
+                nodeStack[stackSize++] = { itrIdx + 1, nodeMask };
+                itrIdx = node->secondChildIdx;
             } else {
-                // Internal node. Test near nodes first. Put far nodes in the stack
-                if (isDirNeg[node->splitAxis]) {
-                    // Stash first child and inspect second child first
-                    nodeStack[stackSize++] = itrIdx + 1;
-                    itrIdx = node->secondChildIdx;
-                } else {
-                    // Stash second child and inspect first child first
-                    nodeStack[stackSize++] = node->secondChildIdx;
-                    itrIdx++;
-                }
+                nodeStack[stackSize++] = { node->secondChildIdx, nodeMask };
+                itrIdx++;
             }
-        } else {
-            if (stackSize == 0) break;
-            itrIdx = nodeStack[--stackSize];
+            rayMask = nodeMask;
+            continue;
         }
+
+        if (stackSize == 0) break;
+        --stackSize;
+        itrIdx = nodeStack[stackSize].idx;
+        rayMask = nodeStack[stackSize].rayMask;
     }
+}
+
+template <typename NodeType>
+void AccelBVH::intersectWidePacket(const NodeType* nodes, const Ray* rays, BVHRay* bvhRays,
+                                   SurfaceHit* hit, bool* hits, uint64_t activeMask) const {
+    constexpr int N = NodeType::width;
 
-    return false;
+    struct StackEntry { int idx, nObjects; uint64_t rayMask; float tNear; };
+    StackEntry nodeStack[64 * N];
+    int stackSize = 0;
+    nodeStack[stackSize++] = { 0, 0, activeMask, 0 };
+    uint64_t doneMask = 0;
+
+    while (stackSize > 0) {
+        const StackEntry entry = nodeStack[--stackSize];
+        uint64_t rayMask = entry.rayMask & ~doneMask;
+        // No ray enters the node before {tNear}, so rays that found a closer
+        // hit since it was pushed skip it
+        if (hit) {
+            for (uint64_t m = rayMask; m; m &= m - 1) {
+                int r = __builtin_ctzll(m);
+                if (bvhRays[r].tMax < entry.tNear) rayMask &= ~(uint64_t(1) << r);
+            }
+        }
+        if (rayMask == 0) continue;
+
+        if (entry.nObjects > 0) {
+            intersectLeafPacket(entry.idx, entry.nObjects, rayMask,
+                                rays, bvhRays, hit, hits, &doneMask);
+            if (doneMask == activeMask) break;
+            continue;
+        }
+
+        // Gather the rays entering each child and their closest entry distance
+        const NodeType& node = nodes[entry.idx];
+        uint64_t childMasks[N] = {};
+        float childNear[N];
+        for (int i = 0; i < N; i++) childNear[i] = Infinity;
+
+        for (uint64_t m = rayMask; m; m &= m - 1) {
+            int r = __builtin_ctzll(m);
+            float tNear[N];
+            int hitMask = intersectWideNode(node, bvhRays[r], tNear);
+            for (; hitMask; hitMask &= hitMask - 1) {
+                int i = __builtin_ctz(hitMask);
+                childMasks[i] |= uint64_t(1) << r;
+                childNear[i] = std::min(childNear[i], tNear[i]);
+            }
+        }
+
+        // Push children farthest first, so that the nearest one is popped next
+        StackEntry children[N];
+        int nChildren = 0;
+        for (int i = 0; i < N; i++) {
+            if (childMasks[i] == 0) continue;
+            StackEntry child = { node.childIdx[i], node.nObjects[i], childMasks[i], childNear[i] };
+            int j = nChildren++;
+            for (; j > 0 && children[j - 1].tNear < child.tNear; j--) children[j] = children[j - 1];
+            children[j] = child;
+        }
+        for (int i = 0; i < nChildren; i++) nodeStack[stackSize++] = children[i];
+    }
 }
 
 std::shared_ptr<AccelBVH> createBVHAccel(const std::vector<std::shared_ptr<Object>>& objList,
-                                         int maxObjectsPerNode, const TreeSplitMethod tsp) {
-    return std::make_shared<AccelBVH>(objList, maxObjectsPerNode, tsp);
+                                         int maxObjectsPerNode, const TreeSplitMethod tsp,
+                                         const BVHLayout layout) {
+    return std::make_shared<AccelBVH>(objList, maxObjectsPerNode, tsp, layout);
+}
+
+std::shared_ptr<AccelBVH> createLazyBVHAccel(const std::vector<std::shared_ptr<Object>>& objList,
+                                             int maxObjectsPerNode) {
+    return std::make_shared<AccelBVH>(objList, maxObjectsPerNode, TreeSplitMethod::SAH,
+                                      BVHLayout::Binary, true);
+}
+
+std::shared_ptr<AccelBVH> createCachedBVHAccel(const std::vector<std::shared_ptr<Object>>& objList,
+                                               const std::string& cachePath,
+                                               int maxObjectsPerNode, const TreeSplitMethod tsp,
+                                               const BVHLayout layout) {
+    return std::make_shared<AccelBVH>(objList, cachePath, maxObjectsPerNode, tsp, layout);
+}
+
+std::shared_ptr<AccelBVH> createInstanceBVHAccel(
+        const std::vector<std::shared_ptr<InstancedObject>>& instances,
+        int maxObjectsPerNode, const BVHLayout layout) {
+    std::vector<std::shared_ptr<Object>> objList(instances.begin(), instances.end());
+    return std::make_shared<AccelBVH>(objList, maxObjectsPerNode, TreeSplitMethod::SAH, layout);
 }
 
 }  // namespace phyr
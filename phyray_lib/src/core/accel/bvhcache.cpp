@@ -0,0 +1,337 @@
+#include <core/phyr.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/shape.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <typeinfo>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace phyr {
+
+// Cache files start with this header, followed by the object order
+// as {nReferences} 32-bit indexes and the nodes of the active layout
+// at {nodeOffset}. Fields are stored in native byte order.
+struct BVHCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t layout;
+    uint64_t sceneHash;
+    uint32_t nodeSize;
+    uint32_t nReferences;
+    int32_t totalNodes, totalWideNodes;
+    double sahCost, builtSAHCost;
+    uint64_t nodeOffset;
+};
+
+static const char bvhCacheMagic[8] = { 'P', 'H', 'Y', 'R', 'B', 'V', 'H', '\0' };
+// Bump whenever the node layouts or the file format change. Versions so far:
+//  1: leaves index objects; also written by the first SBVH builds, whose
+//     leaves index references, so version 1 files are never reused
+//  2: leaves index references, binary nodes in cache locality order
+//  3: 16 bit object counts in compressed nodes
+constexpr uint32_t bvhCacheVersion = 3;
+// Nodes are stored at this alignment, so the mapped nodes stay aligned
+constexpr uint64_t bvhCacheNodeAlignment = 64;
+// Trees loaded from cache may be at most this deep, which the traversal
+// stacks have room for
+constexpr int bvhCacheMaxDepth = 64;
+
+// 64-bit FNV-1a
+constexpr uint64_t fnvOffsetBasis = 14695981039346656037ULL;
+constexpr uint64_t fnvPrime = 1099511628211ULL;
+
+template <typename T>
+inline void hashValue(uint64_t* hash, const T& value) {
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&value);
+    for (size_t i = 0; i < sizeof(T); i++) {
+        *hash ^= bytes[i];
+        *hash *= fnvPrime;
+    }
+}
+
+AccelBVH::AccelBVH(const std::vector<std::shared_ptr<Object>>& objList,
+                   const std::string& cachePath, const int maxObjectsPerNode,
+                   const TreeSplitMethod tspMethod, const BVHLayout layout) :
+    maxObjectsPerNode(std::min(DEF_MAX_OBJ_PER_NODE, maxObjectsPerNode)),
+    tspMethod(tspMethod), layout(layout), sourceObjects(objList), objectList(objList) {
+    Bounds3f bounds;
+    uint64_t sceneHash = computeSceneHash(&bounds);
+
+    if (loadCache(cachePath, sceneHash)) {
+        sceneBounds = bounds;
+        LOG_INFO_FMT("Loaded BVH from cache \"%s\" (%d nodes).", cachePath.c_str(),
+                     layout == BVHLayout::Binary ? totalNodes : totalWideNodes);
+        return;
+    }
+
+    LOG_INFO_FMT("Constructing BVH (%s)...", getTreeSplitMethodName(tspMethod));
+    LOG_INFO_FMT("Number of objects received: %d", objList.size());
+    constructBVH();
+    LOG_INFO("Done constructing BVH.");
+
+    if (!objectList.empty() && saveCache(cachePath, sceneHash, objList))
+        LOG_INFO_FMT("Wrote BVH cache \"%s\".", cachePath.c_str());
+}
+
+uint64_t AccelBVH::computeSceneHash(Bounds3f* bounds) const {
+    uint64_t hash = fnvOffsetBasis;
+    hashValue(&hash, uint64_t(sourceObjects.size()));
+    hashValue(&hash, int32_t(maxObjectsPerNode));
+    hashValue(&hash, int32_t(tspMethod));
+    hashValue(&hash, int32_t(layout));
+
+    // Object and spatial splits only depend on the object bounds, but the
+    // bounds of split objects are clipped to the geometry, so spatial
+    // splits also depend on the shape types and their clip parameters.
+    // Values are hashed as doubles, as {Real} may hold padding bytes.
+    std::vector<Real> clipParams;
+    for (size_t i = 0; i < sourceObjects.size(); i++) {
+        const Object* object = sourceObjects[i].get();
+        Bounds3f b = object->worldBounds();
+        for (int axis = 0; axis < 3; axis++) {
+            hashValue(&hash, double(b.pMin[axis]));
+            hashValue(&hash, double(b.pMax[axis]));
+        }
+        *bounds = i == 0 ? b : unionBounds(*bounds, b);
+        if (tspMethod != TreeSplitMethod::SBVH) continue;
+
+        const GeometricObject* geometric = dynamic_cast<const GeometricObject*>(object);
+        const std::type_info& type = geometric ? typeid(*geometric->getShape()) : typeid(*object);
+        for (const char* c = type.name(); *c; c++) hashValue(&hash, *c);
+        clipParams.clear();
+        object->getClipParameters(&clipParams);
+        hashValue(&hash, uint64_t(clipParams.size()));
+        for (Real param : clipParams) hashValue(&hash, double(param));
+    }
+
+    return hash;
+}
+
+/**
+ * Checks that the children of each of the {nNodes} nodes are stored after
+ * it, within the array, that leaves reference objects in [0, {nReferences}),
+ * and that the tree fits the traversal stacks. Traversal of a damaged
+ * file thus stays within the mapping.
+ */
+static bool validateNodes(const LinearBVHNode* nodes, int nNodes, uint32_t nReferences) {
+    std::vector<int> depth(nNodes, 0);
+    for (int i = 0; i < nNodes; i++) {
+        const LinearBVHNode& node = nodes[i];
+        if (node.nObjects > 0) {
+            if (node.objectStartIdx < 0 ||
+                uint64_t(node.objectStartIdx) + node.nObjects > nReferences)
+                return false;
+            continue;
+        }
+
+        // Lazy subtrees are never cached
+        if (node.splitAxis > 2 || i + 1 >= nNodes || node.secondChildIdx <= i + 1 ||
+            node.secondChildIdx >= nNodes || depth[i] + 1 >= bvhCacheMaxDepth)
+            return false;
+        depth[i + 1] = std::max(depth[i + 1], depth[i] + 1);
+        depth[node.secondChildIdx] = std::max(depth[node.secondChildIdx], depth[i] + 1);
+    }
+    return true;
+}
+
+template <typename NodeType>
+static bool validateWideNodes(const NodeType* nodes, int nNodes, uint32_t nReferences) {
+    std::vector<int> depth(nNodes, 0);
+    for (int i = 0; i < nNodes; i++) {
+        const NodeType& node = nodes[i];
+        for (int lane = 0; lane < NodeType::width; lane++) {
+            int idx = node.childIdx[lane];
+            if (idx < 0) continue;
+            if (node.nObjects[lane] > 0) {
+                if (uint64_t(idx) + node.nObjects[lane] > nReferences) return false;
+                continue;
+            }
+
+            if (idx <= i || idx >= nNodes || depth[i] + 1 >= bvhCacheMaxDepth) return false;
+            depth[idx] = std::max(depth[idx], depth[i] + 1);
+        }
+    }
+    return true;
+}
+
+bool AccelBVH::loadCache(const std::string& path, uint64_t sceneHash) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || size_t(fileStat.st_size) < sizeof(BVHCacheHeader)) {
+        close(fd);
+        return false;
+    }
+
+    // Map privately, so that refitting writes to copies of the pages
+    size_t fileSize = fileStat.st_size;
+    void* mapping = mmap(nullptr, fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    const char* data = static_cast<const char*>(mapping);
+    const BVHCacheHeader* header = reinterpret_cast<const BVHCacheHeader*>(data);
+
+    size_t nodeSize = 0;
+    int nNodes = layout == BVHLayout::Binary ? header->totalNodes : header->totalWideNodes;
+    switch (layout) {
+        case BVHLayout::Binary: nodeSize = sizeof(LinearBVHNode); break;
+        case BVHLayout::Wide4: nodeSize = sizeof(WideBVHNode<4>); break;
+        case BVHLayout::Wide8: nodeSize = sizeof(WideBVHNode<8>); break;
+        case BVHLayout::Compressed: nodeSize = sizeof(CompressedBVHNode); break;
+    }
+
+    bool valid = std::memcmp(header->magic, bvhCacheMagic, sizeof(bvhCacheMagic)) == 0 &&
+                 header->version == bvhCacheVersion && header->sceneHash == sceneHash &&
+                 header->layout == uint32_t(layout) && header->nodeSize == nodeSize &&
+                 header->nReferences >= sourceObjects.size() && nNodes > 0 &&
+                 header->nodeOffset % bvhCacheNodeAlignment == 0 &&
+                 header->nodeOffset >= sizeof(BVHCacheHeader) +
+                                       uint64_t(header->nReferences) * sizeof(uint32_t) &&
+                 header->nodeOffset + nNodes * nodeSize <= fileSize;
+
+    // Reorder the objects as they were ordered by the build. Objects
+    // split by the SBVH builder are referenced more than once.
+    const uint32_t* objectOrder = reinterpret_cast<const uint32_t*>(data + sizeof(BVHCacheHeader));
+    std::vector<std::shared_ptr<Object>> orderedObjectList(valid ? header->nReferences : 0);
+    for (size_t i = 0; valid && i < orderedObjectList.size(); i++) {
+        valid = objectOrder[i] < sourceObjects.size();
+        if (valid) orderedObjectList[i] = sourceObjects[objectOrder[i]];
+    }
+
+    // Check the node indices before any traversal relies on them
+    const char* nodeData = data + header->nodeOffset;
+    if (valid) {
+        switch (layout) {
+            case BVHLayout::Binary:
+                valid = validateNodes(reinterpret_cast<const LinearBVHNode*>(nodeData), nNodes,
+                                      header->nReferences);
+                break;
+            case BVHLayout::Wide4:
+                valid = validateWideNodes(reinterpret_cast<const WideBVHNode<4>*>(nodeData), nNodes,
+                                          header->nReferences);
+                break;
+            case BVHLayout::Wide8:
+                valid = validateWideNodes(reinterpret_cast<const WideBVHNode<8>*>(nodeData), nNodes,
+                                          header->nReferences);
+                break;
+            case BVHLayout::Compressed:
+                valid = validateWideNodes(reinterpret_cast<const CompressedBVHNode*>(nodeData),
+                                          nNodes, header->nReferences);
+                break;
+        }
+    }
+
+    if (!valid) {
+        LOG_WARNING_FMT("BVH cache \"%s\" is stale or invalid, rebuilding.", path.c_str());
+        munmap(mapping, fileSize);
+        return false;
+    }
+
+    // The stored order already has the leaves grouped by object type
+    objectList.swap(orderedObjectList);
+    createLeafObjects(false);
+
+    void* nodes = static_cast<char*>(mapping) + header->nodeOffset;
+    switch (layout) {
+        case BVHLayout::Binary: bvhNodes = static_cast<LinearBVHNode*>(nodes); break;
+        case BVHLayout::Wide4: wide4Nodes = static_cast<WideBVHNode<4>*>(nodes); break;
+        case BVHLayout::Wide8: wide8Nodes = static_cast<WideBVHNode<8>*>(nodes); break;
+        case BVHLayout::Compressed: compressedNodes = static_cast<CompressedBVHNode*>(nodes); break;
+    }
+
+    totalNodes = header->totalNodes;
+    totalWideNodes = header->totalWideNodes;
+    sahCost = header->sahCost;
+    builtSAHCost = header->builtSAHCost;
+
+    cacheMapping = mapping;
+    cacheMappingSize = fileSize;
+    return true;
+}
+
+// Writes {size} bytes to {fd}, retrying short writes
+static bool writeAll(int fd, const void* data, size_t size) {
+    const char* bytes = static_cast<const char*>(data);
+    while (size > 0) {
+        ssize_t n = write(fd, bytes, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        bytes += n;
+        size -= n;
+    }
+    return true;
+}
+
+bool AccelBVH::saveCache(const std::string& path, uint64_t sceneHash,
+                         const std::vector<std::shared_ptr<Object>>& objList) const {
+    // Map each object back to its index in the list the BVH was created with
+    std::unordered_map<const Object*, uint32_t> objectIdx;
+    objectIdx.reserve(objList.size());
+    for (size_t i = 0; i < objList.size(); i++) objectIdx[objList[i].get()] = i;
+
+    std::vector<uint32_t> objectOrder(objectList.size());
+    for (size_t i = 0; i < objectList.size(); i++)
+        objectOrder[i] = objectIdx[objectList[i].get()];
+
+    BVHCacheHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, bvhCacheMagic, sizeof(bvhCacheMagic));
+    header.version = bvhCacheVersion;
+    header.layout = uint32_t(layout);
+    header.sceneHash = sceneHash;
+    header.nReferences = objectList.size();
+    header.totalNodes = totalNodes;
+    header.totalWideNodes = totalWideNodes;
+    header.sahCost = sahCost;
+    header.builtSAHCost = builtSAHCost;
+
+    uint64_t orderEnd = sizeof(header) + objectOrder.size() * sizeof(uint32_t);
+    header.nodeOffset = (orderEnd + bvhCacheNodeAlignment - 1) & ~(bvhCacheNodeAlignment - 1);
+
+    const char* nodes = nullptr;
+    switch (layout) {
+        case BVHLayout::Binary: nodes = reinterpret_cast<const char*>(bvhNodes); break;
+        case BVHLayout::Wide4: nodes = reinterpret_cast<const char*>(wide4Nodes); break;
+        case BVHLayout::Wide8: nodes = reinterpret_cast<const char*>(wide8Nodes); break;
+        case BVHLayout::Compressed: nodes = reinterpret_cast<const char*>(compressedNodes); break;
+    }
+    header.nodeSize = getNodeMemory() / (layout == BVHLayout::Binary ? totalNodes : totalWideNodes);
+
+    // Write to a uniquely named temporary file first, so that concurrent
+    // runs neither map a partially written cache nor write to the same file
+    std::vector<char> tmpPath(path.begin(), path.end());
+    const char tmpSuffix[] = ".XXXXXX";
+    tmpPath.insert(tmpPath.end(), tmpSuffix, tmpSuffix + sizeof(tmpSuffix));
+    int fd = mkstemp(tmpPath.data());
+    if (fd < 0) {
+        LOG_ERR_FMT("Unable to create a temporary file for \"%s\".", path.c_str());
+        return false;
+    }
+
+    const char padding[bvhCacheNodeAlignment] = {};
+    bool written = fchmod(fd, 0644) == 0 &&
+                   writeAll(fd, &header, sizeof(header)) &&
+                   writeAll(fd, objectOrder.data(), objectOrder.size() * sizeof(uint32_t)) &&
+                   writeAll(fd, padding, header.nodeOffset - orderEnd) &&
+                   writeAll(fd, nodes, getNodeMemory());
+    written &= close(fd) == 0;
+
+    if (!written || std::rename(tmpPath.data(), path.c_str()) != 0) {
+        LOG_ERR_FMT("Error while writing BVH cache \"%s\".", path.c_str());
+        std::remove(tmpPath.data());
+        return false;
+    }
+
+    return true;
+}
+
+}  // namespace phyr
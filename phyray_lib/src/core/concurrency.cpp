@@ -1,10 +1,20 @@
 #include <core/phyr.h>
 #include <core/concurrency.h>
 #include <core/debug.h>
+#include <core/phyr_mem.h>
 
-#include <list>
+#include <algorithm>
+#include <deque>
 #include <memory>
+#include <new>
+#include <string>
 #include <thread>
+#include <fstream>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 
 /*
  * Code adapted from pbrt-v3 for use with PhyRay
@@ -14,14 +24,14 @@ namespace phyr {
 
 // Parallel Local Definitions
 static std::vector<std::thread> threads;
-static bool shutdownThreads = false;
-class ParallelForLoop;
-static ParallelForLoop* workList = nullptr;
-static std::mutex workListMutex;
+static std::atomic<bool> shutdownThreads{false};
+// Thread count requested through parallelInit(); 0 if unspecified
+static int nRequestedThreads = 0;
 
 // Bookkeeping variables to help with the implementation of
-// MergeWorkerThreadStats().
-static std::atomic<bool> reportWorkerStats{false};
+// MergeWorkerThreadStats(). Each request bumps the generation, which
+// every worker reports once.
+static std::atomic<int> reportGeneration{0};
 // Number of workers that still need to report their stats.
 static std::atomic<int> reporterCount;
 // After kicking the workers to report their stats, the main thread waits
@@ -29,34 +39,192 @@ static std::atomic<int> reporterCount;
 static std::condition_variable reportDoneCondition;
 static std::mutex reportDoneMutex;
 
+// Idle workers, and threads waiting in runLoop() for their loop to
+// complete, sleep on this condition variable. Queuing work or completing a
+// loop only takes the mutex when some thread is asleep.
+static std::mutex sleepMutex;
+static std::condition_variable sleepCondition;
+static std::atomic<int> nSleepingWorkers{0};
+// Number of ranges in all of the work queues
+static std::atomic<int64_t> nQueuedRanges{0};
+
 class ParallelForLoop {
   public:
     // ParallelForLoop Public Methods
     ParallelForLoop(std::function<void(int64_t)> func1D, int64_t maxIndex, int chunkSize)
-        : func1D(std::move(func1D)), maxIndex(maxIndex), chunkSize(chunkSize) {}
+        : func1D(std::move(func1D)), maxIndex(maxIndex), chunkSize(chunkSize),
+          nRemaining(maxIndex) {}
 
     ParallelForLoop(const std::function<void(Point2i)>& f, const Point2i& count)
-        : func2D(f), maxIndex(count.x * count.y), chunkSize(1) {
+        : func2D(f), maxIndex(count.x * count.y), chunkSize(1), nRemaining(maxIndex) {
         nX = count.x;
     }
 
+    ParallelForLoop(std::function<void(int64_t, int64_t)> funcBlock, int64_t indexOffset,
+                    int64_t maxIndex, int64_t chunkSize)
+        : funcBlock(std::move(funcBlock)), maxIndex(maxIndex), chunkSize(chunkSize),
+          nRemaining(maxIndex), indexOffset(indexOffset) {}
+
   public:
     // ParallelForLoop Private Data
     std::function<void(int64_t)> func1D;
     std::function<void(Point2i)> func2D;
+    std::function<void(int64_t, int64_t)> funcBlock;
     const int64_t maxIndex;
-    const int chunkSize;
-    int64_t nextIndex = 0;
-    int activeWorkers = 0;
-    ParallelForLoop *next = nullptr;
+    const int64_t chunkSize;
+    // Iterations not yet run to completion
+    std::atomic<int64_t> nRemaining;
     int nX = -1;
+    // Added to the indices passed to {funcBlock}
+    int64_t indexOffset = 0;
 
     // ParallelForLoop Private Methods
-    bool finished() const {
-        return nextIndex >= maxIndex && activeWorkers == 0;
-    }
+    bool finished() const { return nRemaining == 0; }
 };
 
+// Iterations [start, end) of a loop, the unit of work that is queued and stolen
+struct WorkRange {
+    ParallelForLoop* loop;
+    int64_t start, end;
+};
+
+/**
+ * Ranges queued by one thread. The owner pushes and pops at the back, so it
+ * works depth first on the ranges it split last, while other threads steal
+ * from the front, where the largest ranges are.
+ */
+struct alignas(DEF_PHYR_L1_CACHE_LINESZ) WorkQueue {
+    std::mutex mutex;
+    std::deque<WorkRange> ranges;
+};
+
+// One queue per thread, indexed by ThreadIndex. Allocated with allocAligned()
+// since new does not honour the cache line alignment of WorkQueue.
+static WorkQueue* workQueues = nullptr;
+static int nWorkQueues = 0;
+// Queues each thread steals from, in order, indexed by ThreadIndex. Queues
+// of threads on the same NUMA node come first.
+static std::vector<std::vector<int>> stealOrder;
+
+// NUMA node each thread is pinned to, indexed by ThreadIndex; empty if
+// threads are not pinned
+static std::vector<int> threadNodes;
+static int nThreadNodes = 1;
+#ifdef __linux__
+// Affinity of the main thread before parallelInit() pinned it
+static cpu_set_t mainThreadCpus;
+#endif
+static bool mainThreadPinned = false;
+
+static void pushRange(WorkQueue& queue, const WorkRange& range) {
+    {
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.ranges.push_back(range);
+    }
+    // Pairs with the sleeping worker incrementing nSleepingWorkers before
+    // checking nQueuedRanges, so that one of the two sees the other
+    nQueuedRanges++;
+    if (nSleepingWorkers > 0) {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_one();
+    }
+}
+
+static bool popRange(WorkQueue& queue, WorkRange* range) {
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (queue.ranges.empty()) return false;
+    *range = queue.ranges.back();
+    queue.ranges.pop_back();
+    nQueuedRanges--;
+    return true;
+}
+
+/**
+ * Takes the oldest range of another thread's queue, trying the threads in
+ * the steal order of {tIndex}
+ */
+static bool stealRange(int tIndex, WorkRange* range) {
+    const std::vector<int>& victims = stealOrder[tIndex % nWorkQueues];
+    for (size_t i = 0; i < victims.size() && nQueuedRanges > 0; i++) {
+        WorkQueue& victim = workQueues[victims[i]];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (victim.ranges.empty()) continue;
+        *range = victim.ranges.front();
+        victim.ranges.pop_front();
+        nQueuedRanges--;
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Runs {range}, first halving it on chunk boundaries and queuing the upper
+ * halves in {queue} for other threads to steal, until one chunk is left
+ */
+static void runRange(WorkQueue& queue, WorkRange range) {
+    ParallelForLoop& loop = *range.loop;
+    int64_t nChunks = (range.end - range.start + loop.chunkSize - 1) / loop.chunkSize;
+    while (nChunks > 1) {
+        int64_t mid = range.start + (nChunks / 2) * loop.chunkSize;
+        pushRange(queue, WorkRange{range.loop, mid, range.end});
+        range.end = mid;
+        nChunks /= 2;
+    }
+
+    // Run loop indices in _[range.start, range.end)_, choosing the type of
+    // loop once for the whole range
+    if (loop.funcBlock) {
+        loop.funcBlock(loop.indexOffset + range.start, loop.indexOffset + range.end);
+    } else if (loop.func1D) {
+        for (int64_t index = range.start; index < range.end; ++index) loop.func1D(index);
+    } else {
+        ASSERT(loop.func2D);
+        for (int64_t index = range.start; index < range.end; ++index)
+            loop.func2D(Point2i(index % loop.nX, index / loop.nX));
+    }
+
+    // The loop may be destroyed by its owner as soon as this reaches zero,
+    // so only the returned count is used afterwards
+    int64_t nRun = range.end - range.start;
+    if (loop.nRemaining.fetch_sub(nRun) == nRun && nSleepingWorkers > 0) {
+        // Wake the thread waiting for the loop in runLoop()
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        sleepCondition.notify_all();
+    }
+}
+
+/**
+ * Runs one range from the queue of {tIndex}, or else one stolen from
+ * another thread. Returns false if there was no work to do.
+ */
+static bool runQueuedRange(int tIndex) {
+    WorkQueue& queue = workQueues[tIndex % nWorkQueues];
+    WorkRange range;
+    if (!popRange(queue, &range) && !stealRange(tIndex, &range)) return false;
+    runRange(queue, range);
+    return true;
+}
+
+/**
+ * Queues all iterations of {loop} in the calling thread's queue and helps
+ * run ranges until they have all completed. Ranges of other loops may run
+ * in the meantime, which is what lets nested loops make progress.
+ */
+static void runLoop(ParallelForLoop& loop) {
+    int tIndex = ThreadIndex;
+    pushRange(workQueues[tIndex % nWorkQueues], WorkRange{&loop, 0, loop.maxIndex});
+    while (!loop.finished()) {
+        if (runQueuedRange(tIndex)) continue;
+
+        // Sleep until there are more ranges to run or the last ranges of
+        // the loop, running on other threads, complete
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        nSleepingWorkers++;
+        sleepCondition.wait(lock, [&] { return loop.finished() || nQueuedRanges > 0; });
+        nSleepingWorkers--;
+    }
+}
+
 void Barrier::wait() {
     std::unique_lock<std::mutex> lock(mutex);
     ASSERT(count > 0);
@@ -71,11 +239,134 @@ void Barrier::wait() {
         cv.wait(lock, [this] { return count == 0; });
 }
 
-static std::condition_variable workListCondition;
+/**
+ * Parses a CPU list as found in sysfs, e.g. "0-7,16-23"
+ */
+static std::vector<int> parseCpuList(const std::string& list) {
+    std::vector<int> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        size_t end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        std::string item = list.substr(pos, end - pos);
+        size_t dash = item.find('-');
+        try {
+            int first = std::stoi(item.substr(0, dash));
+            int last = dash == std::string::npos ? first : std::stoi(item.substr(dash + 1));
+            for (int cpu = first; cpu <= last; cpu++) cpus.push_back(cpu);
+        } catch (const std::exception&) {}
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+/**
+ * Returns the CPUs the calling thread may run on, grouped by NUMA node.
+ * Without NUMA information all of them are in a single node.
+ */
+static std::vector<std::vector<int>> getNumaNodeCpus() {
+    std::vector<std::vector<int>> nodes;
+#ifdef __linux__
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0) {
+        // Node numbers may have gaps when nodes are offline
+        for (int node = 0; node < 64; node++) {
+            std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!file || !std::getline(file, list)) continue;
+
+            std::vector<int> cpus;
+            for (int cpu : parseCpuList(list))
+                if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+            if (!cpus.empty()) nodes.push_back(cpus);
+        }
+
+        if (nodes.empty()) {
+            nodes.resize(1);
+            for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+                if (CPU_ISSET(cpu, &allowed)) nodes[0].push_back(cpu);
+        }
+        return nodes;
+    }
+#endif
+    nodes.resize(1);
+    for (int cpu = 0; cpu < int(std::max(1u, std::thread::hardware_concurrency())); cpu++)
+        nodes[0].push_back(cpu);
+    return nodes;
+}
+
+/**
+ * Restricts the calling thread to run on {cpu}
+ */
+static void pinThread(int cpu) {
+#ifdef __linux__
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    CPU_SET(cpu, &cpus);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) != 0)
+        LOG_WARNING_FMT("Could not pin thread %d to CPU %d", ThreadIndex, cpu);
+#else
+    LOG_WARNING_FMT("Pinning threads is not supported, thread %d is not pinned", ThreadIndex);
+#endif
+}
 
-static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
+/**
+ * Assigns a CPU to each of {nThreads} threads by {affinity}, returned in
+ * {threadCpus}, and sets up the NUMA node and steal order of each thread
+ */
+static void placeThreads(int nThreads, ThreadAffinity affinity, std::vector<int>* threadCpus) {
+    stealOrder.assign(nThreads, std::vector<int>());
+    threadNodes.clear();
+    nThreadNodes = 1;
+    if (affinity != ThreadAffinity::None) {
+        std::vector<std::vector<int>> nodes = getNumaNodeCpus();
+
+        // Order the CPUs node by node for compact placement, and round robin
+        // over the nodes for scattered placement
+        std::vector<std::pair<int, int>> cpuNodes;
+        size_t maxNodeCpus = 0;
+        for (const auto& cpus : nodes) maxNodeCpus = std::max(maxNodeCpus, cpus.size());
+        if (affinity == ThreadAffinity::Compact) {
+            for (size_t n = 0; n < nodes.size(); n++)
+                for (int cpu : nodes[n]) cpuNodes.push_back(std::make_pair(cpu, int(n)));
+        } else {
+            for (size_t i = 0; i < maxNodeCpus; i++)
+                for (size_t n = 0; n < nodes.size(); n++)
+                    if (i < nodes[n].size()) cpuNodes.push_back(std::make_pair(nodes[n][i], int(n)));
+        }
+
+        // More threads than CPUs share them in turn
+        for (int t = 0; t < nThreads; t++) {
+            const std::pair<int, int>& cpuNode = cpuNodes[t % cpuNodes.size()];
+            threadCpus->push_back(cpuNode.first);
+            threadNodes.push_back(cpuNode.second);
+        }
+
+        // Compact placement may leave nodes without threads
+        std::vector<bool> nodeUsed(nodes.size(), false);
+        for (int node : threadNodes) nodeUsed[node] = true;
+        nThreadNodes = int(std::count(nodeUsed.begin(), nodeUsed.end(), true));
+    }
+
+    // Steal from threads on the same node first, then from the others, each
+    // starting after the thread itself so that thieves spread over victims
+    for (int t = 0; t < nThreads; t++) {
+        for (int sameNode = 1; sameNode >= 0; sameNode--) {
+            for (int i = 1; i < nThreads; i++) {
+                int victim = (t + i) % nThreads;
+                bool same = threadNodes.empty() || threadNodes[victim] == threadNodes[t];
+                if (same == bool(sameNode)) stealOrder[t].push_back(victim);
+            }
+        }
+    }
+}
+
+static void workerThreadFunc(int tIndex, int cpu, std::shared_ptr<Barrier> barrier) {
     LOG_INFO_FMT("Started execution in worker thread %d", tIndex);
     ThreadIndex = tIndex;
+    // Pin before anything is allocated, so that the worker's memory is
+    // first touched on its NUMA node
+    if (cpu >= 0) pinThread(cpu);
 
     // The main thread sets up a barrier so that it can be sure that all
     // workers have called ProfilerWorkerThreadInit() before it continues
@@ -86,52 +377,30 @@ static void workerThreadFunc(int tIndex, std::shared_ptr<Barrier> barrier) {
     // the threads have cleared it.
     barrier.reset();
 
-    std::unique_lock<std::mutex> lock(workListMutex);
+    int reportedGeneration = reportGeneration;
     while (!shutdownThreads) {
-        if (reportWorkerStats) {
-            if (--reporterCount == 0)
+        // Run ranges from our own queue, stealing from the others when empty
+        if (runQueuedRange(tIndex)) continue;
+
+        if (reportedGeneration != reportGeneration) {
+            reportedGeneration = reportGeneration;
+            if (--reporterCount == 0) {
                 // Once all worker threads have merged their stats, wake up
                 // the main thread.
+                std::lock_guard<std::mutex> lock(reportDoneMutex);
                 reportDoneCondition.notify_one();
-            // Now sleep again.
-            workListCondition.wait(lock);
-        } else if (!workList) {
-            // Sleep until there are more tasks to run
-            workListCondition.wait(lock);
-        } else {
-            // Get work from _workList_ and run loop iterations
-            ParallelForLoop &loop = *workList;
-
-            // Run a chunk of loop iterations for _loop_
-
-            // Find the set of loop iterations to run next
-            int64_t indexStart = loop.nextIndex;
-            int64_t indexEnd =
-                std::min(indexStart + loop.chunkSize, loop.maxIndex);
-
-            // Update _loop_ to reflect iterations this thread will run
-            loop.nextIndex = indexEnd;
-            if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-            loop.activeWorkers++;
-
-            // Run loop indices in _[indexStart, indexEnd)_
-            lock.unlock();
-            for (int64_t index = indexStart; index < indexEnd; ++index) {
-                if (loop.func1D) {
-                    loop.func1D(index);
-                }
-                // Handle other types of loops
-                else {
-                    ASSERT(loop.func2D);
-                    loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-                }
             }
-            lock.lock();
-
-            // Update _loop_ to reflect completion of iterations
-            loop.activeWorkers--;
-            if (loop.finished()) workListCondition.notify_all();
+            continue;
         }
+
+        // Sleep until there are more ranges to run
+        std::unique_lock<std::mutex> lock(sleepMutex);
+        nSleepingWorkers++;
+        sleepCondition.wait(lock, [&] {
+            return shutdownThreads || nQueuedRanges > 0 ||
+                   reportedGeneration != reportGeneration;
+        });
+        nSleepingWorkers--;
     }
     LOG_INFO_FMT("Exiting worker thread %d", tIndex);
 }
@@ -146,52 +415,15 @@ void ParallelFor(std::function<void(int64_t)> func, int64_t count, int chunkSize
         return;
     }
 
-    // Create and enqueue _ParallelForLoop_ for this loop
     ParallelForLoop loop(std::move(func), count, chunkSize);
-    workListMutex.lock();
-    loop.next = workList;
-    workList = &loop;
-    workListMutex.unlock();
-
-    // Notify worker threads of work to be done
-    std::unique_lock<std::mutex> lock(workListMutex);
-    workListCondition.notify_all();
-
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.finished()) {
-        // Run a chunk of loop iterations for _loop_
-
-        // Find the set of loop iterations to run next
-        int64_t indexStart = loop.nextIndex;
-        int64_t indexEnd = std::min(indexStart + loop.chunkSize, loop.maxIndex);
-
-        // Update _loop_ to reflect iterations this thread will run
-        loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-        loop.activeWorkers++;
-
-        // Run loop indices in _[indexStart, indexEnd)_
-        lock.unlock();
-        for (int64_t index = indexStart; index < indexEnd; ++index) {
-            if (loop.func1D) {
-                loop.func1D(index);
-            }
-            // Handle other types of loops
-            else {
-                ASSERT(loop.func2D);
-                loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-            }
-        }
-        lock.lock();
-
-        // Update _loop_ to reflect completion of iterations
-        loop.activeWorkers--;
-    }
+    runLoop(loop);
 }
 
 thread_local int ThreadIndex;
 
-int maxThreadIndex() { return numSystemCores(); }
+int maxThreadIndex() {
+    return nRequestedThreads > 0 ? nRequestedThreads : numSystemCores();
+}
 
 void ParallelFor2D(std::function<void(Point2i)> func, const Point2i& count) {
     ASSERT(threads.size() > 0 || maxThreadIndex() == 1);
@@ -203,99 +435,128 @@ void ParallelFor2D(std::function<void(Point2i)> func, const Point2i& count) {
     }
 
     ParallelForLoop loop(std::move(func), count);
-    {
-        std::lock_guard<std::mutex> lock(workListMutex);
-        loop.next = workList;
-        workList = &loop;
-    }
-
-    std::unique_lock<std::mutex> lock(workListMutex);
-    workListCondition.notify_all();
+    runLoop(loop);
+}
 
-    // Help out with parallel loop iterations in the current thread
-    while (!loop.finished()) {
-        // Run a chunk of loop iterations for _loop_
-
-        // Find the set of loop iterations to run next
-        int64_t indexStart = loop.nextIndex;
-        int64_t indexEnd = std::min(indexStart + loop.chunkSize, loop.maxIndex);
-
-        // Update _loop_ to reflect iterations this thread will run
-        loop.nextIndex = indexEnd;
-        if (loop.nextIndex == loop.maxIndex) workList = loop.next;
-        loop.activeWorkers++;
-
-        // Run loop indices in _[indexStart, indexEnd)_
-        lock.unlock();
-        for (int64_t index = indexStart; index < indexEnd; ++index) {
-            if (loop.func1D) {
-                loop.func1D(index);
-            }
-            // Handle other types of loops
-            else {
-                ASSERT(loop.func2D);
-                loop.func2D(Point2i(index % loop.nX, index / loop.nX));
-            }
-        }
-        lock.lock();
+void ParallelForBlocks(std::function<void(int64_t, int64_t)> func, int64_t begin,
+                       int64_t end, int64_t grain) {
+    ASSERT(threads.size() > 0 || maxThreadIndex() == 1);
+    grain = std::max(int64_t(1), grain);
 
-        // Update _loop_ to reflect completion of iterations
-        loop.activeWorkers--;
+    // Run the whole range as one block if not using threads or if it is small
+    if (threads.empty() || end - begin <= grain) {
+        if (begin < end) func(begin, end);
+        return;
     }
+
+    ParallelForLoop loop(std::move(func), begin, end - begin, grain);
+    runLoop(loop);
 }
 
 int numSystemCores() {
-    return std::max(1u, std::thread::hardware_concurrency());
+    // Counted once, before parallelInit() may pin the main thread
+    static const int nCores = [] {
+#ifdef __linux__
+        cpu_set_t allowed;
+        if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+            return std::max(1, CPU_COUNT(&allowed));
+#endif
+        return int(std::max(1u, std::thread::hardware_concurrency()));
+    }();
+    return nCores;
+}
+
+int numNumaNodes() {
+    return nThreadNodes;
+}
+
+int threadNumaNode() {
+    return threadNodes.empty() ? 0 : threadNodes[ThreadIndex % threadNodes.size()];
 }
 
-void parallelInit() {
+void parallelInit(int nThreads, ThreadAffinity affinity) {
     ASSERT(threads.size() == 0);
-    int nThreads = maxThreadIndex();
+    nRequestedThreads = std::max(0, nThreads);
+    nThreads = maxThreadIndex();
     ThreadIndex = 0;
 
+    // Choose the CPU of each thread before pinning the main thread, which
+    // would restrict the CPUs that are found
+    std::vector<int> threadCpus;
+    placeThreads(nThreads, affinity, &threadCpus);
+    if (!threadCpus.empty()) {
+#ifdef __linux__
+        mainThreadPinned = pthread_getaffinity_np(pthread_self(), sizeof(mainThreadCpus),
+                                                  &mainThreadCpus) == 0;
+        if (mainThreadPinned) pinThread(threadCpus[0]);
+#endif
+        LOG_INFO_FMT("Pinned %d threads over %d NUMA nodes", nThreads, nThreadNodes);
+    }
+
     // Create a barrier so that we can be sure all worker threads get past
     // their call to ProfilerWorkerThreadInit() before we return from this
     // function.  In turn, we can be sure that the profiling system isn't
     // started until after all worker threads have done that.
     std::shared_ptr<Barrier> barrier = std::make_shared<Barrier>(nThreads);
 
+    // One work queue for each thread, including the main thread
+    workQueues = allocAligned<WorkQueue>(nThreads);
+    for (int i = 0; i < nThreads; ++i) new (&workQueues[i]) WorkQueue();
+    nWorkQueues = nThreads;
+
     // Launch one fewer worker thread than the total number we want doing
     // work, since the main thread helps out, too.
-    for (int i = 0; i < nThreads - 1; ++i)
-        threads.push_back(std::thread(workerThreadFunc, i + 1, barrier));
+    for (int i = 0; i < nThreads - 1; ++i) {
+        int cpu = threadCpus.empty() ? -1 : threadCpus[i + 1];
+        threads.push_back(std::thread(workerThreadFunc, i + 1, cpu, barrier));
+    }
 
     barrier->wait();
 }
 
 void parallelCleanup() {
+    nRequestedThreads = 0;
+#ifdef __linux__
+    // Let the main thread run anywhere it could before
+    if (mainThreadPinned)
+        pthread_setaffinity_np(pthread_self(), sizeof(mainThreadCpus), &mainThreadCpus);
+#endif
+    mainThreadPinned = false;
+    threadNodes.clear();
+    nThreadNodes = 1;
     if (threads.empty()) return;
 
     {
-        std::lock_guard<std::mutex> lock(workListMutex);
+        std::lock_guard<std::mutex> lock(sleepMutex);
         shutdownThreads = true;
-        workListCondition.notify_all();
+        sleepCondition.notify_all();
     }
 
     for (std::thread &thread : threads) thread.join();
     threads.erase(threads.begin(), threads.end());
+    for (int i = 0; i < nWorkQueues; ++i) workQueues[i].~WorkQueue();
+    freeAligned(workQueues);
+    workQueues = nullptr;
+    nWorkQueues = 0;
+    stealOrder.clear();
     shutdownThreads = false;
 }
 
 void mergeWorkerThreadStats() {
-    std::unique_lock<std::mutex> lock(workListMutex);
+    if (threads.empty()) return;
     std::unique_lock<std::mutex> doneLock(reportDoneMutex);
     // Set up state so that the worker threads will know that we would like
     // them to report their thread-specific stats when they wake up.
-    reportWorkerStats = true;
     reporterCount = threads.size();
-
-    // Wake up the worker threads.
-    workListCondition.notify_all();
+    {
+        std::lock_guard<std::mutex> lock(sleepMutex);
+        reportGeneration++;
+        // Wake up the worker threads.
+        sleepCondition.notify_all();
+    }
 
     // Wait for all of them to merge their stats.
-    reportDoneCondition.wait(lock, []() { return reporterCount == 0; });
-
-    reportWorkerStats = false;
+    reportDoneCondition.wait(doneLock, []() { return reporterCount == 0; });
 }
 
 }  // namespace phyr
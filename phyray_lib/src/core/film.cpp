@@ -5,6 +5,9 @@
 
 namespace phyr {
 
+// Pixels converted per block of the parallel loops over the whole film
+static constexpr int64_t filmConversionGrain = 4096;
+
 // FilmTile definitions
 void FilmTile::addSample(const Point2f& pFilm, const Spectrum& L, Real sampleWeight) {
     // Compute sample's raster bounds
@@ -49,9 +52,9 @@ void FilmTile::addSample(const Point2f& pFilm, const Spectrum& L, Real sampleWei
 // Film definitions
 Film::Film(const Point2i& resolution, const Bounds2f& cropWindow,
            std::unique_ptr<Filter> _filter, Real filmSize,
-           const std::string& filename, Real scale) :
+           const std::string& filename, Real scale, SplatMode splatMode) :
     resolution(resolution), filmSize(filmSize * .001), filter(std::move(_filter)),
-    filename(filename), scale(scale) {
+    filename(filename), scale(scale), splatMode(splatMode) {
     // Compute film image bounds
     croppedImageBounds = Bounds2i(Point2i(std::ceil(resolution.x * cropWindow.pMin.x),
                                           std::ceil(resolution.y * cropWindow.pMin.y)),
@@ -60,6 +63,10 @@ Film::Film(const Point2i& resolution, const Bounds2f& cropWindow,
 
     // Allocate memory for image pixels
     pixels = std::unique_ptr<Pixel[]>(new Pixel[croppedImageBounds.area()]);
+    if (splatMode == SplatMode::ThreadBuffers) {
+        nSplatBuffers = maxThreadIndex();
+        splatBuffers.reset(new std::unique_ptr<Real[]>[nSplatBuffers]);
+    }
 
     // Precompute filter weight table
     Real invFilterTableSize = Real(1) / filterTableSize;
@@ -111,33 +118,59 @@ std::unique_ptr<FilmTile> Film::getFilmTile(const Bounds2i& sampleBounds) {
 }
 
 void Film::mergeFilmTile(std::unique_ptr<FilmTile> tile) {
-    // Acquire lock
-    std::lock_guard<std::mutex> lock(mutex);
-
-    // Iterate through all pixels within pixel bounds
-    for (Point2i pixel : tile->getPixelBounds()) {
-        // Merge pixel into {Film::pixels}
-        FilmTilePixel& tilePixel = tile->getPixel(pixel);
-        Pixel& filmPixel = getPixel(pixel);
-
-        // Get xyz spectrum data
-        Real xyz[3];
-        tilePixel.contributionSum.toXYZConstants(xyz);
-        // Add spectrum data to {filmPixel}
-        filmPixel.xyz[0] += xyz[0]; filmPixel.xyz[1] += xyz[1];
-        filmPixel.xyz[2] += xyz[2];
-        filmPixel.filterWeightSum += tilePixel.filterWeightSum;
+    Bounds2i bounds = tile->getPixelBounds();
+    int width = bounds.pMax.x - bounds.pMin.x;
+    if (width <= 0 || bounds.pMax.y <= bounds.pMin.y) return;
+
+    // Convert the tile pixels to XYZ and filter weight sums before taking
+    // any locks, as the spectral conversion is most of the work
+    std::vector<Real> tileXYZW(4 * size_t(bounds.area()));
+    Real* xyzw = tileXYZW.data();
+    for (int y = bounds.pMin.y; y < bounds.pMax.y; y++) {
+        for (int x = bounds.pMin.x; x < bounds.pMax.x; x++, xyzw += 4) {
+            const FilmTilePixel& tilePixel = tile->getPixel(Point2i(x, y));
+            tilePixel.contributionSum.toXYZConstants(xyzw);
+            xyzw[3] = tilePixel.filterWeightSum;
+        }
     }
+
+    // Add each row into {Film::pixels} under the lock of its stripe
+    uint64_t nContended = 0;
+    xyzw = tileXYZW.data();
+    for (int y = bounds.pMin.y; y < bounds.pMax.y; y++) {
+        std::unique_lock<std::mutex> lock(mergeStripes[y % nMergeStripes].mutex, std::try_to_lock);
+        if (!lock.owns_lock()) {
+            nContended++;
+            lock.lock();
+        }
+
+        Pixel* filmPixel = &getPixel(Point2i(bounds.pMin.x, y));
+        for (int x = 0; x < width; x++, filmPixel++, xyzw += 4) {
+            filmPixel->xyz[0] += xyzw[0]; filmPixel->xyz[1] += xyzw[1];
+            filmPixel->xyz[2] += xyzw[2];
+            filmPixel->filterWeightSum += xyzw[3];
+        }
+    }
+
+    nMergeLocks += bounds.pMax.y - bounds.pMin.y;
+    if (nContended > 0) nContendedMergeLocks += nContended;
+}
+
+void Film::getPixelSums(const Point2i& p, Real xyz[3], Real* filterWeightSum) const {
+    const Pixel& pixel = getPixel(p);
+    xyz[0] = pixel.xyz[0]; xyz[1] = pixel.xyz[1]; xyz[2] = pixel.xyz[2];
+    *filterWeightSum = pixel.filterWeightSum;
 }
 
 void Film::setImage(const Spectrum* img) {
     int nPixels = croppedImageBounds.area();
-    for (int i = 0; i < nPixels; i++) {
+    ParallelForRange(0, nPixels, filmConversionGrain, [&](int64_t i) {
         Pixel& pixel = pixels[i];
         img[i].toXYZConstants(pixel.xyz);
         pixel.filterWeightSum = 1;
         pixel.splatXYZ[0] = pixel.splatXYZ[1] = pixel.splatXYZ[2] = 0;
-    }
+    });
+    for (int t = 0; t < nSplatBuffers; t++) splatBuffers[t].reset();
 }
 
 void Film::addSplat(const Point2f& pt, const Spectrum& spec) {
@@ -165,21 +198,55 @@ void Film::addSplat(const Point2f& pt, const Spectrum& spec) {
     // Get xyz contributions
     Real xyz[3];
     spec.toXYZConstants(xyz);
+
+    int tIndex = ThreadIndex;
+    if (tIndex < nSplatBuffers) {
+        // Add to this thread's buffer, which no other thread writes. It is
+        // allocated and zeroed here, so that it is local to the thread.
+        std::unique_ptr<Real[]>& buffer = splatBuffers[tIndex];
+        if (!buffer) buffer.reset(new Real[3 * size_t(croppedImageBounds.area())]());
+        Real* splatXYZ = &buffer[3 * (&getPixel(p) - pixels.get())];
+        splatXYZ[0] += xyz[0]; splatXYZ[1] += xyz[1]; splatXYZ[2] += xyz[2];
+        return;
+    }
+
     // Add as splat to pixel
     Pixel& pixel = getPixel(p);
     pixel.splatXYZ[0].add(xyz[0]); pixel.splatXYZ[1].add(xyz[1]);
     pixel.splatXYZ[2].add(xyz[2]);
 }
 
+void Film::sumSplats(int64_t idx, Real xyz[3]) const {
+    const Pixel& pixel = pixels[idx];
+    xyz[0] = pixel.splatXYZ[0]; xyz[1] = pixel.splatXYZ[1]; xyz[2] = pixel.splatXYZ[2];
+    for (int t = 0; t < nSplatBuffers; t++) {
+        if (const Real* buffer = splatBuffers[t].get()) {
+            xyz[0] += buffer[3 * idx]; xyz[1] += buffer[3 * idx + 1];
+            xyz[2] += buffer[3 * idx + 2];
+        }
+    }
+}
+
+void Film::getSplatXYZ(const Point2i& p, Real xyz[3]) const {
+    sumSplats(&getPixel(p) - pixels.get(), xyz);
+}
+
+size_t Film::getSplatBufferMemory() const {
+    size_t bytes = 0;
+    for (int t = 0; t < nSplatBuffers; t++)
+        if (splatBuffers[t]) bytes += 3 * sizeof(Real) * size_t(croppedImageBounds.area());
+    return bytes;
+}
+
 void Film::writeImage(Real splatScale) {
     // Allocate space for RGB image data
     std::unique_ptr<Real[]> rgb(new Real[3 * croppedImageBounds.area()]);
-    int idx = 0;
 
-    // Convert image to RGB and calculate final pixel values
-    for (Point2i p : croppedImageBounds) {
+    // Convert image to RGB and calculate final pixel values. Pixels are
+    // stored in the same order as the image data.
+    ParallelForRange(0, croppedImageBounds.area(), filmConversionGrain, [&](int64_t idx) {
         // Convert XYZ pixel data to RGB
-        Pixel& pixel = getPixel(p);
+        Pixel& pixel = pixels[idx];
         convertXYZToRGB(pixel.xyz, &rgb[3 * idx]);
 
         // Normalize pixel with filter weight sum
@@ -192,18 +259,15 @@ void Film::writeImage(Real splatScale) {
             rgb[3 * idx + 2] = std::max(Real(0), rgb[3 * idx + 2] * invFilterWeightSum);
         }
 
-        // Add splat value to pixel
-        Real splatRGB[3];
-        Real splatXYZ[3] = { pixel.splatXYZ[0], pixel.splatXYZ[1], pixel.splatXYZ[2] };
+        // Add splat value to pixel, summing the splats of all threads
+        Real splatRGB[3], splatXYZ[3];
+        sumSplats(idx, splatXYZ);
         convertXYZToRGB(splatXYZ, splatRGB);
 
         rgb[3 * idx    ] = scale * (rgb[3 * idx    ] + splatScale * splatRGB[0]);
         rgb[3 * idx + 1] = scale * (rgb[3 * idx + 1] + splatScale * splatRGB[1]);
         rgb[3 * idx + 2] = scale * (rgb[3 * idx + 2] + splatScale * splatRGB[2]);
-
-        // Increment to next pixel index
-        idx++;
-    }
+    });
 
     // Write rgb image data to file. Apply gamma correction according
     // to the sRGB standard if writing to an 8-bit integer format.
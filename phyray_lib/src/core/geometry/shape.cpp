@@ -1,5 +1,6 @@
 #include <core/geometry/shape.h>
 #include <core/geometry/interaction.h>
+#include <core/material/texture.h>
 
 namespace phyr {
 
@@ -7,9 +8,48 @@ namespace phyr {
  * Just checks for a ray intersection without having to fill in any details
  */
 bool Shape::intersectRay(const Ray& ray, bool testAlpha) const {
-    Real t0 = ray.tMax;
-    SurfaceInteraction si;
-    return intersectRay(ray, &t0, &si, testAlpha);
+    SurfaceHit hit;
+    return intersectHit(ray, &hit, testAlpha);
+}
+
+bool Shape::intersectRay(const Ray& ray, Real* t0, SurfaceInteraction* si,
+                         bool testAlpha) const {
+    SurfaceHit hit;
+    if (!intersectHit(ray, &hit, testAlpha)) return false;
+    computeInteraction(ray, hit, si);
+    *t0 = hit.t;
+    return true;
+}
+
+// Finalizer of MurmurHash3, spreading the bits of {v} over the result
+static inline uint64_t mixBits(uint64_t v) {
+    v ^= v >> 33; v *= 0xff51afd7ed558ccdULL;
+    v ^= v >> 33; v *= 0xc4ceb9fe1a85ec53ULL;
+    return v ^ (v >> 33);
+}
+
+bool Shape::alphaTest(const Texture<Real>& alphaMask, const SurfaceInteraction& si,
+                      const Ray& ray) {
+    Real alpha = alphaMask.evaluate(si);
+    if (alpha >= 1) return true;
+    if (alpha <= 0) return false;
+
+    // Include the hit point, so that the hits along a ray decide independently
+    uint64_t h = 0;
+    for (int i = 0; i < 3; i++) {
+        h = mixBits(h ^ floatToBits(ray.o[i]));
+        h = mixBits(h ^ floatToBits(ray.d[i]));
+        h = mixBits(h ^ floatToBits(si.p[i]));
+    }
+    // Uniform value in [0, 1) from the top 53 bits
+    return std::ldexp(Real(h >> 11), -53) < alpha;
+}
+
+bool Shape::clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const {
+    Bounds3f wb = worldBounds();
+    if (!overlaps(wb, clip)) return false;
+    *bounds = intersect(wb, clip);
+    return true;
 }
 
 Interaction Shape::sample(const Interaction& ref, const Point2f& u,
@@ -36,7 +76,7 @@ Real Shape::pdf(const Interaction& ref, const Vector3f& wi) const {
 
     // Ignore any alpha textures used for trimming the shape when performing
     // this intersection.
-    if (!intersectRay(ray, &tHit, &isectLight)) return 0;
+    if (!intersectRay(ray, &tHit, &isectLight, false)) return 0;
 
     // Convert light sample weight to solid angle measure
     Real pdf = distanceSquared(ref.p, isectLight.p) / (absDot(isectLight.n, -wi) * surfaceArea());
@@ -71,6 +71,12 @@ Vector3f uniformSampleSphere(const Point2f& u) {
 
 Real uniformSpherePdf() { return Inv4Pi; }
 
+// Triangle sampling definitions
+Point2f uniformSampleTriangle(const Point2f& u) {
+    Real su0 = std::sqrt(u[0]);
+    return Point2f(1 - su0, u[1] * su0);
+}
+
 void stratifiedSample1D(Real* sample, int nSamples, bool jitter, RNG& rng) {
     Real invNSamples = Real(1) / nSamples;
     for (int i = 0; i < nSamples; i++) {
@@ -0,0 +1,1147 @@
+#include <core/phyr.h>
+#include <core/meshio.h>
+#include <core/concurrency.h>
+
+#include <atomic>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace phyr {
+
+// Number of elements decoded per work item when parsing in parallel
+constexpr int64_t parallelChunkSize = 16384;
+// Number of bytes of text parsed per work item
+constexpr size_t parallelChunkBytes = 1 << 20;
+
+#ifdef PHYRAY_USE_LONG_P
+constexpr MeshScalarType RealScalarType = MeshScalarType::Float64;
+#else
+constexpr MeshScalarType RealScalarType = MeshScalarType::Float32;
+#endif
+
+static size_t getScalarSize(MeshScalarType type) {
+    switch (type) {
+        case MeshScalarType::Int8: case MeshScalarType::UInt8: return 1;
+        case MeshScalarType::Int16: case MeshScalarType::UInt16: return 2;
+        case MeshScalarType::Int32: case MeshScalarType::UInt32:
+        case MeshScalarType::Float32: return 4;
+        case MeshScalarType::Float64: return 8;
+    }
+    return 0;
+}
+
+template <typename T>
+inline T readUnaligned(const char* data) {
+    T value;
+    std::memcpy(&value, data, sizeof(T));
+    return value;
+}
+
+static double readScalar(const char* data, MeshScalarType type) {
+    switch (type) {
+        case MeshScalarType::Int8: return readUnaligned<int8_t>(data);
+        case MeshScalarType::UInt8: return readUnaligned<uint8_t>(data);
+        case MeshScalarType::Int16: return readUnaligned<int16_t>(data);
+        case MeshScalarType::UInt16: return readUnaligned<uint16_t>(data);
+        case MeshScalarType::Int32: return readUnaligned<int32_t>(data);
+        case MeshScalarType::UInt32: return readUnaligned<uint32_t>(data);
+        case MeshScalarType::Float32: return readUnaligned<float>(data);
+        case MeshScalarType::Float64: return readUnaligned<double>(data);
+    }
+    return 0;
+}
+
+// Reads a scalar stored in the opposite byte order of the host
+static double readSwappedScalar(const char* data, MeshScalarType type) {
+    char swapped[8] = {};
+    size_t size = getScalarSize(type);
+    for (size_t i = 0; i < size; i++) swapped[i] = data[size - 1 - i];
+    return readScalar(swapped, type);
+}
+
+inline bool isHostLittleEndian() {
+    const uint16_t value = 1;
+    return *reinterpret_cast<const uint8_t*>(&value) == 1;
+}
+
+// Read only mapping of a whole file
+class MappedFile {
+  public:
+    ~MappedFile() { if (data) munmap(const_cast<char*>(data), size); }
+
+    // Maps the file at {path}, logging an error on failure
+    bool map(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            LOG_ERR_FMT("Unable to open file \"%s\".", path.c_str());
+            return false;
+        }
+
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+            LOG_ERR_FMT("Unable to read file \"%s\".", path.c_str());
+            close(fd);
+            return false;
+        }
+
+        void* mapping = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapping == MAP_FAILED) {
+            LOG_ERR_FMT("Unable to map file \"%s\".", path.c_str());
+            return false;
+        }
+
+        data = static_cast<const char*>(mapping);
+        size = fileStat.st_size;
+        return true;
+    }
+
+    // Hands the mapping over to the caller
+    void* release() {
+        void* mapping = const_cast<char*>(data);
+        data = nullptr;
+        return mapping;
+    }
+
+    const char* data = nullptr;
+    size_t size = 0;
+};
+
+// Finds the next line holding any text in [*s, end), advancing *s past it
+static bool nextLine(const char** s, const char* end, const char** lineStart,
+                     const char** lineEnd) {
+    while (*s < end) {
+        const char* start = *s;
+        const char* newline = static_cast<const char*>(std::memchr(start, '\n', end - start));
+        const char* stop = newline ? newline : end;
+        *s = newline ? newline + 1 : end;
+
+        for (const char* c = start; c < stop; c++) {
+            if (!std::isspace(static_cast<unsigned char>(*c))) {
+                *lineStart = start; *lineEnd = stop;
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+// Parses the next number of the line [*s, end), advancing *s past it
+static bool nextNumber(const char** s, const char* end, double* value) {
+    while (*s < end && std::isspace(static_cast<unsigned char>(**s))) (*s)++;
+    const char* start = *s;
+    while (*s < end && !std::isspace(static_cast<unsigned char>(**s))) (*s)++;
+
+    // Copy the token, as the mapped file is not null terminated
+    char token[64];
+    size_t length = *s - start;
+    if (length == 0 || length >= sizeof(token)) return false;
+    std::memcpy(token, start, length);
+    token[length] = '\0';
+
+    char* tokenEnd;
+    *value = std::strtod(token, &tokenEnd);
+    return tokenEnd == token + length;
+}
+
+/**
+ * Splits the text [begin, end) into chunks of about {parallelChunkBytes}
+ * that start at line boundaries, so they can be parsed in parallel.
+ * Returns the start of each chunk followed by {end}.
+ */
+static std::vector<const char*> splitLines(const char* begin, const char* end) {
+    size_t nChunks = std::max(size_t(1), (end - begin + parallelChunkBytes - 1) / parallelChunkBytes);
+    std::vector<const char*> chunkStart(nChunks + 1);
+    chunkStart[0] = begin;
+    chunkStart[nChunks] = end;
+    for (size_t c = 1; c < nChunks; c++) {
+        const char* s = begin + c * parallelChunkBytes - 1;
+        const char* newline = static_cast<const char*>(std::memchr(s, '\n', end - s));
+        chunkStart[c] = std::max(chunkStart[c - 1], newline ? newline + 1 : end);
+    }
+    return chunkStart;
+}
+
+// MeshAttribute definitions
+Real MeshAttribute::getReal(size_t i) const {
+    const char* element = data + i * stride;
+    switch (type) {
+        case MeshScalarType::Float32: return readUnaligned<float>(element);
+        case MeshScalarType::Float64: return readUnaligned<double>(element);
+        default: return readScalar(element, type);
+    }
+}
+
+uint32_t MeshAttribute::getIndex(size_t i) const {
+    const char* element = data + i * stride;
+    switch (type) {
+        case MeshScalarType::UInt32: return readUnaligned<uint32_t>(element);
+        case MeshScalarType::Int32: return uint32_t(readUnaligned<int32_t>(element));
+        default: return uint32_t(int64_t(readScalar(element, type)));
+    }
+}
+
+// IndexedMesh definitions
+IndexedMesh::~IndexedMesh() {
+    if (mapping) munmap(mapping, mappingSize);
+}
+
+void IndexedMesh::setDecodedAttributes(bool hasNormals, bool hasUVs) {
+    int nComponents = 3 + (hasNormals ? 3 : 0) + (hasUVs ? 2 : 0);
+    const char* vertices = reinterpret_cast<const char*>(vertexData.data());
+    size_t stride = nComponents * sizeof(Real);
+    for (int c = 0; c < 3; c++)
+        p[c] = MeshAttribute(vertices + c * sizeof(Real), stride, RealScalarType);
+    for (int c = 0; c < 3 && hasNormals; c++)
+        n[c] = MeshAttribute(vertices + (3 + c) * sizeof(Real), stride, RealScalarType);
+    int uvOffset = hasNormals ? 6 : 3;
+    for (int c = 0; c < 2 && hasUVs; c++)
+        uv[c] = MeshAttribute(vertices + (uvOffset + c) * sizeof(Real), stride, RealScalarType);
+
+    const char* triangles = reinterpret_cast<const char*>(indexData.data());
+    for (int k = 0; k < 3; k++)
+        indices[k] = MeshAttribute(triangles + 4 * k, 12, MeshScalarType::UInt32);
+}
+
+// PLY loading
+struct PLYProperty {
+    std::string name;
+    MeshScalarType type;
+    // Lists store a count of {countType} followed by that many {type} items
+    bool isList = false;
+    MeshScalarType countType;
+};
+
+struct PLYElement {
+    std::string name;
+    int64_t count = 0;
+    std::vector<PLYProperty> properties;
+    bool hasList = false;
+    // Size of a record, for elements without list properties
+    size_t recordSize = 0;
+};
+
+static bool parsePLYScalarType(const std::string& name, MeshScalarType* type) {
+    static const struct { const char* name; MeshScalarType type; } types[] = {
+        { "char", MeshScalarType::Int8 }, { "int8", MeshScalarType::Int8 },
+        { "uchar", MeshScalarType::UInt8 }, { "uint8", MeshScalarType::UInt8 },
+        { "short", MeshScalarType::Int16 }, { "int16", MeshScalarType::Int16 },
+        { "ushort", MeshScalarType::UInt16 }, { "uint16", MeshScalarType::UInt16 },
+        { "int", MeshScalarType::Int32 }, { "int32", MeshScalarType::Int32 },
+        { "uint", MeshScalarType::UInt32 }, { "uint32", MeshScalarType::UInt32 },
+        { "float", MeshScalarType::Float32 }, { "float32", MeshScalarType::Float32 },
+        { "double", MeshScalarType::Float64 }, { "float64", MeshScalarType::Float64 }
+    };
+    for (const auto& t : types) {
+        if (name == t.name) {
+            *type = t.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+class PLYReader {
+  public:
+    explicit PLYReader(const std::string& path) : path(path) {}
+
+    std::unique_ptr<IndexedMesh> read();
+
+  private:
+    enum class Format { ASCII, BinaryLittleEndian, BinaryBigEndian };
+
+    bool parseHeader();
+    bool findAttributes();
+    bool readBinary();
+    bool readBinaryVertices(const char* records);
+    bool readBinaryFaces(const char* records, const char** recordsEnd);
+    bool readASCII();
+    bool validateIndices() const;
+
+    // Skips a binary record of {element} at {record}, adding the
+    // triangles of its index list to {nTriangles}
+    const char* skipRecord(const PLYElement& element, const char* record,
+                           int64_t* nTriangles) const;
+
+    const std::string path;
+    IndexedMesh* mesh = nullptr;
+    const char *data = nullptr, *body = nullptr, *end = nullptr;
+    Format format = Format::ASCII;
+    bool swapBytes = false;
+
+    std::vector<PLYElement> elements;
+    int vertexElement = -1, faceElement = -1;
+    // Index of the vertex index list among the face properties
+    int indexProperty = -1;
+    // Attribute component stored by each vertex property (x, y, z, nx, ny, nz, u, v), or -1
+    std::vector<int> vertexComponent;
+    int nComponents = 0;
+    bool hasNormals = false, hasUVs = false;
+};
+
+std::unique_ptr<IndexedMesh> PLYReader::read() {
+    MappedFile file;
+    if (!file.map(path)) return nullptr;
+
+    // The mesh owns the mapping from here on
+    std::unique_ptr<IndexedMesh> result(new IndexedMesh());
+    mesh = result.get();
+    data = file.data;
+    end = data + file.size;
+    mesh->mappingSize = file.size;
+    mesh->mapping = file.release();
+
+    if (!parseHeader() || !findAttributes()) {
+        LOG_ERR_FMT("Invalid or unsupported PLY header in \"%s\".", path.c_str());
+        return nullptr;
+    }
+
+    bool valid = format == Format::ASCII ? readASCII() : readBinary();
+    if (!valid) {
+        LOG_ERR_FMT("PLY file \"%s\" is truncated or malformed.", path.c_str());
+        return nullptr;
+    }
+    if (!validateIndices()) {
+        LOG_ERR_FMT("PLY file \"%s\" references vertices out of range.", path.c_str());
+        return nullptr;
+    }
+
+    // Release the mapping early if nothing views it
+    if (!mesh->zeroCopyVertices && !mesh->zeroCopyIndices) {
+        munmap(mesh->mapping, mesh->mappingSize);
+        mesh->mapping = nullptr;
+    }
+
+    return result;
+}
+
+bool PLYReader::parseHeader() {
+    const char* line = data;
+    bool hasFormat = false;
+
+    for (int lineIdx = 0; line < end; lineIdx++) {
+        const char* newline = static_cast<const char*>(std::memchr(line, '\n', end - line));
+        if (!newline) return false;
+        std::istringstream tokens(std::string(line, newline));
+        line = newline + 1;
+
+        std::string keyword;
+        tokens >> keyword;
+        if (lineIdx == 0) {
+            if (keyword != "ply") return false;
+        } else if (keyword == "format") {
+            std::string name;
+            tokens >> name;
+            if (name == "ascii") format = Format::ASCII;
+            else if (name == "binary_little_endian") format = Format::BinaryLittleEndian;
+            else if (name == "binary_big_endian") format = Format::BinaryBigEndian;
+            else return false;
+            hasFormat = true;
+        } else if (keyword == "element") {
+            PLYElement element;
+            tokens >> element.name >> element.count;
+            if (tokens.fail() || element.count < 0) return false;
+            elements.push_back(element);
+        } else if (keyword == "property") {
+            if (elements.empty()) return false;
+            PLYProperty property;
+            std::string type;
+            tokens >> type;
+            if (type == "list") {
+                std::string countType;
+                tokens >> countType >> type;
+                if (!parsePLYScalarType(countType, &property.countType)) return false;
+                property.isList = true;
+                elements.back().hasList = true;
+            }
+            tokens >> property.name;
+            if (tokens.fail() || !parsePLYScalarType(type, &property.type)) return false;
+            if (!property.isList) elements.back().recordSize += getScalarSize(property.type);
+            elements.back().properties.push_back(property);
+        } else if (keyword == "end_header") {
+            body = line;
+            swapBytes = format != Format::ASCII &&
+                        (format == Format::BinaryLittleEndian) != isHostLittleEndian();
+            return hasFormat;
+        }
+        // Comments and other keywords are ignored
+    }
+
+    return false;
+}
+
+bool PLYReader::findAttributes() {
+    for (size_t i = 0; i < elements.size(); i++) {
+        if (elements[i].name == "vertex" && vertexElement < 0) vertexElement = i;
+        if (elements[i].name == "face" && faceElement < 0) faceElement = i;
+    }
+    if (vertexElement < 0 || faceElement < 0) return false;
+
+    // Both counts must fit the 32-bit vertex indices
+    const int64_t maxCount = std::numeric_limits<int32_t>::max();
+    const PLYElement& vertices = elements[vertexElement];
+    if (vertices.hasList || vertices.count > maxCount || elements[faceElement].count > maxCount)
+        return false;
+
+    static const char* componentNames[8][4] = {
+        { "x" }, { "y" }, { "z" }, { "nx" }, { "ny" }, { "nz" },
+        { "u", "s", "texture_u", "texture_s" }, { "v", "t", "texture_v", "texture_t" }
+    };
+
+    int found[8];
+    std::fill(found, found + 8, -1);
+    vertexComponent.assign(vertices.properties.size(), -1);
+    for (size_t p = 0; p < vertices.properties.size(); p++) {
+        for (int c = 0; c < 8; c++) {
+            for (const char* name : componentNames[c]) {
+                if (name && vertices.properties[p].name == name && found[c] < 0) {
+                    vertexComponent[p] = c;
+                    found[c] = p;
+                }
+            }
+        }
+    }
+
+    if (found[0] < 0 || found[1] < 0 || found[2] < 0) return false;
+    hasNormals = found[3] >= 0 && found[4] >= 0 && found[5] >= 0;
+    hasUVs = found[6] >= 0 && found[7] >= 0;
+    nComponents = 3 + (hasNormals ? 3 : 0) + (hasUVs ? 2 : 0);
+
+    // Drop incomplete normals or (u, v) coordinates
+    for (int& c : vertexComponent) {
+        if ((c >= 3 && c < 6 && !hasNormals) || (c >= 6 && !hasUVs)) c = -1;
+    }
+
+    const std::vector<PLYProperty>& faceProperties = elements[faceElement].properties;
+    for (size_t p = 0; p < faceProperties.size(); p++) {
+        if (faceProperties[p].isList && (faceProperties[p].name == "vertex_indices" ||
+                                         faceProperties[p].name == "vertex_index"))
+            indexProperty = p;
+    }
+
+    mesh->nVertices = vertices.count;
+    return indexProperty >= 0;
+}
+
+const char* PLYReader::skipRecord(const PLYElement& element, const char* record,
+                                  int64_t* nTriangles) const {
+    for (size_t p = 0; p < element.properties.size(); p++) {
+        const PLYProperty& property = element.properties[p];
+        size_t size = getScalarSize(property.isList ? property.countType : property.type);
+        if (record + size > end) return nullptr;
+        if (!property.isList) {
+            record += size;
+            continue;
+        }
+
+        double count = swapBytes ? readSwappedScalar(record, property.countType)
+                                 : readScalar(record, property.countType);
+        if (count < 0) return nullptr;
+        record += size + size_t(count) * getScalarSize(property.type);
+        if (nTriangles && int(p) == indexProperty && count > 2) *nTriangles += int64_t(count) - 2;
+    }
+    return record <= end ? record : nullptr;
+}
+
+bool PLYReader::readBinary() {
+    // Records of elements ahead of the mesh elements are skipped
+    const char* record = body;
+    for (int e = 0; e <= std::max(vertexElement, faceElement); e++) {
+        const PLYElement& element = elements[e];
+        if (e == vertexElement) {
+            if (!readBinaryVertices(record)) return false;
+            record += element.count * element.recordSize;
+        } else if (e == faceElement) {
+            if (!readBinaryFaces(record, &record)) return false;
+        } else if (!element.hasList) {
+            record += element.count * element.recordSize;
+        } else {
+            for (int64_t i = 0; i < element.count && record; i++)
+                record = skipRecord(element, record, nullptr);
+        }
+        if (!record || record > end) return false;
+    }
+    return true;
+}
+
+bool PLYReader::readBinaryVertices(const char* records) {
+    const PLYElement& vertices = elements[vertexElement];
+    if (size_t(end - records) < vertices.count * vertices.recordSize) return false;
+
+    // Offset of each property within a record
+    std::vector<size_t> offsets(vertices.properties.size());
+    for (size_t p = 1; p < offsets.size(); p++)
+        offsets[p] = offsets[p - 1] + getScalarSize(vertices.properties[p - 1].type);
+
+    if (!swapBytes) {
+        // View the vertices in place
+        for (size_t p = 0; p < offsets.size(); p++) {
+            int c = vertexComponent[p];
+            if (c < 0) continue;
+            MeshAttribute attribute(records + offsets[p], vertices.recordSize,
+                                    vertices.properties[p].type);
+            if (c < 3) mesh->p[c] = attribute;
+            else if (c < 6) mesh->n[c - 3] = attribute;
+            else mesh->uv[c - 6] = attribute;
+        }
+        mesh->zeroCopyVertices = true;
+        return true;
+    }
+
+    // Decode the vertices in parallel. Decoded components are packed
+    // as positions, then normals and (u, v) coordinates if present.
+    int slot[8];
+    for (int c = 0; c < 8; c++)
+        slot[c] = c < 3 ? c : (c < 6 ? 3 + (c - 3) : (hasNormals ? 6 : 3) + (c - 6));
+
+    int64_t nVertices = vertices.count;
+    mesh->vertexData.resize(nVertices * nComponents);
+    int64_t nChunks = (nVertices + parallelChunkSize - 1) / parallelChunkSize;
+    ParallelFor([&](int64_t chunk) {
+        int64_t s = chunk * parallelChunkSize, e = std::min(s + parallelChunkSize, nVertices);
+        for (int64_t v = s; v < e; v++) {
+            const char* record = records + v * vertices.recordSize;
+            for (size_t p = 0; p < offsets.size(); p++) {
+                int c = vertexComponent[p];
+                if (c < 0) continue;
+                mesh->vertexData[v * nComponents + slot[c]] =
+                        readSwappedScalar(record + offsets[p], vertices.properties[p].type);
+            }
+        }
+    }, nChunks);
+
+    mesh->setDecodedAttributes(hasNormals, hasUVs);
+    return true;
+}
+
+bool PLYReader::readBinaryFaces(const char* records, const char** recordsEnd) {
+    const PLYElement& faces = elements[faceElement];
+    const PLYProperty& indexList = faces.properties[indexProperty];
+    int64_t nFaces = faces.count;
+
+    // Triangles stored with 32-bit indices and no other lists have
+    // fixed size records, whose indices can be viewed in place
+    size_t countSize = getScalarSize(indexList.countType);
+    size_t countOffset = 0;
+    bool otherLists = false;
+    for (int p = 0; p < indexProperty; p++) countOffset += getScalarSize(faces.properties[p].type);
+    for (size_t p = 0; p < faces.properties.size(); p++)
+        otherLists |= faces.properties[p].isList && int(p) != indexProperty;
+
+    if (!swapBytes && !otherLists && getScalarSize(indexList.type) == 4) {
+        size_t recordSize = faces.recordSize + countSize + 3 * 4;
+        if (size_t(end - records) >= nFaces * recordSize) {
+            int64_t nChunks = (nFaces + parallelChunkSize - 1) / parallelChunkSize;
+            std::atomic<bool> allTriangles(true);
+            ParallelFor([&](int64_t chunk) {
+                int64_t s = chunk * parallelChunkSize, e = std::min(s + parallelChunkSize, nFaces);
+                for (int64_t f = s; f < e && allTriangles; f++) {
+                    if (readScalar(records + f * recordSize + countOffset, indexList.countType) != 3)
+                        allTriangles = false;
+                }
+            }, nChunks);
+
+            if (allTriangles) {
+                for (int k = 0; k < 3; k++) {
+                    mesh->indices[k] = MeshAttribute(records + countOffset + countSize + 4 * k,
+                                                     recordSize, indexList.type);
+                }
+                mesh->nTriangles = nFaces;
+                mesh->zeroCopyIndices = true;
+                *recordsEnd = records + nFaces * recordSize;
+                return true;
+            }
+        }
+    }
+
+    // Otherwise locate the variable size records first and decode them in
+    // parallel, triangulating polygons as fans
+    std::vector<const char*> faceRecords(nFaces + 1);
+    std::vector<int64_t> firstTriangle(nFaces + 1);
+    const char* record = records;
+    int64_t nTriangles = 0;
+    for (int64_t f = 0; f < nFaces; f++) {
+        faceRecords[f] = record;
+        firstTriangle[f] = nTriangles;
+        record = skipRecord(faces, record, &nTriangles);
+        if (!record) return false;
+    }
+    faceRecords[nFaces] = *recordsEnd = record;
+    firstTriangle[nFaces] = nTriangles;
+
+    size_t indexSize = getScalarSize(indexList.type);
+    mesh->indexData.resize(3 * nTriangles);
+    int64_t nChunks = (nFaces + parallelChunkSize - 1) / parallelChunkSize;
+    ParallelFor([&](int64_t chunk) {
+        int64_t s = chunk * parallelChunkSize, e = std::min(s + parallelChunkSize, nFaces);
+        for (int64_t f = s; f < e; f++) {
+            const char* list = faceRecords[f] + countOffset;
+            if (otherLists) {
+                // Walk the properties up to the index list
+                list = faceRecords[f];
+                for (int p = 0; p < indexProperty; p++) {
+                    const PLYProperty& property = faces.properties[p];
+                    size_t size = getScalarSize(property.isList ? property.countType : property.type);
+                    if (property.isList) {
+                        double count = swapBytes ? readSwappedScalar(list, property.countType)
+                                                 : readScalar(list, property.countType);
+                        size += size_t(count) * getScalarSize(property.type);
+                    }
+                    list += size;
+                }
+            }
+
+            auto readIndex = [&](int64_t i) {
+                const char* item = list + countSize + i * indexSize;
+                double value = swapBytes ? readSwappedScalar(item, indexList.type)
+                                         : readScalar(item, indexList.type);
+                return uint32_t(int64_t(value));
+            };
+
+            uint32_t* triangle = &mesh->indexData[3 * firstTriangle[f]];
+            int64_t nFaceTriangles = firstTriangle[f + 1] - firstTriangle[f];
+            for (int64_t t = 0; t < nFaceTriangles; t++, triangle += 3) {
+                triangle[0] = readIndex(0);
+                triangle[1] = readIndex(t + 1);
+                triangle[2] = readIndex(t + 2);
+            }
+        }
+    }, nChunks);
+
+    // Decoded vertices are set up along with the indices, unless they are viewed in place
+    if (mesh->zeroCopyVertices) {
+        const char* indexData = reinterpret_cast<const char*>(mesh->indexData.data());
+        for (int k = 0; k < 3; k++)
+            mesh->indices[k] = MeshAttribute(indexData + 4 * k, 12, MeshScalarType::UInt32);
+    } else {
+        mesh->setDecodedAttributes(hasNormals, hasUVs);
+    }
+    mesh->nTriangles = nTriangles;
+    return true;
+}
+
+bool PLYReader::readASCII() {
+    std::vector<const char*> chunkStart = splitLines(body, end);
+    int64_t nChunks = chunkStart.size() - 1;
+
+    // Count the lines of each chunk to find the element each line belongs to
+    std::vector<int64_t> firstLine(nChunks + 1);
+    ParallelFor([&](int64_t c) {
+        const char *s = chunkStart[c], *lineStart, *lineEnd;
+        int64_t nLines = 0;
+        while (nextLine(&s, chunkStart[c + 1], &lineStart, &lineEnd)) nLines++;
+        firstLine[c + 1] = nLines;
+    }, nChunks);
+    for (int64_t c = 0; c < nChunks; c++) firstLine[c + 1] += firstLine[c];
+
+    std::vector<int64_t> elementFirstLine(elements.size() + 1);
+    for (size_t e = 0; e < elements.size(); e++)
+        elementFirstLine[e + 1] = elementFirstLine[e] + elements[e].count;
+    if (firstLine[nChunks] < elementFirstLine[std::max(vertexElement, faceElement) + 1])
+        return false;
+
+    const PLYElement& vertices = elements[vertexElement];
+    const PLYElement& faces = elements[faceElement];
+    int slot[8];
+    for (int c = 0; c < 8; c++)
+        slot[c] = c < 3 ? c : (c < 6 ? 3 + (c - 3) : (hasNormals ? 6 : 3) + (c - 6));
+    mesh->vertexData.resize(vertices.count * nComponents);
+
+    // Parse the chunks in parallel. Triangles are gathered per chunk,
+    // as polygons may make up any number of them.
+    std::vector<std::vector<uint32_t>> chunkIndices(nChunks);
+    std::atomic<bool> valid(true);
+    ParallelFor([&](int64_t c) {
+        const char *s = chunkStart[c], *lineStart, *lineEnd;
+        for (int64_t line = firstLine[c]; valid && nextLine(&s, chunkStart[c + 1], &lineStart, &lineEnd);
+             line++) {
+            double value;
+            if (line >= elementFirstLine[vertexElement] && line < elementFirstLine[vertexElement + 1]) {
+                Real* vertex = &mesh->vertexData[(line - elementFirstLine[vertexElement]) * nComponents];
+                for (size_t p = 0; p < vertices.properties.size(); p++) {
+                    if (!nextNumber(&lineStart, lineEnd, &value)) valid = false;
+                    if (vertexComponent[p] >= 0) vertex[slot[vertexComponent[p]]] = value;
+                }
+            } else if (line >= elementFirstLine[faceElement] && line < elementFirstLine[faceElement + 1]) {
+                for (size_t p = 0; p < faces.properties.size() && valid; p++) {
+                    if (!nextNumber(&lineStart, lineEnd, &value)) valid = false;
+                    if (!faces.properties[p].isList) continue;
+
+                    int64_t count = value;
+                    uint32_t first = 0, previous = 0;
+                    for (int64_t i = 0; i < count && valid; i++) {
+                        if (!nextNumber(&lineStart, lineEnd, &value)) valid = false;
+                        if (int(p) != indexProperty) continue;
+
+                        // Triangulate the polygon as a fan
+                        uint32_t index = uint32_t(int64_t(value));
+                        if (i == 0) first = index;
+                        if (i >= 2) {
+                            uint32_t triangle[3] = { first, previous, index };
+                            chunkIndices[c].insert(chunkIndices[c].end(), triangle, triangle + 3);
+                        }
+                        previous = index;
+                    }
+                }
+            }
+        }
+    }, nChunks);
+    if (!valid) return false;
+
+    // Gather the triangles of all chunks
+    std::vector<size_t> chunkOffset(nChunks + 1);
+    for (int64_t c = 0; c < nChunks; c++) chunkOffset[c + 1] = chunkOffset[c] + chunkIndices[c].size();
+    mesh->indexData.resize(chunkOffset[nChunks]);
+    ParallelFor([&](int64_t c) {
+        std::copy(chunkIndices[c].begin(), chunkIndices[c].end(), &mesh->indexData[chunkOffset[c]]);
+    }, nChunks);
+
+    mesh->setDecodedAttributes(hasNormals, hasUVs);
+    mesh->nTriangles = chunkOffset[nChunks] / 3;
+    return true;
+}
+
+bool PLYReader::validateIndices() const {
+    int64_t nTriangles = mesh->nTriangles;
+    uint32_t nVertices = mesh->nVertices;
+    int64_t nChunks = (nTriangles + parallelChunkSize - 1) / parallelChunkSize;
+
+    std::atomic<bool> valid(nTriangles <= std::numeric_limits<int32_t>::max());
+    ParallelFor([&](int64_t chunk) {
+        int64_t s = chunk * parallelChunkSize, e = std::min(s + parallelChunkSize, nTriangles);
+        for (int64_t t = s; t < e && valid; t++) {
+            if (mesh->indices[0].getIndex(t) >= nVertices || mesh->indices[1].getIndex(t) >= nVertices ||
+                mesh->indices[2].getIndex(t) >= nVertices)
+                valid = false;
+        }
+    }, nChunks);
+    return valid;
+}
+
+std::unique_ptr<IndexedMesh> loadPLYMesh(const std::string& path) {
+    PLYReader reader(path);
+    return reader.read();
+}
+
+// OBJ loading
+
+// Index of the attributes a face vertex does not reference
+constexpr int64_t missingOBJIndex = std::numeric_limits<int64_t>::max();
+// Negative indices count back from the latest element. They are parsed as the
+// index within their chunk less {relativeOBJBias}, and resolved once the
+// number of elements in earlier chunks is known.
+constexpr int64_t relativeOBJBias = int64_t(1) << 48;
+
+// Face vertex, i.e. the attribute indices of a vertex of a face
+struct OBJVertex {
+    bool operator==(const OBJVertex& v) const {
+        return p == v.p && uv == v.uv && n == v.n && mesh == v.mesh;
+    }
+
+    int64_t p, uv, n;
+    // Mesh of the face. Vertices are only shared within a mesh.
+    int64_t mesh;
+};
+
+// Elements of a chunk of an OBJ file
+struct OBJChunk {
+    // Positions, (u, v) coordinates and normals
+    std::vector<Real> p, uv, n;
+    std::vector<OBJVertex> vertices;
+    // Number of vertices of each face
+    std::vector<int> faceSizes;
+    // Materials used from the given face of the chunk on
+    std::vector<std::pair<int64_t, std::string>> materials;
+};
+
+static bool isOBJKeyword(const char* s, const char* end, const char* keyword) {
+    size_t length = std::strlen(keyword);
+    return size_t(end - s) == length && std::memcmp(s, keyword, length) == 0;
+}
+
+// Parses an attribute index of a face vertex, advancing *s past it. {count}
+// is the number of elements of the attribute in the chunk so far.
+static bool parseOBJIndex(const char** s, const char* end, int64_t count, int64_t* index) {
+    bool negative = *s < end && **s == '-';
+    if (negative) (*s)++;
+
+    const char* digits = *s;
+    int64_t value = 0;
+    for (; *s < end && **s >= '0' && **s <= '9'; (*s)++) {
+        value = 10 * value + (**s - '0');
+        if (value >= relativeOBJBias) return false;
+    }
+
+    // Attributes may be left out, as in "1//2"
+    if (*s == digits) {
+        *index = missingOBJIndex;
+        return !negative;
+    }
+    if (value == 0) return false;
+    *index = negative ? count - value - relativeOBJBias : value - 1;
+    return true;
+}
+
+static bool parseOBJChunk(const char* begin, const char* end, OBJChunk* chunk) {
+    const char *s = begin, *line, *lineEnd;
+    while (nextLine(&s, end, &line, &lineEnd)) {
+        while (std::isspace(static_cast<unsigned char>(*line))) line++;
+        const char* keyword = line;
+        while (line < lineEnd && !std::isspace(static_cast<unsigned char>(*line))) line++;
+
+        double x, y, z;
+        if (isOBJKeyword(keyword, line, "v") || isOBJKeyword(keyword, line, "vn")) {
+            if (!nextNumber(&line, lineEnd, &x) || !nextNumber(&line, lineEnd, &y) ||
+                !nextNumber(&line, lineEnd, &z))
+                return false;
+            std::vector<Real>& elements = keyword[1] == 'n' ? chunk->n : chunk->p;
+            elements.push_back(x); elements.push_back(y); elements.push_back(z);
+        } else if (isOBJKeyword(keyword, line, "vt")) {
+            if (!nextNumber(&line, lineEnd, &x)) return false;
+            if (!nextNumber(&line, lineEnd, &y)) y = 0;
+            chunk->uv.push_back(x); chunk->uv.push_back(y);
+        } else if (isOBJKeyword(keyword, line, "f")) {
+            int size = 0;
+            for (;; size++) {
+                while (line < lineEnd && std::isspace(static_cast<unsigned char>(*line))) line++;
+                if (line == lineEnd) break;
+
+                OBJVertex v;
+                v.uv = v.n = missingOBJIndex;
+                v.mesh = -1;
+                if (!parseOBJIndex(&line, lineEnd, chunk->p.size() / 3, &v.p) || v.p == missingOBJIndex)
+                    return false;
+                if (line < lineEnd && *line == '/') {
+                    line++;
+                    if (!parseOBJIndex(&line, lineEnd, chunk->uv.size() / 2, &v.uv)) return false;
+                    if (line < lineEnd && *line == '/') {
+                        line++;
+                        if (!parseOBJIndex(&line, lineEnd, chunk->n.size() / 3, &v.n)) return false;
+                    }
+                }
+                if (line < lineEnd && !std::isspace(static_cast<unsigned char>(*line))) return false;
+                chunk->vertices.push_back(v);
+            }
+
+            // Points and lines are not part of the mesh
+            if (size >= 3) chunk->faceSizes.push_back(size);
+            else chunk->vertices.resize(chunk->vertices.size() - size);
+        } else if (isOBJKeyword(keyword, line, "usemtl")) {
+            while (line < lineEnd && std::isspace(static_cast<unsigned char>(*line))) line++;
+            while (lineEnd > line && std::isspace(static_cast<unsigned char>(lineEnd[-1]))) lineEnd--;
+            chunk->materials.emplace_back(chunk->faceSizes.size(), std::string(line, lineEnd));
+        }
+        // Other statements, such as groups and material libraries, are ignored
+    }
+    return true;
+}
+
+// Resolves an index parsed from the chunk whose elements start at {base},
+// returning -1 if it is out of range
+inline int64_t resolveOBJIndex(int64_t index, int64_t base, int64_t count) {
+    if (index == missingOBJIndex) return index;
+    if (index < 0) index += relativeOBJBias + base;
+    return index >= 0 && index < count ? index : -1;
+}
+
+class OBJReader {
+  public:
+    explicit OBJReader(const std::string& path) : path(path) {}
+
+    std::vector<std::unique_ptr<IndexedMesh>> read();
+
+  private:
+    // Resolves the attribute indices of the parsed face vertices, assigns
+    // faces to meshes and gathers the elements of all chunks
+    bool gatherFaces();
+    // Finds the first face vertex with the same attributes as each face vertex
+    void mergeVertices();
+    bool createMeshes();
+
+    // Number of elements processed per work item, such that the
+    // per mesh counts of all work items stay small
+    static int64_t getBlockSize(int64_t count) {
+        return std::max(parallelChunkSize, count / 1024 + 1);
+    }
+
+    const std::string path;
+    std::vector<OBJChunk> chunks;
+
+    // Elements of all chunks
+    std::vector<Real> p, uv, n;
+    std::vector<OBJVertex> vertices;
+    // First vertex of each face, followed by the number of vertices
+    std::vector<int64_t> faceStart;
+    std::vector<std::string> materials;
+
+    std::vector<int64_t> firstInstance;
+    std::vector<std::unique_ptr<IndexedMesh>> meshes;
+};
+
+std::vector<std::unique_ptr<IndexedMesh>> OBJReader::read() {
+    MappedFile file;
+    if (!file.map(path)) return {};
+
+    std::vector<const char*> chunkStart = splitLines(file.data, file.data + file.size);
+    int64_t nChunks = chunkStart.size() - 1;
+    chunks.resize(nChunks);
+    std::atomic<bool> valid(true);
+    ParallelFor([&](int64_t c) {
+        if (!parseOBJChunk(chunkStart[c], chunkStart[c + 1], &chunks[c])) valid = false;
+    }, nChunks);
+
+    if (!valid) {
+        LOG_ERR_FMT("OBJ file \"%s\" is malformed.", path.c_str());
+        return {};
+    }
+    if (!gatherFaces()) {
+        LOG_ERR_FMT("OBJ file \"%s\" references vertices out of range.", path.c_str());
+        return {};
+    }
+
+    mergeVertices();
+    if (!createMeshes()) {
+        LOG_ERR_FMT("OBJ file \"%s\" has too many vertices for 32-bit indices.", path.c_str());
+        meshes.clear();
+    }
+    return std::move(meshes);
+}
+
+bool OBJReader::gatherFaces() {
+    // Offsets of the elements of each chunk among those of all chunks
+    struct ChunkOffsets { int64_t p = 0, uv = 0, n = 0, vertices = 0, faces = 0; };
+    int64_t nChunks = chunks.size();
+    std::vector<ChunkOffsets> offsets(nChunks + 1);
+    for (int64_t c = 0; c < nChunks; c++) {
+        offsets[c + 1].p = offsets[c].p + chunks[c].p.size() / 3;
+        offsets[c + 1].uv = offsets[c].uv + chunks[c].uv.size() / 2;
+        offsets[c + 1].n = offsets[c].n + chunks[c].n.size() / 3;
+        offsets[c + 1].vertices = offsets[c].vertices + chunks[c].vertices.size();
+        offsets[c + 1].faces = offsets[c].faces + chunks[c].faceSizes.size();
+    }
+    const ChunkOffsets& total = offsets[nChunks];
+
+    // Materials carry over from one chunk to the next. Each chunk is split into
+    // runs of faces sharing a material, and meshes are numbered by first use.
+    std::vector<std::vector<std::pair<int64_t, int64_t>>> chunkRuns(nChunks);
+    std::unordered_map<std::string, int64_t> meshIds;
+    std::string material;
+    for (int64_t c = 0; c < nChunks; c++) {
+        const OBJChunk& chunk = chunks[c];
+        for (size_t r = 0; r <= chunk.materials.size(); r++) {
+            int64_t first = r == 0 ? 0 : chunk.materials[r - 1].first;
+            int64_t last = r == chunk.materials.size() ? chunk.faceSizes.size() : chunk.materials[r].first;
+            if (r > 0) material = chunk.materials[r - 1].second;
+            if (first == last) continue;
+
+            auto id = meshIds.find(material);
+            if (id == meshIds.end()) {
+                id = meshIds.emplace(material, materials.size()).first;
+                materials.push_back(material);
+            }
+            chunkRuns[c].emplace_back(first, id->second);
+        }
+    }
+
+    p.resize(3 * total.p);
+    uv.resize(2 * total.uv);
+    n.resize(3 * total.n);
+    vertices.resize(total.vertices);
+    faceStart.resize(total.faces + 1);
+    faceStart[total.faces] = total.vertices;
+
+    std::atomic<bool> valid(true);
+    ParallelFor([&](int64_t c) {
+        OBJChunk& chunk = chunks[c];
+        const ChunkOffsets& o = offsets[c];
+        std::copy(chunk.p.begin(), chunk.p.end(), &p[3 * o.p]);
+        std::copy(chunk.uv.begin(), chunk.uv.end(), &uv[2 * o.uv]);
+        std::copy(chunk.n.begin(), chunk.n.end(), &n[3 * o.n]);
+
+        size_t run = 0;
+        int64_t v = o.vertices;
+        for (size_t f = 0; f < chunk.faceSizes.size(); f++) {
+            while (run + 1 < chunkRuns[c].size() && chunkRuns[c][run + 1].first <= int64_t(f)) run++;
+            faceStart[o.faces + f] = v;
+
+            for (int k = 0; k < chunk.faceSizes[f]; k++, v++) {
+                OBJVertex vertex = chunk.vertices[v - o.vertices];
+                vertex.p = resolveOBJIndex(vertex.p, o.p, total.p);
+                vertex.uv = resolveOBJIndex(vertex.uv, o.uv, total.uv);
+                vertex.n = resolveOBJIndex(vertex.n, o.n, total.n);
+                vertex.mesh = chunkRuns[c][run].second;
+                if (vertex.p < 0 || vertex.uv < 0 || vertex.n < 0) valid = false;
+                vertices[v] = vertex;
+            }
+        }
+
+        // The chunk is no longer needed
+        chunk = OBJChunk();
+    }, nChunks);
+
+    return valid;
+}
+
+void OBJReader::mergeVertices() {
+    int64_t nVertices = vertices.size();
+    size_t tableSize = 16;
+    while (tableSize < 2 * size_t(nVertices)) tableSize *= 2;
+    std::unique_ptr<std::atomic<int64_t>[]> table(new std::atomic<int64_t>[tableSize]);
+
+    int64_t tableBlockSize = getBlockSize(tableSize);
+    ParallelFor([&](int64_t block) {
+        size_t s = block * tableBlockSize, e = std::min(s + tableBlockSize, tableSize);
+        for (size_t i = s; i < e; i++) table[i].store(-1, std::memory_order_relaxed);
+    }, (tableSize + tableBlockSize - 1) / tableBlockSize);
+
+    auto hash = [&](const OBJVertex& v) {
+        // See SpatialLightDistribution::lookup for the bit mixing
+        uint64_t h = uint64_t(v.p) * 0x9e3779b97f4a7c15 ^ uint64_t(v.uv) * 0xc2b2ae3d27d4eb4f ^
+                     uint64_t(v.n) * 0x165667b19e3779f9 ^ uint64_t(v.mesh);
+        h ^= (h >> 31);
+        h *= 0x7fb5d329728ea185;
+        h ^= (h >> 27);
+        h *= 0x81dadef4bc2dd44d;
+        h ^= (h >> 33);
+        return h & (tableSize - 1);
+    };
+
+    // Insert the face vertices into the hash table without locks. Equal face
+    // vertices share an entry, which ends up holding the first of them, so
+    // that the merged vertices do not depend on the order of insertion.
+    int64_t blockSize = getBlockSize(nVertices);
+    int64_t nBlocks = (nVertices + blockSize - 1) / blockSize;
+    ParallelFor([&](int64_t block) {
+        int64_t s = block * blockSize, e = std::min(s + blockSize, nVertices);
+        for (int64_t i = s; i < e; i++) {
+            for (size_t slot = hash(vertices[i]);; slot = (slot + 1) & (tableSize - 1)) {
+                int64_t entry = table[slot].load(std::memory_order_acquire);
+                // On failure, {entry} is set to the face vertex inserted by another thread
+                if (entry < 0 && table[slot].compare_exchange_strong(entry, i)) break;
+                if (vertices[entry] == vertices[i]) {
+                    while (i < entry && !table[slot].compare_exchange_weak(entry, i)) {}
+                    break;
+                }
+            }
+        }
+    }, nBlocks);
+
+    firstInstance.resize(nVertices);
+    ParallelFor([&](int64_t block) {
+        int64_t s = block * blockSize, e = std::min(s + blockSize, nVertices);
+        for (int64_t i = s; i < e; i++) {
+            size_t slot = hash(vertices[i]);
+            while (!(vertices[table[slot].load(std::memory_order_relaxed)] == vertices[i]))
+                slot = (slot + 1) & (tableSize - 1);
+            firstInstance[i] = table[slot].load(std::memory_order_relaxed);
+        }
+    }, nBlocks);
+}
+
+bool OBJReader::createMeshes() {
+    int64_t nVertices = vertices.size(), nFaces = faceStart.size() - 1;
+    int64_t nMeshes = materials.size();
+
+    // Count the vertices and triangles of each mesh per block, where vertices
+    // are numbered in order of their first instance
+    int64_t vertexBlockSize = getBlockSize(nVertices), faceBlockSize = getBlockSize(nFaces);
+    int64_t nVertexBlocks = (nVertices + vertexBlockSize - 1) / vertexBlockSize;
+    int64_t nFaceBlocks = (nFaces + faceBlockSize - 1) / faceBlockSize;
+    std::vector<int64_t> blockVertices(nVertexBlocks * nMeshes), blockTriangles(nFaceBlocks * nMeshes);
+    std::vector<char> blockMissingUVs(nVertexBlocks * nMeshes), blockMissingNormals(nVertexBlocks * nMeshes);
+
+    ParallelFor([&](int64_t block) {
+        int64_t s = block * vertexBlockSize, e = std::min(s + vertexBlockSize, nVertices);
+        for (int64_t i = s; i < e; i++) {
+            int64_t m = block * nMeshes + vertices[i].mesh;
+            if (firstInstance[i] == i) blockVertices[m]++;
+            if (vertices[i].uv == missingOBJIndex) blockMissingUVs[m] = true;
+            if (vertices[i].n == missingOBJIndex) blockMissingNormals[m] = true;
+        }
+    }, nVertexBlocks);
+    ParallelFor([&](int64_t block) {
+        int64_t s = block * faceBlockSize, e = std::min(s + faceBlockSize, nFaces);
+        for (int64_t f = s; f < e; f++)
+            blockTriangles[block * nMeshes + vertices[faceStart[f]].mesh] += faceStart[f + 1] - faceStart[f] - 2;
+    }, nFaceBlocks);
+
+    // Meshes only have (u, v) coordinates or normals if all their vertices do
+    std::vector<bool> hasUVs(nMeshes, true), hasNormals(nMeshes, true);
+    std::vector<int> nComponents(nMeshes);
+    for (int64_t m = 0; m < nMeshes; m++) {
+        int64_t meshVertices = 0, meshTriangles = 0;
+        for (int64_t b = 0; b < nVertexBlocks; b++) {
+            std::swap(meshVertices, blockVertices[b * nMeshes + m]);
+            meshVertices += blockVertices[b * nMeshes + m];
+            if (blockMissingUVs[b * nMeshes + m]) hasUVs[m] = false;
+            if (blockMissingNormals[b * nMeshes + m]) hasNormals[m] = false;
+        }
+        for (int64_t b = 0; b < nFaceBlocks; b++) {
+            std::swap(meshTriangles, blockTriangles[b * nMeshes + m]);
+            meshTriangles += blockTriangles[b * nMeshes + m];
+        }
+        if (meshVertices > std::numeric_limits<int32_t>::max() ||
+            meshTriangles > std::numeric_limits<int32_t>::max())
+            return false;
+
+        IndexedMesh* mesh = new IndexedMesh();
+        meshes.emplace_back(mesh);
+        nComponents[m] = 3 + (hasNormals[m] ? 3 : 0) + (hasUVs[m] ? 2 : 0);
+        mesh->material = materials[m];
+        mesh->nVertices = meshVertices;
+        mesh->nTriangles = meshTriangles;
+        mesh->vertexData.resize(meshVertices * nComponents[m]);
+        mesh->indexData.resize(3 * meshTriangles);
+    }
+
+    // Write the vertices of each mesh at their first instance
+    std::vector<uint32_t> vertexIds(nVertices);
+    ParallelFor([&](int64_t block) {
+        int64_t s = block * vertexBlockSize, e = std::min(s + vertexBlockSize, nVertices);
+        for (int64_t i = s; i < e; i++) {
+            if (firstInstance[i] != i) continue;
+            const OBJVertex& v = vertices[i];
+            IndexedMesh* mesh = meshes[v.mesh].get();
+            vertexIds[i] = blockVertices[block * nMeshes + v.mesh]++;
+
+            Real* vertex = &mesh->vertexData[vertexIds[i] * nComponents[v.mesh]];
+            for (int c = 0; c < 3; c++) *vertex++ = p[3 * v.p + c];
+            for (int c = 0; c < 3 && hasNormals[v.mesh]; c++) *vertex++ = n[3 * v.n + c];
+            for (int c = 0; c < 2 && hasUVs[v.mesh]; c++) *vertex++ = uv[2 * v.uv + c];
+        }
+    }, nVertexBlocks);
+
+    // Triangulate the faces as fans
+    ParallelFor([&](int64_t block) {
+        int64_t s = block * faceBlockSize, e = std::min(s + faceBlockSize, nFaces);
+        for (int64_t f = s; f < e; f++) {
+            int64_t first = faceStart[f], mesh = vertices[first].mesh;
+            int64_t& triangle = blockTriangles[block * nMeshes + mesh];
+            uint32_t* indices = &meshes[mesh]->indexData[3 * triangle];
+            for (int64_t v = first + 2; v < faceStart[f + 1]; v++, triangle++) {
+                *indices++ = vertexIds[firstInstance[first]];
+                *indices++ = vertexIds[firstInstance[v - 1]];
+                *indices++ = vertexIds[firstInstance[v]];
+            }
+        }
+    }, nFaceBlocks);
+
+    for (int64_t m = 0; m < nMeshes; m++) meshes[m]->setDecodedAttributes(hasNormals[m], hasUVs[m]);
+    return true;
+}
+
+std::vector<std::unique_ptr<IndexedMesh>> loadOBJMeshes(const std::string& path) {
+    OBJReader reader(path);
+    return reader.read();
+}
+
+}  // namespace phyr
@@ -7,22 +7,54 @@
 
 namespace phyr {
 
+// Object definitions
+void Object::intersectRays(const Ray* rays, SurfaceInteraction* si, bool* hits, int n) const {
+    for (int i = 0; i < n; i++) hits[i] = intersectRay(rays[i], &si[i]);
+}
+void Object::intersectRays(const Ray* rays, bool* hits, int n) const {
+    for (int i = 0; i < n; i++) hits[i] = intersectRay(rays[i]);
+}
+
+bool Object::clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const {
+    Bounds3f wb = worldBounds();
+    if (!overlaps(wb, clip)) return false;
+    *bounds = intersect(wb, clip);
+    return true;
+}
+
 // GeometricObject definitions
 Bounds3f GeometricObject::worldBounds() const { return shape->worldBounds(); }
+bool GeometricObject::clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const {
+    return shape->clipWorldBounds(clip, bounds);
+}
+void GeometricObject::getClipParameters(std::vector<Real>* params) const {
+    shape->getClipParameters(params);
+}
 
 // GeometricObject intersections
 bool GeometricObject::intersectRay(const Ray& ray) const {
     return shape->intersectRay(ray);
 }
 bool GeometricObject::intersectRay(const Ray& ray, SurfaceInteraction* si) const {
-    Real t0;
+    SurfaceHit hit;
+    if (!intersectHit(ray, &hit)) return false;
+    computeInteraction(ray, hit, si);
+    return true;
+}
+bool GeometricObject::intersectHit(const Ray& ray, SurfaceHit* hit) const {
     // Check for intersection
-    if (!shape->intersectRay(ray, &t0, si)) return false;
-    // Update ray and interaction
-    ray.tMax = t0; si->object = this;
+    if (!shape->intersectHit(ray, hit)) return false;
+    // Update ray and hit record
+    ray.tMax = hit->t;
+    hit->object = this; hit->nInstances = 0;
 
     return true;
 }
+void GeometricObject::computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                                         SurfaceInteraction* si) const {
+    shape->computeInteraction(ray, hit, si);
+    si->object = this;
+}
 
 void GeometricObject::computeScatteringFunctions(SurfaceInteraction* si,
                                                  MemoryPool& pool, TransportMode mode,
@@ -42,23 +74,65 @@ const Material* GeometricObject::getMaterial() const {
 
 
 // InstancedObject declarations
-Bounds3f InstancedObject::worldBounds() const {
-    return objectToInstanceWorld(object->worldBounds());
-}
+Bounds3f InstancedObject::worldBounds() const { return instanceBounds; }
 
 bool InstancedObject::intersectRay(const Ray& ray) const {
-    return object->intersectRay(Transform::inverse(objectToInstanceWorld)(ray));
+    return object->intersectRay(instanceWorldToObject(ray));
 }
 bool InstancedObject::intersectRay(const Ray& ray, SurfaceInteraction* si) const {
+    SurfaceHit hit;
+    if (!intersectHit(ray, &hit)) return false;
+    computeInteraction(ray, hit, si);
+    return true;
+}
+
+bool InstancedObject::intersectHit(const Ray& ray, SurfaceHit* hit) const {
     // Transform ray to instance local space
-    Ray r = Transform::inverse(objectToInstanceWorld)(ray);
-    if (!object->intersectRay(r, si)) return false;
+    Ray r = instanceWorldToObject(ray);
+    SurfaceHit objectHit;
+    if (!object->intersectHit(r, &objectHit)) return false;
+
+    // Deeper nesting than the hit can record is not supported
+    ASSERT(objectHit.nInstances < MaxInstanceDepth);
+    if (objectHit.nInstances >= MaxInstanceDepth) return false;
     ray.tMax = r.tMax;
+    *hit = objectHit;
+    hit->instances[hit->nInstances++] = this;
+    return true;
+}
+void InstancedObject::computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                                         SurfaceInteraction* si) const {
+    // This is the outermost instance recorded in {hit}; hand the rest of
+    // the chain to the next instance inwards, if any
+    ASSERT(hit.nInstances > 0 && hit.instances[hit.nInstances - 1] == this);
+    SurfaceHit objectHit = hit;
+    objectHit.nInstances--;
+    Ray r = instanceWorldToObject(ray);
+    if (objectHit.nInstances > 0)
+        objectHit.instances[objectHit.nInstances - 1]->computeInteraction(r, objectHit, si);
+    else
+        objectHit.object->computeInteraction(r, objectHit, si);
 
     // Transform surface interaction data back to instance world space
     if (!objectToInstanceWorld.isIdentity())
         *si = objectToInstanceWorld(*si);
-    return true;
+}
+
+void InstancedObject::setTransform(const Transform& objectToInstanceWorld) {
+    this->objectToInstanceWorld = objectToInstanceWorld;
+    instanceWorldToObject = Transform::inverse(objectToInstanceWorld);
+    updateBounds();
+}
+
+void InstancedObject::updateBounds() {
+    instanceBounds = objectToInstanceWorld(object->worldBounds());
+}
+
+// ObjectGroup definitions
+void ObjectGroup::computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                                     SurfaceInteraction* si) const {
+    if (hit.nInstances > 0) hit.instances[hit.nInstances - 1]->computeInteraction(ray, hit, si);
+    else hit.object->computeInteraction(ray, hit, si);
 }
 
 }  // namespace phyr
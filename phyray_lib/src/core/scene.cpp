@@ -14,6 +14,22 @@ bool Scene::intersectP(const Ray& ray) const {
     return aggregate->intersectRay(ray);
 }
 
+int Scene::intersect(const Ray* rays, SurfaceInteraction* isects, bool* hits, int n) const {
+    aggregate->intersectRays(rays, isects, hits, n);
+
+    int nHits = 0;
+    for (int i = 0; i < n; i++) nHits += hits[i];
+    return nHits;
+}
+
+int Scene::intersectP(const Ray* rays, bool* occluded, int n) const {
+    aggregate->intersectRays(rays, occluded, n);
+
+    int nOccluded = 0;
+    for (int i = 0; i < n; i++) nOccluded += occluded[i];
+    return nOccluded;
+}
+
 bool Scene::intersectTr(Ray ray, Sampler& sampler, SurfaceInteraction* isect,
                         Spectrum* Tr) const {
     *Tr = Spectrum(1.f);
@@ -1,5 +1,6 @@
 #include <core/geometry/interaction.h>
 #include <core/integrator/sampling.h>
+#include <core/material/texture.h>
 
 #include <modules/shapes/disk.h>
 
@@ -10,8 +11,33 @@ Bounds3f Disk::objectBounds() const {
                     Point3f(radius, radius, height));
 }
 
-bool Disk::intersectRay(const Ray& r, Real* t0, SurfaceInteraction* si,
-                        bool testAlpha) const {
+bool Disk::clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const {
+    if (!Shape::clipWorldBounds(clip, bounds)) return false;
+
+    // The box must reach the disk plane and the ring between the disk radii
+    Bounds3f localClip = (*worldToLocal)(clip);
+    Real tol = ClipTolerance * std::max(radius, std::abs(height));
+    if (localClip.pMin.z > height + tol || localClip.pMax.z < height - tol) return false;
+
+    Real nearest2 = 0, farthest2 = 0;
+    for (int axis = 0; axis < 2; axis++) {
+        Real lo = localClip.pMin[axis], hi = localClip.pMax[axis];
+        Real d = lo > 0 ? lo : (hi < 0 ? -hi : 0);
+        nearest2 += d * d;
+        farthest2 += std::max(lo * lo, hi * hi);
+    }
+
+    return nearest2 <= radius * radius * (1 + ClipTolerance) &&
+           farthest2 >= innerRadius * innerRadius * (1 - ClipTolerance);
+}
+
+void Disk::getClipParameters(std::vector<Real>* params) const {
+    const Mat4x4& m = worldToLocal->getMatrix();
+    params->insert(params->end(), &m.d[0][0], &m.d[0][0] + 16);
+    params->insert(params->end(), { height, radius, innerRadius });
+}
+
+bool Disk::intersectHit(const Ray& r, SurfaceHit* hit, bool testAlpha) const {
     // Transform {Ray} to local space
     Vector3f oErr, dErr;
     Ray ray = (*worldToLocal)(r, &oErr, &dErr);
@@ -30,13 +56,36 @@ bool Disk::intersectRay(const Ray& r, Real* t0, SurfaceInteraction* si,
         return false;
 
     // Test disk {phi} value against {phiMax}
+    if (phiMax < 2 * Pi) {
+        Real phi = std::atan2(pHit.y, pHit.x);
+        if (phi < 0) phi += 2 * Pi;
+        if (phi > phiMax) return false;
+    }
+
+    if (testAlpha && alphaMask) {
+        // Leave {hit} untouched if the point is cut out
+        SurfaceHit maskHit;
+        maskHit.hint[0] = pHit.x; maskHit.hint[1] = pHit.y; maskHit.hint[2] = pHit.z;
+        SurfaceInteraction si;
+        computeInteraction(r, maskHit, &si);
+        if (!alphaTest(*alphaMask, si, r)) return false;
+    }
+
+    // Keep the local hit point for {computeInteraction}
+    hit->t = tShapeHit;
+    hit->hint[0] = pHit.x; hit->hint[1] = pHit.y; hit->hint[2] = pHit.z;
+    return true;
+}
+
+void Disk::computeInteraction(const Ray& r, const SurfaceHit& hit,
+                              SurfaceInteraction* si) const {
+    Point3f pHit(hit.hint[0], hit.hint[1], hit.hint[2]);
     Real phi = std::atan2(pHit.y, pHit.x);
     if (phi < 0) phi += 2 * Pi;
-    if (phi > phiMax) return false;
 
     // Find parametric representation of disk hit
     Real u = phi / phiMax;
-    Real rHit = std::sqrt(dist2);
+    Real rHit = std::sqrt(pHit.x * pHit.x + pHit.y * pHit.y);
     Real oneMinusV = ((rHit - innerRadius) / (radius - innerRadius));
     Real v = 1 - oneMinusV;
     Vector3f dpdu(-phiMax * pHit.y, phiMax * pHit.x, 0);
@@ -50,37 +99,9 @@ bool Disk::intersectRay(const Ray& r, Real* t0, SurfaceInteraction* si,
     Vector3f pError(0, 0, 0);
 
     // Initialize _SurfaceInteraction_ from parametric information
-    *si = (*localToWorld)(SurfaceInteraction(pHit, -ray.d, pError, Point2f(u, v),
+    Vector3f wo = -(*worldToLocal)(r.d);
+    *si = (*localToWorld)(SurfaceInteraction(pHit, wo, pError, Point2f(u, v),
                                              dpdu, dpdv, dndu, dndv, this));
-
-    // Update _tHit_ for quadric intersection
-    *t0 = Real(tShapeHit);
-    return true;
-}
-
-bool Disk::intersectRay(const Ray& r, bool testAlpha) const {
-    // Transform {Ray} to object space
-    Vector3f oErr, dErr;
-    Ray ray = (*worldToLocal)(r, &oErr, &dErr);
-
-    // Compute plane intersection for disk
-
-    // Reject disk intersections for rays parallel to the disk's plane
-    if (ray.d.z == 0) return false;
-    Real tShapeHit = (height - ray.o.z) / ray.d.z;
-    if (tShapeHit <= 0 || tShapeHit >= ray.tMax) return false;
-
-    // See if hit point is inside disk radii and {phiMax}
-    Point3f pHit = ray(tShapeHit);
-    Real dist2 = pHit.x * pHit.x + pHit.y * pHit.y;
-    if (dist2 > radius * radius || dist2 < innerRadius * innerRadius)
-        return false;
-
-    // Test disk {phi} value against {phiMax}
-    Real phi = std::atan2(pHit.y, pHit.x);
-    if (phi < 0) phi += 2 * Pi;
-    if (phi > phiMax) return false;
-    return true;
 }
 
 Real Disk::surfaceArea() const {
@@ -102,9 +123,10 @@ Interaction Disk::sample(const Point2f& u, Real* pdf) const {
 
 std::shared_ptr<Disk> createDiskShape(const Transform* o2w, const Transform* w2o,
                                       Real height, Real radius, Real innerRadius,
-                                      Real phiMax, bool reverseOrientation) {
+                                      Real phiMax, bool reverseOrientation,
+                                      const std::shared_ptr<Texture<Real>>& alphaMask) {
     return std::make_shared<Disk>(o2w, w2o, height, radius, innerRadius,
-                                  phiMax, reverseOrientation);
+                                  phiMax, reverseOrientation, alphaMask);
 }
 
 }  // namespace phyr
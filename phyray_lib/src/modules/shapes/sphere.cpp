@@ -3,13 +3,38 @@
 #include <core/geometry/geometry.h>
 #include <core/geometry/interaction.h>
 #include <core/integrator/sampling.h>
+#include <core/material/texture.h>
 
 #include <modules/shapes/sphere.h>
 
 namespace phyr {
 
-bool Sphere::intersectRay(const Ray& ray, Real* t0, SurfaceInteraction* si,
-                          bool testAlpha) const {
+bool Sphere::clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const {
+    if (!Shape::clipWorldBounds(clip, bounds)) return false;
+
+    // The surface misses boxes lying entirely inside or outside of
+    // the sphere, e.g. the interior of a large enclosing sphere
+    Bounds3f localClip = (*worldToLocal)(clip);
+    Real nearest2 = 0, farthest2 = 0;
+    for (int axis = 0; axis < 3; axis++) {
+        Real lo = localClip.pMin[axis], hi = localClip.pMax[axis];
+        Real d = lo > 0 ? lo : (hi < 0 ? -hi : 0);
+        nearest2 += d * d;
+        farthest2 += std::max(lo * lo, hi * hi);
+    }
+
+    // Leave some slack for the error in transforming {clip}
+    Real r2 = radius * radius;
+    return nearest2 <= r2 * (1 + ClipTolerance) && farthest2 >= r2 * (1 - ClipTolerance);
+}
+
+void Sphere::getClipParameters(std::vector<Real>* params) const {
+    const Mat4x4& m = worldToLocal->getMatrix();
+    params->insert(params->end(), &m.d[0][0], &m.d[0][0] + 16);
+    params->push_back(radius);
+}
+
+bool Sphere::intersectHit(const Ray& ray, SurfaceHit* hit, bool testAlpha) const {
     Vector3f roErr, rdErr;
     // Transform ray to local space
     Ray lr = (*worldToLocal)(ray, &roErr, &rdErr);
@@ -33,27 +58,44 @@ bool Sphere::intersectRay(const Ray& ray, Real* t0, SurfaceInteraction* si,
         tt0 = t2; if (tt0.upperBound() > lr.tMax) return false;
     }
 
-    Point3f hpt = lr(Real(tt0));
-    // Reproject the point onto the surface to refine it
-    hpt *= radius / distance(hpt, Point3f(0, 0, 0));
-
-    if ((zMin > -radius && hpt.z < zMin) || (zMax < radius && hpt.z > zMax)) {
-        // If ray origin is inside the sphere and t2 intersects a clipped region
+    Point3f hpt;
+    if (!refineHit(ray, lr, Real(tt0), testAlpha, &hpt)) {
+        // If ray origin is inside the sphere and t2 is clipped or cut out
         if (tt0 == t2) return false;
         // We're looking at a hole in the sphere on the near side.
         // Test intersection with the farther side
-        if (tt0.upperBound() > lr.tMax) return false;
+        if (t2.upperBound() > lr.tMax) return false;
 
         // Test with t1 failed, try t2
-        tt0 = t2; hpt = lr(Real(tt0));
-        // Reproject the point onto the surface to refine it
-        hpt *= radius / distance(hpt, Point3f(0, 0, 0));
-
-        if ((zMin > -radius && hpt.z < zMin) || (zMax < radius && hpt.z > zMax))
-            return false;
+        tt0 = t2;
+        if (!refineHit(ray, lr, Real(tt0), testAlpha, &hpt)) return false;
     }
 
-    *t0 = Real(tt0);
+    // Keep the refined local hit point for {computeInteraction}
+    hit->t = Real(tt0);
+    hit->hint[0] = hpt.x; hit->hint[1] = hpt.y; hit->hint[2] = hpt.z;
+    return true;
+}
+
+bool Sphere::refineHit(const Ray& ray, const Ray& lr, Real t, bool testAlpha,
+                       Point3f* hpt) const {
+    *hpt = lr(t);
+    // Reproject the point onto the surface to refine it
+    *hpt *= radius / distance(*hpt, Point3f(0, 0, 0));
+    if ((zMin > -radius && hpt->z < zMin) || (zMax < radius && hpt->z > zMax)) return false;
+    if (!testAlpha || !alphaMask) return true;
+
+    SurfaceHit hit;
+    hit.t = t;
+    hit.hint[0] = hpt->x; hit.hint[1] = hpt->y; hit.hint[2] = hpt->z;
+    SurfaceInteraction si;
+    computeInteraction(ray, hit, &si);
+    return alphaTest(*alphaMask, si, ray);
+}
+
+void Sphere::computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                                SurfaceInteraction* si) const {
+    Point3f hpt(hit.hint[0], hit.hint[1], hit.hint[2]);
     Real twoPi = 2 * Pi, delTheta = thetaMax - thetaMin;
 
     // Make sure phi = atan(y / x) doesn't result in NaN
@@ -88,57 +130,9 @@ bool Sphere::intersectRay(const Ray& ray, Real* t0, SurfaceInteraction* si,
     // Compute error bounds for ray-sphere intersection
     Vector3f pfError = abs(Vector3f(hpt)) * gamma(5);
     // Initiate the SurfaceInteraction object
-    *si = (*localToWorld)(SurfaceInteraction(hpt, -lr.d, pfError,
+    Vector3f wo = -(*worldToLocal)(ray.d);
+    *si = (*localToWorld)(SurfaceInteraction(hpt, wo, pfError,
                                              Point2f(u, v), dpdu, dpdv, dndu, dndv, this));
-
-    return true;
-}
-
-bool Sphere::intersectRay(const Ray& ray, bool testAlpha) const {
-    Vector3f roErr, rdErr;
-    // Transform ray to local space
-    Ray lr = (*worldToLocal)(ray, &roErr, &rdErr);
-
-    // Compute quadratic sphere coefficients
-    FPError ox(lr.o.x, roErr.x), oy(lr.o.y, roErr.y), oz(lr.o.z, roErr.z);
-    FPError dx(lr.d.x, rdErr.x), dy(lr.d.y, rdErr.y), dz(lr.d.z, rdErr.z);
-    FPError a = dx * dx + dy * dy + dz * dz;
-    FPError b = 2 * (ox * dx + oy * dy + oz * dz);
-    FPError c = ox * ox + oy * oy + oz * oz - FPError(radius) * FPError(radius);
-
-    // Solve quadratic equation for t
-    FPError t1, t2;
-    // No intersections
-    if (!solveQuadraticSystem(a, b, c, &t1, &t2)) return false;
-
-    // Check for trivial range exclusion
-    if (t1.upperBound() > lr.tMax || t2.lowerBound() <= 0) return false;
-    FPError t0 = t1;
-    if (t0.lowerBound() <= 0) {
-        t0 = t2; if (t0.upperBound() > lr.tMax) return false;
-    }
-
-    Point3f hpt = lr(Real(t0));
-    // Reproject the point onto the surface to refine it
-    hpt *= radius / distance(hpt, Point3f(0, 0, 0));
-
-    if ((zMin > -radius && hpt.z < zMin) || (zMax < radius && hpt.z > zMax)) {
-        // If ray origin is inside the sphere and t2 intersects a clipped region
-        if (t0 == t2) return false;
-        // We're looking at a hole in the sphere on the near side.
-        // Test intersection with the farther side
-        if (t0.upperBound() > lr.tMax) return false;
-
-        // Test with t1 failed, try t2
-        t0 = t2; hpt = lr(Real(t0));
-        // Reproject the point onto the surface to refine it
-        hpt *= radius / distance(hpt, Point3f(0, 0, 0));
-
-        if ((zMin > -radius && hpt.z < zMin) || (zMax < radius && hpt.z > zMax))
-            return false;
-    }
-
-    return true;
 }
 
 // Sampling definitions for Sphere
@@ -244,8 +238,10 @@ Real Sphere::solidAngle(const Point3f& p, int nSamples) const {
 
 std::shared_ptr<Shape> createSphereShape(const Transform* o2w,
                                          const Transform* w2o,
-                                         bool reverseNormals, Real radius) {
-    return std::make_shared<Sphere>(o2w, w2o, radius, reverseNormals);
+                                         bool reverseNormals, Real radius,
+                                         const std::shared_ptr<Texture<Real>>& alphaMask) {
+    return std::make_shared<Sphere>(o2w, w2o, radius, reverseNormals,
+                                    -Infinity, Infinity, alphaMask);
 }
 
 } // namespace phyr
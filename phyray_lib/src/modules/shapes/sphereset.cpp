@@ -0,0 +1,566 @@
+#include <core/fperror.h>
+#include <core/concurrency.h>
+#include <core/geometry/interaction.h>
+#include <core/integrator/sampling.h>
+
+#include <modules/shapes/sphereset.h>
+
+#include <algorithm>
+#include <array>
+#include <functional>
+
+namespace phyr {
+
+// Relative slack of the single precision packet test. The test only
+// culls spheres ahead of the exact one, so it may pass a few too many.
+static constexpr float SpherePacketTolerance = 1e-5f;
+// Number of bins of the SAH split search
+static constexpr int SphereSetBins = 16;
+// Nodes deeper than this are split at the median, which bounds the
+// depth of the tree and keeps the traversal stack within 64 entries
+static constexpr int SphereSetMaxSAHDepth = 32;
+
+/**
+ * Ray data for the packet test, in the local space of the set. The
+ * direction is normalized, so that distances along it are comparable
+ * with the sphere radii.
+ */
+struct SpherePacketRay {
+    explicit SpherePacketRay(const Ray& lr) : length(lr.d.length()) {
+        Real maxO = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            o[axis] = lr.o[axis];
+            d[axis] = lr.d[axis] / length;
+            maxO = std::max(maxO, std::abs(lr.o[axis]));
+        }
+        // The origin is rounded to single precision
+        oTolerance = 2 * std::numeric_limits<float>::epsilon() * maxO;
+        setTMax(lr.tMax);
+    }
+
+    void setTMax(Real t) { tMax = roundFloatUp(t * length) * (1 + SpherePacketTolerance); }
+
+    float o[3], d[3];
+    // Distance along {d} to test up to
+    float tMax;
+    // Widening of the sphere radii for the rounded origin
+    float oTolerance;
+    Real length;
+};
+
+/**
+ * Conservatively tests {ray} against all spheres of {packet}, with their
+ * radii widened to cover the rounding errors of the single precision test.
+ * A sphere passes if the ray comes close enough to its center within the
+ * distance range of the ray.
+ * @returns A bit mask of the spheres that may be hit
+ */
+inline int intersectSpherePacket(const SpherePacket& packet, const SpherePacketRay& ray) {
+#if defined(__AVX__)
+    __m256 oc[3], b = _mm256_setzero_ps(), dist2 = _mm256_setzero_ps();
+    for (int axis = 0; axis < 3; axis++) {
+        oc[axis] = _mm256_sub_ps(_mm256_loadu_ps(packet.center[axis]), _mm256_set1_ps(ray.o[axis]));
+        b = _mm256_add_ps(b, _mm256_mul_ps(oc[axis], _mm256_set1_ps(ray.d[axis])));
+    }
+    // Squared distance of the centers from the ray
+    for (int axis = 0; axis < 3; axis++) {
+        __m256 perp = _mm256_sub_ps(oc[axis], _mm256_mul_ps(b, _mm256_set1_ps(ray.d[axis])));
+        dist2 = _mm256_add_ps(dist2, _mm256_mul_ps(perp, perp));
+    }
+
+    __m256 radius = _mm256_loadu_ps(packet.radius);
+    __m256 absB = _mm256_andnot_ps(_mm256_set1_ps(-0.f), b);
+    __m256 r = _mm256_add_ps(radius, _mm256_add_ps(_mm256_set1_ps(ray.oTolerance),
+                                                   _mm256_mul_ps(_mm256_set1_ps(SpherePacketTolerance),
+                                                                 _mm256_add_ps(absB, radius))));
+    // Ordered comparisons fail for the NaN centers of unused lanes
+    __m256 hit = _mm256_and_ps(_mm256_cmp_ps(dist2, _mm256_mul_ps(r, r), _CMP_LE_OQ),
+                               _mm256_cmp_ps(_mm256_add_ps(b, r), _mm256_setzero_ps(), _CMP_GE_OQ));
+    hit = _mm256_and_ps(hit, _mm256_cmp_ps(_mm256_sub_ps(b, r), _mm256_set1_ps(ray.tMax), _CMP_LE_OQ));
+    return _mm256_movemask_ps(hit);
+#elif defined(__SSE__)
+    __m128 oc[3], b = _mm_setzero_ps(), dist2 = _mm_setzero_ps();
+    for (int axis = 0; axis < 3; axis++) {
+        oc[axis] = _mm_sub_ps(_mm_load_ps(packet.center[axis]), _mm_set1_ps(ray.o[axis]));
+        b = _mm_add_ps(b, _mm_mul_ps(oc[axis], _mm_set1_ps(ray.d[axis])));
+    }
+    // Squared distance of the centers from the ray
+    for (int axis = 0; axis < 3; axis++) {
+        __m128 perp = _mm_sub_ps(oc[axis], _mm_mul_ps(b, _mm_set1_ps(ray.d[axis])));
+        dist2 = _mm_add_ps(dist2, _mm_mul_ps(perp, perp));
+    }
+
+    __m128 radius = _mm_load_ps(packet.radius);
+    __m128 absB = _mm_andnot_ps(_mm_set1_ps(-0.f), b);
+    __m128 r = _mm_add_ps(radius, _mm_add_ps(_mm_set1_ps(ray.oTolerance),
+                                             _mm_mul_ps(_mm_set1_ps(SpherePacketTolerance),
+                                                        _mm_add_ps(absB, radius))));
+    // Ordered comparisons fail for the NaN centers of unused lanes
+    __m128 hit = _mm_and_ps(_mm_cmple_ps(dist2, _mm_mul_ps(r, r)),
+                            _mm_cmpge_ps(_mm_add_ps(b, r), _mm_setzero_ps()));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(_mm_sub_ps(b, r), _mm_set1_ps(ray.tMax)));
+    return _mm_movemask_ps(hit);
+#else
+    int mask = 0;
+    for (int i = 0; i < SpherePacketWidth; i++) {
+        float oc[3], b = 0, dist2 = 0;
+        for (int axis = 0; axis < 3; axis++) {
+            oc[axis] = packet.center[axis][i] - ray.o[axis];
+            b += oc[axis] * ray.d[axis];
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            float perp = oc[axis] - b * ray.d[axis];
+            dist2 += perp * perp;
+        }
+
+        float radius = packet.radius[i];
+        float r = radius + ray.oTolerance + SpherePacketTolerance * (std::abs(b) + radius);
+        if (dist2 <= r * r && b + r >= 0 && b - r <= ray.tMax) mask |= 1 << i;
+    }
+    return mask;
+#endif
+}
+
+/**
+ * Builds the BVH of a SphereSet over the spheres in {order}. Nodes are
+ * split with binned SAH, counting the packets rather than the spheres
+ * on each side, until the spheres of a node fit a packet.
+ */
+struct SphereSetBuilder {
+    SphereSetBuilder(int nSpheres, const Point3f* centers, const Real* radii) : order(nSpheres) {
+        for (int axis = 0; axis < 3; axis++) center[axis].resize(nSpheres);
+        radius.resize(nSpheres);
+        for (int i = 0; i < nSpheres; i++) {
+            for (int axis = 0; axis < 3; axis++) center[axis][i] = centers[i][axis];
+            radius[i] = radii[i];
+            order[i] = i;
+        }
+    }
+
+    Point3f getCenter(uint32_t i) const {
+        return Point3f(center[0][i], center[1][i], center[2][i]);
+    }
+    Bounds3f getBounds(uint32_t i) const {
+        Vector3f r(radius[i], radius[i], radius[i]);
+        return Bounds3f(getCenter(i) - r, getCenter(i) + r);
+    }
+
+    static int countPackets(int nSpheres) {
+        return (nSpheres + SpherePacketWidth - 1) / SpherePacketWidth;
+    }
+
+    /**
+     * Partitions the spheres in [{start}, {end}), storing their bounds in
+     * {nodeBounds} and the split axis in {axis}
+     * @returns The index at which the range was split
+     */
+    int split(int start, int end, int depth, Bounds3f* nodeBounds, int* axis) {
+        Bounds3f b = getBounds(order[start]), centroidBounds(getCenter(order[start]));
+        for (int i = start + 1; i < end; i++) {
+            b = unionBounds(b, getBounds(order[i]));
+            centroidBounds = unionBounds(centroidBounds, getCenter(order[i]));
+        }
+        *nodeBounds = b;
+
+        int dim = centroidBounds.maximumExtent();
+        *axis = dim;
+        int mid = (start + end) / 2;
+        Real cMin = centroidBounds.pMin[dim], extent = centroidBounds.pMax[dim] - cMin;
+        // Coincident centers can only be split by count
+        if (extent == 0) return mid;
+
+        auto byCenter = [&](uint32_t s0, uint32_t s1) { return center[dim][s0] < center[dim][s1]; };
+        if (depth >= SphereSetMaxSAHDepth) {
+            std::nth_element(&order[start], &order[mid], &order[0] + end, byCenter);
+            return mid;
+        }
+
+        auto getBin = [&](uint32_t s) {
+            return std::min(SphereSetBins - 1, int(SphereSetBins * ((center[dim][s] - cMin) / extent)));
+        };
+        int counts[SphereSetBins] = {};
+        Bounds3f binBounds[SphereSetBins];
+        for (int i = start; i < end; i++) {
+            int bin = getBin(order[i]);
+            binBounds[bin] = counts[bin]++ == 0 ? getBounds(order[i])
+                                                : unionBounds(binBounds[bin], getBounds(order[i]));
+        }
+
+        // Sweep the bins from the right, then find the cheapest split from the left
+        Real rightCost[SphereSetBins];
+        Bounds3f right;
+        for (int bin = SphereSetBins - 1, n = 0; bin > 0; bin--) {
+            if (counts[bin] > 0) right = n == 0 ? binBounds[bin] : unionBounds(right, binBounds[bin]);
+            n += counts[bin];
+            rightCost[bin] = n > 0 ? countPackets(n) * right.surfaceArea() : 0;
+        }
+
+        Real bestCost = Infinity;
+        int bestBin = -1;
+        Bounds3f left;
+        for (int bin = 0, n = 0; bin < SphereSetBins - 1; bin++) {
+            if (counts[bin] > 0) left = n == 0 ? binBounds[bin] : unionBounds(left, binBounds[bin]);
+            n += counts[bin];
+            Real cost = (n > 0 ? countPackets(n) * left.surfaceArea() : 0) + rightCost[bin + 1];
+            if (n > 0 && n < end - start && cost < bestCost) {
+                bestCost = cost;
+                bestBin = bin;
+            }
+        }
+
+        if (bestBin >= 0) {
+            uint32_t* pmid = std::partition(&order[start], &order[0] + end,
+                                            [&](uint32_t s) { return getBin(s) <= bestBin; });
+            return pmid - &order[0];
+        }
+        std::nth_element(&order[start], &order[mid], &order[0] + end, byCenter);
+        return mid;
+    }
+
+    /**
+     * Builds the subtree over [{start}, {end}) into {nodes} in depth first
+     * order, with its leaves referring to the packets appended to {packets}
+     */
+    void build(int start, int end, int depth, std::vector<LinearBVHNode>& nodes,
+               std::vector<SpherePacket>& packets) {
+        int nodeIdx = nodes.size();
+        nodes.emplace_back();
+        nodes[nodeIdx].splitAxis = 0;
+        nodes[nodeIdx].childrenSwapped = 0;
+
+        if (end - start <= SpherePacketWidth) {
+            SpherePacket packet;
+            Bounds3f b = getBounds(order[start]);
+            for (int lane = 0; lane < SpherePacketWidth; lane++) {
+                bool used = start + lane < end;
+                uint32_t s = used ? order[start + lane] : 0;
+                for (int axis = 0; axis < 3; axis++)
+                    packet.center[axis][lane] = used ? center[axis][s] : std::numeric_limits<float>::quiet_NaN();
+                packet.radius[lane] = used ? radius[s] : 0;
+                if (used) b = unionBounds(b, getBounds(s));
+            }
+
+            nodes[nodeIdx].setBounds(b);
+            nodes[nodeIdx].objectStartIdx = packets.size();
+            nodes[nodeIdx].nObjects = end - start;
+            packets.push_back(packet);
+            return;
+        }
+
+        Bounds3f b;
+        int axis;
+        int mid = split(start, end, depth, &b, &axis);
+        nodes[nodeIdx].setBounds(b);
+        nodes[nodeIdx].nObjects = 0;
+        nodes[nodeIdx].splitAxis = axis;
+
+        build(start, mid, depth + 1, nodes, packets);
+        nodes[nodeIdx].secondChildIdx = nodes.size();
+        build(mid, end, depth + 1, nodes, packets);
+    }
+
+    /**
+     * Builds the top levels of the tree over [{start}, {end}) like {build}.
+     * Ranges of at most {subtreeSize} spheres are left to be built separately,
+     * and recorded in {subtrees} as their range and depth, along with the
+     * node standing in for them.
+     */
+    void buildTopLevel(int start, int end, int depth, int subtreeSize,
+                       std::vector<LinearBVHNode>& nodes,
+                       std::vector<std::array<int, 3>>& subtrees, std::vector<int>& nodeSubtree) {
+        int nodeIdx = nodes.size();
+        nodes.emplace_back();
+        nodeSubtree.push_back(-1);
+
+        if (end - start <= subtreeSize) {
+            nodeSubtree[nodeIdx] = subtrees.size();
+            subtrees.push_back({ { start, end, depth } });
+            return;
+        }
+
+        Bounds3f b;
+        int axis;
+        int mid = split(start, end, depth, &b, &axis);
+        nodes[nodeIdx].setBounds(b);
+        nodes[nodeIdx].nObjects = 0;
+        nodes[nodeIdx].splitAxis = axis;
+        nodes[nodeIdx].childrenSwapped = 0;
+
+        buildTopLevel(start, mid, depth + 1, subtreeSize, nodes, subtrees, nodeSubtree);
+        nodes[nodeIdx].secondChildIdx = nodes.size();
+        buildTopLevel(mid, end, depth + 1, subtreeSize, nodes, subtrees, nodeSubtree);
+    }
+
+    std::vector<float> center[3], radius;
+    std::vector<uint32_t> order;
+};
+
+// SphereSet definitions
+SphereSet::SphereSet(const Transform* localToWorld, const Transform* worldToLocal,
+                     bool reverseNormals, int nSpheres, const Point3f* centers, const Real* radii,
+                     const std::shared_ptr<Texture<Real>>& alphaMask) :
+    Shape(localToWorld, worldToLocal, reverseNormals), nSpheres(nSpheres), alphaMask(alphaMask) {
+    constructBVH(centers, radii);
+}
+
+SphereSet::~SphereSet() {}
+
+void SphereSet::constructBVH(const Point3f* centers, const Real* radii) {
+    if (nSpheres == 0) {
+        bounds = Bounds3f(Point3f(0, 0, 0));
+        return;
+    }
+    SphereSetBuilder builder(nSpheres, centers, radii);
+
+    // Split the top levels on this thread, and build the subtrees below them in parallel
+    const int subtreeSize = std::max(4096, nSpheres / 256);
+    std::vector<LinearBVHNode> topNodes;
+    std::vector<std::array<int, 3>> subtrees;
+    std::vector<int> nodeSubtree;
+    builder.buildTopLevel(0, nSpheres, 0, subtreeSize, topNodes, subtrees, nodeSubtree);
+
+    std::vector<std::vector<LinearBVHNode>> subtreeNodes(subtrees.size());
+    std::vector<std::vector<SpherePacket>> subtreePackets(subtrees.size());
+    ParallelFor([&](int64_t s) {
+        builder.build(subtrees[s][0], subtrees[s][1], subtrees[s][2], subtreeNodes[s], subtreePackets[s]);
+    }, subtrees.size());
+
+    // Stitch the subtrees into the top levels, keeping the depth first order
+    size_t totalNodes = topNodes.size(), totalPackets = 0;
+    for (size_t s = 0; s < subtrees.size(); s++) {
+        totalNodes += subtreeNodes[s].size() - 1;
+        totalPackets += subtreePackets[s].size();
+    }
+    nodes.reserve(totalNodes);
+    packets.reserve(totalPackets);
+
+    std::function<void(int)> emit = [&](int topIdx) {
+        int s = nodeSubtree[topIdx];
+        if (s >= 0) {
+            int nodeBase = nodes.size(), packetBase = packets.size();
+            for (LinearBVHNode node : subtreeNodes[s]) {
+                if (node.nObjects > 0) node.objectStartIdx += packetBase;
+                else node.secondChildIdx += nodeBase;
+                nodes.push_back(node);
+            }
+            packets.insert(packets.end(), subtreePackets[s].begin(), subtreePackets[s].end());
+            std::vector<LinearBVHNode>().swap(subtreeNodes[s]);
+            std::vector<SpherePacket>().swap(subtreePackets[s]);
+            return;
+        }
+
+        int nodeIdx = nodes.size();
+        nodes.push_back(topNodes[topIdx]);
+        emit(topIdx + 1);
+        nodes[nodeIdx].secondChildIdx = nodes.size();
+        emit(topNodes[topIdx].secondChildIdx);
+    };
+    emit(0);
+
+    // Exact bounds and area of the single precision spheres
+    bounds = builder.getBounds(0);
+    for (int i = 0; i < nSpheres; i++) {
+        bounds = unionBounds(bounds, builder.getBounds(i));
+        area += 4 * Pi * Real(builder.radius[i]) * Real(builder.radius[i]);
+    }
+
+    LOG_INFO_FMT("Sphere set: %d spheres, %d nodes, %.1f bytes per sphere", nSpheres,
+                 int(nodes.size()), double(getMemory()) / nSpheres);
+}
+
+size_t SphereSet::getMemory() const {
+    return sizeof(*this) + nodes.size() * sizeof(LinearBVHNode) + packets.size() * sizeof(SpherePacket);
+}
+
+bool SphereSet::intersectSphere(const SpherePacket& packet, int lane, const Ray& lr,
+                                const Vector3f& roErr, const Vector3f& rdErr,
+                                Real* tHit, Real* tFar) const {
+    // Solve the quadratic with the origin relative to the center, as for {Sphere}
+    Vector3f oc = lr.o - Point3f(packet.center[0][lane], packet.center[1][lane], packet.center[2][lane]);
+    Vector3f ocErr = roErr + gamma(1) * abs(oc);
+    FPError ox(oc.x, ocErr.x), oy(oc.y, ocErr.y), oz(oc.z, ocErr.z);
+    FPError dx(lr.d.x, rdErr.x), dy(lr.d.y, rdErr.y), dz(lr.d.z, rdErr.z);
+    FPError radius(packet.radius[lane]);
+    FPError a = dx * dx + dy * dy + dz * dz;
+    FPError b = 2 * (ox * dx + oy * dy + oz * dz);
+    FPError c = ox * ox + oy * oy + oz * oz - radius * radius;
+
+    FPError t1, t2;
+    if (!solveQuadraticSystem(a, b, c, &t1, &t2)) return false;
+    if (t1.upperBound() > lr.tMax || t2.lowerBound() <= 0) return false;
+    FPError tt0 = t1;
+    *tFar = Infinity;
+    if (tt0.lowerBound() <= 0) {
+        tt0 = t2;
+        if (tt0.upperBound() > lr.tMax) return false;
+    } else if (t2.upperBound() <= lr.tMax) {
+        *tFar = Real(t2);
+    }
+
+    *tHit = Real(tt0);
+    return true;
+}
+
+bool SphereSet::testAlphaMask(const Ray& ray, int index, Real t) const {
+    SurfaceHit hit;
+    hit.t = t;
+    hit.hintIndex = index;
+    SurfaceInteraction si;
+    computeInteraction(ray, hit, &si);
+    return alphaTest(*alphaMask, si, ray);
+}
+
+bool SphereSet::intersectSpheres(const Ray& ray, const Ray& lr, const Vector3f& roErr,
+                                 const Vector3f& rdErr, bool testAlpha, SurfaceHit* hit) const {
+    if (nodes.empty()) return false;
+
+    bool intersected = false;
+    BVHRay bvhRay(lr);
+    SpherePacketRay packetRay(lr);
+    const int* isDirNeg = bvhRay.nearIdx;
+
+    int nodeStack[64];
+    int stackSize = 0, itrIdx = 0;
+
+    while (true) {
+        const LinearBVHNode* node = &nodes[itrIdx];
+        if (node->intersectRay(bvhRay)) {
+            if (node->nObjects > 0) {
+                // Exactly test the spheres passing the packet test
+                const SpherePacket& packet = packets[node->objectStartIdx];
+                int mask = intersectSpherePacket(packet, packetRay);
+                for (int lane = 0; mask != 0; lane++, mask >>= 1) {
+                    Real t, tFar;
+                    if (!(mask & 1) || !intersectSphere(packet, lane, lr, roErr, rdErr, &t, &tFar))
+                        continue;
+                    int index = node->objectStartIdx * SpherePacketWidth + lane;
+                    if (testAlpha && alphaMask && !testAlphaMask(ray, index, t)) {
+                        // Look through a hole on the near side to the far side
+                        if (tFar == Infinity || !testAlphaMask(ray, index, tFar)) continue;
+                        t = tFar;
+                    }
+                    if (!hit) return true;
+
+                    intersected = true;
+                    lr.tMax = hit->t = t;
+                    hit->hintIndex = index;
+                    bvhRay.setTMax(t);
+                    packetRay.setTMax(t);
+                }
+                if (stackSize == 0) break;
+                itrIdx = nodeStack[--stackSize];
+            } else {
+                // Test the near child first
+                if (isDirNeg[node->splitAxis]) {
+                    nodeStack[stackSize++] = itrIdx + 1;
+                    itrIdx = node->secondChildIdx;
+                } else {
+                    nodeStack[stackSize++] = node->secondChildIdx;
+                    itrIdx++;
+                }
+            }
+        } else {
+            if (stackSize == 0) break;
+            itrIdx = nodeStack[--stackSize];
+        }
+    }
+
+    return intersected;
+}
+
+bool SphereSet::intersectRay(const Ray& ray, bool testAlpha) const {
+    Vector3f roErr, rdErr;
+    Ray lr = (*worldToLocal)(ray, &roErr, &rdErr);
+    return intersectSpheres(ray, lr, roErr, rdErr, testAlpha, nullptr);
+}
+
+bool SphereSet::intersectHit(const Ray& ray, SurfaceHit* hit, bool testAlpha) const {
+    Vector3f roErr, rdErr;
+    Ray lr = (*worldToLocal)(ray, &roErr, &rdErr);
+    return intersectSpheres(ray, lr, roErr, rdErr, testAlpha, hit);
+}
+
+void SphereSet::computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                                   SurfaceInteraction* si) const {
+    int slot = hit.hintIndex;
+    const SpherePacket& packet = packets[slot / SpherePacketWidth];
+    int lane = slot % SpherePacketWidth;
+    Point3f center(packet.center[0][lane], packet.center[1][lane], packet.center[2][lane]);
+    Real radius = packet.radius[lane];
+
+    // Transform the ray as {intersectHit} did, since the origin is offset
+    // by its error bounds, and reproject the hit point to refine it
+    Vector3f roErr, rdErr;
+    Ray lr = (*worldToLocal)(ray, &roErr, &rdErr);
+    Vector3f hpt = lr.o + hit.t * lr.d - center;
+    hpt *= radius / hpt.length();
+
+    // Parameterize the full sphere as {Sphere} does
+    const Real twoPi = 2 * Pi, thetaMin = Pi, delTheta = -Pi;
+    if (hpt.x == 0 && hpt.y == 0) hpt.x = 1e-5f * radius;
+    Real phi = std::atan2(hpt.y, hpt.x);
+    if (phi < 0) phi += twoPi;
+    Real theta = std::acos(clamp(hpt.z / radius, -1, 1));
+    Real u = phi / twoPi;
+    Real v = (theta - thetaMin) / delTheta;
+
+    Real invHypot = 1 / std::sqrt(hpt.x * hpt.x + hpt.y * hpt.y);
+    Real cosPhi = hpt.x * invHypot, sinPhi = hpt.y * invHypot;
+    Vector3f dpdu(-twoPi * hpt.y, twoPi * hpt.x, 0);
+    Vector3f dpdv = delTheta * Vector3f(hpt.z * cosPhi, hpt.z * sinPhi, -radius * std::sin(theta));
+
+    Vector3f d2pduu = -twoPi * twoPi * Vector3f(hpt.x, hpt.y, 0);
+    Vector3f d2pduv = delTheta * hpt.z * twoPi * Vector3f(-sinPhi, cosPhi, 0);
+    Vector3f d2pdvv = -delTheta * delTheta * hpt;
+    Normal3f dndu, dndv;
+    solveSurfaceNormal(dpdu, dpdv, d2pduu, d2pduv, d2pdvv, &dndu, &dndv);
+
+    // Bound the error of the reprojected point and of offsetting it by the center
+    Point3f pHit = center + hpt;
+    Vector3f pfError = gamma(5) * abs(hpt) + gamma(1) * abs(Vector3f(pHit));
+    Vector3f wo = -lr.d;
+    *si = (*localToWorld)(SurfaceInteraction(pHit, wo, pfError, Point2f(u, v),
+                                             dpdu, dpdv, dndu, dndv, this));
+}
+
+Interaction SphereSet::sample(const Point2f& u, Real* pdf) const {
+    std::call_once(areaDistributionFlag, [&]() {
+        std::vector<Real> areas(packets.size() * SpherePacketWidth);
+        for (size_t slot = 0; slot < areas.size(); slot++) {
+            Real radius = packets[slot / SpherePacketWidth].radius[slot % SpherePacketWidth];
+            areas[slot] = radius * radius;
+        }
+        areaDistribution.reset(new Distribution1D(areas.data(), areas.size()));
+    });
+
+    // Pick a sphere by area, reusing the remapped sample for the point on it
+    Real uRemapped;
+    int slot = areaDistribution->sampleDiscrete(u[0], nullptr, &uRemapped);
+    const SpherePacket& packet = packets[slot / SpherePacketWidth];
+    int lane = slot % SpherePacketWidth;
+    Point3f center(packet.center[0][lane], packet.center[1][lane], packet.center[2][lane]);
+    Real radius = packet.radius[lane];
+
+    Vector3f offset = radius * uniformSampleSphere(Point2f(std::min(uRemapped, OneMinusEpsilon), u[1]));
+    Interaction it;
+    it.n = normalize((*localToWorld)(Normal3f(offset.x, offset.y, offset.z)));
+    if (reverseNormals) it.n *= -1;
+
+    offset *= radius / offset.length();
+    Point3f pObj = center + offset;
+    Vector3f pObjError = gamma(5) * abs(offset) + gamma(1) * abs(Vector3f(pObj));
+    it.p = (*localToWorld)(pObj, pObjError, &it.pfError);
+    *pdf = 1 / surfaceArea();
+
+    return it;
+}
+
+std::shared_ptr<SphereSet> createSphereSetShape(const Transform* o2w, const Transform* w2o,
+                                                bool reverseOrientation, int nSpheres,
+                                                const Point3f* centers, const Real* radii,
+                                                const std::shared_ptr<Texture<Real>>& alphaMask) {
+    return std::make_shared<SphereSet>(o2w, w2o, reverseOrientation, nSpheres, centers, radii,
+                                       alphaMask);
+}
+
+}  // namespace phyr
@@ -0,0 +1,352 @@
+#include <core/meshio.h>
+#include <core/concurrency.h>
+#include <core/geometry/interaction.h>
+#include <core/integrator/sampling.h>
+#include <core/material/texture.h>
+
+#include <modules/shapes/triangle.h>
+
+namespace phyr {
+
+// TriangleMesh definitions
+TriangleMesh::TriangleMesh(const Transform* localToWorld, const Transform* worldToLocal,
+                           bool reverseOrientation, int nTriangles,
+                           const uint32_t* vertexIndices, int nVertices,
+                           const Point3f* p, const Normal3f* n, const Point2f* uv) :
+    nTriangles(nTriangles), nVertices(nVertices),
+    vertexIndices(new uint32_t[3 * nTriangles]), p(new Point3f[nVertices]) {
+    std::copy(vertexIndices, vertexIndices + 3 * nTriangles, this->vertexIndices.get());
+
+    // Transform mesh vertices to world space
+    for (int i = 0; i < nVertices; i++) this->p[i] = (*localToWorld)(p[i]);
+    if (n) {
+        this->n.reset(new Normal3f[nVertices]);
+        for (int i = 0; i < nVertices; i++) this->n[i] = (*localToWorld)(n[i]);
+    }
+    if (uv) {
+        this->uv.reset(new Point2f[nVertices]);
+        std::copy(uv, uv + nVertices, this->uv.get());
+    }
+
+    createTriangles(localToWorld, worldToLocal, reverseOrientation);
+}
+
+TriangleMesh::TriangleMesh(const Transform* localToWorld, const Transform* worldToLocal,
+                           bool reverseOrientation, const IndexedMesh& mesh) :
+    nTriangles(mesh.nTriangles), nVertices(mesh.nVertices),
+    vertexIndices(new uint32_t[3 * nTriangles]), p(new Point3f[nVertices]) {
+    if (mesh.hasNormals()) n.reset(new Normal3f[nVertices]);
+    if (mesh.hasUVs()) uv.reset(new Point2f[nVertices]);
+
+    // Read the attribute views straight into the world space vertices
+    constexpr int chunkSize = 16384;
+    ParallelForRange(0, nVertices, chunkSize, [&](int64_t i) {
+        p[i] = (*localToWorld)(Point3f(mesh.p[0].getReal(i), mesh.p[1].getReal(i),
+                                       mesh.p[2].getReal(i)));
+        if (n) {
+            n[i] = (*localToWorld)(Normal3f(mesh.n[0].getReal(i), mesh.n[1].getReal(i),
+                                            mesh.n[2].getReal(i)));
+        }
+        if (uv) uv[i] = Point2f(mesh.uv[0].getReal(i), mesh.uv[1].getReal(i));
+    });
+
+    ParallelForRange(0, nTriangles, chunkSize, [&](int64_t i) {
+        for (int k = 0; k < 3; k++) vertexIndices[3 * i + k] = mesh.indices[k].getIndex(i);
+    });
+
+    createTriangles(localToWorld, worldToLocal, reverseOrientation);
+}
+
+void TriangleMesh::createTriangles(const Transform* localToWorld, const Transform* worldToLocal,
+                                   bool reverseOrientation) {
+    triangles.reserve(nTriangles);
+    for (int i = 0; i < nTriangles; i++)
+        triangles.emplace_back(localToWorld, worldToLocal, reverseOrientation, this, i);
+}
+
+size_t TriangleMesh::getMemory() const {
+    size_t vertexSize = sizeof(Point3f) + (n ? sizeof(Normal3f) : 0) + (uv ? sizeof(Point2f) : 0);
+    return sizeof(*this) + size_t(nVertices) * vertexSize +
+           size_t(nTriangles) * (3 * sizeof(uint32_t) + sizeof(Triangle));
+}
+
+// Triangle definitions
+Bounds3f Triangle::objectBounds() const {
+    return (*worldToLocal)(worldBounds());
+}
+
+Bounds3f Triangle::worldBounds() const {
+    const uint32_t* v = &mesh->vertexIndices[3 * triIdx];
+    return unionBounds(Bounds3f(mesh->p[v[0]], mesh->p[v[1]]), mesh->p[v[2]]);
+}
+
+bool Triangle::clipWorldBounds(const Bounds3f& clip, Bounds3f* bounds) const {
+    const uint32_t* v = &mesh->vertexIndices[3 * triIdx];
+
+    // Clip the triangle against each slab of {clip} in turn. Every
+    // plane adds at most one vertex to the clipped polygon.
+    Point3f poly[9], clipped[9];
+    poly[0] = mesh->p[v[0]]; poly[1] = mesh->p[v[1]]; poly[2] = mesh->p[v[2]];
+    int nPoly = 3;
+
+    for (int axis = 0; axis < 3; axis++) {
+        for (int side = 0; side < 2; side++) {
+            Real plane = side == 0 ? clip.pMin[axis] : clip.pMax[axis];
+            int nClipped = 0;
+            for (int i = 0; i < nPoly; i++) {
+                const Point3f& a = poly[i];
+                const Point3f& b = poly[i + 1 == nPoly ? 0 : i + 1];
+                bool aInside = side == 0 ? a[axis] >= plane : a[axis] <= plane;
+                bool bInside = side == 0 ? b[axis] >= plane : b[axis] <= plane;
+
+                if (aInside) clipped[nClipped++] = a;
+                if (aInside != bInside) {
+                    Point3f p = lerp((plane - a[axis]) / (b[axis] - a[axis]), a, b);
+                    p[axis] = plane;
+                    clipped[nClipped++] = p;
+                }
+            }
+
+            if (nClipped == 0) return false;
+            std::copy(clipped, clipped + nClipped, poly);
+            nPoly = nClipped;
+        }
+    }
+
+    Bounds3f b(poly[0]);
+    for (int i = 1; i < nPoly; i++) b = unionBounds(b, poly[i]);
+    // Interpolated points may stray outside {clip} by rounding
+    *bounds = intersect(b, clip);
+    return true;
+}
+
+void Triangle::getClipParameters(std::vector<Real>* params) const {
+    const uint32_t* v = &mesh->vertexIndices[3 * triIdx];
+    for (int i = 0; i < 3; i++)
+        params->insert(params->end(), { mesh->p[v[i]].x, mesh->p[v[i]].y, mesh->p[v[i]].z });
+}
+
+Real Triangle::surfaceArea() const {
+    const uint32_t* v = &mesh->vertexIndices[3 * triIdx];
+    const Point3f &p0 = mesh->p[v[0]], &p1 = mesh->p[v[1]], &p2 = mesh->p[v[2]];
+    return 0.5 * cross(p1 - p0, p2 - p0).length();
+}
+
+void Triangle::getUVs(Point2f uv[3]) const {
+    if (mesh->uv) {
+        const uint32_t* v = &mesh->vertexIndices[3 * triIdx];
+        uv[0] = mesh->uv[v[0]]; uv[1] = mesh->uv[v[1]]; uv[2] = mesh->uv[v[2]];
+    } else {
+        uv[0] = Point2f(0, 0); uv[1] = Point2f(1, 0); uv[2] = Point2f(1, 1);
+    }
+}
+
+bool Triangle::intersectHit(const Ray& ray, SurfaceHit* hit, bool testAlpha) const {
+    const uint32_t* v = &mesh->vertexIndices[3 * triIdx];
+    const Point3f &p0 = mesh->p[v[0]], &p1 = mesh->p[v[1]], &p2 = mesh->p[v[2]];
+
+    // Transform the vertices to a space where the ray starts at the origin
+    // and points along +z, so that the hit reduces to a 2D edge test
+    Point3f p0t = p0 - Vector3f(ray.o), p1t = p1 - Vector3f(ray.o), p2t = p2 - Vector3f(ray.o);
+
+    // Permute components so that z is the largest direction component
+    int kz = maxDimension(abs(ray.d));
+    int kx = kz + 1; if (kx == 3) kx = 0;
+    int ky = kx + 1; if (ky == 3) ky = 0;
+    Vector3f d = permute(ray.d, kx, ky, kz);
+    p0t = permute(p0t, kx, ky, kz);
+    p1t = permute(p1t, kx, ky, kz);
+    p2t = permute(p2t, kx, ky, kz);
+
+    // Shear the vertices to align the ray with +z. The z shear
+    // is deferred until the ray is known to hit the triangle.
+    Real sx = -d.x / d.z, sy = -d.y / d.z, sz = 1 / d.z;
+    p0t.x += sx * p0t.z; p0t.y += sy * p0t.z;
+    p1t.x += sx * p1t.z; p1t.y += sy * p1t.z;
+    p2t.x += sx * p2t.z; p2t.y += sy * p2t.z;
+
+    // Compute edge function coefficients
+    Real e0 = p1t.x * p2t.y - p1t.y * p2t.x;
+    Real e1 = p2t.x * p0t.y - p2t.y * p0t.x;
+    Real e2 = p0t.x * p1t.y - p0t.y * p1t.x;
+
+    // Recompute edge functions that are zero in double precision,
+    // so that rays through shared edges never miss both triangles
+    if (sizeof(Real) == sizeof(float) && (e0 == 0 || e1 == 0 || e2 == 0)) {
+        e0 = Real(double(p1t.x) * double(p2t.y) - double(p1t.y) * double(p2t.x));
+        e1 = Real(double(p2t.x) * double(p0t.y) - double(p2t.y) * double(p0t.x));
+        e2 = Real(double(p0t.x) * double(p1t.y) - double(p0t.y) * double(p1t.x));
+    }
+
+    // The ray misses if the edge functions differ in sign
+    if ((e0 < 0 || e1 < 0 || e2 < 0) && (e0 > 0 || e1 > 0 || e2 > 0)) return false;
+    Real det = e0 + e1 + e2;
+    if (det == 0) return false;
+
+    // Compute the scaled hit distance and test it against the ray range
+    p0t.z *= sz; p1t.z *= sz; p2t.z *= sz;
+    Real tScaled = e0 * p0t.z + e1 * p1t.z + e2 * p2t.z;
+    if (det < 0 && (tScaled >= 0 || tScaled < ray.tMax * det)) return false;
+    if (det > 0 && (tScaled <= 0 || tScaled > ray.tMax * det)) return false;
+
+    Real invDet = 1 / det;
+    Real t = tScaled * invDet;
+
+    // Make sure that t is conservatively greater than zero, bounding
+    // the rounding errors of the transformed vertices and edge functions
+    Real maxZt = maxComponent(abs(Vector3f(p0t.z, p1t.z, p2t.z)));
+    Real deltaZ = gamma(3) * maxZt;
+    Real maxXt = maxComponent(abs(Vector3f(p0t.x, p1t.x, p2t.x)));
+    Real maxYt = maxComponent(abs(Vector3f(p0t.y, p1t.y, p2t.y)));
+    Real deltaX = gamma(5) * (maxXt + maxZt);
+    Real deltaY = gamma(5) * (maxYt + maxZt);
+    Real deltaE = 2 * (gamma(2) * maxXt * maxYt + deltaY * maxXt + deltaX * maxYt);
+    Real maxE = maxComponent(abs(Vector3f(e0, e1, e2)));
+    Real deltaT = 3 * (gamma(3) * maxE * maxZt + deltaE * maxZt + deltaZ * maxE) * std::abs(invDet);
+    if (t <= deltaT) return false;
+
+    Real b0 = e0 * invDet, b1 = e1 * invDet, b2 = e2 * invDet;
+    if (testAlpha && mesh->alphaMask) {
+        // Cutout masks only read the point and its (u, v) coordinates
+        Point2f uv[3];
+        getUVs(uv);
+        SurfaceInteraction si;
+        si.p = b0 * p0 + b1 * p1 + b2 * p2;
+        si.uv = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
+        si.wo = -ray.d;
+        si.shape = this;
+        if (!alphaTest(*mesh->alphaMask, si, ray)) return false;
+    }
+
+    // Keep the barycentric coordinates for {computeInteraction}
+    hit->t = t;
+    hit->hint[0] = b0; hit->hint[1] = b1; hit->hint[2] = b2;
+    return true;
+}
+
+void Triangle::computeInteraction(const Ray& ray, const SurfaceHit& hit,
+                                  SurfaceInteraction* si) const {
+    const uint32_t* v = &mesh->vertexIndices[3 * triIdx];
+    const Point3f &p0 = mesh->p[v[0]], &p1 = mesh->p[v[1]], &p2 = mesh->p[v[2]];
+    Real b0 = hit.hint[0], b1 = hit.hint[1], b2 = hit.hint[2];
+
+    // Compute partial derivatives from the (u, v) parameterization
+    Point2f uv[3];
+    getUVs(uv);
+    Vector2f duv02 = uv[0] - uv[2], duv12 = uv[1] - uv[2];
+    Vector3f dp02 = p0 - p2, dp12 = p1 - p2;
+    Real determinant = duv02.x * duv12.y - duv02.y * duv12.x;
+
+    Vector3f dpdu, dpdv;
+    bool degenerateUV = std::abs(determinant) < 1e-8;
+    if (!degenerateUV) {
+        Real invDet = 1 / determinant;
+        dpdu = (duv12.y * dp02 - duv02.y * dp12) * invDet;
+        dpdv = (duv02.x * dp12 - duv12.x * dp02) * invDet;
+    }
+    // Pick any tangent frame if the parameterization is degenerate
+    if (degenerateUV || cross(dpdu, dpdv).lengthSquared() == 0)
+        coordinateSystem(normalize(cross(p2 - p0, p1 - p0)), &dpdu, &dpdv);
+
+    // Compute error bounds for the interpolated hit point
+    Real xAbsSum = std::abs(b0 * p0.x) + std::abs(b1 * p1.x) + std::abs(b2 * p2.x);
+    Real yAbsSum = std::abs(b0 * p0.y) + std::abs(b1 * p1.y) + std::abs(b2 * p2.y);
+    Real zAbsSum = std::abs(b0 * p0.z) + std::abs(b1 * p1.z) + std::abs(b2 * p2.z);
+    Vector3f pfError = gamma(7) * Vector3f(xAbsSum, yAbsSum, zAbsSum);
+
+    Point3f pHit = b0 * p0 + b1 * p1 + b2 * p2;
+    Point2f uvHit = b0 * uv[0] + b1 * uv[1] + b2 * uv[2];
+    *si = SurfaceInteraction(pHit, -ray.d, pfError, uvHit, dpdu, dpdv,
+                             Normal3f(0, 0, 0), Normal3f(0, 0, 0), this);
+
+    // The geometric normal follows the vertex winding order, not the parameterization
+    si->n = si->shadingGeom.n = Normal3f(normalize(cross(dp02, dp12)));
+    if (reverseNormals ^ transformChangesCoordSys) si->n = si->shadingGeom.n = -si->n;
+    if (!mesh->n) return;
+
+    // Shade with the interpolated vertex normals, which also
+    // orient the geometric normal in {setShadingGeomerty}
+    const Normal3f &n0 = mesh->n[v[0]], &n1 = mesh->n[v[1]], &n2 = mesh->n[v[2]];
+    Normal3f ns = b0 * n0 + b1 * n1 + b2 * n2;
+    ns = ns.lengthSquared() > 0 ? normalize(ns) : si->n;
+
+    Vector3f ss = normalize(si->dpdu);
+    Vector3f ts = cross(ss, Vector3f(ns));
+    if (ts.lengthSquared() > 0) {
+        ts = normalize(ts);
+        ss = cross(ts, Vector3f(ns));
+    } else {
+        coordinateSystem(Vector3f(ns), &ss, &ts);
+    }
+
+    // Compute the normal derivatives from the vertex normals
+    Normal3f dndu(0, 0, 0), dndv(0, 0, 0);
+    Normal3f dn02 = n0 - n2, dn12 = n1 - n2;
+    if (!degenerateUV) {
+        Real invDet = 1 / determinant;
+        dndu = (duv12.y * dn02 - duv02.y * dn12) * invDet;
+        dndv = (duv02.x * dn12 - duv12.x * dn02) * invDet;
+    }
+
+    si->setShadingGeomerty(ss, ts, dndu, dndv, true);
+}
+
+Interaction Triangle::sample(const Point2f& u, Real* pdf) const {
+    const uint32_t* v = &mesh->vertexIndices[3 * triIdx];
+    const Point3f &p0 = mesh->p[v[0]], &p1 = mesh->p[v[1]], &p2 = mesh->p[v[2]];
+    Point2f b = uniformSampleTriangle(u);
+
+    Interaction it;
+    it.p = b[0] * p0 + b[1] * p1 + (1 - b[0] - b[1]) * p2;
+    it.n = Normal3f(normalize(cross(p1 - p0, p2 - p0)));
+    if (mesh->n) {
+        Normal3f ns = b[0] * mesh->n[v[0]] + b[1] * mesh->n[v[1]] +
+                      (1 - b[0] - b[1]) * mesh->n[v[2]];
+        it.n = faceForward(it.n, ns);
+    } else if (reverseNormals ^ transformChangesCoordSys) {
+        it.n *= -1;
+    }
+
+    Vector3f pAbsSum = abs(Vector3f(b[0] * p0)) + abs(Vector3f(b[1] * p1)) +
+                       abs(Vector3f((1 - b[0] - b[1]) * p2));
+    it.pfError = gamma(6) * pAbsSum;
+    *pdf = 1 / surfaceArea();
+
+    return it;
+}
+
+// Returns the triangles of {mesh}. The triangles live in the mesh, so they
+// share its reference count instead of each getting a control block of their own.
+static std::vector<std::shared_ptr<Shape>> getTriangleShapes(
+        const std::shared_ptr<TriangleMesh>& mesh,
+        const std::shared_ptr<Texture<Real>>& alphaMask) {
+    mesh->alphaMask = alphaMask;
+    LOG_INFO_FMT("Triangle mesh: %d triangles, %d vertices, %.1f bytes per triangle",
+                 mesh->nTriangles, mesh->nVertices,
+                 double(mesh->getMemory()) / std::max(1, mesh->nTriangles));
+
+    std::vector<std::shared_ptr<Shape>> shapes;
+    shapes.reserve(mesh->nTriangles);
+    for (Triangle& triangle : mesh->triangles)
+        shapes.push_back(std::shared_ptr<Shape>(mesh, &triangle));
+    return shapes;
+}
+
+std::vector<std::shared_ptr<Shape>> createTriangleMeshShapes(
+        const Transform* o2w, const Transform* w2o, bool reverseOrientation,
+        int nTriangles, const uint32_t* vertexIndices, int nVertices,
+        const Point3f* p, const Normal3f* n, const Point2f* uv,
+        const std::shared_ptr<Texture<Real>>& alphaMask) {
+    return getTriangleShapes(std::make_shared<TriangleMesh>(
+            o2w, w2o, reverseOrientation, nTriangles, vertexIndices, nVertices, p, n, uv),
+            alphaMask);
+}
+
+std::vector<std::shared_ptr<Shape>> createTriangleMeshShapes(
+        const Transform* o2w, const Transform* w2o, bool reverseOrientation,
+        const IndexedMesh& mesh, const std::shared_ptr<Texture<Real>>& alphaMask) {
+    return getTriangleShapes(std::make_shared<TriangleMesh>(o2w, w2o, reverseOrientation, mesh),
+                             alphaMask);
+}
+
+}  // namespace phyr
@@ -0,0 +1,345 @@
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/concurrency.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+#include <modules/shapes/disk.h>
+#include <modules/shapes/triangle.h>
+
+#include "test_util.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay AccelBVH..." << std::endl;
+
+    const int nSpheres = 20000;
+    RNG rng;
+
+    // Shapes only keep pointers to their transforms
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * nSpheres);
+
+    std::vector<std::shared_ptr<Object>> objects;
+    for (int i = 0; i < nSpheres; i++) {
+        Vector3f center(nextReal(rng, -50, 50), nextReal(rng, -50, 50), nextReal(rng, -50, 50));
+        transforms.push_back(Transform::translate(center));
+        transforms.push_back(Transform::inverse(transforms.back()));
+
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, nextReal(rng, 0.05, 0.5));
+        objects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    // Build once on a single thread and once with each parallel builder
+    parallelInit(1);
+    std::shared_ptr<AccelBVH> serialBVH = createBVHAccel(objects, 4);
+    parallelCleanup();
+
+    parallelInit(4);
+    std::shared_ptr<AccelBVH> parallelBVH = createBVHAccel(objects, 4);
+    std::shared_ptr<AccelBVH> hlbvh = createBVHAccel(objects, 4, TreeSplitMethod::HLBVH);
+    parallelCleanup();
+
+    // Collapsed layouts, traversed with SIMD slab tests
+    std::shared_ptr<AccelBVH> wideBVHs[3] = {
+        createBVHAccel(objects, 4, TreeSplitMethod::SAH, BVHLayout::Wide4),
+        createBVHAccel(objects, 4, TreeSplitMethod::SAH, BVHLayout::Wide8),
+        createBVHAccel(objects, 4, TreeSplitMethod::SAH, BVHLayout::Compressed)
+    };
+
+    // Node order must not affect the results
+    parallelBVH->reorderNodes(0);
+    hlbvh->reorderNodes(256);
+
+    bool valid = serialBVH->getNodeCount() == parallelBVH->getNodeCount() &&
+                 serialBVH->worldBounds() == parallelBVH->worldBounds();
+    valid = valid && hlbvh->worldBounds() == serialBVH->worldBounds();
+    valid = valid && wideBVHs[2]->getNodeMemory() < wideBVHs[1]->getNodeMemory();
+    std::cout << "Nodes: " << serialBVH->getNodeCount() << " (serial), "
+              << parallelBVH->getNodeCount() << " (parallel), "
+              << hlbvh->getNodeCount() << " (HLBVH), "
+              << wideBVHs[0]->getWideNodeCount() << " (BVH4), "
+              << wideBVHs[1]->getWideNodeCount() << " (BVH8)" << std::endl;
+    std::cout << "Node memory: " << serialBVH->getNodeMemory() << " (binary), "
+              << wideBVHs[1]->getNodeMemory() << " (BVH8), "
+              << wideBVHs[2]->getNodeMemory() << " (compressed)" << std::endl;
+
+    // Both trees must agree with each other and with brute force intersection
+    int nHits = 0;
+    for (int i = 0; i < 500 && valid; i++) {
+        Point3f o(nextReal(rng, -60, 60), nextReal(rng, -60, 60), nextReal(rng, -60, 60));
+        Vector3f d = normalize(Vector3f(nextReal(rng, -1, 1), nextReal(rng, -1, 1),
+                                        nextReal(rng, -1, 1)));
+
+        Ray r0(o, d), r1(o, d), r2(o, d), r3(o, d);
+        SurfaceInteraction si0, si1, si2, si3;
+        bool h0 = serialBVH->intersectRay(r0, &si0);
+        bool h1 = parallelBVH->intersectRay(r1, &si1);
+        bool h2 = intersectAll(objects, r2, &si2);
+        bool h3 = hlbvh->intersectRay(r3, &si3);
+
+        valid = (h0 == h1) && (h0 == h2) && (h0 == h3) &&
+                (h0 == serialBVH->intersectRay(Ray(o, d))) &&
+                (h0 == hlbvh->intersectRay(Ray(o, d)));
+        if (valid && h0) {
+            valid = r0.tMax == r1.tMax && r0.tMax == r2.tMax && r0.tMax == r3.tMax &&
+                    si0.object == si1.object && si0.object == si2.object &&
+                    si0.object == si3.object;
+            // The interaction built once after traversal must match the
+            // one of the closest hit found by brute force
+            valid = valid && si0.p == si2.p && si0.n == si2.n && si0.uv == si2.uv &&
+                    si0.dpdu == si2.dpdu && si0.wo == si2.wo;
+            nHits++;
+        }
+
+        for (int w = 0; w < 3 && valid; w++) {
+            Ray r(o, d);
+            SurfaceInteraction si;
+            valid = wideBVHs[w]->intersectRay(r, &si) == h0 &&
+                    wideBVHs[w]->intersectRay(Ray(o, d)) == h0 &&
+                    (!h0 || (r.tMax == r0.tMax && si.object == si0.object));
+        }
+    }
+
+    std::cout << "Ray hits: " << nHits << std::endl;
+
+    // Objects whose centroids coincide cannot be split, and end up in a
+    // single leaf of more than 255 objects next to one other sphere
+    const int nCoincident = 300;
+    std::vector<Transform> clusterTransforms = { Transform::translate(Vector3f(3, 0, 0)),
+                                                 Transform::translate(Vector3f(-20, 0, 0)) };
+    clusterTransforms.push_back(Transform::inverse(clusterTransforms[0]));
+    clusterTransforms.push_back(Transform::inverse(clusterTransforms[1]));
+    std::vector<std::shared_ptr<Object>> cluster;
+    for (int i = 0; i <= nCoincident; i++) {
+        int t = i < nCoincident ? 0 : 1;
+        std::shared_ptr<Shape> shape = createSphereShape(&clusterTransforms[t], &clusterTransforms[t + 2],
+                                                         false, 0.5 + 0.001 * (i % 400));
+        cluster.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+    std::shared_ptr<AccelBVH> clusterBVHs[4] = {
+        createBVHAccel(cluster, 4),
+        createBVHAccel(cluster, 4, TreeSplitMethod::SAH, BVHLayout::Wide4),
+        createBVHAccel(cluster, 4, TreeSplitMethod::SAH, BVHLayout::Wide8),
+        createBVHAccel(cluster, 4, TreeSplitMethod::SAH, BVHLayout::Compressed)
+    };
+    for (int i = 0; i < 100 && valid; i++) {
+        Point3f o(nextReal(rng, -30, 30), nextReal(rng, -30, 30), nextReal(rng, -30, 30));
+        Point3f target = i % 2 ? Point3f(3, 0, 0) : Point3f(-20, 0, 0);
+        Vector3f d = normalize(target + Vector3f(nextReal(rng, -0.5, 0.5), nextReal(rng, -0.5, 0.5),
+                                                 nextReal(rng, -0.5, 0.5)) - o);
+        Ray r0(o, d);
+        SurfaceInteraction si0;
+        bool h0 = intersectAll(cluster, r0, &si0);
+        for (int b = 0; b < 4 && valid; b++) {
+            Ray r(o, d);
+            SurfaceInteraction si;
+            valid = clusterBVHs[b]->intersectRay(r, &si) == h0 &&
+                    clusterBVHs[b]->intersectRay(Ray(o, d)) == h0 &&
+                    (!h0 || (r.tMax == r0.tMax && si.object == si0.object));
+        }
+    }
+    std::cout << "Leaf of " << nCoincident << " coincident objects, valid: " << valid << std::endl;
+
+    // Batched traversal must match single rays, for coherent (shared origin)
+    // as well as incoherent rays, including a partial last packet
+    const int nBatch = 300;
+    std::vector<Ray> batch(nBatch);
+    for (int i = 0; i < nBatch; i++) {
+        Point3f o = i < nBatch / 2 ? Point3f(0, 0, -60)
+                                   : Point3f(nextReal(rng, -60, 60), nextReal(rng, -60, 60),
+                                             nextReal(rng, -60, 60));
+        batch[i] = Ray(o, normalize(Vector3f(nextReal(rng, -1, 1), nextReal(rng, -1, 1),
+                                             nextReal(rng, -1, 1))));
+    }
+
+    std::shared_ptr<AccelBVH> batchBVHs[4] = { serialBVH, wideBVHs[0], wideBVHs[1], wideBVHs[2] };
+    for (int b = 0; b < 4 && valid; b++) {
+        std::vector<Ray> rays(batch);
+        std::vector<SurfaceInteraction> isects(nBatch);
+        std::unique_ptr<bool[]> hits(new bool[nBatch]), occluded(new bool[nBatch]);
+        batchBVHs[b]->intersectRays(rays.data(), isects.data(), hits.get(), nBatch);
+        batchBVHs[b]->intersectRays(batch.data(), occluded.get(), nBatch);
+
+        for (int i = 0; i < nBatch && valid; i++) {
+            Ray r(batch[i]);
+            SurfaceInteraction si;
+            bool hit = serialBVH->intersectRay(r, &si);
+            valid = hits[i] == hit && occluded[i] == hit &&
+                    (!hit || (rays[i].tMax == r.tMax && isects[i].object == si.object));
+        }
+    }
+
+    // Large objects overlapping the whole scene get split spatially. The
+    // dome is dropped from nodes inside it, the floor from nodes off its plane.
+    Transform domeToWorld, floorToWorld = Transform::translate(Vector3f(0, -55, 0)) *
+                                          Transform::rotateX(90);
+    Transform floorToLocal = Transform::inverse(floorToWorld);
+    std::vector<std::shared_ptr<Object>> enclosedObjects(objects);
+    enclosedObjects.push_back(std::make_shared<GeometricObject>(
+        createSphereShape(&domeToWorld, &domeToWorld, true, 100), nullptr, nullptr));
+    enclosedObjects.push_back(std::make_shared<GeometricObject>(
+        createDiskShape(&floorToWorld, &floorToLocal, 0, 80), nullptr, nullptr));
+
+    std::shared_ptr<AccelBVH> sahBVH = createBVHAccel(enclosedObjects, 4);
+    std::shared_ptr<AccelBVH> sbvhs[2] = {
+        createBVHAccel(enclosedObjects, 4, TreeSplitMethod::SBVH),
+        createBVHAccel(enclosedObjects, 4, TreeSplitMethod::SBVH, BVHLayout::Wide8)
+    };
+
+    int nReferences = sbvhs[0]->getReferenceCount(), nEnclosed = enclosedObjects.size();
+    valid = valid && nReferences > nEnclosed &&
+            nReferences <= nEnclosed * AccelBVH::SBVH_REFERENCE_BUDGET &&
+            sbvhs[0]->getSAHCost() < sahBVH->getSAHCost() &&
+            sbvhs[0]->worldBounds() == sahBVH->worldBounds();
+    std::cout << "SBVH references: " << nReferences << ", SAH cost: "
+              << sahBVH->getSAHCost() << " (SAH), " << sbvhs[0]->getSAHCost() << " (SBVH)"
+              << std::endl;
+
+    for (int i = 0; i < 200 && valid; i++) {
+        Point3f o(nextReal(rng, -60, 60), nextReal(rng, -60, 60), nextReal(rng, -60, 60));
+        Vector3f d = normalize(Vector3f(nextReal(rng, -1, 1), nextReal(rng, -1, 1),
+                                        nextReal(rng, -1, 1)));
+
+        Ray r0(o, d);
+        SurfaceInteraction si0;
+        bool h0 = intersectAll(enclosedObjects, r0, &si0);
+        for (int s = 0; s < 2 && valid; s++) {
+            Ray r(o, d);
+            SurfaceInteraction si;
+            valid = sbvhs[s]->intersectRay(r, &si) == h0 &&
+                    sbvhs[s]->intersectRay(Ray(o, d)) == h0 &&
+                    (!h0 || (r.tMax == r0.tMax && si.object == si0.object));
+        }
+    }
+
+    // Leaves mixing spheres, disks, triangles and other objects, which are
+    // tested through Object, e.g. instances, must match brute force
+    const int nMixed = 2000;
+    std::vector<Point3f> vertices;
+    std::vector<uint32_t> indices;
+    for (int i = 0; i < nMixed; i++) {
+        Vector3f center(nextReal(rng, -20, 20), nextReal(rng, -20, 20), nextReal(rng, -20, 20));
+        for (int v = 0; v < 3; v++) {
+            vertices.push_back(Point3f(center + Vector3f(nextReal(rng, -1, 1), nextReal(rng, -1, 1),
+                                                         nextReal(rng, -1, 1))));
+            indices.push_back(3 * i + v);
+        }
+    }
+    Transform identity;
+    std::vector<std::shared_ptr<Shape>> triangles = createTriangleMeshShapes(
+            &identity, &identity, false, nMixed, indices.data(), vertices.size(), vertices.data());
+
+    std::vector<Transform> mixedTransforms;
+    mixedTransforms.reserve(2 * nMixed);
+    std::vector<std::shared_ptr<Object>> mixedObjects;
+    for (int i = 0; i < nMixed; i++) {
+        Vector3f center(nextReal(rng, -20, 20), nextReal(rng, -20, 20), nextReal(rng, -20, 20));
+        mixedTransforms.push_back(Transform::translate(center) * Transform::rotateX(nextReal(rng, 0, 180)));
+        mixedTransforms.push_back(Transform::inverse(mixedTransforms.back()));
+        const Transform* o2w = &mixedTransforms[2 * i];
+        const Transform* w2o = &mixedTransforms[2 * i + 1];
+
+        std::shared_ptr<Shape> shape = i % 3 == 0 ? createSphereShape(o2w, w2o, false, nextReal(rng, 0.2, 1))
+                                     : i % 3 == 1 ? triangles[i]
+                                     : std::shared_ptr<Shape>(createDiskShape(o2w, w2o, 0, nextReal(rng, 0.2, 1)));
+        std::shared_ptr<Object> object = std::make_shared<GeometricObject>(shape, nullptr, nullptr);
+        if (i % 7 == 0) object = std::make_shared<InstancedObject>(object, Transform::translate(Vector3f(0, 0.5, 0)));
+        mixedObjects.push_back(object);
+    }
+
+    std::shared_ptr<AccelBVH> mixedBVHs[2] = {
+        createBVHAccel(mixedObjects, 8),
+        createBVHAccel(mixedObjects, 8, TreeSplitMethod::SAH, BVHLayout::Wide8)
+    };
+    int nMixedHits = 0;
+    for (int i = 0; i < 500 && valid; i++) {
+        Point3f o(nextReal(rng, -25, 25), nextReal(rng, -25, 25), nextReal(rng, -25, 25));
+        Vector3f d = normalize(Vector3f(nextReal(rng, -1, 1), nextReal(rng, -1, 1),
+                                        nextReal(rng, -1, 1)));
+
+        Ray r0(o, d);
+        SurfaceInteraction si0;
+        bool h0 = intersectAll(mixedObjects, r0, &si0);
+        nMixedHits += h0;
+        for (int b = 0; b < 2 && valid; b++) {
+            Ray r(o, d);
+            SurfaceInteraction si;
+            valid = mixedBVHs[b]->intersectRay(r, &si) == h0 &&
+                    mixedBVHs[b]->intersectRay(Ray(o, d)) == h0 &&
+                    (!h0 || (r.tMax == r0.tMax && si.object == si0.object && si.p == si0.p));
+        }
+    }
+    std::cout << "Mixed object hits: " << nMixedHits << std::endl;
+
+    // Lazy builds only build the subtrees rays reach. A narrow bundle of rays
+    // builds a few of them, then rays from all threads race for the rest.
+    std::shared_ptr<AccelBVH> lazyBVH = createLazyBVHAccel(objects, 4);
+    int nSubtrees = lazyBVH->getLazySubtreeCount();
+    valid = valid && nSubtrees > 1 && lazyBVH->getBuiltSubtreeCount() == 0 &&
+            lazyBVH->worldBounds() == serialBVH->worldBounds();
+
+    for (int i = 0; i < 50 && valid; i++) {
+        Point3f o(-45, -45, -45);
+        Vector3f d = normalize(Vector3f(1, 1 + nextReal(rng, -0.01, 0.01), 1 + nextReal(rng, -0.01, 0.01)));
+        Ray r0(o, d, 10), r1(o, d, 10);
+        SurfaceInteraction si0, si1;
+        bool h0 = serialBVH->intersectRay(r0, &si0);
+        valid = lazyBVH->intersectRay(r1, &si1) == h0 && (!h0 || r0.tMax == r1.tMax);
+    }
+    int nBundleBuilt = lazyBVH->getBuiltSubtreeCount();
+    valid = valid && nBundleBuilt > 0 && nBundleBuilt < nSubtrees;
+
+    const int nLazyRays = 4000;
+    std::vector<Ray> lazyRays(nLazyRays);
+    for (Ray& r : lazyRays) {
+        r = Ray(Point3f(nextReal(rng, -60, 60), nextReal(rng, -60, 60), nextReal(rng, -60, 60)),
+                normalize(Vector3f(nextReal(rng, -1, 1), nextReal(rng, -1, 1), nextReal(rng, -1, 1))));
+    }
+    std::unique_ptr<bool[]> lazyValid(new bool[nLazyRays]);
+    parallelInit(4);
+    ParallelFor([&](int64_t i) {
+        Ray r0(lazyRays[i]), r1(lazyRays[i]);
+        SurfaceInteraction si0, si1;
+        bool h0 = serialBVH->intersectRay(r0, &si0);
+        bool h1 = i % 2 ? lazyBVH->intersectRay(r1, &si1) : lazyBVH->intersectRay(r1);
+        lazyValid[i] = h0 == h1 && (!h0 || i % 2 == 0 || (r0.tMax == r1.tMax && si0.object == si1.object));
+    }, nLazyRays, 16);
+    parallelCleanup();
+    for (int i = 0; i < nLazyRays; i++) valid &= lazyValid[i];
+
+    // Packets reaching lazy subtrees, and a rebuild on refit
+    std::shared_ptr<AccelBVH> lazyBVHs[2] = { createLazyBVHAccel(objects, 4), lazyBVH };
+    lazyBVHs[1]->refit();
+    for (int b = 0; b < 2 && valid; b++) {
+        std::vector<Ray> rays(batch);
+        std::vector<SurfaceInteraction> isects(nBatch);
+        std::unique_ptr<bool[]> hits(new bool[nBatch]), occluded(new bool[nBatch]);
+        lazyBVHs[b]->intersectRays(rays.data(), isects.data(), hits.get(), nBatch);
+        lazyBVHs[b]->intersectRays(batch.data(), occluded.get(), nBatch);
+
+        for (int i = 0; i < nBatch && valid; i++) {
+            Ray r(batch[i]);
+            SurfaceInteraction si;
+            bool hit = serialBVH->intersectRay(r, &si);
+            valid = hits[i] == hit && occluded[i] == hit &&
+                    (!hit || (rays[i].tMax == r.tMax && isects[i].object == si.object));
+        }
+    }
+    std::cout << "Lazy subtrees: " << nSubtrees << ", " << nBundleBuilt << " built by a ray bundle, "
+              << lazyBVHs[0]->getBuiltSubtreeCount() << " by packets, valid: " << valid << std::endl;
+
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,147 @@
+#include <iostream>
+#include <cstddef>
+#include <cstdio>
+#include <fstream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+#include <modules/shapes/triangle.h>
+
+#include "test_util.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay BVH cache..." << std::endl;
+
+    const int nSpheres = 5000;
+    RNG rng;
+
+    std::vector<Transform> transforms(2 * nSpheres + 2);
+    std::vector<std::shared_ptr<Object>> objects;
+    for (int i = 0; i <= nSpheres; i++) {
+        transforms[2 * i] = Transform::translate(nextVector(rng, 50));
+        transforms[2 * i + 1] = Transform::inverse(transforms[2 * i]);
+
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, nextReal(rng, 0.1, 1));
+        objects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    // The last sphere is only added to the scene further below
+    std::shared_ptr<Object> extraObject = objects.back();
+    objects.pop_back();
+
+    const BVHLayout layouts[4] = { BVHLayout::Binary, BVHLayout::Wide4,
+                                   BVHLayout::Wide8, BVHLayout::Compressed };
+    const char* cachePaths[4] = { "test_bvhcache_binary.bvh", "test_bvhcache_wide4.bvh",
+                                  "test_bvhcache_wide8.bvh", "test_bvhcache_compressed.bvh" };
+
+    bool valid = true;
+    for (int l = 0; l < 4 && valid; l++) {
+        std::remove(cachePaths[l]);
+
+        // The first run builds and writes the cache, the second one maps it
+        std::shared_ptr<AccelBVH> built = createCachedBVHAccel(objects, cachePaths[l], 4,
+                                                               TreeSplitMethod::SAH, layouts[l]);
+        std::shared_ptr<AccelBVH> loaded = createCachedBVHAccel(objects, cachePaths[l], 4,
+                                                                TreeSplitMethod::SAH, layouts[l]);
+        valid = !built->isLoadedFromCache() && loaded->isLoadedFromCache() &&
+                loaded->getNodeMemory() == built->getNodeMemory() &&
+                loaded->getSAHCost() == built->getSAHCost() &&
+                loaded->worldBounds() == built->worldBounds() &&
+                checkBVH(*loaded, objects, rng);
+
+        // Mapped nodes are copied on write, so refitting must leave the file intact
+        valid = valid && !loaded->refit() && checkBVH(*loaded, objects, rng);
+        valid = valid && createCachedBVHAccel(objects, cachePaths[l], 4, TreeSplitMethod::SAH,
+                                              layouts[l])->isLoadedFromCache();
+
+        // A different layout or object set must not use the cache
+        BVHLayout otherLayout = layouts[(l + 1) % 4];
+        valid = valid && !createCachedBVHAccel(objects, cachePaths[l], 4, TreeSplitMethod::SAH,
+                                               otherLayout)->isLoadedFromCache();
+
+        std::vector<std::shared_ptr<Object>> changedObjects(objects);
+        changedObjects.push_back(extraObject);
+        std::shared_ptr<AccelBVH> rebuilt = createCachedBVHAccel(changedObjects, cachePaths[l], 4,
+                                                                 TreeSplitMethod::SAH, layouts[l]);
+        valid = valid && !rebuilt->isLoadedFromCache() && checkBVH(*rebuilt, changedObjects, rng);
+
+        std::cout << "Layout " << l << ": " << loaded->getNodeMemory() << " node bytes, "
+                  << "valid: " << valid << std::endl;
+    }
+
+    // Truncated files are detected and rebuilt
+    if (valid) {
+        std::ofstream stream(cachePaths[0], std::ios::binary | std::ios::trunc);
+        stream << "PHYRBVH";
+        stream.close();
+        std::shared_ptr<AccelBVH> bvh = createCachedBVHAccel(objects, cachePaths[0], 4);
+        valid = !bvh->isLoadedFromCache() && checkBVH(*bvh, objects, rng);
+    }
+
+    // Files whose nodes index past the nodes or objects are rejected,
+    // although their header matches. The last node is damaged here.
+    if (valid) {
+        createCachedBVHAccel(objects, cachePaths[0], 4);
+        std::fstream stream(cachePaths[0], std::ios::binary | std::ios::in | std::ios::out);
+        stream.seekp(-std::streamoff(sizeof(LinearBVHNode) - offsetof(LinearBVHNode, objectStartIdx)),
+                     std::ios::end);
+        int32_t badIdx = 0x7fffffff;
+        stream.write(reinterpret_cast<const char*>(&badIdx), sizeof(badIdx));
+        stream.close();
+        std::shared_ptr<AccelBVH> bvh = createCachedBVHAccel(objects, cachePaths[0], 4);
+        valid = !bvh->isLoadedFromCache() && checkBVH(*bvh, objects, rng);
+        std::cout << "Damaged node indices, valid: " << valid << std::endl;
+    }
+
+    // Spatial splits clip the triangles of these squares differently once
+    // their diagonals are flipped, although the triangle bounds stay the same
+    if (valid) {
+        const int nSquares = 200;
+        std::vector<Point3f> p;
+        std::vector<uint32_t> indices, flippedIndices;
+        for (int i = 0; i < nSquares; i++) {
+            Point3f o = Point3f(nextVector(rng, 40));
+            Real size = nextReal(rng, 1, 20);
+            uint32_t v = p.size();
+            p.insert(p.end(), { o, o + Vector3f(size, 0, 0), o + Vector3f(size, size, 0),
+                                o + Vector3f(0, size, 0) });
+            indices.insert(indices.end(), { v, v + 1, v + 2, v, v + 2, v + 3 });
+            flippedIndices.insert(flippedIndices.end(), { v, v + 1, v + 3, v + 1, v + 2, v + 3 });
+        }
+
+        Transform identity;
+        std::vector<std::shared_ptr<Object>> squares, flippedSquares;
+        for (const auto& shape : createTriangleMeshShapes(&identity, &identity, false, 2 * nSquares,
+                                                          indices.data(), p.size(), p.data()))
+            squares.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+        for (const auto& shape : createTriangleMeshShapes(&identity, &identity, false, 2 * nSquares,
+                                                          flippedIndices.data(), p.size(), p.data()))
+            flippedSquares.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+
+        std::remove(cachePaths[0]);
+        createCachedBVHAccel(squares, cachePaths[0], 4, TreeSplitMethod::SBVH);
+        valid = createCachedBVHAccel(squares, cachePaths[0], 4,
+                                     TreeSplitMethod::SBVH)->isLoadedFromCache();
+        std::shared_ptr<AccelBVH> flipped = createCachedBVHAccel(flippedSquares, cachePaths[0], 4,
+                                                                 TreeSplitMethod::SBVH);
+        valid = valid && !flipped->isLoadedFromCache() && checkBVH(*flipped, flippedSquares, rng);
+        std::cout << "SBVH cache of flipped triangles, valid: " << valid << std::endl;
+    }
+
+    for (const char* path : cachePaths) std::remove(path);
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,183 @@
+#include <cmath>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/film.h>
+#include <core/concurrency.h>
+
+#include <modules/filters/mitchell.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+static std::unique_ptr<Film> createFilm(const Point2i& resolution,
+                                        SplatMode splatMode = SplatMode::ThreadBuffers) {
+    std::unique_ptr<Filter> filter(new MitchellFilter(Vector2f(2, 2), Real(1) / 3, Real(1) / 3));
+    return std::unique_ptr<Film>(new Film(resolution, Bounds2f(Point2f(0, 0), Point2f(1, 1)),
+                                          std::move(filter), 35., "test_film", 1, splatMode));
+}
+
+static bool nearlyEqual(Real a, Real b) {
+    return std::abs(a - b) <= 1e-9 * std::max(Real(1), std::max(std::abs(a), std::abs(b)));
+}
+
+/**
+ * Checks that the pixel sums of {film} match those of {reference}
+ */
+static bool comparePixelSums(const Film& film, const Film& reference) {
+    for (Point2i p : film.croppedImageBounds) {
+        Real xyz[3], refXYZ[3], weight, refWeight;
+        film.getPixelSums(p, xyz, &weight);
+        reference.getPixelSums(p, refXYZ, &refWeight);
+        if (!nearlyEqual(xyz[0], refXYZ[0]) || !nearlyEqual(xyz[1], refXYZ[1]) ||
+            !nearlyEqual(xyz[2], refXYZ[2]) || !nearlyEqual(weight, refWeight))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Returns tile {tileIdx} of {film}, of {tileSize} sample pixels, filled
+ * with random samples. Neighbouring tiles overlap by the filter radius.
+ */
+static std::unique_ptr<FilmTile> createTile(Film& film, int tileIdx, int tileSize) {
+    Bounds2i sampleBounds = film.getSampleBounds();
+    int nTilesX = (sampleBounds.diagonal().x + tileSize - 1) / tileSize;
+    int x0 = sampleBounds.pMin.x + (tileIdx % nTilesX) * tileSize;
+    int y0 = sampleBounds.pMin.y + (tileIdx / nTilesX) * tileSize;
+    Bounds2i tileBounds(Point2i(x0, y0), Point2i(std::min(x0 + tileSize, sampleBounds.pMax.x),
+                                                 std::min(y0 + tileSize, sampleBounds.pMax.y)));
+
+    Real rgb[3] = { 0.8, 0.4, 0.2 };
+    Spectrum L = Spectrum::getFromRGB(rgb, SpectrumType::Reflectance);
+    RNG rng(tileIdx);
+    std::unique_ptr<FilmTile> tile = film.getFilmTile(tileBounds);
+    for (Point2i pixel : tileBounds) {
+        for (int s = 0; s < 4; s++) {
+            Point2f pFilm(pixel.x + rng.uniformReal(), pixel.y + rng.uniformReal());
+            tile->addSample(pFilm, L * rng.uniformReal(), 1);
+        }
+    }
+    return tile;
+}
+
+/**
+ * Checks that the splat sums of {film} match those of {reference}
+ */
+static bool compareSplats(const Film& film, const Film& reference) {
+    for (Point2i p : film.croppedImageBounds) {
+        Real xyz[3], refXYZ[3];
+        film.getSplatXYZ(p, xyz);
+        reference.getSplatXYZ(p, refXYZ);
+        if (!nearlyEqual(xyz[0], refXYZ[0]) || !nearlyEqual(xyz[1], refXYZ[1]) ||
+            !nearlyEqual(xyz[2], refXYZ[2]))
+            return false;
+    }
+    return true;
+}
+
+/**
+ * Adds {nSplats} random splats to {film} from all threads, the same
+ * splats for the same {seed}
+ */
+static void addSplats(Film& film, int64_t nSplats, int seed) {
+    Real rgb[3] = { 0.8, 0.4, 0.2 };
+    Spectrum L = Spectrum::getFromRGB(rgb, SpectrumType::Illuminant);
+    Vector2i extent = film.croppedImageBounds.diagonal();
+
+    constexpr int64_t chunkSize = 256;
+    ParallelFor([&](int64_t chunk) {
+        RNG rng(seed * 1000003 + chunk);
+        int64_t end = std::min(nSplats, (chunk + 1) * chunkSize);
+        for (int64_t i = chunk * chunkSize; i < end; i++) {
+            Point2f p(extent.x * rng.uniformReal(), extent.y * rng.uniformReal());
+            film.addSplat(p, L * rng.uniformReal());
+        }
+    }, (nSplats + chunkSize - 1) / chunkSize);
+}
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay Film..." << std::endl;
+    Spectrum::init();
+    bool valid = true;
+
+    // Tiles merged from several threads sum to the same pixels as tiles
+    // merged one by one. Rows outnumber the merge stripes, so stripes
+    // are shared by rows far apart, too.
+    const Point2i resolution(96, 150);
+    const int tileSize = 8;
+    Bounds2i sampleBounds = createFilm(resolution)->getSampleBounds();
+    Vector2i sampleExtent = sampleBounds.diagonal();
+    int nTiles = ((sampleExtent.x + tileSize - 1) / tileSize) *
+                 ((sampleExtent.y + tileSize - 1) / tileSize);
+
+    std::unique_ptr<Film> serialFilm = createFilm(resolution);
+    uint64_t nTileRows = 0;
+    for (int t = 0; t < nTiles; t++) {
+        std::unique_ptr<FilmTile> tile = createTile(*serialFilm, t, tileSize);
+        Bounds2i tilePixels = tile->getPixelBounds();
+        nTileRows += tilePixels.pMax.y - tilePixels.pMin.y;
+        serialFilm->mergeFilmTile(std::move(tile));
+    }
+    bool serialValid = serialFilm->getMergeLockCount() == nTileRows &&
+                       serialFilm->getContendedMergeLockCount() == 0;
+    std::cout << "Serial merge of " << nTiles << " tiles, " << nTileRows
+              << " rows, valid: " << serialValid << std::endl;
+    valid &= serialValid;
+
+    parallelInit(4);
+    std::unique_ptr<Film> parallelFilm = createFilm(resolution);
+    ParallelFor([&](int64_t t) {
+        parallelFilm->mergeFilmTile(createTile(*parallelFilm, t, tileSize));
+    }, nTiles);
+    parallelCleanup();
+
+    bool parallelValid = comparePixelSums(*parallelFilm, *serialFilm) &&
+                         parallelFilm->getMergeLockCount() == nTileRows &&
+                         parallelFilm->getContendedMergeLockCount() <= nTileRows;
+    std::cout << "Parallel merge, " << parallelFilm->getContendedMergeLockCount()
+              << " contended row locks, valid: " << parallelValid << std::endl;
+    valid &= parallelValid;
+
+    // Splats sum the same in thread buffers as atomically. The buffered film
+    // is created for two threads, so that the other two splat atomically.
+    const int64_t nSplats = 200000;
+    parallelInit(2);
+    std::unique_ptr<Film> bufferedFilm = createFilm(resolution, SplatMode::ThreadBuffers);
+    parallelCleanup();
+    std::unique_ptr<Film> atomicFilm = createFilm(resolution, SplatMode::Atomic);
+
+    parallelInit(4);
+    addSplats(*bufferedFilm, nSplats, 1);
+    addSplats(*atomicFilm, nSplats, 1);
+    bool splatValid = compareSplats(*bufferedFilm, *atomicFilm) &&
+                      bufferedFilm->getSplatBufferMemory() > 0 &&
+                      atomicFilm->getSplatBufferMemory() == 0;
+
+    // Setting the image drops all splats, including the buffered ones
+    std::vector<Spectrum> image(bufferedFilm->croppedImageBounds.area(), Spectrum(0));
+    bufferedFilm->setImage(image.data());
+    atomicFilm->setImage(image.data());
+    splatValid &= bufferedFilm->getSplatBufferMemory() == 0;
+    for (Point2i p : bufferedFilm->croppedImageBounds) {
+        Real xyz[3];
+        bufferedFilm->getSplatXYZ(p, xyz);
+        splatValid &= xyz[0] == 0 && xyz[1] == 0 && xyz[2] == 0;
+    }
+
+    addSplats(*bufferedFilm, nSplats / 4, 2);
+    addSplats(*atomicFilm, nSplats / 4, 2);
+    parallelCleanup();
+    splatValid &= compareSplats(*bufferedFilm, *atomicFilm);
+    std::cout << "Buffered and atomic splats, valid: " << splatValid << std::endl;
+    valid &= splatValid;
+
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
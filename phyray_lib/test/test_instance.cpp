@@ -0,0 +1,148 @@
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+
+#include "test_util.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+/**
+ * Checks single and batched rays through {tlas} against brute force
+ * intersection of {flattened}, counting the hits in {nHits} if set
+ */
+static bool checkInstances(const AccelBVH& tlas, const std::vector<std::shared_ptr<Object>>& flattened,
+                           const std::vector<Ray>& rays, int* nHits) {
+    int nRays = rays.size();
+    std::vector<Ray> batch(rays);
+    std::vector<SurfaceInteraction> isects(nRays);
+    std::unique_ptr<bool[]> hits(new bool[nRays]);
+    tlas.intersectRays(batch.data(), isects.data(), hits.get(), nRays);
+
+    for (int i = 0; i < nRays; i++) {
+        Ray r0(rays[i]), r1(rays[i]);
+        SurfaceInteraction si0, si1;
+        bool h0 = intersectAll(flattened, r0, &si0);
+        bool h1 = tlas.intersectRay(r1, &si1);
+
+        if (h0 != h1 || h0 != hits[i] || h0 != tlas.intersectRay(rays[i])) return false;
+        if (!h0) continue;
+        if (r0.tMax != r1.tMax || r0.tMax != batch[i].tMax ||
+            si0.object != si1.object || si0.object != isects[i].object ||
+            si0.p != si1.p || si0.p != isects[i].p || si0.n != si1.n)
+            return false;
+        if (nHits) (*nHits)++;
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay instanced BVH..." << std::endl;
+
+    const int nSpheres = 200, nInstances = 32;
+    RNG rng;
+
+    // Shapes only keep pointers to their transforms
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * nSpheres);
+
+    std::vector<std::shared_ptr<Object>> spheres;
+    for (int i = 0; i < nSpheres; i++) {
+        Vector3f center(nextReal(rng, -5, 5), nextReal(rng, -5, 5), nextReal(rng, -5, 5));
+        transforms.push_back(Transform::translate(center));
+        transforms.push_back(Transform::inverse(transforms.back()));
+
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, nextReal(rng, 0.1, 0.5));
+        spheres.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    // All instances share a single bottom level BVH
+    std::shared_ptr<AccelBVH> blas = createBVHAccel(spheres, 4);
+
+    std::vector<std::shared_ptr<InstancedObject>> instances;
+    std::vector<std::shared_ptr<Object>> flattened;
+    for (int i = 0; i < nInstances; i++) {
+        Vector3f offset(nextReal(rng, -40, 40), nextReal(rng, -40, 40), nextReal(rng, -40, 40));
+        Vector3f axis = normalize(Vector3f(nextReal(rng, -1, 1), nextReal(rng, -1, 1),
+                                           nextReal(rng, -1, 1)));
+        Transform objectToWorld = Transform::translate(offset) *
+                                  Transform::rotate(axis, nextReal(rng, 0, 360)) *
+                                  Transform::scale(2, 2, 2);
+        instances.push_back(std::make_shared<InstancedObject>(blas, objectToWorld));
+
+        // Reference scene instancing every sphere on its own
+        for (const auto& sphere : spheres)
+            flattened.push_back(std::make_shared<InstancedObject>(sphere, objectToWorld));
+    }
+
+    std::shared_ptr<AccelBVH> tlas[2] = {
+        createInstanceBVHAccel(instances),
+        createInstanceBVHAccel(instances, 1, BVHLayout::Wide4)
+    };
+
+    const int nRays = 300;
+    std::vector<Ray> rays(nRays);
+    for (int i = 0; i < nRays; i++) {
+        Point3f o(nextReal(rng, -60, 60), nextReal(rng, -60, 60), nextReal(rng, -60, 60));
+        // Aim at instances to get a good share of hits
+        Vector3f target = Vector3f(instances[i % nInstances]->worldBounds().pMin);
+        rays[i] = Ray(o, normalize(target - Vector3f(o) +
+                                   Vector3f(nextReal(rng, 0, 20), nextReal(rng, 0, 20),
+                                            nextReal(rng, 0, 20))));
+    }
+
+    bool valid = true;
+    int nHits = 0;
+    for (int t = 0; t < 2; t++) valid &= checkInstances(*tlas[t], flattened, rays, t == 0 ? &nHits : nullptr);
+
+    std::cout << "Ray hits: " << nHits << std::endl;
+
+    // Nested instances each apply their own transform: a unit sphere in a
+    // BVH, instanced at (5, 0, 0), in a BVH instanced again at (0, 5, 0)
+    Transform identity;
+    std::shared_ptr<Object> unitSphere = std::make_shared<GeometricObject>(
+        createSphereShape(&identity, &identity, false, 1), nullptr, nullptr);
+    std::shared_ptr<Object> inner = std::make_shared<InstancedObject>(
+        createBVHAccel({ unitSphere }, 1), Transform::translate(Vector3f(5, 0, 0)));
+    std::shared_ptr<Object> outer = std::make_shared<InstancedObject>(
+        createBVHAccel({ inner }, 1), Transform::translate(Vector3f(0, 5, 0)));
+    std::shared_ptr<AccelBVH> nested = createBVHAccel({ outer }, 1);
+
+    Ray nestedRay(Point3f(5, 5, -10), Vector3f(0, 0, 1));
+    SurfaceInteraction nestedSi;
+    bool nestedValid = nested->intersectRay(nestedRay, &nestedSi) &&
+                       distance(nestedSi.p, Point3f(5, 5, -1)) < 1e-4 &&
+                       std::abs(nestedRay.tMax - 9) < 1e-4 && nestedSi.n.z < 0;
+    std::cout << "Nested instance hit at " << nestedSi.p << ", valid: " << nestedValid << std::endl;
+    valid &= nestedValid;
+
+    // Instances pick up the new bounds of a refitted bottom level BVH when
+    // the top level BVH is refitted. The spheres move out of the old bounds.
+    for (int i = 0; i < nSpheres; i++) {
+        transforms[2 * i] = Transform::translate(Vector3f(8, 0, 0)) * transforms[2 * i];
+        transforms[2 * i + 1] = Transform::inverse(transforms[2 * i]);
+    }
+    blas->refit(Infinity);
+    int nRefitHits = 0;
+    bool refitValid = true;
+    for (int t = 0; t < 2; t++) {
+        tlas[t]->refit(Infinity);
+        refitValid &= checkInstances(*tlas[t], flattened, rays, t == 0 ? &nRefitHits : nullptr);
+    }
+    std::cout << "Ray hits after refit: " << nRefitHits << ", valid: " << refitValid << std::endl;
+    valid &= refitValid;
+
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
@@ -2,10 +2,12 @@
 #include <iostream>
 
 #include <core/phyr.h>
+#include <core/rng.h>
 #include <core/geometry/transform.h>
 #include <core/geometry/interaction.h>
 
 #include <modules/shapes/sphere.h>
+#include <modules/shapes/disk.h>
 
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunused-parameter"
@@ -40,7 +42,43 @@ int main(int argc, const char* argv[]) {
         std::cout << "Ray extension: " << ray(t0) << std::endl;
     }
 
-    return isec ? 0 : 1;
+    // Rays transformed by scales and translations skip the full matrix
+    // products, but must get the same results and error bounds
+    Transform st = Transform::translate(Vector3f(3, -7, 0.1)) * Transform::scale(0.3, 0.3, 0.3);
+    Transform rotated = st * Transform::rotateZ(30);
+    bool detected = st.isScaleTranslation() && Transform::inverse(st).isScaleTranslation() &&
+                    !rotated.isScaleTranslation() && !Transform::scale(1, 2, 1).isScaleTranslation();
+    std::cout << "Scale and translation detected: " << detected << std::endl;
+
+    Transform stInv = Transform::inverse(st), rotatedInv = Transform::inverse(rotated);
+    // Spheres and full disks look the same when rotated around z, but take the full transform
+    Sphere spST(&st, &stInv, 1.5), spRotated(&rotated, &rotatedInv, 1.5);
+    Disk diskST(&st, &stInv, 0.5, 2, 0.5, 360, false), diskRotated(&rotated, &rotatedInv, 0.5, 2, 0.5, 360, false);
+
+    RNG rng;
+    bool matched = detected;
+    for (int i = 0; i < 1000 && matched; i++) {
+        Point3f o(20 * rng.uniformReal() - 10, 20 * rng.uniformReal() - 10, 20 * rng.uniformReal() - 10);
+        Point3f target = st(Point3f(4 * rng.uniformReal() - 2, 4 * rng.uniformReal() - 2, rng.uniformReal() - 0.5));
+        Ray r(o, target - o);
+
+        Vector3f oErr0, dErr0, oErr1, dErr1;
+        Point3f o0 = stInv(r.o, &oErr0);
+        Vector3f d0 = stInv(r.d, &dErr0);
+        o0 += d0 * (dot(abs(d0), oErr0) / d0.lengthSquared());
+        Ray r1 = stInv(r, &oErr1, &dErr1);
+        matched = o0 == r1.o && d0 == r1.d && oErr0 == oErr1 && dErr0 == dErr1;
+
+        Real t0 = 0, t1 = 0;
+        SurfaceInteraction si0, si1;
+        bool h0 = spST.intersectRay(r, &t0, &si0), h1 = spRotated.intersectRay(r, &t1, &si1);
+        matched &= h0 == h1 && std::abs(t0 - t1) < 1e-9;
+        h0 = diskST.intersectRay(r, &t0, &si0); h1 = diskRotated.intersectRay(r, &t1, &si1);
+        matched &= h0 == h1 && std::abs(t0 - t1) < 1e-9;
+    }
+    std::cout << "Scale and translation rays match: " << matched << std::endl;
+
+    return isec && matched ? 0 : 1;
 }
 
 #pragma GCC diagnostic pop
@@ -0,0 +1,235 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/meshio.h>
+#include <core/concurrency.h>
+
+#include <modules/shapes/triangle.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+// A unit square made of a quad and two triangles, which
+// triangulates to the vertex indices {expectedIndices}
+static const float vertices[5][5] = {
+    { 0, 0, 0, 0, 0 }, { 1, 0, 0, 1, 0 }, { 1, 1, 0, 1, 1 }, { 0, 1, 0, 0, 1 }, { 0.5, 0.5, 0, 0.5, 0.5 }
+};
+static const int faces[3][5] = { { 4, 0, 1, 2, 3 }, { 3, 0, 1, 4 }, { 3, 1, 2, 4 } };
+static const uint32_t expectedIndices[] = { 0, 1, 2, 0, 2, 3, 0, 1, 4, 1, 2, 4 };
+
+template <typename T>
+static void writeBinary(std::ofstream& file, T value, bool bigEndian) {
+    char bytes[sizeof(T)];
+    std::memcpy(bytes, &value, sizeof(T));
+    if (bigEndian) std::reverse(bytes, bytes + sizeof(T));
+    file.write(bytes, sizeof(T));
+}
+
+/**
+ * Writes the square in the given format. Vertices carry an unused property
+ * and a header element precedes them, which the loader must skip. With
+ * {trianglesOnly} set, only the triangles of the square are written.
+ */
+static void writePLY(const std::string& path, const std::string& format, bool trianglesOnly) {
+    std::ofstream file(path, std::ios::binary);
+    bool ascii = format == "ascii", bigEndian = format == "binary_big_endian";
+    file << "ply\nformat " << format << " 1.0\ncomment unit square\n"
+         << "element camera 1\nproperty double fov\n"
+         << "element vertex 5\nproperty float x\nproperty float y\nproperty float z\n"
+         << "property uchar quality\nproperty float s\nproperty float t\n"
+         << "element face " << (trianglesOnly ? 2 : 3) << "\n"
+         << "property list uchar uint vertex_indices\nend_header\n";
+
+    if (ascii) file << "45\n";
+    else writeBinary(file, 45.0, bigEndian);
+
+    for (const auto& v : vertices) {
+        if (ascii) {
+            file << v[0] << " " << v[1] << " " << v[2] << " 7 " << v[3] << " " << v[4] << "\n";
+        } else {
+            for (int c = 0; c < 3; c++) writeBinary(file, v[c], bigEndian);
+            writeBinary(file, uint8_t(7), bigEndian);
+            for (int c = 3; c < 5; c++) writeBinary(file, v[c], bigEndian);
+        }
+    }
+
+    for (int f = trianglesOnly ? 1 : 0; f < 3; f++) {
+        if (ascii) file << "\n";  // Blank lines are skipped
+        for (int i = 0; i <= faces[f][0]; i++) {
+            if (ascii) file << faces[f][i] << (i < faces[f][0] ? " " : "\n");
+            else if (i == 0) writeBinary(file, uint8_t(faces[f][i]), bigEndian);
+            else writeBinary(file, uint32_t(faces[f][i]), bigEndian);
+        }
+    }
+}
+
+static bool checkMesh(const IndexedMesh& mesh, bool trianglesOnly) {
+    const uint32_t* expected = expectedIndices + (trianglesOnly ? 6 : 0);
+    int nTriangles = trianglesOnly ? 2 : 4;
+    if (mesh.nVertices != 5 || mesh.nTriangles != nTriangles || mesh.hasNormals() || !mesh.hasUVs())
+        return false;
+
+    for (int v = 0; v < 5; v++) {
+        for (int c = 0; c < 3; c++)
+            if (mesh.p[c].getReal(v) != vertices[v][c]) return false;
+        for (int c = 0; c < 2; c++)
+            if (mesh.uv[c].getReal(v) != vertices[v][3 + c]) return false;
+    }
+    for (int t = 0; t < nTriangles; t++) {
+        for (int k = 0; k < 3; k++)
+            if (mesh.indices[k].getIndex(t) != expected[3 * t + k]) return false;
+    }
+    return true;
+}
+
+/**
+ * Writes a {res} x {res} grid of quads to an OBJ file, split into two materials
+ * by rows. Face vertices reference positions and (u, v) coordinates relative to
+ * the latest ones, and the file spans several of the chunks parsed in parallel.
+ */
+static void writeGridOBJ(const std::string& path, int res) {
+    std::ofstream file(path);
+    file << "# grid\nmtllib grid.mtl\n";
+    for (int y = 0; y <= res; y++) {
+        for (int x = 0; x <= res; x++)
+            file << "v " << x << " " << y << " 0\nvt " << x << " " << y << "\n";
+    }
+    file << "vn 0 0 1\ng grid\n";
+
+    int nVertices = (res + 1) * (res + 1);
+    for (int y = 0; y < res; y++) {
+        if (y == 0) file << "usemtl bottom\n";
+        if (y == res / 2) file << "usemtl top\n";
+        for (int x = 0; x < res; x++) {
+            int v0 = y * (res + 1) + x - nVertices, v1 = v0 + 1, v2 = v0 + res + 1, v3 = v2 + 1;
+            file << "f " << v0 << "/" << v0 << "/1 " << v1 << "/" << v1 << "/1 "
+                 << v3 << "/" << v3 << "/1 " << v2 << "/" << v2 << "/1\n";
+        }
+    }
+}
+
+static bool checkGridOBJ(const std::vector<std::unique_ptr<IndexedMesh>>& meshes, int res) {
+    if (meshes.size() != 2 || meshes[0]->material != "bottom" || meshes[1]->material != "top")
+        return false;
+
+    int rows[2] = { res / 2, res - res / 2 };
+    for (int m = 0; m < 2; m++) {
+        const IndexedMesh& mesh = *meshes[m];
+        if (mesh.nVertices != (rows[m] + 1) * (res + 1) || mesh.nTriangles != 2 * rows[m] * res ||
+            !mesh.hasNormals() || !mesh.hasUVs())
+            return false;
+
+        // Each triangle covers half a grid cell, and (u, v) matches the position
+        for (int64_t t = 0; t < mesh.nTriangles; t++) {
+            Point3f p[3];
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = mesh.indices[k].getIndex(t);
+                p[k] = Point3f(mesh.p[0].getReal(v), mesh.p[1].getReal(v), mesh.p[2].getReal(v));
+                if (mesh.uv[0].getReal(v) != p[k].x || mesh.uv[1].getReal(v) != p[k].y ||
+                    mesh.n[2].getReal(v) != 1)
+                    return false;
+            }
+            if (std::abs(cross(p[1] - p[0], p[2] - p[0]).z - 1) > 1e-9) return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay PLY and OBJ mesh loading..." << std::endl;
+
+    bool valid = true;
+    const std::string path = "test_meshio.ply";
+    const char* formats[3] = { "binary_little_endian", "binary_big_endian", "ascii" };
+
+    for (const char* format : formats) {
+        for (int trianglesOnly = 0; trianglesOnly < 2; trianglesOnly++) {
+            writePLY(path, format, trianglesOnly);
+            std::unique_ptr<IndexedMesh> mesh = loadPLYMesh(path);
+
+            // Only little endian triangles are viewed in place, on a little endian host
+            bool expectZeroCopy = trianglesOnly && std::string(format) == "binary_little_endian";
+            bool loaded = mesh && checkMesh(*mesh, trianglesOnly) &&
+                          mesh->isZeroCopy() == expectZeroCopy;
+            std::cout << format << (trianglesOnly ? " triangles" : " polygons") << ": "
+                      << loaded << (mesh && mesh->isZeroCopy() ? " (zero-copy)" : "") << std::endl;
+            valid &= loaded;
+
+            if (mesh) {
+                Transform identity;
+                std::vector<std::shared_ptr<Shape>> shapes =
+                        createTriangleMeshShapes(&identity, &identity, false, *mesh);
+                Real area = 0;
+                for (const auto& shape : shapes) area += shape->surfaceArea();
+                valid &= shapes.size() == size_t(mesh->nTriangles) &&
+                         std::abs(area - (trianglesOnly ? 0.5 : 1.5)) < 1e-6;
+            }
+        }
+    }
+
+    // Out of range indices and truncated files are rejected
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "ply\nformat ascii 1.0\nelement vertex 3\nproperty float x\nproperty float y\n"
+             << "property float z\nelement face 1\nproperty list uchar int vertex_indices\n"
+             << "end_header\n0 0 0\n1 0 0\n0 1 0\n3 0 1 3\n";
+    }
+    bool rejected = loadPLYMesh(path) == nullptr;
+    {
+        std::ofstream file(path, std::ios::binary);
+        file << "ply\nformat binary_little_endian 1.0\nelement vertex 3\nproperty float x\n"
+             << "property float y\nproperty float z\nelement face 1\n"
+             << "property list uchar int vertex_indices\nend_header\n";
+        file.write(std::string(30, '\0').data(), 30);
+    }
+    rejected &= loadPLYMesh(path) == nullptr && loadPLYMesh("missing.ply") == nullptr;
+    std::cout << "Invalid files rejected: " << rejected << std::endl;
+    valid &= rejected;
+
+    // OBJ grid, in two meshes with their face vertices merged
+    const std::string objPath = "test_meshio.obj";
+    const int res = 300;
+    writeGridOBJ(objPath, res);
+    std::vector<std::unique_ptr<IndexedMesh>> serialMeshes = loadOBJMeshes(objPath);
+    bool objLoaded = checkGridOBJ(serialMeshes, res);
+
+    // Parsing and merging in parallel gives the same meshes
+    parallelInit(4);
+    std::vector<std::unique_ptr<IndexedMesh>> parallelMeshes = loadOBJMeshes(objPath);
+    parallelCleanup();
+    objLoaded &= checkGridOBJ(parallelMeshes, res);
+    for (size_t m = 0; m < parallelMeshes.size() && objLoaded; m++) {
+        for (int64_t t = 0; t < parallelMeshes[m]->nTriangles; t++) {
+            for (int k = 0; k < 3; k++) {
+                uint32_t v = parallelMeshes[m]->indices[k].getIndex(t);
+                objLoaded &= v == serialMeshes[m]->indices[k].getIndex(t) &&
+                             parallelMeshes[m]->p[0].getReal(v) == serialMeshes[m]->p[0].getReal(v);
+            }
+        }
+    }
+    std::cout << "OBJ grid: " << objLoaded << std::endl;
+    valid &= objLoaded;
+
+    // Faces referencing missing vertices are rejected
+    {
+        std::ofstream file(objPath);
+        file << "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 3\nf 1 2 -4\n";
+    }
+    bool objRejected = loadOBJMeshes(objPath).empty();
+    std::cout << "Invalid OBJ rejected: " << objRejected << std::endl;
+    valid &= objRejected;
+
+    std::remove(path.c_str());
+    std::remove(objPath.c_str());
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
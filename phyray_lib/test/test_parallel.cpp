@@ -0,0 +1,130 @@
+#include <iostream>
+#include <vector>
+
+#include <core/phyr.h>
+#include <core/concurrency.h>
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+/**
+ * Checks that each of {count} iterations runs exactly once
+ */
+static bool checkParallelFor(int64_t count, int chunkSize) {
+    std::vector<std::atomic<int>> runs(count);
+    for (auto& r : runs) r = 0;
+    ParallelFor([&](int64_t i) { runs[i]++; }, count, chunkSize);
+
+    bool valid = true;
+    for (const auto& r : runs) valid &= r == 1;
+    return valid;
+}
+
+static bool checkParallelFor2D(const Point2i& count) {
+    std::vector<std::atomic<int>> runs(count.x * count.y);
+    for (auto& r : runs) r = 0;
+    ParallelFor2D([&](Point2i p) { runs[p.y * count.x + p.x]++; }, count);
+
+    bool valid = true;
+    for (const auto& r : runs) valid &= r == 1;
+    return valid;
+}
+
+/**
+ * Checks that each index of [begin, end) runs exactly once, in blocks of
+ * at most {grain} indices when using threads
+ */
+static bool checkParallelForRange(int64_t begin, int64_t end, int64_t grain) {
+    std::vector<std::atomic<int>> runs(std::max(int64_t(0), end - begin));
+    for (auto& r : runs) r = 0;
+    ParallelForRange(begin, end, grain, [&](int64_t i) { runs[i - begin]++; });
+
+    std::atomic<bool> blocksValid{true};
+    ParallelForBlocks([&](int64_t s, int64_t e) {
+        if (s < begin || e > end || e <= s || (maxThreadIndex() > 1 && e - s > grain))
+            blocksValid = false;
+    }, begin, end, grain);
+
+    bool valid = blocksValid;
+    for (const auto& r : runs) valid &= r == 1;
+    return valid;
+}
+
+/**
+ * Runs loops nested three deep, as e.g. tiles, rows and then pixels
+ */
+static bool checkNestedParallelFor() {
+    const int n = 24;
+    std::vector<std::atomic<int>> runs(n * n * n);
+    for (auto& r : runs) r = 0;
+    ParallelFor([&](int64_t i) {
+        ParallelFor([&](int64_t j) {
+            ParallelFor([&](int64_t k) { runs[(i * n + j) * n + k]++; }, n, 2);
+        }, n);
+    }, n);
+
+    bool valid = true;
+    for (const auto& r : runs) valid &= r == 1;
+    return valid;
+}
+
+static bool checkAll() {
+    bool valid = true;
+    valid &= checkParallelFor(0, 1);
+    valid &= checkParallelFor(1, 1);
+    valid &= checkParallelFor(1000, 1);
+    valid &= checkParallelFor(1001, 16);
+    valid &= checkParallelFor(100000, 7);
+    valid &= checkParallelFor2D(Point2i(13, 7));
+    valid &= checkParallelFor2D(Point2i(1, 1));
+    valid &= checkParallelForRange(0, 0, 16);
+    valid &= checkParallelForRange(-50, 1000, 1);
+    valid &= checkParallelForRange(7, 100007, 4096);
+    valid &= checkParallelForRange(3, 10, 100);
+    valid &= checkNestedParallelFor();
+    return valid;
+}
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay parallel loops..." << std::endl;
+
+    // Serially, and then with threads, including more than the system cores
+    parallelInit(1);
+    bool valid = checkAll();
+    parallelCleanup();
+    std::cout << "1 thread, valid: " << valid << std::endl;
+
+    for (int nThreads : { 4, 16 }) {
+        parallelInit(nThreads);
+        bool threadsValid = checkAll();
+        mergeWorkerThreadStats();
+        threadsValid &= checkAll();
+        parallelCleanup();
+        std::cout << nThreads << " threads, valid: " << threadsValid << std::endl;
+        valid &= threadsValid;
+    }
+
+    // Pinned threads run the same loops, and each lies on one of the nodes
+    for (ThreadAffinity affinity : { ThreadAffinity::Compact, ThreadAffinity::Scatter }) {
+        parallelInit(6, affinity);
+        bool pinnedValid = checkAll() && numNumaNodes() >= 1;
+        std::atomic<bool> nodesValid{true};
+        ParallelFor([&](int64_t i) {
+            if (threadNumaNode() < 0 || threadNumaNode() >= numNumaNodes()) nodesValid = false;
+        }, 1000);
+        pinnedValid &= nodesValid;
+        int nNodes = numNumaNodes();
+        parallelCleanup();
+        std::cout << "6 pinned threads over " << nNodes << " nodes, valid: "
+                  << pinnedValid << std::endl;
+        valid &= pinnedValid;
+    }
+
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
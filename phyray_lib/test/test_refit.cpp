@@ -0,0 +1,104 @@
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/concurrency.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+
+#include "test_util.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay BVH refit..." << std::endl;
+    // The binary trees are large enough to refit their subtrees in parallel
+    parallelInit(4);
+
+    const int nSpheres = 5000;
+    RNG rng;
+
+    // Spheres are moved by updating their transforms in place
+    std::vector<Transform> transforms(2 * nSpheres);
+    std::vector<Vector3f> centers(nSpheres);
+    std::vector<std::shared_ptr<Object>> objects;
+    for (int i = 0; i < nSpheres; i++) {
+        centers[i] = nextVector(rng, 50);
+        transforms[2 * i] = Transform::translate(centers[i]);
+        transforms[2 * i + 1] = Transform::inverse(transforms[2 * i]);
+
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, nextReal(rng, 0.1, 1));
+        objects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    const BVHLayout layouts[4] = { BVHLayout::Binary, BVHLayout::Wide4,
+                                   BVHLayout::Wide8, BVHLayout::Compressed };
+    std::vector<std::shared_ptr<AccelBVH>> bvhs;
+    for (BVHLayout layout : layouts)
+        bvhs.push_back(createBVHAccel(objects, 4, TreeSplitMethod::SAH, layout));
+
+    // Small motion keeps the tree quality, so refitting suffices
+    for (int i = 0; i < nSpheres; i++) {
+        transforms[2 * i] = Transform::translate(centers[i] + nextVector(rng, 0.5));
+        transforms[2 * i + 1] = Transform::inverse(transforms[2 * i]);
+    }
+
+    bool valid = true;
+    for (const auto& bvh : bvhs) {
+        Real builtCost = bvh->getSAHCost();
+        valid = valid && !bvh->refit() && checkBVH(*bvh, objects, rng);
+        std::cout << "Refit SAH cost: " << builtCost << " -> " << bvh->getSAHCost() << std::endl;
+    }
+
+    // Scrambling the scene degrades the tree enough to trigger a rebuild
+    for (int i = 0; i < nSpheres; i++) {
+        transforms[2 * i] = Transform::translate(nextVector(rng, 50));
+        transforms[2 * i + 1] = Transform::inverse(transforms[2 * i]);
+    }
+
+    for (const auto& bvh : bvhs) {
+        valid = valid && bvh->refit() && checkBVH(*bvh, objects, rng);
+        std::cout << "Rebuilt SAH cost: " << bvh->getSAHCost() << std::endl;
+    }
+
+    // Rebuilding an SBVH starts from the objects it was created with, not
+    // from the references that spatial splits duplicated
+    const int nSBVHSpheres = 2000;
+    std::vector<Transform> sbvhTransforms(2 * nSBVHSpheres);
+    std::vector<std::shared_ptr<Object>> sbvhObjects;
+    for (int i = 0; i < nSBVHSpheres; i++) {
+        sbvhTransforms[2 * i] = Transform::translate(nextVector(rng, 50));
+        sbvhTransforms[2 * i + 1] = Transform::inverse(sbvhTransforms[2 * i]);
+        Real radius = i % 10 == 0 ? 30 : nextReal(rng, 0.1, 1);
+        std::shared_ptr<Shape> shape = createSphereShape(&sbvhTransforms[2 * i],
+                                                         &sbvhTransforms[2 * i + 1], false, radius);
+        sbvhObjects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    std::shared_ptr<AccelBVH> sbvh = createBVHAccel(sbvhObjects, 4, TreeSplitMethod::SBVH);
+    for (int i = 0; i < nSBVHSpheres; i++) {
+        sbvhTransforms[2 * i] = Transform::translate(nextVector(rng, 50));
+        sbvhTransforms[2 * i + 1] = Transform::inverse(sbvhTransforms[2 * i]);
+    }
+
+    bool sbvhValid = sbvh->refit(1) && checkBVH(*sbvh, sbvhObjects, rng);
+    std::shared_ptr<AccelBVH> freshSBVH = createBVHAccel(sbvhObjects, 4, TreeSplitMethod::SBVH);
+    sbvhValid &= sbvh->getSAHCost() <= 1.01 * freshSBVH->getSAHCost() &&
+                 sbvh->getReferenceCount() <= 1.01 * freshSBVH->getReferenceCount();
+    std::cout << "Rebuilt SBVH SAH cost: " << sbvh->getSAHCost() << " (fresh build "
+              << freshSBVH->getSAHCost() << "), valid: " << sbvhValid << std::endl;
+    valid &= sbvhValid;
+
+    parallelCleanup();
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
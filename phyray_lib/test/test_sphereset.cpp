@@ -0,0 +1,152 @@
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/concurrency.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/sphere.h>
+#include <modules/shapes/sphereset.h>
+#include <modules/textures/consttex.h>
+#include <modules/textures/checkerboard.h>
+
+#include "test_util.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+/**
+ * Checks a sphere set against the same spheres created as individual
+ * shapes under {setToWorld}, with random rays tested by brute force
+ */
+static bool checkSphereSet(RNG& rng, const Transform& setToWorld, int nSpheres, int nRays) {
+    Transform worldToSet = Transform::inverse(setToWorld);
+
+    // Spheres are stored in single precision, so round them the same way
+    std::vector<Point3f> centers;
+    std::vector<Real> radii;
+    std::vector<Transform> transforms;
+    transforms.reserve(2 * nSpheres);
+    std::vector<std::shared_ptr<Object>> spheres;
+    for (int i = 0; i < nSpheres; i++) {
+        Vector3f c = nextVector(rng, 20);
+        centers.push_back(Point3f(float(c.x), float(c.y), float(c.z)));
+        radii.push_back(float(nextReal(rng, 0.05, 0.5)));
+
+        transforms.push_back(setToWorld * Transform::translate(Vector3f(centers.back())));
+        transforms.push_back(Transform::inverse(transforms.back()));
+        std::shared_ptr<Shape> shape = createSphereShape(&transforms[2 * i], &transforms[2 * i + 1],
+                                                         false, radii.back());
+        spheres.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    }
+
+    std::shared_ptr<SphereSet> set = createSphereSetShape(&setToWorld, &worldToSet, false, nSpheres,
+                                                          centers.data(), radii.data());
+    GeometricObject setObject(set, nullptr, nullptr);
+
+    Real area = 0;
+    for (Real r : radii) area += 4 * Pi * r * r;
+    bool valid = std::abs(set->surfaceArea() - area) < 1e-9 * area;
+
+    int nHits = 0;
+    for (int i = 0; i < nRays && valid; i++) {
+        // Aim half of the rays at the spheres, so that most of them hit
+        Point3f o = setToWorld(Point3f(nextVector(rng, 25)));
+        Point3f target = setToWorld(i % 2 ? centers[i % nSpheres] + nextVector(rng, 0.3)
+                                          : Point3f(nextVector(rng, 20)));
+        Ray r0(o, target - o), r1(r0);
+        SurfaceInteraction si0, si1;
+
+        bool h0 = false;
+        for (const auto& sphere : spheres)
+            if (sphere->intersectRay(r0, &si0)) h0 = true;
+        bool h1 = setObject.intersectRay(r1, &si1);
+
+        valid = h0 == h1 && h0 == setObject.intersectRay(Ray(r1.o, r1.d));
+        if (valid && h0) {
+            // The origin relative to the center is rounded differently, which
+            // grazing rays amplify to about the square root of the rounding error
+            nHits++;
+            valid = std::abs(r0.tMax - r1.tMax) * r0.d.length() < 1e-5 &&
+                    distance(si0.p, si1.p) < 1e-5 && dot(si0.n, si1.n) > 1 - 1e-6 &&
+                    std::abs(si0.uv.x - si1.uv.x) < 1e-4 && std::abs(si0.uv.y - si1.uv.y) < 1e-4;
+            if (!valid) {
+                std::cout << "Mismatch: t " << r0.tMax << " " << r1.tMax << ", p "
+                          << si0.p << " " << si1.p << std::endl;
+            }
+        } else if (!valid) {
+            std::cout << "Mismatch: hit " << h0 << " " << h1 << std::endl;
+        }
+    }
+
+    // Sampled points lie on the spheres
+    for (int i = 0; i < 100 && valid; i++) {
+        Real pdf;
+        Interaction it = set->sample(Point2f(rng.uniformReal(), rng.uniformReal()), &pdf);
+        Point3f p = worldToSet(it.p);
+        Real nearest = Infinity;
+        for (int s = 0; s < nSpheres; s++)
+            nearest = std::min(nearest, std::abs(distance(p, centers[s]) - radii[s]));
+        valid = nearest < 1e-6 && std::abs(pdf * area - 1) < 1e-9;
+    }
+
+    std::cout << nSpheres << " spheres: " << nHits << " hits, "
+              << double(set->getMemory()) / nSpheres << " bytes per sphere, valid: "
+              << valid << std::endl;
+    return valid;
+}
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay sphere sets..." << std::endl;
+
+    RNG rng;
+    Transform identity;
+    bool valid = true;
+
+    // Sets of a single packet and of a few, and one with subtrees built in parallel
+    valid &= checkSphereSet(rng, identity, 3, 200);
+    valid &= checkSphereSet(rng, identity, 50, 500);
+    parallelInit(4);
+    valid &= checkSphereSet(rng, identity, 20000, 500);
+    parallelCleanup();
+
+    Transform setToWorld = Transform::translate(Vector3f(100, -20, 5)) *
+                           Transform::rotate(normalize(Vector3f(1, 2, 3)), 40);
+    valid &= checkSphereSet(rng, setToWorld, 5000, 500);
+
+    // Empty sets are never hit
+    std::shared_ptr<SphereSet> empty = createSphereSetShape(&identity, &identity, false, 0,
+                                                            nullptr, nullptr);
+    valid &= !empty->intersectRay(Ray(Point3f(0, 0, 0), Vector3f(1, 0, 0)));
+
+    // Alpha masks: a unit sphere with its lower half (v < 0.5) cut out is
+    // seen through on the near side from below, and hit on the far side
+    std::shared_ptr<Texture<Real>> zero = std::make_shared<ConstantTexture<Real>>(0);
+    std::shared_ptr<Texture<Real>> one = std::make_shared<ConstantTexture<Real>>(1);
+    std::shared_ptr<Texture<Real>> upperHalf =
+        std::make_shared<CheckerboardTexture<Real>>(zero, one, 1, 2);
+    Point3f center(0, 0, 0);
+    Real radius = 1;
+    std::shared_ptr<SphereSet> cutOut = createSphereSetShape(&identity, &identity, false, 1,
+                                                             &center, &radius, zero);
+    std::shared_ptr<SphereSet> halfCut = createSphereSetShape(&identity, &identity, false, 1,
+                                                              &center, &radius, upperHalf);
+    Ray fromBelow(Point3f(0.1, 0.1, -10), Vector3f(0, 0, 1));
+    SurfaceHit maskHit;
+    bool maskValid = !cutOut->intersectRay(fromBelow) && cutOut->intersectRay(fromBelow, false) &&
+                     halfCut->intersectHit(fromBelow, &maskHit) &&
+                     std::abs(maskHit.t - 11) < 0.05 &&
+                     halfCut->intersectHit(fromBelow, &maskHit, false) &&
+                     std::abs(maskHit.t - 9) < 0.05;
+    std::cout << "Alpha masked sphere sets, valid: " << maskValid << std::endl;
+    valid &= maskValid;
+
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
@@ -0,0 +1,245 @@
+#include <iostream>
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+#include <modules/shapes/disk.h>
+#include <modules/shapes/sphere.h>
+#include <modules/shapes/sphereset.h>
+#include <modules/shapes/triangle.h>
+#include <modules/textures/consttex.h>
+#include <modules/textures/checkerboard.h>
+
+#include "test_util.h"
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+
+using namespace phyr;
+
+static std::vector<std::shared_ptr<Object>> createObjects(
+        const std::vector<std::shared_ptr<Shape>>& shapes) {
+    std::vector<std::shared_ptr<Object>> objects;
+    for (const auto& shape : shapes)
+        objects.push_back(std::make_shared<GeometricObject>(shape, nullptr, nullptr));
+    return objects;
+}
+
+int main(int argc, const char* argv[]) {
+    std::cout << "Testing PhyRay triangle meshes..." << std::endl;
+
+    RNG rng;
+    Transform identity;
+    bool valid = true;
+
+    // A tilted grid of jittered vertices in [-1, 1]^2, with (u, v) set to
+    // the vertex position in the grid, so that hits can be checked
+    const int res = 32;
+    std::vector<Point3f> gridP;
+    std::vector<Point2f> gridUV;
+    std::vector<uint32_t> gridIndices;
+    for (int y = 0; y <= res; y++) {
+        for (int x = 0; x <= res; x++) {
+            bool border = x == 0 || y == 0 || x == res || y == res;
+            Real jx = border ? 0 : nextReal(rng, -0.3, 0.3), jy = border ? 0 : nextReal(rng, -0.3, 0.3);
+            Point2f uv(2 * (x + jx) / res - 1, 2 * (y + jy) / res - 1);
+            gridP.push_back(Point3f(uv.x, uv.y, 0));
+            gridUV.push_back(uv);
+        }
+    }
+    for (int y = 0; y < res; y++) {
+        for (int x = 0; x < res; x++) {
+            uint32_t v0 = y * (res + 1) + x, v1 = v0 + 1, v2 = v0 + res + 1, v3 = v2 + 1;
+            uint32_t quad[6] = { v0, v1, v3, v0, v3, v2 };
+            gridIndices.insert(gridIndices.end(), quad, quad + 6);
+        }
+    }
+
+    Transform gridToWorld = Transform::rotate(normalize(Vector3f(1, 1, 0)), 30);
+    Transform worldToGrid = Transform::inverse(gridToWorld);
+    std::vector<std::shared_ptr<Shape>> grid = createTriangleMeshShapes(
+            &gridToWorld, &worldToGrid, false, 2 * res * res, gridIndices.data(),
+            gridP.size(), gridP.data(), nullptr, gridUV.data());
+    std::vector<std::shared_ptr<Object>> gridObjects = createObjects(grid);
+    std::shared_ptr<AccelBVH> gridBVH = createBVHAccel(gridObjects, 4);
+
+    // Rays through the shared vertices and edges of the grid must never
+    // slip through. Hits must lie on the grid and interpolate (u, v).
+    int nGridRays = 0;
+    for (int i = 0; i < res * res && valid; i++) {
+        // Only quads off the border have all their edges shared
+        int x = i % res, y = i / res;
+        if (x == 0 || y == 0 || x == res - 1 || y == res - 1) continue;
+
+        const uint32_t* quad = &gridIndices[6 * i];
+        Point3f targets[4] = { gridP[quad[0]], lerp(0.5, gridP[quad[0]], gridP[quad[1]]),
+                               lerp(0.5, gridP[quad[0]], gridP[quad[2]]),
+                               Point3f(nextReal(rng, -1, 1), nextReal(rng, -1, 1), 0) };
+
+        for (const Point3f& target : targets) {
+            Point3f pTarget = gridToWorld(target);
+            Point3f o = pTarget + 5 * normalize(nextVector(rng, 1));
+            Ray ray(o, pTarget - o);
+            SurfaceInteraction si;
+            nGridRays++;
+
+            if (!gridBVH->intersectRay(ray, &si)) {
+                std::cout << "Ray slipped through the mesh at " << target << std::endl;
+                valid = false;
+                break;
+            }
+
+            Point3f pGrid = worldToGrid(si.p);
+            valid = std::abs(ray.tMax - 1) < 1e-6 && std::abs(pGrid.z) < 1e-6 &&
+                    std::abs(si.uv.x - pGrid.x) < 1e-6 && std::abs(si.uv.y - pGrid.y) < 1e-6 &&
+                    std::abs(std::abs(dot(si.n, gridToWorld(Normal3f(0, 0, 1)))) - 1) < 1e-6;
+            if (!valid) break;
+        }
+    }
+    std::cout << "Grid rays: " << nGridRays << ", valid: " << valid << std::endl;
+
+    // The same grid cut out by an 8 x 8 checkerboard over (u, v), in front
+    // of an unmasked copy one unit further back. Rays through kept cells stop
+    // at the grid, the others pass through it to the copy.
+    std::shared_ptr<Texture<Real>> checker = std::make_shared<CheckerboardTexture<Real>>(
+            std::make_shared<ConstantTexture<Real>>(1), std::make_shared<ConstantTexture<Real>>(0), 4, 4);
+    std::vector<std::shared_ptr<Shape>> maskedGrid = createTriangleMeshShapes(
+            &gridToWorld, &worldToGrid, false, 2 * res * res, gridIndices.data(),
+            gridP.size(), gridP.data(), nullptr, gridUV.data(), checker);
+    Transform backToWorld = gridToWorld * Transform::translate(Vector3f(0, 0, -1));
+    Transform worldToBack = Transform::inverse(backToWorld);
+    std::vector<std::shared_ptr<Shape>> backGrid = createTriangleMeshShapes(
+            &backToWorld, &worldToBack, false, 2 * res * res, gridIndices.data(),
+            gridP.size(), gridP.data(), nullptr, gridUV.data());
+    std::vector<std::shared_ptr<Object>> maskedObjects = createObjects(maskedGrid);
+    std::shared_ptr<AccelBVH> maskedBVH = createBVHAccel(maskedObjects, 4);
+    for (const auto& object : createObjects(backGrid)) maskedObjects.push_back(object);
+    std::shared_ptr<AccelBVH> layeredBVH = createBVHAccel(maskedObjects, 4);
+
+    int nKept = 0;
+    for (int i = 0; i < 2000 && valid; i++) {
+        // Aim at the middle of a cell, away from its borders
+        int cx = int(8 * rng.uniformReal()), cy = int(8 * rng.uniformReal());
+        Point3f target((cx + nextReal(rng, 0.1, 0.9)) / 4 - 1, (cy + nextReal(rng, 0.1, 0.9)) / 4 - 1, 0);
+        bool kept = ((cx + cy) & 1) == 0;
+        nKept += kept;
+
+        Ray ray(gridToWorld(target + Vector3f(0, 0, 2)), gridToWorld(Vector3f(0, 0, -1)));
+        SurfaceInteraction si;
+        valid = layeredBVH->intersectRay(ray, &si) &&
+                std::abs(ray.tMax - (kept ? 2 : 3)) < 1e-6 &&
+                maskedBVH->intersectRay(Ray(ray.o, ray.d)) == kept;
+
+        // The triangles themselves are only hit regardless of the mask without testing it
+        int nHits = 0, nMaskedHits = 0;
+        for (const auto& shape : maskedGrid) {
+            nHits += shape->intersectRay(Ray(ray.o, ray.d), false);
+            nMaskedHits += shape->intersectRay(Ray(ray.o, ray.d));
+        }
+        valid &= nHits > 0 && nMaskedHits == (kept ? nHits : 0);
+        if (!valid) std::cout << "Alpha mask mismatch at " << target << std::endl;
+    }
+    std::cout << "Alpha masked rays: " << nKept << " kept, valid: " << valid << std::endl;
+
+    // Spheres and disks cut out by the same mask, and a sphere, alone and in
+    // a sphere set, whose mask keeps half of its hits. The near side of a
+    // sphere that is cut out reveals the far one.
+    Transform quadricToWorld = Transform::translate(Vector3f(0, 0, 5));
+    Transform worldToQuadric = Transform::inverse(quadricToWorld);
+    std::shared_ptr<Shape> maskedDisk = createDiskShape(&quadricToWorld, &worldToQuadric, 0, 1, 0,
+                                                        360, false, checker);
+    std::shared_ptr<Shape> maskedSphere = createSphereShape(&quadricToWorld, &worldToQuadric, false, 1,
+                                                            std::make_shared<ConstantTexture<Real>>(0.5));
+    Point3f setCenter(0, 0, 0);
+    Real setRadius = 1;
+    std::shared_ptr<Shape> maskedSet = createSphereSetShape(&quadricToWorld, &worldToQuadric, false, 1,
+                                                            &setCenter, &setRadius,
+                                                            std::make_shared<ConstantTexture<Real>>(0.5));
+    Disk disk(&quadricToWorld, &worldToQuadric, 0, 1, 0, 360, false);
+    int nDiskKept = 0, nSphereKept = 0, nSetKept = 0, nRays = 2000;
+    for (int i = 0; i < nRays && valid; i++) {
+        Point3f target = quadricToWorld(Point3f(nextReal(rng, -0.7, 0.7), nextReal(rng, -0.7, 0.7), 0));
+        Ray ray(target + Vector3f(0, 0, 3), Vector3f(0, 0, -1));
+
+        Real t0, t1;
+        SurfaceInteraction si0, si1;
+        bool kept = maskedDisk->intersectRay(ray, &t0, &si0);
+        valid = disk.intersectRay(ray, &t1, &si1) && maskedDisk->intersectRay(ray, &t0, &si0, false) &&
+                t0 == t1 && kept == (checker->evaluate(si1) == 1);
+        nDiskKept += kept;
+
+        // Fractional masks decide the same way for the same ray
+        if (maskedSphere->intersectRay(ray, &t0, &si0)) {
+            valid &= maskedSphere->intersectRay(ray, &t1, &si1) && t0 == t1;
+            nSphereKept += t0 < 3;
+        } else {
+            valid &= !maskedSphere->intersectRay(ray) && maskedSphere->intersectRay(ray, false);
+        }
+        if (maskedSet->intersectRay(ray, &t0, &si0)) {
+            valid &= maskedSet->intersectRay(ray, &t1, &si1) && t0 == t1;
+            nSetKept += t0 < 3;
+        } else {
+            valid &= !maskedSet->intersectRay(ray) && maskedSet->intersectRay(ray, false);
+        }
+    }
+    valid &= nDiskKept > nRays / 4 && nDiskKept < 3 * nRays / 4 &&
+             nSphereKept > nRays / 3 && nSphereKept < 2 * nRays / 3 &&
+             nSetKept > nRays / 3 && nSetKept < 2 * nRays / 3;
+    std::cout << "Alpha masked quadrics: " << nDiskKept << " disk hits, " << nSphereKept
+              << " near sphere hits, " << nSetKept << " near sphere set hits, valid: "
+              << valid << std::endl;
+
+    // A soup of random triangles, checked against brute force
+    const int nTriangles = 20000;
+    std::vector<Point3f> soupP;
+    std::vector<Normal3f> soupN;
+    std::vector<uint32_t> soupIndices;
+    for (int i = 0; i < nTriangles; i++) {
+        Vector3f center = nextVector(rng, 50);
+        for (int v = 0; v < 3; v++) {
+            soupP.push_back(Point3f(center + nextVector(rng, 2)));
+            soupN.push_back(Normal3f(normalize(nextVector(rng, 1))));
+            soupIndices.push_back(3 * i + v);
+        }
+    }
+
+    std::vector<std::shared_ptr<Shape>> soup = createTriangleMeshShapes(
+            &identity, &identity, false, nTriangles, soupIndices.data(),
+            soupP.size(), soupP.data(), soupN.data());
+    std::vector<std::shared_ptr<Object>> soupObjects = createObjects(soup);
+
+    const TreeSplitMethod methods[2] = { TreeSplitMethod::SAH, TreeSplitMethod::SBVH };
+    for (int m = 0; m < 2 && valid; m++) {
+        std::shared_ptr<AccelBVH> bvh = createBVHAccel(soupObjects, 4, methods[m]);
+
+        int nHits = 0;
+        for (int i = 0; i < 300 && valid; i++) {
+            Ray r0(Point3f(nextVector(rng, 60)), normalize(nextVector(rng, 1))), r1(r0);
+            SurfaceInteraction si0, si1;
+
+            bool h0 = false;
+            for (const auto& obj : soupObjects)
+                if (obj->intersectRay(r0, &si0)) h0 = true;
+            bool h1 = bvh->intersectRay(r1, &si1);
+
+            valid = h0 == h1 && h0 == bvh->intersectRay(Ray(r1.o, r1.d));
+            if (valid && h0) {
+                valid = r0.tMax == r1.tMax && si0.object == si1.object && si0.p == si1.p &&
+                        dot(si1.n, si1.shadingGeom.n) >= 0;
+                nHits++;
+            }
+        }
+
+        std::cout << getTreeSplitMethodName(methods[m]) << ": " << bvh->getReferenceCount()
+                  << " references, " << nHits << " hits, valid: " << valid << std::endl;
+    }
+
+    std::cout << "Triangle shape size: " << sizeof(Triangle) << " bytes" << std::endl;
+    std::cout << "Result: " << valid << std::endl;
+
+    return valid ? 0 : 1;
+}
+
+#pragma GCC diagnostic pop
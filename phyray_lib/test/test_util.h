@@ -0,0 +1,53 @@
+#ifndef PHYRAY_TEST_UTIL_H
+#define PHYRAY_TEST_UTIL_H
+
+#include <core/phyr.h>
+#include <core/rng.h>
+#include <core/accel/bvh.h>
+#include <core/geometry/interaction.h>
+
+// Helpers shared by the tests
+
+namespace phyr {
+
+inline Real nextReal(RNG& rng, Real minv, Real maxv) {
+    return minv + (maxv - minv) * rng.uniformReal();
+}
+
+inline Vector3f nextVector(RNG& rng, Real extent) {
+    return Vector3f(nextReal(rng, -extent, extent), nextReal(rng, -extent, extent),
+                    nextReal(rng, -extent, extent));
+}
+
+/**
+ * Intersects {ray} with every object in {objects}, returning the closest hit
+ */
+inline bool intersectAll(const std::vector<std::shared_ptr<Object>>& objects,
+                         const Ray& ray, SurfaceInteraction* si) {
+    bool hit = false;
+    for (const auto& obj : objects)
+        if (obj->intersectRay(ray, si)) hit = true;
+    return hit;
+}
+
+/**
+ * Checks {bvh} against brute force intersection of {objects} with random rays
+ */
+inline bool checkBVH(const AccelBVH& bvh, const std::vector<std::shared_ptr<Object>>& objects,
+                     RNG& rng) {
+    for (int i = 0; i < 200; i++) {
+        Ray r0(Point3f(nextVector(rng, 60)), normalize(nextVector(rng, 1))), r1(r0);
+        SurfaceInteraction si0, si1;
+
+        bool h0 = intersectAll(objects, r0, &si0);
+        bool h1 = bvh.intersectRay(r1, &si1);
+
+        if (h0 != h1 || h0 != bvh.intersectRay(Ray(r1.o, r1.d))) return false;
+        if (h0 && (r0.tMax != r1.tMax || si0.object != si1.object)) return false;
+    }
+    return true;
+}
+
+}  // namespace phyr
+
+#endif